@@ -0,0 +1,607 @@
+//----------------------------------------------------------------------------
+//
+//  This file is part of seq42.
+//
+//  seq42 is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  seq42 is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with seq42; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+//-----------------------------------------------------------------------------
+
+
+/*
+ *  seq42-bench: builds a synthetic project and times the playback, file
+ *  and editing paths of the engine. Not installed, "make seq42-bench".
+ *
+ *  Results go to stdout as one JSON object per line so runs of different
+ *  releases can be compared by a script, progress goes to stderr.
+ *  Playback is captured (see perform::render()), no midi goes out.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#ifdef __WIN32__
+#    include "configwin32.h"
+#else
+#    include "config.h"
+#endif
+
+#include "midifile.h"
+#include "perform.h"
+#include "perfstats.h"
+
+/* one pass of the play benchmarks steps this many ticks per call, about
+   what the output thread does at 120 bpm */
+const int c_bench_play_step = 2;
+
+/* sequences are 4 bars, 64 triggers per track, a tempo marker every 8 bars */
+const long c_bench_seq_length = c_ppqn * 4 * 4;
+const int c_bench_triggers = 64;
+const long c_bench_marker_spacing = c_ppqn * 4 * 8;
+
+/* perform_play covers the first 16 bars, the whole song takes minutes */
+const long c_bench_song_play_length = c_bench_seq_length * 4;
+
+struct bench_params
+{
+    int m_tracks;
+    int m_sequences;
+    int m_events;
+    int m_iterations;
+    const char *m_only;
+};
+
+static bench_params params;
+
+/* the real stdout, the engine's own printfs go to stderr */
+static FILE *results = stdout;
+
+/* set when a benchmark finds the engine giving a wrong result */
+static bool failed = false;
+
+static struct
+    option long_options[] =
+{
+    {"help",       0, 0, 'h'},
+    {"tracks",     required_argument, 0, 't'},
+    {"sequences",  required_argument, 0, 's'},
+    {"events",     required_argument, 0, 'e'},
+    {"iterations", required_argument, 0, 'i'},
+    {"bench",      required_argument, 0, 'b'},
+    {0, 0, 0, 0}
+};
+
+static bool
+wanted( const char *a_name )
+{
+    return params.m_only == NULL || strstr( a_name, params.m_only ) != NULL;
+}
+
+/* a_samples are per iteration, a_ops is how many calls one iteration made */
+static void
+report( const char *a_name, std::vector<long> &a_samples, long a_ops )
+{
+    if ( a_samples.empty() )
+        return;
+
+    std::sort( a_samples.begin(), a_samples.end() );
+
+    long long sum = 0;
+    for ( unsigned i = 0; i < a_samples.size(); i++ )
+        sum += a_samples[i];
+
+    long median = a_samples[a_samples.size() / 2];
+
+    fprintf( results, "{\"bench\":\"%s\",\"version\":\"%s\","
+            "\"tracks\":%d,\"sequences\":%d,\"events\":%d,"
+            "\"iterations\":%d,\"ops\":%ld,"
+            "\"min_us\":%ld,\"median_us\":%ld,\"avg_us\":%lld,\"max_us\":%ld,"
+            "\"op_ns\":%lld}\n",
+            a_name, VERSION,
+            params.m_tracks, params.m_sequences, params.m_events,
+            (int) a_samples.size(), a_ops,
+            a_samples.front(), median, sum / (long long) a_samples.size(),
+            a_samples.back(),
+            (long long) median * 1000 / (a_ops > 0 ? a_ops : 1) );
+    fflush( results );
+}
+
+/* small lcg, same numbers everywhere so runs compare */
+static unsigned
+bench_rand( unsigned *a_seed )
+{
+    *a_seed = *a_seed * 1103515245 + 12345;
+    return (*a_seed >> 16) & 0x7FFF;
+}
+
+/* half notes, half a dense cc lane */
+static void
+fill_sequence( sequence *a_seq, int a_events, unsigned *a_seed )
+{
+    int notes = a_events / 4;           // on + off each
+    int ccs = a_events - (notes * 2);
+
+    event e;
+
+    for ( int n = 0; n < notes; n++ )
+    {
+        long tick = (long)(bench_rand( a_seed ) % (c_bench_seq_length - c_ppqn));
+        long length = c_ppqn / 8 + (bench_rand( a_seed ) % c_ppqn);
+        int note = 36 + (bench_rand( a_seed ) % 48);
+
+        e.set_status( EVENT_NOTE_ON );
+        e.set_data( note, 100 );
+        e.set_timestamp( tick );
+        a_seq->add_event_no_sort( &e );
+
+        e.set_status( EVENT_NOTE_OFF );
+        e.set_data( note, c_note_off_velocity_default );
+        e.set_timestamp( tick + length );
+        a_seq->add_event_no_sort( &e );
+    }
+
+    for ( int n = 0; n < ccs; n++ )
+    {
+        e.set_status( EVENT_CONTROL_CHANGE );
+        e.set_data( 1, (n * 7) % 128 );
+        e.set_timestamp( (long) n * c_bench_seq_length / (ccs > 0 ? ccs : 1) );
+        a_seq->add_event_no_sort( &e );
+    }
+
+    a_seq->sort_events();
+    a_seq->verify_and_link();
+}
+
+static void
+build_project( perform *a_perf )
+{
+    unsigned seed = 42;
+
+    for ( int t = 0; t < params.m_tracks; t++ )
+    {
+        a_perf->new_track( t );
+        track *trk = a_perf->get_track( t );
+
+        /* room for any int */
+        char name[sizeof("bench ") + 11];
+        snprintf( name, sizeof(name), "bench %d", t );
+        trk->set_name( name );
+        trk->set_midi_bus( 0 );
+        trk->set_midi_channel( t % 16 );
+
+        for ( int s = 0; s < params.m_sequences; s++ )
+        {
+            sequence *seq = trk->get_sequence( trk->new_sequence() );
+            seq->set_length( c_bench_seq_length );
+            fill_sequence( seq, params.m_events, &seed );
+        }
+
+        for ( int n = 0; n < c_bench_triggers; n++ )
+        {
+            trk->add_trigger( n * c_bench_seq_length, c_bench_seq_length, 0,
+                              n % params.m_sequences );
+        }
+    }
+
+    a_perf->m_list_total_marker.clear();
+
+    long end = c_bench_triggers * c_bench_seq_length;
+    for ( long tick = 0; tick < end; tick += c_bench_marker_spacing )
+    {
+        tempo_mark marker;
+        marker.tick = tick;
+        marker.bpm = 100.0 + (tick / c_bench_marker_spacing) % 40;
+        a_perf->m_list_total_marker.push_back( marker );
+    }
+
+    a_perf->load_tempo_list();
+}
+
+/* not a timing, what the built project holds per event */
+static void
+bench_memory( perform *a_perf )
+{
+    long total_events = 0;
+    long total_bytes = 0;
+
+    for ( int t = 0; t < params.m_tracks; t++ )
+    {
+        track *trk = a_perf->get_track( t );
+        total_bytes += trk->get_memory_bytes();
+
+        for ( unsigned s = 0; s < trk->get_number_of_sequences(); s++ )
+        {
+            long events, bytes, undo;
+            trk->get_sequence( s )->get_memory_bytes( &events, &bytes, &undo );
+
+            total_events += events;
+            total_bytes += bytes + undo;
+        }
+    }
+
+    fprintf( results, "{\"bench\":\"memory\",\"version\":\"%s\","
+            "\"tracks\":%d,\"sequences\":%d,\"events\":%d,"
+            "\"event_size\":%d,\"total_events\":%ld,\"total_bytes\":%ld,"
+            "\"bytes_per_event\":%ld}\n",
+            VERSION, params.m_tracks, params.m_sequences, params.m_events,
+            (int) sizeof(event), total_events, total_bytes,
+            total_bytes / (total_events > 0 ? total_events : 1) );
+    fflush( results );
+}
+
+static void
+bench_sequence_play( perform *a_perf )
+{
+    sequence *seq = a_perf->get_track( 0 )->get_sequence( 0 );
+
+    std::vector<render_event> capture;
+    capture.reserve( params.m_events * 2 );
+    a_perf->get_master_midi_bus()->set_capture( &capture );
+
+    seq->set_playing( true );
+
+    std::vector<long> samples;
+    long calls = 0;
+
+    for ( int i = 0; i < params.m_iterations; i++ )
+    {
+        seq->set_orig_tick( 0 );
+        capture.clear();
+        calls = 0;
+
+        long start = perfstats::now_us();
+        for ( long tick = 0; tick < c_bench_seq_length; tick += c_bench_play_step )
+        {
+            seq->play( tick, NULL );
+            calls++;
+        }
+        samples.push_back( perfstats::now_us() - start );
+    }
+
+    seq->set_playing( false );
+    a_perf->get_master_midi_bus()->set_capture( NULL );
+
+    report( "sequence_play", samples, calls );
+}
+
+static void
+bench_perform_play( perform *a_perf )
+{
+    std::vector<render_event> capture;
+    a_perf->get_master_midi_bus()->set_capture( &capture );
+    a_perf->set_playback_mode( true );
+
+    long end = std::min( a_perf->get_max_trigger(), c_bench_song_play_length );
+
+    std::vector<long> samples;
+    long calls = 0;
+
+    for ( int i = 0; i < params.m_iterations; i++ )
+    {
+        a_perf->reset_sequences();
+        a_perf->set_orig_ticks( 0 );
+        a_perf->m_list_play_marker = a_perf->m_list_total_marker;
+        capture.clear();
+        calls = 0;
+
+        long start = perfstats::now_us();
+        for ( long tick = 0; tick < end; tick += c_bench_play_step )
+        {
+            a_perf->play( tick );
+            calls++;
+        }
+        samples.push_back( perfstats::now_us() - start );
+    }
+
+    a_perf->reset_sequences();
+    a_perf->get_master_midi_bus()->set_capture( NULL );
+
+    report( "perform_play", samples, calls );
+}
+
+static void
+bench_files( perform *a_perf, perform *a_scratch, const std::string& a_dir )
+{
+    std::string s42 = a_dir + "/seq42-bench.s42";
+    std::string mid = a_dir + "/seq42-bench.mid";
+
+    std::vector<long> samples;
+
+    if ( wanted( "perform_save" ) || wanted( "perform_load" ) ||
+            wanted( "perform_load_lazy" ) )
+    {
+        for ( int i = 0; i < params.m_iterations; i++ )
+        {
+            long start = perfstats::now_us();
+            a_perf->save( s42 );
+            samples.push_back( perfstats::now_us() - start );
+        }
+        report( "perform_save", samples, 1 );
+        samples.clear();
+
+        for ( int i = 0; i < params.m_iterations; i++ )
+        {
+            a_scratch->clear_all();
+
+            long start = perfstats::now_us();
+            a_scratch->load( s42 );
+            samples.push_back( perfstats::now_us() - start );
+        }
+        report( "perform_load", samples, 1 );
+        samples.clear();
+
+        /* the events are only read in when first needed */
+        global_lazy_load = true;
+        for ( int i = 0; i < params.m_iterations; i++ )
+        {
+            a_scratch->clear_all();
+
+            long start = perfstats::now_us();
+            a_scratch->load( s42 );
+            samples.push_back( perfstats::now_us() - start );
+        }
+        global_lazy_load = false;
+        report( "perform_load_lazy", samples, 1 );
+        samples.clear();
+    }
+
+    if ( wanted( "midifile_write_song" ) || wanted( "midifile_parse" ) )
+    {
+        for ( int i = 0; i < params.m_iterations; i++ )
+        {
+            midifile f( mid );
+
+            long start = perfstats::now_us();
+            f.write_song( a_perf, E_MIDI_SONG_FORMAT, NULL );
+            samples.push_back( perfstats::now_us() - start );
+        }
+        report( "midifile_write_song", samples, 1 );
+        samples.clear();
+
+        for ( int i = 0; i < params.m_iterations; i++ )
+        {
+            a_scratch->clear_all();
+            midifile f( mid );
+
+            long start = perfstats::now_us();
+            f.parse( a_scratch, -1 );
+            samples.push_back( perfstats::now_us() - start );
+        }
+        report( "midifile_parse", samples, 1 );
+    }
+
+    a_scratch->clear_all();
+
+    unlink( s42.c_str() );
+    unlink( mid.c_str() );
+}
+
+static void
+bench_editing( perform *a_perf )
+{
+    sequence *orig = a_perf->get_track( 0 )->get_sequence( 0 );
+
+    std::vector<long> samples;
+    sequence work;
+    work.set_track( orig->get_track() );
+
+    if ( wanted( "verify_and_link" ) )
+    {
+        for ( int i = 0; i < params.m_iterations; i++ )
+        {
+            long start = perfstats::now_us();
+            orig->verify_and_link();
+            samples.push_back( perfstats::now_us() - start );
+        }
+        report( "verify_and_link", samples, 1 );
+        samples.clear();
+    }
+
+    if ( wanted( "quanize_events" ) )
+    {
+        for ( int i = 0; i < params.m_iterations; i++ )
+        {
+            work = *orig;
+            work.select_all();
+
+            long start = perfstats::now_us();
+            work.quanize_events( EVENT_NOTE_ON, 0, c_ppqn / 4, 1, true );
+            samples.push_back( perfstats::now_us() - start );
+        }
+        report( "quanize_events", samples, 1 );
+        samples.clear();
+    }
+
+    if ( wanted( "move_selected_notes" ) )
+    {
+        work = *orig;
+        work.select_all();
+
+        for ( int i = 0; i < params.m_iterations; i++ )
+        {
+            int dir = (i % 2) ? -1 : 1;
+
+            long start = perfstats::now_us();
+            work.move_selected_notes( dir * c_ppqn / 4, dir );
+            samples.push_back( perfstats::now_us() - start );
+        }
+        report( "move_selected_notes", samples, 1 );
+        samples.clear();
+    }
+
+    if ( wanted( "sequence_undo" ) )
+    {
+        std::vector<long> pops;
+        work = *orig;
+
+        for ( int i = 0; i < params.m_iterations; i++ )
+        {
+            long start = perfstats::now_us();
+            work.push_undo();
+            samples.push_back( perfstats::now_us() - start );
+
+            start = perfstats::now_us();
+            work.pop_undo();
+            pops.push_back( perfstats::now_us() - start );
+        }
+        report( "sequence_push_undo", samples, 1 );
+        report( "sequence_pop_undo", pops, 1 );
+        samples.clear();
+    }
+
+    /* one held edit and one undo must give the events back */
+    if ( wanted( "sequence_held_undo" ) )
+    {
+        for ( int i = 0; i < params.m_iterations; i++ )
+        {
+            work = *orig;
+            work.select_all();
+
+            long start = perfstats::now_us();
+            work.increment_selected( EVENT_NOTE_ON, 0 );
+            work.set_hold_undo( false );
+            work.pop_undo();
+            samples.push_back( perfstats::now_us() - start );
+
+            if ( !work.matches( *orig ) )
+            {
+                fprintf( stderr, "sequence_held_undo: the undo did not restore the events\n" );
+                failed = true;
+                break;
+            }
+        }
+        report( "sequence_held_undo", samples, 1 );
+        samples.clear();
+    }
+
+    if ( wanted( "perform_undo" ) )
+    {
+        std::vector<long> pops;
+
+        for ( int i = 0; i < params.m_iterations; i++ )
+        {
+            long start = perfstats::now_us();
+            a_perf->push_perf_undo();
+            samples.push_back( perfstats::now_us() - start );
+
+            start = perfstats::now_us();
+            a_perf->pop_perf_undo();
+            pops.push_back( perfstats::now_us() - start );
+        }
+        report( "perform_push_undo", samples, 1 );
+        report( "perform_pop_undo", pops, 1 );
+        samples.clear();
+    }
+}
+
+int
+main( int argc, char *argv[] )
+{
+    /* no display, and perform's dialogs must print */
+    global_headless = true;
+
+    params.m_tracks = 16;
+    params.m_sequences = 4;
+    params.m_events = 2048;
+    params.m_iterations = 10;
+    params.m_only = NULL;
+
+    int c;
+    while ( (c = getopt_long( argc, argv, "b:e:hi:s:t:", long_options, NULL )) != -1 )
+    {
+        switch ( c )
+        {
+        case 't':
+            params.m_tracks = atoi( optarg );
+            break;
+
+        case 's':
+            params.m_sequences = atoi( optarg );
+            break;
+
+        case 'e':
+            params.m_events = atoi( optarg );
+            break;
+
+        case 'i':
+            params.m_iterations = atoi( optarg );
+            break;
+
+        case 'b':
+            params.m_only = optarg;
+            break;
+
+        default:
+            printf( "usage: seq42-bench [options]\n" );
+            printf( "   -t, --tracks <n>: tracks in the project (max %d, default 16)\n", c_max_track );
+            printf( "   -s, --sequences <n>: sequences per track (default 4)\n" );
+            printf( "   -e, --events <n>: events per sequence (default 2048)\n" );
+            printf( "   -i, --iterations <n>: runs of each benchmark (default 10)\n" );
+            printf( "   -b, --bench <name>: only run benchmarks whose name contains this\n" );
+            return ( c == 'h' ) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if ( params.m_tracks < 1 || params.m_tracks > c_max_track )
+        params.m_tracks = (params.m_tracks < 1) ? 1 : c_max_track;
+    if ( params.m_sequences < 1 )
+        params.m_sequences = 1;
+    if ( params.m_events < 4 )
+        params.m_events = 4;
+    if ( params.m_iterations < 1 )
+        params.m_iterations = 1;
+
+    /* keep stdout to the results, load and save talk on it */
+    fflush( stdout );
+    int fd = dup( 1 );
+    if ( fd >= 0 && (results = fdopen( fd, "w" )) != NULL )
+        dup2( 2, 1 );
+    else
+        results = stdout;
+
+    const char *dir = getenv( "TMPDIR" );
+    if ( dir == NULL )
+        dir = "/tmp";
+
+    perform *perf = new perform();
+    perform *scratch = new perform();
+
+    fprintf( stderr, "building %d tracks x %d sequences x %d events\n",
+             params.m_tracks, params.m_sequences, params.m_events );
+
+    build_project( perf );
+
+    if ( wanted( "memory" ) )
+        bench_memory( perf );
+
+    if ( wanted( "sequence_play" ) )
+        bench_sequence_play( perf );
+
+    if ( wanted( "perform_play" ) )
+        bench_perform_play( perf );
+
+    bench_files( perf, scratch, dir );
+    bench_editing( perf );
+
+    delete scratch;
+    delete perf;
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
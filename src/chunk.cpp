@@ -0,0 +1,419 @@
+//----------------------------------------------------------------------------
+//
+//  This file is part of seq42.
+//
+//  seq42 is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  seq42 is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with seq42; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+//-----------------------------------------------------------------------------
+
+#include "chunk.h"
+
+#include <string.h>
+#include <string>
+
+#ifndef __WIN32__
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#else
+#   include <windows.h>
+#endif
+
+void
+chunk_writer::put( const void *a_data, size_t a_size )
+{
+    const char *data = (const char *) a_data;
+    m_data.insert( m_data.end(), data, data + a_size );
+}
+
+char *
+chunk_writer::grow( size_t a_size )
+{
+    size_t start = m_data.size();
+    m_data.resize( start + a_size );
+
+    return m_data.data() + start;
+}
+
+void
+chunk_writer::shrink( size_t a_size )
+{
+    m_data.resize( m_data.size() - a_size );
+}
+
+void
+chunk_writer::put_int( int32_t a_value )
+{
+    put( &a_value, sizeof(a_value) );
+}
+
+size_t
+chunk_writer::begin_chunk()
+{
+    size_t start = m_data.size();
+    put_int( 0 );
+
+    return start;
+}
+
+void
+chunk_writer::end_chunk( size_t a_start )
+{
+    uint32_t size = m_data.size() - a_start - sizeof(uint32_t);
+    memcpy( &m_data[a_start], &size, sizeof(size) );
+}
+
+bool
+chunk_writer::write( ofstream *a_file )
+{
+    uint32_t size = m_data.size();
+    a_file->write( (const char *) &size, sizeof(size) );
+
+    if ( size > 0 )
+        a_file->write( m_data.data(), size );
+
+    return a_file->good();
+}
+
+const char *
+chunk_writer::get_data()
+{
+    return m_data.data();
+}
+
+size_t
+chunk_writer::get_size()
+{
+    return m_data.size();
+}
+
+void
+midi_writer::reserve( size_t a_size )
+{
+    size_t need = m_data.size() + a_size;
+
+    if ( need <= m_data.capacity() )
+        return;
+
+    /* still double, so many small reserves do not each copy */
+    size_t capacity = m_data.capacity() * 2;
+    m_data.reserve( capacity > need ? capacity : need );
+}
+
+void
+midi_writer::put( const void *a_data, size_t a_size )
+{
+    const unsigned char *data = (const unsigned char *) a_data;
+    m_data.insert( m_data.end(), data, data + a_size );
+}
+
+void
+midi_writer::put_short( unsigned short a_x )
+{
+    put_byte( (a_x & 0xFF00) >> 8 );
+    put_byte( (a_x & 0x00FF) );
+}
+
+void
+midi_writer::put_mid( unsigned long a_x )
+{
+    put_byte( (a_x & 0xFF0000) >> 16 );
+    put_byte( (a_x & 0x00FF00) >> 8 );
+    put_byte( (a_x & 0x0000FF) );
+}
+
+void
+midi_writer::put_long( unsigned long a_x )
+{
+    put_byte( (a_x & 0xFF000000) >> 24 );
+    put_byte( (a_x & 0x00FF0000) >> 16 );
+    put_byte( (a_x & 0x0000FF00) >> 8 );
+    put_byte( (a_x & 0x000000FF) );
+}
+
+void
+midi_writer::put_var( unsigned long a_x )
+{
+    unsigned long buffer = a_x & 0x7F;
+
+    while ( (a_x >>= 7) > 0 )
+    {
+        buffer <<= 8;
+        buffer |= ((a_x & 0x7F) | 0x80);
+    }
+
+    while ( true )
+    {
+        put_byte( (unsigned char) (buffer & 0xFF) );
+
+        if ( buffer & 0x80 )
+            buffer >>= 8;
+        else
+            break;
+    }
+}
+
+size_t
+midi_writer::begin_chunk( unsigned long a_id )
+{
+    put_long( a_id );
+
+    size_t start = m_data.size();
+    put_long( 0 );
+
+    return start;
+}
+
+void
+midi_writer::end_chunk( size_t a_start )
+{
+    unsigned long size = m_data.size() - a_start - 4;
+
+    m_data[a_start]     = (size & 0xFF000000) >> 24;
+    m_data[a_start + 1] = (size & 0x00FF0000) >> 16;
+    m_data[a_start + 2] = (size & 0x0000FF00) >> 8;
+    m_data[a_start + 3] = (size & 0x000000FF);
+}
+
+size_t
+midi_writer::get_size()
+{
+    return m_data.size();
+}
+
+bool
+midi_writer::write( const char *a_filename )
+{
+    ofstream file( a_filename, ios::out | ios::binary | ios::trunc );
+
+    if ( !file.is_open() )
+        return false;
+
+    if ( !m_data.empty() )
+        file.write( (const char *) m_data.data(), m_data.size() );
+
+    file.close();
+
+    return !file.fail();
+}
+
+mapped_file::mapped_file() :
+    m_data(NULL),
+    m_size(0)
+{
+}
+
+mapped_file::~mapped_file()
+{
+    close();
+}
+
+bool
+mapped_file::open( const char *a_filename )
+{
+    close();
+
+#ifndef __WIN32__
+    int fd = ::open( a_filename, O_RDONLY );
+    if ( fd < 0 )
+        return false;
+
+    struct stat info;
+    if ( fstat( fd, &info ) != 0 || info.st_size <= 0 )
+    {
+        ::close( fd );
+        return false;
+    }
+
+    void *data = mmap( NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+
+    /* the mapping stays good without the descriptor */
+    ::close( fd );
+
+    if ( data == MAP_FAILED )
+        return false;
+
+    m_data = (const char *) data;
+    m_size = info.st_size;
+#else
+    ifstream file( a_filename, ios::in | ios::binary | ios::ate );
+    if ( !file.is_open() )
+        return false;
+
+    streamsize size = file.tellg();
+    if ( size <= 0 )
+        return false;
+
+    m_buffer.resize( size );
+    file.seekg( 0, ios::beg );
+    if ( !file.read( m_buffer.data(), size ) )
+    {
+        m_buffer.clear();
+        return false;
+    }
+
+    m_data = m_buffer.data();
+    m_size = size;
+#endif
+
+    return true;
+}
+
+void
+mapped_file::close()
+{
+#ifndef __WIN32__
+    if ( m_data != NULL )
+        munmap( (void *) m_data, m_size );
+#else
+    vector<char>().swap( m_buffer );
+#endif
+
+    m_data = NULL;
+    m_size = 0;
+}
+
+const char *
+mapped_file::get_data()
+{
+    return m_data;
+}
+
+size_t
+mapped_file::get_size()
+{
+    return m_size;
+}
+
+chunk_reader::chunk_reader( const char *a_data, size_t a_size ) :
+    m_data(a_data),
+    m_size(a_size),
+    m_pos(0),
+    m_good(true)
+{
+}
+
+const char *
+chunk_reader::get_block( size_t a_size )
+{
+    if ( !m_good || a_size > m_size - m_pos )
+    {
+        m_good = false;
+        return NULL;
+    }
+
+    const char *block = m_data + m_pos;
+    m_pos += a_size;
+
+    return block;
+}
+
+bool
+chunk_reader::get( void *a_data, size_t a_size )
+{
+    const char *block = get_block( a_size );
+    if ( block == NULL )
+        return false;
+
+    memcpy( a_data, block, a_size );
+
+    return true;
+}
+
+bool
+chunk_reader::get_int( int32_t *a_value )
+{
+    return get( a_value, sizeof(*a_value) );
+}
+
+bool
+chunk_reader::get_chunk( chunk_reader *a_chunk )
+{
+    uint32_t size;
+    if ( !get( &size, sizeof(size) ) )
+        return false;
+
+    const char *block = get_block( size );
+    if ( block == NULL )
+        return false;
+
+    *a_chunk = chunk_reader( block, size );
+
+    return true;
+}
+
+bool
+chunk_reader::good()
+{
+    return m_good;
+}
+
+bool
+chunk_reader::at_end()
+{
+    return m_pos == m_size;
+}
+
+bool
+sync_file( const char *a_filename )
+{
+#ifndef __WIN32__
+    int fd = ::open( a_filename, O_RDONLY );
+    if ( fd < 0 )
+        return false;
+
+    bool synced = ( fsync( fd ) == 0 );
+    ::close( fd );
+
+    return synced;
+#else
+    HANDLE file = CreateFileA( a_filename, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+            NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+    if ( file == INVALID_HANDLE_VALUE )
+        return false;
+
+    bool synced = FlushFileBuffers( file ) != 0;
+    CloseHandle( file );
+
+    return synced;
+#endif
+}
+
+bool
+replace_file( const char *a_temp, const char *a_filename )
+{
+#ifndef __WIN32__
+    if ( !sync_file( a_temp ) || rename( a_temp, a_filename ) != 0 )
+        return false;
+
+    /* and the directory, so the rename is on the disk too */
+    string dir = a_filename;
+    size_t slash = dir.rfind( '/' );
+    dir = ( slash == string::npos ) ? "." : dir.substr( 0, slash + 1 );
+
+    int fd = ::open( dir.c_str(), O_RDONLY );
+    if ( fd >= 0 )
+    {
+        fsync( fd );
+        ::close( fd );
+    }
+
+    return true;
+#else
+    return MoveFileExA( a_temp, a_filename,
+            MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH ) != 0;
+#endif
+}
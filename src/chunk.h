@@ -0,0 +1,200 @@
+//----------------------------------------------------------------------------
+//
+//  This file is part of seq42.
+//
+//  seq42 is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  seq42 is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with seq42; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <fstream>
+#include <vector>
+
+using namespace std;
+
+/* base 128, low bits first, the high bit set on all but the last byte */
+const int c_max_varint_size = 5;
+
+inline int
+put_varint( char *a_out, uint32_t a_value )
+{
+    int size = 0;
+    while ( a_value >= 0x80 )
+    {
+        a_out[size++] = (char) (a_value | 0x80);
+        a_value >>= 7;
+    }
+    a_out[size++] = (char) a_value;
+
+    return size;
+}
+
+/* reads c_max_varint_size bytes at most, the caller sees they are there */
+inline const char *
+get_varint( const char *a_in, uint32_t *a_value )
+{
+    unsigned char byte = *a_in++;
+    uint32_t value = byte & 0x7F;
+
+    for ( int shift = 7; byte >= 0x80 && shift < 7 * c_max_varint_size; shift += 7 )
+    {
+        byte = *a_in++;
+        value |= (uint32_t) (byte & 0x7F) << shift;
+    }
+
+    *a_value = value;
+    return a_in;
+}
+
+/* version 8 files keep each track and each of its sequences in a
+   chunk, a 32 bit byte count and then that many bytes. A chunk is
+   written and read in one call, and one that does not add up can
+   be stepped over without losing the rest of the file */
+
+class chunk_writer
+{
+
+private:
+
+    vector<char> m_data;
+
+public:
+
+    void put( const void *a_data, size_t a_size );
+    void put_int( int32_t a_value );
+
+    /* room for a_size bytes to be filled in, good until the next put */
+    char *grow( size_t a_size );
+    /* gives back what was not used of the last grow() */
+    void shrink( size_t a_size );
+
+    /* starts a chunk inside this one, end_chunk() fills in its size */
+    size_t begin_chunk();
+    void end_chunk( size_t a_start );
+
+    /* the size and then the bytes */
+    bool write( ofstream *a_file );
+
+    const char *get_data();
+    size_t get_size();
+};
+
+/* a standard MIDI file as it is written, everything big endian. The
+   bytes go on the end of one buffer, and begin_chunk() leaves the
+   chunk length to be filled in by end_chunk() once it is known */
+
+class midi_writer
+{
+
+private:
+
+    vector<unsigned char> m_data;
+
+public:
+
+    /* room for a_size more bytes, so they go in without a copy */
+    void reserve( size_t a_size );
+
+    void put_byte( unsigned char a_x )
+    {
+        m_data.push_back( a_x );
+    }
+
+    void put( const void *a_data, size_t a_size );
+    void put_short( unsigned short a_x );
+    void put_mid( unsigned long a_x );
+    void put_long( unsigned long a_x );
+    /* variable length quantity, 7 bits a byte, high bit set on all but the last */
+    void put_var( unsigned long a_x );
+
+    /* the ID and a length to be filled in, returns where the length is */
+    size_t begin_chunk( unsigned long a_id );
+    void end_chunk( size_t a_start );
+
+    size_t get_size();
+
+    bool write( const char *a_filename );
+};
+
+/* a whole file in memory, mapped where there is mmap() so only
+   what is read gets paged in, read in one go elsewhere */
+class mapped_file
+{
+
+private:
+
+    const char *m_data;
+    size_t m_size;
+
+#ifdef __WIN32__
+    vector<char> m_buffer;
+#endif
+
+public:
+
+    mapped_file();
+    ~mapped_file();
+
+    /* the mapping has one owner */
+    mapped_file( const mapped_file& ) = delete;
+    mapped_file& operator=( const mapped_file& ) = delete;
+
+    bool open( const char *a_filename );
+    void close();
+
+    const char *get_data();
+    size_t get_size();
+};
+
+/* flushes what was written to a_filename out to the disk */
+bool sync_file( const char *a_filename );
+
+/* flushes a_temp out to the disk and puts it in place of a_filename,
+   so a_filename is always the whole old file or the whole new one */
+bool replace_file( const char *a_temp, const char *a_filename );
+
+/* reads over bytes that are already in memory, nothing is copied
+   until get() is asked for it */
+class chunk_reader
+{
+
+private:
+
+    const char *m_data;
+    size_t m_size;
+    size_t m_pos;
+
+    /* cleared by the first read past the end, and stays that way */
+    bool m_good;
+
+public:
+
+    chunk_reader( const char *a_data = NULL, size_t a_size = 0 );
+
+    bool get( void *a_data, size_t a_size );
+    bool get_int( int32_t *a_value );
+
+    /* a_size bytes in place, NULL if there are not that many */
+    const char *get_block( size_t a_size );
+
+    /* the chunk that comes next, false if its size runs past ours */
+    bool get_chunk( chunk_reader *a_chunk );
+
+    bool good();
+    bool at_end();
+};
@@ -0,0 +1,206 @@
+//----------------------------------------------------------------------------
+//
+//  This file is part of seq42.
+//
+//  seq42 is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  seq42 is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with seq42; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+//-----------------------------------------------------------------------------
+
+#include "convert.h"
+#include "midifile.h"
+#include "perform.h"
+
+#include <thread>
+
+#ifdef __WIN32__
+#   define SLASH "\\"
+#else
+#   define SLASH "/"
+#endif
+
+/* what each worker thread is given */
+struct convert_worker
+{
+    converter *m_converter;
+    perform *m_perf;
+    pthread_t m_thread;
+};
+
+converter::converter( convert_type_e a_type ) :
+    m_type(a_type),
+    m_next(0)
+{
+}
+
+Glib::ustring
+converter::get_output_name( const Glib::ustring& a_in, const Glib::ustring& a_dir )
+{
+    const char *extension = (m_type == CONVERT_SONG_TO_MIDI) ? ".mid" : ".s42";
+
+    Glib::ustring name = a_in;
+    Glib::ustring::size_type slash = name.find_last_of( "/\\" );
+
+    if ( a_dir != "" && slash != Glib::ustring::npos )
+        name = name.substr( slash + 1 );
+
+    /* swap the extension, if the last dot is in the file name */
+    Glib::ustring::size_type dot = name.rfind( '.' );
+    slash = name.find_last_of( "/\\" );
+
+    if ( dot != Glib::ustring::npos && dot > 0 &&
+            (slash == Glib::ustring::npos || dot > slash + 1) )
+        name = name.substr( 0, dot );
+
+    name += extension;
+
+    if ( a_dir != "" )
+        name = a_dir + SLASH + name;
+
+    /* never write over what we read */
+    if ( name == a_in )
+        name += extension;
+
+    return name;
+}
+
+void
+converter::add( const Glib::ustring& a_in, const Glib::ustring& a_out )
+{
+    convert_job job;
+    job.m_in = a_in;
+    job.m_out = a_out;
+    job.m_ok = false;
+
+    m_jobs.push_back( job );
+}
+
+int
+converter::get_count()
+{
+    return m_jobs.size();
+}
+
+bool
+converter::convert( perform *a_perf, convert_job *a_job )
+{
+    if ( !a_perf->clear_all() )
+        return false;
+
+    if ( m_type == CONVERT_SONG_TO_MIDI )
+    {
+        if ( !a_perf->load( a_job->m_in ) )
+            return false;
+
+        /* as headless open does, the gui tempo widget normally does this */
+        a_perf->set_tempo_load( false );
+        a_perf->load_tempo_list();
+        a_perf->set_bpm( a_perf->get_start_tempo() );
+
+        midifile f( a_job->m_out );
+        return f.write_song( a_perf, E_MIDI_SONG_FORMAT, nullptr );
+    }
+
+    /* a new song, as File > New leaves it */
+    a_perf->set_bp_measure( 4 );
+    a_perf->set_bw( 4 );
+    a_perf->set_swing_amount8( 0 );
+    a_perf->set_swing_amount16( 0 );
+    a_perf->set_start_tempo( c_bpm );
+
+    midifile f( a_job->m_in );
+    if ( !f.parse( a_perf, -1 ) )
+        return false;
+
+    return a_perf->save( a_job->m_out );
+}
+
+void
+converter::work( perform *a_perf )
+{
+    while ( true )
+    {
+        m_mutex.lock();
+        unsigned index = m_next++;
+        m_mutex.unlock();
+
+        if ( index >= m_jobs.size() )
+            break;
+
+        convert_job *job = &m_jobs[index];
+        job->m_ok = convert( a_perf, job );
+
+        m_mutex.lock();
+        if ( job->m_ok )
+            printf( "Converted [%s] to [%s]\n", job->m_in.c_str(), job->m_out.c_str() );
+        else
+            printf( "Error converting [%s] to [%s]\n", job->m_in.c_str(), job->m_out.c_str() );
+        m_mutex.unlock();
+    }
+
+    a_perf->clear_all();
+}
+
+bool
+converter::run( int a_workers )
+{
+    unsigned workers = a_workers;
+    if ( a_workers <= 0 )
+        workers = thread::hardware_concurrency();
+    if ( workers > m_jobs.size() )
+        workers = m_jobs.size();
+    if ( workers < 1 )
+        workers = 1;
+
+    m_next = 0;
+
+    /* nothing is played, so the performs open no midi clients */
+    vector<convert_worker> pool( workers );
+    for ( unsigned i = 0; i < workers; i++ )
+    {
+        pool[i].m_converter = this;
+        pool[i].m_perf = new perform( false );
+    }
+
+    /* the first worker is this thread */
+    vector<bool> launched( workers, false );
+    for ( unsigned i = 1; i < workers; i++ )
+        launched[i] = pthread_create( &pool[i].m_thread, NULL, convert_thread_func, &pool[i] ) == 0;
+
+    work( pool[0].m_perf );
+
+    for ( unsigned i = 1; i < workers; i++ )
+    {
+        if ( launched[i] )
+            pthread_join( pool[i].m_thread, NULL );
+    }
+
+    for ( unsigned i = 0; i < workers; i++ )
+        delete pool[i].m_perf;
+
+    bool ret = true;
+    for ( unsigned i = 0; i < m_jobs.size(); i++ )
+        ret = ret && m_jobs[i].m_ok;
+
+    return ret;
+}
+
+void *
+convert_thread_func( void *a_p )
+{
+    convert_worker *worker = (convert_worker *) a_p;
+    worker->m_converter->work( worker->m_perf );
+
+    return 0;
+}
@@ -0,0 +1,79 @@
+//----------------------------------------------------------------------------
+//
+//  This file is part of seq42.
+//
+//  seq42 is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  seq42 is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with seq42; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <pthread.h>
+#include <vector>
+
+#include "globals.h"
+#include "mutex.h"
+
+class perform;
+
+/* what seq42 --export_song and --import_midi turn a file into */
+enum convert_type_e
+{
+    CONVERT_SONG_TO_MIDI,   /* .s42 to a MIDI song file, as File > Export Song */
+    CONVERT_MIDI_TO_SONG    /* MIDI file to .s42, as File > Import */
+};
+
+struct convert_job
+{
+    Glib::ustring m_in;
+    Glib::ustring m_out;
+    bool m_ok;
+};
+
+/* converts files with no gui. Each worker thread has a perform of
+   its own and takes the next job until there are none left */
+class converter
+{
+
+private:
+
+    convert_type_e m_type;
+
+    vector<convert_job> m_jobs;
+    unsigned m_next;
+
+    /* guards m_next, and keeps the output of one file together */
+    seq42_mutex m_mutex;
+
+    bool convert( perform *a_perf, convert_job *a_job );
+
+public:
+
+    converter( convert_type_e a_type );
+
+    /* the file a_in would be converted to, next to it or in a_dir */
+    Glib::ustring get_output_name( const Glib::ustring& a_in, const Glib::ustring& a_dir );
+
+    void add( const Glib::ustring& a_in, const Glib::ustring& a_out );
+    int get_count();
+
+    /* on a_workers threads, 0 for one a core. False if any failed */
+    bool run( int a_workers );
+
+    /* on each worker thread */
+    void work( perform *a_perf );
+};
+
+extern void *convert_thread_func( void *a_p );
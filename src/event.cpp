@@ -23,19 +23,105 @@
 
 event::event() :
     m_timestamp(0),
+    m_linked(-1),
     m_status(EVENT_NOTE_OFF),
-    m_linked(NULL),
-    m_has_link(false),
     m_selected(false),
     m_marked(false),
-    m_painted(false)
+    m_painted(false),
+    m_sysex(NULL)
 {
     m_data[0] = 0;
     m_data[1] = 0;
 }
 
+event::event( const event &a_rhs ) :
+    m_timestamp(a_rhs.m_timestamp),
+    m_linked(a_rhs.m_linked),
+    m_status(a_rhs.m_status),
+    m_selected(a_rhs.m_selected),
+    m_marked(a_rhs.m_marked),
+    m_painted(a_rhs.m_painted),
+    m_sysex(NULL)
+{
+    m_data[0] = a_rhs.m_data[0];
+    m_data[1] = a_rhs.m_data[1];
+
+    if ( a_rhs.m_sysex != NULL )
+        m_sysex = new vector<unsigned char>( *a_rhs.m_sysex );
+}
+
+event::event( event &&a_rhs ) noexcept :
+    m_timestamp(a_rhs.m_timestamp),
+    m_linked(a_rhs.m_linked),
+    m_status(a_rhs.m_status),
+    m_selected(a_rhs.m_selected),
+    m_marked(a_rhs.m_marked),
+    m_painted(a_rhs.m_painted),
+    m_sysex(a_rhs.m_sysex)
+{
+    m_data[0] = a_rhs.m_data[0];
+    m_data[1] = a_rhs.m_data[1];
+
+    a_rhs.m_sysex = NULL;
+}
+
+event::~event()
+{
+    delete m_sysex;
+}
+
+event&
+event::operator=( const event &a_rhs )
+{
+    if ( this == &a_rhs )
+        return *this;
+
+    if ( a_rhs.m_sysex == NULL )
+    {
+        delete m_sysex;
+        m_sysex = NULL;
+    }
+    else if ( m_sysex == NULL )
+        m_sysex = new vector<unsigned char>( *a_rhs.m_sysex );
+    else
+        *m_sysex = *a_rhs.m_sysex;
+
+    m_timestamp = a_rhs.m_timestamp;
+    m_linked = a_rhs.m_linked;
+    m_status = a_rhs.m_status;
+    m_data[0] = a_rhs.m_data[0];
+    m_data[1] = a_rhs.m_data[1];
+    m_selected = a_rhs.m_selected;
+    m_marked = a_rhs.m_marked;
+    m_painted = a_rhs.m_painted;
+
+    return *this;
+}
+
+event&
+event::operator=( event &&a_rhs ) noexcept
+{
+    if ( this == &a_rhs )
+        return *this;
+
+    delete m_sysex;
+    m_sysex = a_rhs.m_sysex;
+    a_rhs.m_sysex = NULL;
+
+    m_timestamp = a_rhs.m_timestamp;
+    m_linked = a_rhs.m_linked;
+    m_status = a_rhs.m_status;
+    m_data[0] = a_rhs.m_data[0];
+    m_data[1] = a_rhs.m_data[1];
+    m_selected = a_rhs.m_selected;
+    m_marked = a_rhs.m_marked;
+    m_painted = a_rhs.m_painted;
+
+    return *this;
+}
+
 long
-event::get_timestamp()
+event::get_timestamp() const
 {
     return m_timestamp;
 }
@@ -122,14 +208,14 @@ event::decrement_data1()
 }
 
 void
-event::get_data( unsigned char *D0, unsigned char *D1 )
+event::get_data( unsigned char *D0, unsigned char *D1 ) const
 {
     *D0 = m_data[0];
     *D1 = m_data[1];
 }
 
 unsigned char
-event::get_status( )
+event::get_status( ) const
 {
     return m_status;
 }
@@ -137,7 +223,8 @@ event::get_status( )
 void
 event::start_sysex( void  )
 {
-    m_sysex.clear();
+    if ( m_sysex != NULL )
+        m_sysex->clear();
 }
 
 bool
@@ -145,10 +232,13 @@ event::append_sysex( unsigned char *a_data, long a_size )
 {
     bool ret = true;
 
+    if ( m_sysex == NULL )
+        m_sysex = new vector<unsigned char>;
+
     for ( int i=0; i<a_size; i++ )
     {
 
-        m_sysex.push_back( a_data[i] );
+        m_sysex->push_back( a_data[i] );
         if ( a_data[i] == EVENT_SYSEX_END )
             ret = false;
     }
@@ -158,21 +248,46 @@ event::append_sysex( unsigned char *a_data, long a_size )
 
 
 unsigned char *
-event::get_sysex()
+event::get_sysex() const
 {
-    return m_sysex.data();
+    if ( m_sysex == NULL )
+        return NULL;
+
+    return m_sysex->data();
 }
 
 void
 event::set_size( long a_size )
 {
-    m_sysex.resize(a_size);
+    if ( m_sysex == NULL )
+    {
+        if ( a_size <= 0 )
+            return;
+
+        m_sysex = new vector<unsigned char>;
+    }
+
+    m_sysex->resize(a_size);
+}
+
+long
+event::get_size() const
+{
+    if ( m_sysex == NULL )
+        return 0;
+
+    return m_sysex->size();
 }
 
 long
-event::get_size()
+event::get_memory_bytes() const
 {
-    return m_sysex.size();
+    long bytes = sizeof(event);
+
+    if ( m_sysex != NULL )
+        bytes += sizeof(vector<unsigned char>) + m_sysex->capacity();
+
+    return bytes;
 }
 
 void
@@ -182,19 +297,19 @@ event::set_note_velocity( int a_vel )
 }
 
 bool
-event::is_note_on()
+event::is_note_on() const
 {
     return (m_status == EVENT_NOTE_ON);
 }
 
 bool
-event::is_note_off()
+event::is_note_off() const
 {
     return (m_status == EVENT_NOTE_OFF);
 }
 
 unsigned char
-event::get_note()
+event::get_note() const
 {
     return m_data[0];
 }
@@ -206,30 +321,30 @@ event::set_note( char a_note )
 }
 
 unsigned char
-event::get_note_velocity()
+event::get_note_velocity() const
 {
     return m_data[1];
 }
 
 void
-event::print()
+event::print() const
 {
     printf
     (
         "[%06ld] [%04X] %02X ",
-        m_timestamp,
-        (unsigned char)m_sysex.size(),
+        (long) m_timestamp,
+        (unsigned char) get_size(),
         m_status
     );
 
     if ( m_status == EVENT_SYSEX )
     {
-        for( size_t i=0; i<m_sysex.size(); i++ )
+        for( long i=0; i<get_size(); i++ )
         {
             if ( i%16 == 0 )
                 printf( "\n    " );
 
-            printf( "%02X ", m_sysex[i] );
+            printf( "%02X ", (*m_sysex)[i] );
         }
 
         printf( "\n" );
@@ -270,7 +385,7 @@ event::get_rank(void) const
 }
 
 bool
-event::operator>( const event &a_rhsevent )
+event::operator>( const event &a_rhsevent ) const
 {
     if ( m_timestamp == a_rhsevent.m_timestamp )
     {
@@ -283,7 +398,7 @@ event::operator>( const event &a_rhsevent )
 }
 
 bool
-event::operator<( const event &a_rhsevent )
+event::operator<( const event &a_rhsevent ) const
 {
     if ( m_timestamp == a_rhsevent.m_timestamp )
     {
@@ -296,40 +411,62 @@ event::operator<( const event &a_rhsevent )
 }
 
 bool
-event::operator<=( const unsigned long &a_rhslong )
+event::operator==( const event &a_rhsevent ) const
+{
+    return m_timestamp == a_rhsevent.m_timestamp &&
+           m_status == a_rhsevent.m_status &&
+           m_data[0] == a_rhsevent.m_data[0] &&
+           m_data[1] == a_rhsevent.m_data[1] &&
+           same_sysex( a_rhsevent );
+}
+
+/* an empty sysex and none at all are the same */
+bool
+event::same_sysex( const event &a_rhsevent ) const
+{
+    size_t size = (m_sysex == NULL) ? 0 : m_sysex->size();
+    size_t rhs_size = (a_rhsevent.m_sysex == NULL) ? 0 : a_rhsevent.m_sysex->size();
+
+    if ( size != rhs_size )
+        return false;
+
+    return size == 0 || *m_sysex == *a_rhsevent.m_sysex;
+}
+
+bool
+event::operator<=( const unsigned long &a_rhslong ) const
 {
     return (m_timestamp <= a_rhslong);
 }
 
 bool
-event::operator>( const unsigned long &a_rhslong )
+event::operator>( const unsigned long &a_rhslong ) const
 {
     return (m_timestamp > a_rhslong);
 }
 
 void
-event::link( event *a_event )
+event::link( long a_index )
 {
-    m_has_link = true;
-    m_linked = a_event;
+    m_linked = a_index;
 }
 
-event*
-event::get_linked( )
+long
+event::get_linked( ) const
 {
     return m_linked;
 }
 
 bool
-event::is_linked( )
+event::is_linked( ) const
 {
-    return m_has_link;
+    return m_linked >= 0;
 }
 
 void
 event::clear_link( )
 {
-    m_has_link = false;
+    m_linked = -1;
 }
 
 void
@@ -345,7 +482,7 @@ event::unselect( )
 }
 
 bool
-event::is_selected( )
+event::is_selected( ) const
 {
     return m_selected;
 }
@@ -362,7 +499,7 @@ event::unpaint( )
 }
 
 bool
-event::is_painted( )
+event::is_painted( ) const
 {
     return m_painted;
 }
@@ -380,23 +517,36 @@ event::unmark( )
 }
 
 bool
-event::is_marked( )
+event::is_marked( ) const
 {
     return m_marked;
 }
 
 void
-event::save(ofstream *file)
+event::get_record( event_record *a_record ) const
+{
+    a_record->m_timestamp = m_timestamp;
+    a_record->m_status = m_status;
+    a_record->m_data[0] = m_data[0];
+    a_record->m_data[1] = m_data[1];
+    a_record->m_reserved = 0;
+}
+
+void
+event::set_record( const event_record &a_record )
 {
-    file->write((const char *) &(m_timestamp), global_file_long_int_size);
-    file->write((const char *) &(m_status), sizeof(char));
-    file->write((const char *) &(m_data), sizeof(char)*2);
+    m_timestamp = a_record.m_timestamp;
+    m_status = a_record.m_status;
+    m_data[0] = a_record.m_data[0];
+    m_data[1] = a_record.m_data[1];
 }
 
 void
 event::load(ifstream *file)
 {
-    file->read((char *) &(m_timestamp), global_file_long_int_size);
+    unsigned long timestamp = 0;
+    file->read((char *) &(timestamp), global_file_long_int_size);
+    m_timestamp = timestamp;
     file->read((char *) &(m_status), sizeof(char));
     file->read((char *) &(m_data), sizeof(char)*2);
 }
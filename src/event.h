@@ -20,6 +20,7 @@
 
 #pragma once
 
+#include <stdint.h>
 #include <stdio.h>
 #include <vector>
 
@@ -46,13 +47,29 @@ const unsigned char  EVENT_SYSEX_END        = 0xF7;
 const int ALL_EVENTS                        = -1;
 const int UNSELECTED_EVENTS                 = 0;
 
+/* an event as version 8 files keep it, the events of a sequence
+   are one array of these */
+struct event_record
+{
+    uint32_t m_timestamp;
+    unsigned char m_status;
+    unsigned char m_data[2];
+    unsigned char m_reserved;
+};
+
 class event
 {
 
 private:
 
-    /* timestamp in ticks */
-    unsigned long m_timestamp;
+    /* timestamp in ticks, 32 bits hold far more than a sequence
+       can be long and are what older files store */
+    uint32_t m_timestamp;
+
+    /* used to link note ons and offs together, the index of the
+       other one in the sequence or -1. An index stays good when the
+       events are copied for undo or the clipboard */
+    int32_t m_linked;
 
     /* status byte with channel on record
        until matching channel determined then
@@ -67,38 +84,43 @@ private:
     /* data for event */
     unsigned char m_data[2];
 
-    /* data for sysex */
-    vector<unsigned char> m_sysex;
-
-    /* used to link note ons and offs together */
-    event *m_linked;
-    bool m_has_link;
-
     /* is this event selected in editing */
-    bool m_selected;
+    bool m_selected : 1;
 
     /* is this event marked in processing */
-    bool m_marked;
+    bool m_marked : 1;
 
     /* is this event being painted */
-    bool m_painted;
+    bool m_painted : 1;
+
+    /* data for sysex, kept out of line so the common events stay
+       small, NULL for everything else */
+    vector<unsigned char> *m_sysex;
 
     /* used in sorting */
     int get_rank( ) const;
 
+    bool same_sysex( const event &a_rhsevent ) const;
+
 public:
 
     event();
+    event( const event &a_rhs );
+    event( event &&a_rhs ) noexcept;
+    ~event();
+
+    event& operator=( const event &a_rhs );
+    event& operator=( event &&a_rhs ) noexcept;
 
     void set_timestamp( const unsigned long time );
-    long get_timestamp();
+    long get_timestamp() const;
     void mod_timestamp( unsigned long a_mod );
 
     void set_status( const char status, bool a_record = false );  // clears the channel portion if false
-    unsigned char get_status( );
+    unsigned char get_status( ) const;
     void set_data( const char D1 );
     void set_data( const char D1, const char D2 );
-    void get_data( unsigned char *D0, unsigned char *D1 );
+    void get_data( unsigned char *D0, unsigned char *D1 ) const;
     void increment_data1();
     void decrement_data1();
     void increment_data2();
@@ -106,55 +128,64 @@ public:
 
     void start_sysex();
     bool append_sysex( unsigned char *a_data, long size );
-    unsigned char *get_sysex();
+    unsigned char *get_sysex() const;
 
     void set_note( char a_note );
 
     void set_size( long a_size );
-    long get_size();
+    long get_size() const;
 
-    void link( event *event );
-    event *get_linked( );
-    bool is_linked( );
+    /* bytes held, the event itself and any sysex */
+    long get_memory_bytes() const;
+
+    void link( long a_index );
+    long get_linked( ) const;
+    bool is_linked( ) const;
     void clear_link( );
 
     void paint( );
     void unpaint( );
-    bool is_painted( );
+    bool is_painted( ) const;
 
     void mark( );
     void unmark( );
-    bool is_marked( );
+    bool is_marked( ) const;
 
     void select( );
     void unselect( );
-    bool is_selected( );
+    bool is_selected( ) const;
 
     /* set status to midi clock */
     void make_clock( );
 
     /* gets the note assuming its note on/off or EVENT_AFTERTOUCH */
-    unsigned char get_note();
-    unsigned char get_note_velocity();
+    unsigned char get_note() const;
+    unsigned char get_note_velocity() const;
     void set_note_velocity( int a_vel );
 
     /* returns true if status is set */
-    bool is_note_on();
-    bool is_note_off();
+    bool is_note_on() const;
+    bool is_note_off() const;
 
-    void print();
+    void print() const;
 
     /* overloads */
 
-    bool operator> ( const event &rhsevent );
-    bool operator< ( const event &rhsevent );
+    bool operator> ( const event &rhsevent ) const;
+    bool operator< ( const event &rhsevent ) const;
+
+    /* same time, status and data, the editing flags and link are not compared */
+    bool operator==( const event &rhsevent ) const;
 
-    bool operator<=( const unsigned long &rhslong );
-    bool operator> ( const unsigned long &rhslong );
+    bool operator<=( const unsigned long &rhslong ) const;
+    bool operator> ( const unsigned long &rhslong ) const;
 
     friend class sequence;
 
-    void save( ofstream *file );
+    void get_record( event_record *a_record ) const;
+    void set_record( const event_record &a_record );
+
+    /* before version 8 */
     void load( ifstream *file );
 };
 
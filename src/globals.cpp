@@ -0,0 +1,98 @@
+//----------------------------------------------------------------------------
+//
+//  This file is part of seq42.
+//
+//  seq42 is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  seq42 is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with seq42; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+//-----------------------------------------------------------------------------
+
+/* globals used by the engine (libseq42core), so it links without the gui */
+
+#include "globals.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#ifdef LASH_SUPPORT
+#    include "lash.h"
+#endif
+
+short global_file_int_size = sizeof(int32_t);
+short global_file_long_int_size = sizeof(int32_t);
+
+bool global_is_running = false;
+bool global_is_modified = false;
+bool global_seqlist_need_update = false;
+
+bool global_manual_alsa_ports = false;
+bool global_headless = false;
+bool global_compact_events = true;
+bool global_lazy_load = false;
+bool global_journal = true;
+bool global_showmidi = false;
+bool global_priority = false;
+bool global_stats = false;
+bool global_pass_sysex = false;
+bool global_use_sysex = false;
+Glib::ustring global_filename = "";
+Glib::ustring last_used_dir ="/";
+Glib::ustring last_midi_dir ="/";
+Glib::ustring global_client_name = "seq42"; // default
+bool global_print_keys = false;
+interaction_method_e global_interactionmethod = e_seq42_interaction;
+
+bool global_with_jack_transport = false;
+bool global_with_jack_master = false;
+bool global_with_jack_master_cond = false;
+bool global_song_start_mode = true;
+
+Glib::ustring global_jack_session_uuid = "";
+
+user_midi_bus_definition   global_user_midi_bus_definitions[c_maxBuses];
+user_instrument_definition global_user_instrument_definitions[c_max_instruments];
+
+#ifdef LASH_SUPPORT
+lash *lash_driver = NULL;
+#endif
+
+void
+string_printf( std::string *a_out, const char *a_format, ... )
+{
+    char buffer[256];
+
+    va_list args;
+    va_start( args, a_format );
+    int size = vsnprintf( buffer, sizeof(buffer), a_format, args );
+    va_end( args );
+
+    if ( size < 0 )
+        return;
+
+    if ( size < (int) sizeof(buffer) )
+    {
+        a_out->append( buffer, size );
+        return;
+    }
+
+    /* rare long line, format again straight into the string */
+    size_t start = a_out->size();
+    a_out->resize( start + size + 1 );
+
+    va_start( args, a_format );
+    vsnprintf( &(*a_out)[start], size + 1, a_format, args );
+    va_end( args );
+
+    a_out->resize( start + size );
+}
@@ -34,7 +34,7 @@
 
 using namespace std;
 
-const int c_file_version = 7;  // Version of our save file format.  Increment this whenever the format of the save file changes.
+const int c_file_version = 9;  // Version of our save file format.  Increment this whenever the format of the save file changes.
 /* Version history:
 0 - initial seq42 file format
 1 - added transposable to track
@@ -44,21 +44,26 @@ const int c_file_version = 7;  // Version of our save file format.  Increment th
 5 - Use int32_t for 32 bit 64 bit compatibility, add file identification, add date & time stamp
 6 - Use double for BPM
 7 - Use tempo list for BPM
+8 - Tracks and sequences in chunks, events as fixed size records
+9 - Events optionally packed, delta times and running status
 */
 
 /* for 32 bit & 64 bit compatible - file version 5 */
 extern short global_file_int_size;  // default sizeof(int32_t)
 extern short global_file_long_int_size; // default sizeof(int32_t) - define in mainwnd
 const uint64_t c_file_identification =  0x293A323451455389; // \211 S E Q 42 : )
+const uint64_t c_journal_identification =  0x4C4E524A32345153; // S Q 4 2 J R N L
 const short global_VERSION_array_size = 8;
 const short global_time_array_size = 32;
 
 const int c_max_track_name = 16;
 const int c_max_seq_name = 32;
 
-const int c_max_track = 64;         // FIXME: use a list instead of a fixed number array?
+const int c_max_track = 1024;       // track slots are added as used, up to this many
+const int c_track_rows = 64;        // rows the song editor shows at least
 const int c_max_undo_track = 100;   // FIXME how big??
 const int c_max_undo_perf  = 40;    // FIXME how big??
+const long c_max_undo_seq_bytes = 4 * 1024 * 1024;  // per sequence undo + redo, oldest dropped first
 
 const int c_ppqn         = 192;  /* default - doesn't change */
 const int c_ppwn         = c_ppqn * 4;  // whole note
@@ -90,6 +95,17 @@ const int c_swing_sixteenths = 4;
 const int c_thread_trigger_width_ms = 4;
 const int c_thread_trigger_lookahead_ms = 2;
 
+/* how far ahead of the song lazily loaded sequences are read in */
+const long c_materialize_ahead_ticks = c_ppqn * 16;
+
+/* how often changes go to the edit journal, and how big it may get
+   before it is written again with only what differs from the song file */
+const int c_journal_interval_ms = 5000;
+const size_t c_journal_compact_bytes = 256 * 1024;
+
+/* smaller MIDI files are imported on one thread */
+const unsigned long c_midi_parallel_bytes = 64 * 1024;
+
 /* for the seqarea class */
 const int c_text_x = 6;
 const int c_text_y = 12;
@@ -198,6 +214,10 @@ extern bool global_with_jack_master;
 extern bool global_with_jack_master_cond;
 extern bool global_song_start_mode;
 extern bool global_manual_alsa_ports;
+extern bool global_headless;
+extern bool global_compact_events;
+extern bool global_lazy_load;
+extern bool global_journal;
 
 /*
     global_is_running:
@@ -510,6 +530,9 @@ string NumberToString ( T Number )
     return ss.str();
 }
 
+/* printf onto the end of a_out, for reports built in memory */
+extern void string_printf( std::string *a_out, const char *a_format, ... );
+
 #define SEQ24_SCREEN_SET_SIZE (32)
 
 enum file_type_e
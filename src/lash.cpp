@@ -20,7 +20,7 @@
 
 #include <string>
 #include <sigc++/slot.h>
-#include <gtkmm.h>
+#include <glibmm/main.h>
 
 #include "lash.h"
 
@@ -102,7 +102,7 @@ lash::handle_event(lash_event_t* ev)
     else if (type == LASH_Quit)
     {
         m_client = NULL;
-        Gtk::Main::quit();
+        m_perform->quit();
     }
     else
     {
@@ -26,43 +26,6 @@
 using std::string;
 using sigc::mem_fun;
 
-#define PI (3.14159265359)
-
-double lfownd::wave_func(double a_angle, int wave_type)
-{
-    double result = 0.0;
-    switch (wave_type)
-    {
-    case WAVE_SINE:
-        result = sin(a_angle * PI * 2.0);
-        break;
-
-    case WAVE_SAWTOOTH:
-        result = (a_angle - int(a_angle)) * 2.0 - 1.0;
-        break;
-
-    case WAVE_REVERSE_SAWTOOTH:
-        result = (a_angle - int(a_angle)) * -2.0 + 1.0;
-        break;
-
-    case WAVE_TRIANGLE:
-    {
-        double tmp = a_angle * 2.0;
-        result = (tmp - int(tmp));
-        if ((int(tmp)) % 2 == 1)
-            result = 1.0 - result;
-
-        result = result * 2.0 - 1.0;
-        break;
-    }
-    default:
-        break;
-    }
-    /*
-     * printf("y[%s](%f)=%f\n", wave_type_name(wavetype).c_str(), angle, result);
-     */
-    return result;
-}
 
 lfownd::~lfownd()
 {
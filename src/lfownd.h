@@ -29,15 +29,6 @@
 using namespace Gtk;
 
 
-enum wave_type_t
-{
-    WAVE_NONE               = 0,    /**< No waveform, never used.           */
-    WAVE_SINE               = 1,    /**< Sine wave modulation.              */
-    WAVE_SAWTOOTH           = 2,    /**< Saw-tooth (ramp) modulation.       */
-    WAVE_REVERSE_SAWTOOTH   = 3,    /**< Reverse saw-tooth (decay).         */
-    WAVE_TRIANGLE           = 4     /**< No waveform, never used.           */
-};
-
 class lfownd: public Gtk::Window
 {
 private:
@@ -68,6 +59,5 @@ public:
     lfownd (sequence *a_seq, seqdata *a_seqdata);
     virtual ~lfownd();
 
-    static double wave_func(double a_angle, int wave_type);
     void toggle_visible();
 };
@@ -30,6 +30,8 @@
 #include "sequence.h"
 #include "font.h"
 #include "seqlist.h"
+#include "perfstats.h"
+#include "trace.h"
 
 #include "pixmaps/seq42_32.xpm"
 #include "pixmaps/play2.xpm"
@@ -54,14 +56,6 @@
 
 using namespace sigc;
 
-short global_file_int_size = sizeof(int32_t);
-short global_file_long_int_size = sizeof(int32_t);
-
-bool global_is_running = false;
-bool global_is_modified = false;
-bool global_seqlist_need_update = false;
-ff_rw_type_e FF_RW_button_type = FF_RW_RELEASE;
-
 // tooltip helper, for old vs new gtk...
 #if GTK_MINOR_VERSION >= 12
 #   define add_tooltip( obj, text ) obj->set_tooltip_text( text);
@@ -76,10 +70,14 @@ mainwnd::mainwnd(perform *a_p):
     m_options(NULL),
     m_snap(c_ppqn / 4),
     m_bp_measure(4),
-    m_bw(4)
+    m_bw(4),
+    m_save_percent(-1)
 {
     using namespace Menu_Helpers;
 
+    /* errors and questions from the engine come up as our dialogs */
+    m_mainperf->set_ui( this );
+
     set_icon(Gdk::Pixbuf::create_from_xpm_data(seq42_32_xpm));
 
     /* main window */
@@ -170,6 +168,12 @@ mainwnd::mainwnd(perform *a_p):
                                             sigc::bind(mem_fun(*this, &mainwnd::file_save_as), E_MIDI_SONG_FORMAT, nullptr)));
 
     /* help menu items */
+    if ( global_stats )
+    {
+        m_menu_help->items().push_back(MenuElem("_Statistics...",
+                                                mem_fun(*this, &mainwnd::stats_dialog)));
+    }
+
     m_menu_help->items().push_back(MenuElem("_About...",
                                             mem_fun(*this, &mainwnd::about_dialog)));
 
@@ -550,6 +554,15 @@ mainwnd::mainwnd(perform *a_p):
     m_timeout_connect = Glib::signal_timeout().connect(
                             mem_fun(*this, &mainwnd::timer_callback), 25);
 
+    if ( global_stats && global_stats_file != "" )
+    {
+        Glib::signal_timeout().connect(
+            mem_fun(*this, &mainwnd::stats_file_callback), c_stats_file_interval_ms);
+    }
+
+    Glib::signal_timeout().connect(
+        mem_fun(*this, &mainwnd::journal_callback), c_journal_interval_ms);
+
     m_sigpipe[0] = -1;
     m_sigpipe[1] = -1;
     install_signal_handlers();
@@ -557,6 +570,8 @@ mainwnd::mainwnd(perform *a_p):
 
 mainwnd::~mainwnd()
 {
+    m_mainperf->set_ui( NULL );
+
     delete m_options;
 
     if (m_sigpipe[0] != -1)
@@ -601,7 +616,7 @@ bool mainwnd::setlist_jump(int jmp, bool a_verify)
                 {
                     Glib::ustring message = "Setlist file open error\n";
                     message += m_mainperf->get_setlist_current_file();
-                    m_mainperf->error_message_gtk(message);
+                    m_mainperf->error_message(message);
                     m_mainperf->set_setlist_mode(false);    // abandon ship
                     result = false;
                     break;  
@@ -611,7 +626,7 @@ bool mainwnd::setlist_jump(int jmp, bool a_verify)
             {
                 Glib::ustring message = "Setlist file does not exist\n";
                 message += m_mainperf->get_setlist_current_file();
-                m_mainperf->error_message_gtk(message);
+                m_mainperf->error_message(message);
                 m_mainperf->set_setlist_mode(false);        // abandon ship
                 result = false;
                 break;  
@@ -671,6 +686,8 @@ mainwnd::setlist_verify()
 bool
 mainwnd::timer_callback(  )
 {
+    TRACE_SCOPE( "mainwnd::timer_callback" );
+
     m_perfroll->redraw_dirty_tracks();
     m_perfroll->draw_progress();
     m_perfnames->redraw_dirty_tracks();
@@ -679,6 +696,17 @@ mainwnd::timer_callback(  )
 
     m_main_time->idle_progress( ticks );
 
+    m_mainperf->materialize_ahead();
+
+    /* a damaged lazily loaded sequence only shows up when read in */
+    if ( sequence::take_damaged_count() > 0 )
+    {
+        m_mainperf->error_message( "Some sequences in this file are damaged and could not be read.\n"
+                                   "They are saved back unchanged unless you edit them." );
+    }
+
+    check_save();
+
     /* used on initial file load and during play with tempo changes from markers */
     if ( m_adjust_bpm->get_value() != m_mainperf->get_bpm())
     {
@@ -804,9 +832,9 @@ mainwnd::timer_callback(  )
     /* when in set list mode, tempo stop markers trigger set file increment.
      We have to let the transport completely stop before doing the 
      file loading or strange things happen*/
-    if(m_mainperf->m_setlist_stop_mark && !global_is_running)
+    if(m_mainperf->get_setlist_stop_mark() && !global_is_running)
     {
-        m_mainperf->m_setlist_stop_mark = false;
+        m_mainperf->set_setlist_stop_mark(false);
         setlist_jump(1);    // next file
     }
     
@@ -1372,7 +1400,7 @@ void mainwnd::new_file()
 /* callback function */
 void mainwnd::file_save()
 {
-    save_file();
+    save_file(false);
 }
 
 /* callback function */
@@ -1491,7 +1519,7 @@ void mainwnd::file_save_as(file_type_e type, void *a_seq_or_track)
         {
             global_filename = fname;
             update_window_title();
-            save_file();
+            save_file(false);
         }
         else
         {
@@ -1535,6 +1563,38 @@ void mainwnd::export_midi(const Glib::ustring& fn, file_type_e type, void *a_seq
         last_midi_dir = fn.substr(0, fn.rfind("/") + 1);
 }
 
+void
+mainwnd::error_message( const Glib::ustring& a_message )
+{
+    Gtk::MessageDialog errdialog
+    (
+        a_message,
+        false,
+        Gtk::MESSAGE_ERROR,
+        Gtk::BUTTONS_OK,
+        true
+    );
+    errdialog.run();
+}
+
+bool
+mainwnd::ask_question( const Glib::ustring& a_message )
+{
+    Gtk::MessageDialog warning(a_message,
+                               false,
+                               Gtk::MESSAGE_WARNING, Gtk::BUTTONS_YES_NO, true);
+
+    auto result = warning.run();
+
+    return (result != Gtk::RESPONSE_NO && result != Gtk::RESPONSE_DELETE_EVENT);
+}
+
+void
+mainwnd::quit()
+{
+    Gtk::Main::quit();
+}
+
 void mainwnd::new_open_error_dialog()
 {
     Gtk::MessageDialog errdialog
@@ -1575,6 +1635,29 @@ bool mainwnd::open_file(const Glib::ustring& fn)
             return false;
         }
 
+        /* not during a set, the journal is left for later */
+        if(!m_mainperf->get_setlist_mode())
+        {
+            bool recover = false;
+
+            if(m_mainperf->has_journal(fn))
+            {
+                Gtk::MessageDialog dialog
+                (
+                    *this,
+                    "Changes to '" + fn + "' were not saved before seq42 last quit.\n"
+                    "Recover them?",
+                    false,
+                    Gtk::MESSAGE_QUESTION, Gtk::BUTTONS_YES_NO,
+                    true
+                );
+                recover = (dialog.run() == Gtk::RESPONSE_YES);
+            }
+
+            m_mainperf->journal_open(fn, recover);
+            global_is_modified = recover;
+        }
+
         last_used_dir = fn.substr(0, fn.rfind("/") + 1);
         global_filename = fn;
         
@@ -1689,7 +1772,9 @@ void mainwnd::choose_file(const bool setlist_mode)
     }
 }
 
-bool mainwnd::save_file()
+/* without a_wait the save is written on the save thread and
+   check_save() reports how it went */
+bool mainwnd::save_file(bool a_wait)
 {
     bool result = false;
 
@@ -1699,6 +1784,13 @@ bool mainwnd::save_file()
         return true;
     }
 
+    if (!a_wait)
+    {
+        m_mainperf->save_async(global_filename);
+        global_is_modified = false;
+        return true;
+    }
+
     result = m_mainperf->save(global_filename);
 
     if (result && !m_mainperf->get_setlist_mode())            /* don't list files from setlist */
@@ -1722,6 +1814,56 @@ bool mainwnd::save_file()
     return result;
 }
 
+/* called from the timer while the save thread writes */
+void mainwnd::check_save()
+{
+    Glib::ustring filename;
+    int percent = 0;
+
+    switch (m_mainperf->get_save_state(&filename, &percent))
+    {
+    case SAVE_RUNNING:
+        if (percent != m_save_percent)
+        {
+            m_save_percent = percent;
+            update_window_title();
+        }
+        break;
+
+    case SAVE_DONE:
+        m_save_percent = -1;
+        update_window_title();
+
+        if (!m_mainperf->get_setlist_mode())            /* don't list files from setlist */
+        {
+            m_mainperf->add_recent_file(filename);
+            update_recent_files_menu();
+        }
+        break;
+
+    case SAVE_FAILED:
+    {
+        m_save_percent = -1;
+        update_window_title();
+        global_is_modified = true;
+
+        Gtk::MessageDialog errdialog
+        (
+            *this,
+            "Error writing file.\n" + filename,
+            false,
+            Gtk::MESSAGE_ERROR, Gtk::BUTTONS_OK,
+            true
+        );
+        errdialog.run();
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
 int mainwnd::query_save_changes()
 {
     Glib::ustring query_str;
@@ -1763,6 +1905,7 @@ bool mainwnd::is_save()
                 result = true;
             break;
         case Gtk::RESPONSE_NO:
+            m_mainperf->journal_close(true);    /* the changes are let go */
             result = true;
             break;
         case Gtk::RESPONSE_CANCEL:
@@ -2002,6 +2145,51 @@ mainwnd::about_dialog()
     dialog.run();
 }
 
+/* shows the current --stats numbers, 'Reset' starts over */
+void
+mainwnd::stats_dialog()
+{
+    while ( true )
+    {
+        Gtk::MessageDialog dialog
+        (
+            *this,
+            "Statistics",
+            false,
+            Gtk::MESSAGE_INFO,
+            Gtk::BUTTONS_NONE,
+            true
+        );
+
+        dialog.set_secondary_text( global_perfstats.get_report() +
+                                   m_mainperf->get_memory_report() );
+        dialog.add_button( "_Reset", Gtk::RESPONSE_REJECT );
+        dialog.add_button( "_Refresh", Gtk::RESPONSE_APPLY );
+        dialog.add_button( Gtk::Stock::CLOSE, Gtk::RESPONSE_CLOSE );
+
+        int response = dialog.run();
+
+        if ( response == Gtk::RESPONSE_REJECT )
+            global_perfstats.reset();
+        else if ( response != Gtk::RESPONSE_APPLY )
+            break;
+    }
+}
+
+bool
+mainwnd::stats_file_callback( )
+{
+    global_perfstats.write_file( global_stats_file );
+    return true;
+}
+
+bool
+mainwnd::journal_callback( )
+{
+    m_mainperf->journal_tick();
+    return true;
+}
+
 void
 mainwnd::adj_callback_bpm( )
 {
@@ -2239,6 +2427,9 @@ mainwnd::update_window_title()
                 + string( " - song - " )
                 + Glib::filename_to_utf8(global_filename);
     }
+
+    if (m_save_percent >= 0)
+        title += " - saving " + std::to_string(m_save_percent) + "%";
     
     set_title ( title.c_str());
 }
@@ -2288,6 +2479,15 @@ mainwnd::install_signal_handlers()
         return false;
     }
 
+#ifdef TRACE_SUPPORT
+    /* kill -USR2 dumps the trace rings */
+    if (sigaction(SIGUSR2, &action, NULL) == -1)
+    {
+        printf("sigaction() failed: %s\n", std::strerror(errno));
+        return false;
+    }
+#endif
+
     return true;
 }
 
@@ -2311,11 +2511,16 @@ mainwnd::signal_action(Glib::IOCondition condition)
     switch (message)
     {
     case SIGUSR1:
-        save_file();
+        save_file(false);
         break;
     case SIGINT:
         file_exit();
         break;
+#ifdef TRACE_SUPPORT
+    case SIGUSR2:
+        trace_dump(global_trace_file);
+        break;
+#endif
     default:
         printf("Unexpected signal received: %d\n", message);
         break;
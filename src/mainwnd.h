@@ -46,7 +46,7 @@ class tempo;
 class perfnames;
 class Bpm_spinbutton;
 
-class mainwnd : public Gtk::Window
+class mainwnd : public Gtk::Window, public perform_ui
 {
 private:
 
@@ -142,6 +142,9 @@ private:
     int m_bp_measure;
     int m_bw;
     /* End variables that used to be in perfedit */
+
+    /* how far the save being written has got, -1 when none is */
+    int m_save_percent;
     
     /* tap button - From sequencer64 */
     int m_current_beats; // value is displayed in the button.
@@ -151,6 +154,9 @@ private:
     void file_import_dialog();
     void options_dialog();
     void about_dialog();
+    void stats_dialog();
+    bool stats_file_callback( );
+    bool journal_callback( );
 
     void adj_callback_bpm( );
     void bw_button_callback(int a_beat_width);
@@ -176,7 +182,8 @@ private:
 
     void file_exit();
     void new_file();
-    bool save_file();
+    bool save_file(bool a_wait = true);
+    void check_save();
     void choose_file(bool setlist_mode = false);
     int query_save_changes();
     bool is_save();
@@ -263,5 +270,10 @@ public:
     bool verify_setlist_dialog();
     void setlist_verify();
     friend int FF_RW_timeout(void *arg);
+
+    /* perform_ui, the engine's dialogs */
+    void error_message( const Glib::ustring& a_message );
+    bool ask_question( const Glib::ustring& a_message );
+    void quit();
 };
 
@@ -19,6 +19,8 @@
 //-----------------------------------------------------------------------------
 
 #include "midibus.h"
+#include "perfstats.h"
+#include "trace.h"
 
 #ifdef HAVE_LIBASOUND
 #    include <sys/poll.h>
@@ -52,6 +54,8 @@ midibus::midibus( int a_localclient,
 
     m_queue(a_queue)
 {
+    memset( m_note_bits, 0, sizeof(m_note_bits) );
+
     char name[60];
     if ( global_user_midi_bus_definitions[m_id].alias.length() > 0 )
     {
@@ -75,6 +79,7 @@ midibus::midibus( int a_localclient,
     );
 
     m_name = tmp;
+    m_mutex.set_name( "midibus ", m_name.c_str() );
 }
 
 midibus::midibus( int a_localclient,
@@ -89,6 +94,8 @@ midibus::midibus( int a_localclient,
     m_local_addr_client(a_localclient),
     m_queue(a_queue)
 {
+    memset( m_note_bits, 0, sizeof(m_note_bits) );
+
     /* copy names */
     char tmp[60];
     snprintf
@@ -100,6 +107,7 @@ midibus::midibus( int a_localclient,
     );
 
     m_name = tmp;
+    m_mutex.set_name( "midibus ", m_name.c_str() );
 }
 #endif
 
@@ -111,6 +119,7 @@ midibus::midibus( char a_id, int a_queue )
     m_id = a_id;
     m_clock_type = e_clock_off;
     m_inputing = false;
+    memset( m_note_bits, 0, sizeof(m_note_bits) );
 
     /* copy names */
     char tmp[60];
@@ -123,6 +132,7 @@ midibus::midibus( char a_id, int a_queue )
     );
 
     m_name = tmp;
+    m_mutex.set_name( "midibus ", m_name.c_str() );
 }
 #endif
 
@@ -358,7 +368,7 @@ midibus::~midibus()
 /* takes an native event, encodes to alsa event,
    puts it in the queue */
 void
-midibus::play( event *a_e24, unsigned char a_channel )
+midibus::play( const event *a_e24, unsigned char a_channel )
 {
     lock();
 
@@ -376,6 +386,7 @@ midibus::play( event *a_e24, unsigned char a_channel )
     buffer[0] = a_e24->get_status();
     buffer[0] += (a_channel & 0x0F);
     a_e24->get_data( &buffer[1], &buffer[2] );
+    note_bits_update( buffer[0], buffer[1], buffer[2] );
     snd_midi_event_new( 10, &midi_ev );
 
     /* clear event */
@@ -399,6 +410,98 @@ midibus::play( event *a_e24, unsigned char a_channel )
     unlock();
 }
 
+/* keeps the sounding note map in step with what goes out,
+   a_status has the channel in its low nibble */
+void
+midibus::note_bits_update( unsigned char a_status, unsigned char a_note,
+                           unsigned char a_velocity )
+{
+    unsigned char kind = a_status & 0xF0;
+    unsigned char channel = a_status & 0x0F;
+    uint32_t bit = 1u << (a_note & 0x1F);
+    uint32_t *word = &m_note_bits[channel][(a_note & 0x7F) >> 5];
+
+    if ( kind == EVENT_NOTE_ON && a_velocity > 0 )
+        *word |= bit;
+    else if ( kind == EVENT_NOTE_OFF || kind == EVENT_NOTE_ON )
+        *word &= ~bit;
+}
+
+/* queues a bare note off, caller holds the lock */
+void
+midibus::note_off( unsigned char a_note, unsigned char a_channel )
+{
+#ifdef HAVE_LIBASOUND
+    snd_seq_event_t ev;
+
+    snd_seq_ev_clear( &ev );
+    snd_seq_ev_set_noteoff( &ev, a_channel & 0x0F, a_note & 0x7F, 0 );
+
+    /* set source */
+    snd_seq_ev_set_source(&ev, m_local_addr_port );
+    snd_seq_ev_set_subs(&ev);
+
+    // its immediate
+    snd_seq_ev_set_direct( &ev );
+
+    snd_seq_event_output(m_seq, &ev);
+#endif
+}
+
+bool
+midibus::release_note( unsigned char a_note, unsigned char a_channel )
+{
+    bool sent = false;
+
+    lock();
+
+    uint32_t bit = 1u << (a_note & 0x1F);
+    uint32_t *word = &m_note_bits[a_channel & 0x0F][(a_note & 0x7F) >> 5];
+
+    if ( *word & bit )
+    {
+        *word &= ~bit;
+        note_off( a_note, a_channel );
+        sent = true;
+    }
+
+    unlock();
+
+    return sent;
+}
+
+/* walks only the set bits, so the cost is the number of sounding
+   notes and each one gets exactly one note off */
+int
+midibus::all_notes_off()
+{
+    int count = 0;
+
+    lock();
+
+    for ( int channel = 0; channel < 16; channel++ )
+    {
+        for ( int w = 0; w < c_midibus_note_words; w++ )
+        {
+            uint32_t bits = m_note_bits[channel][w];
+
+            while ( bits )
+            {
+                int b = __builtin_ctz( bits );
+                bits &= bits - 1;
+
+                note_off( (w << 5) + b, channel );
+                count++;
+            }
+            m_note_bits[channel][w] = 0;
+        }
+    }
+
+    unlock();
+
+    return count;
+}
+
 inline long
 min ( long a, long b )
 {
@@ -456,6 +559,8 @@ midibus::sysex( event *a_e24 )
 void
 midibus::flush()
 {
+    TRACE_SCOPE( "midibus::flush" );
+
     lock();
 #ifdef HAVE_LIBASOUND
     snd_seq_drain_output( m_seq );
@@ -733,7 +838,8 @@ mastermidibus::start()
     lock();
 #ifdef HAVE_LIBASOUND
     /* start timer */
-    snd_seq_start_queue( m_alsa_seq, m_queue, NULL );
+    if ( m_alsa_seq != NULL )
+        snd_seq_start_queue( m_alsa_seq, m_queue, NULL );
 
     for ( int i=0; i < m_num_out_buses; i++ )
         m_buses_out[i]->start();
@@ -748,7 +854,8 @@ mastermidibus::continue_from( long a_tick)
     lock();
 #ifdef HAVE_LIBASOUND
     /* start timer */
-    snd_seq_start_queue( m_alsa_seq, m_queue, NULL );
+    if ( m_alsa_seq != NULL )
+        snd_seq_start_queue( m_alsa_seq, m_queue, NULL );
 
     for ( int i=0; i < m_num_out_buses; i++ )
         m_buses_out[i]->continue_from( a_tick );
@@ -777,11 +884,14 @@ mastermidibus::stop()
 
 
 #ifdef HAVE_LIBASOUND
-    snd_seq_drain_output( m_alsa_seq );
-    snd_seq_sync_output_queue( m_alsa_seq );
+    if ( m_alsa_seq != NULL )
+    {
+        snd_seq_drain_output( m_alsa_seq );
+        snd_seq_sync_output_queue( m_alsa_seq );
 
-    /* start timer */
-    snd_seq_stop_queue( m_alsa_seq, m_queue, NULL );
+        /* start timer */
+        snd_seq_stop_queue( m_alsa_seq, m_queue, NULL );
+    }
 #endif
     unlock();
 }
@@ -805,6 +915,12 @@ mastermidibus::set_ppqn( int a_ppqn )
 #ifdef HAVE_LIBASOUND
     m_ppqn = a_ppqn;
 
+    if ( m_alsa_seq == NULL )
+    {
+        unlock();
+        return;
+    }
+
     /* allocate tempo struct */
     snd_seq_queue_tempo_t *tempo;
     snd_seq_queue_tempo_alloca( &tempo );
@@ -828,6 +944,12 @@ mastermidibus::set_bpm( double a_bpm )
 #ifdef HAVE_LIBASOUND
     m_bpm = a_bpm;
 
+    if ( m_alsa_seq == NULL )
+    {
+        unlock();
+        return;
+    }
+
     /* allocate tempo struct */
     snd_seq_queue_tempo_t *tempo;
     snd_seq_queue_tempo_alloca( &tempo );
@@ -847,23 +969,42 @@ mastermidibus::set_bpm( double a_bpm )
 void
 mastermidibus::flush()
 {
+    TRACE_SCOPE( "mastermidibus::flush" );
+
     lock();
 #ifdef HAVE_LIBASOUND
-    snd_seq_drain_output( m_alsa_seq );
+    if ( m_alsa_seq != NULL )
+    {
+        long start_us = global_stats ? perfstats::now_us() : 0;
+
+        snd_seq_drain_output( m_alsa_seq );
+
+        if ( global_stats )
+            global_perfstats.add_drain( perfstats::now_us() - start_us );
+    }
 #endif
     unlock();
 }
 
-/* fills the array with our buses */
-mastermidibus::mastermidibus()
+/* fills the array with our buses. Without a_open no sequencer client
+   is made, for converting files where nothing is played */
+mastermidibus::mastermidibus( bool a_open )
 {
     /* temp return */
     int ret;
 
+    m_mutex.set_name( "mastermidibus" );
+
     /* set initial number buses */
     m_num_out_buses = 0;
     m_num_in_buses = 0;
 
+    m_capture = NULL;
+
+    /* set in init(), deleted by the destructor */
+    m_bus_announce = NULL;
+    m_poll_descriptors = NULL;
+
     for( int i=0; i<c_maxBuses; ++i )
     {
         m_buses_in_active[i] = false;
@@ -876,6 +1017,12 @@ mastermidibus::mastermidibus()
     }
 
 #ifdef HAVE_LIBASOUND
+    m_alsa_seq = NULL;
+    m_queue = 0;
+
+    if ( !a_open )
+        return;
+
     /* open the sequencer client */
     ret = snd_seq_open(&m_alsa_seq, "default",  SND_SEQ_OPEN_DUPLEX, 0);
 
@@ -903,6 +1050,9 @@ void
 mastermidibus::init( )
 {
 #ifdef HAVE_LIBASOUND
+    if ( m_alsa_seq == NULL )
+        return;
+
     /* client info */
     snd_seq_client_info_t *cinfo;
     /* port info */
@@ -1128,6 +1278,9 @@ mastermidibus::~mastermidibus()
     delete[] m_poll_descriptors;
     
 #ifdef HAVE_LIBASOUND
+    if ( m_alsa_seq == NULL )
+        return;
+
     snd_seq_event_t ev;
 
     /* kill timer */
@@ -1146,22 +1299,98 @@ mastermidibus::sysex( event *a_ev )
 {
     lock();
 
-    for ( int i=0; i<m_num_out_buses; i++ )
-        m_buses_out[i]->sysex( a_ev );
+    /* only passed through from the input, it is not part of the song,
+       so a render drops it rather than send it out in the middle */
+    if ( m_capture == NULL )
+    {
+        for ( int i=0; i<m_num_out_buses; i++ )
+            m_buses_out[i]->sysex( a_ev );
+
+        flush();
+    }
 
-    flush();
     unlock();
 }
 
 void
-mastermidibus::play( unsigned char a_bus, event *a_e24, unsigned char a_channel )
+mastermidibus::set_capture( vector < render_event > *a_capture )
 {
     lock();
-    if ( m_buses_out_active[a_bus] && a_bus < m_num_out_buses )
+    m_capture = a_capture;
+    unlock();
+}
+
+/* caller holds the lock */
+void
+mastermidibus::capture( unsigned char a_bus, unsigned char a_status,
+                        unsigned char a_d0, unsigned char a_d1 )
+{
+    render_event e;
+    e.m_bus = a_bus;
+    e.m_status = a_status;
+    e.m_data[0] = a_d0;
+    e.m_data[1] = a_d1;
+
+    m_capture->push_back( e );
+}
+
+void
+mastermidibus::play( unsigned char a_bus, const event *a_e24, unsigned char a_channel )
+{
+    lock();
+    if ( m_capture != NULL )
+    {
+        unsigned char d0, d1;
+        a_e24->get_data( &d0, &d1 );
+        capture( a_bus, a_e24->get_status() + (a_channel & 0x0F), d0, d1 );
+    }
+    else if ( a_bus < m_num_out_buses && m_buses_out_active[a_bus] )
     {
         m_buses_out[a_bus]->play( a_e24, a_channel );
+        global_perfstats.add_bus_event( a_bus );
+    }
+    unlock();
+}
+
+bool
+mastermidibus::release_note( unsigned char a_bus, unsigned char a_note,
+                             unsigned char a_channel )
+{
+    bool sent = false;
+
+    lock();
+    if ( m_capture != NULL )
+    {
+        capture( a_bus, EVENT_NOTE_OFF + (a_channel & 0x0F), a_note, 0 );
+        sent = true;
+    }
+    else if ( a_bus < m_num_out_buses && m_buses_out_active[a_bus] )
+    {
+        sent = m_buses_out[a_bus]->release_note( a_note, a_channel );
     }
     unlock();
+
+    return sent;
+}
+
+void
+mastermidibus::all_notes_off()
+{
+    lock();
+
+    int count = 0;
+
+    for ( int i=0; i < m_num_out_buses; i++ )
+    {
+        if ( m_buses_out_active[i] )
+            count += m_buses_out[i]->all_notes_off();
+    }
+
+    /* everything goes out in one go */
+    if ( count > 0 )
+        flush();
+
+    unlock();
 }
 
 void
@@ -1172,7 +1401,7 @@ mastermidibus::set_clock( unsigned char a_bus, clock_e a_clock_type )
     {
         m_init_clock[a_bus] = a_clock_type;
     }
-    if ( m_buses_out_active[a_bus] && a_bus < m_num_out_buses )
+    if ( a_bus < m_num_out_buses && m_buses_out_active[a_bus] )
     {
         m_buses_out[a_bus]->set_clock( a_clock_type );
     }
@@ -1182,7 +1411,7 @@ mastermidibus::set_clock( unsigned char a_bus, clock_e a_clock_type )
 clock_e
 mastermidibus::get_clock( unsigned char a_bus )
 {
-    if ( m_buses_out_active[a_bus] && a_bus < m_num_out_buses )
+    if ( a_bus < m_num_out_buses && m_buses_out_active[a_bus] )
     {
         return m_buses_out[a_bus]->get_clock();
     }
@@ -1231,7 +1460,7 @@ mastermidibus::get_input( unsigned char a_bus )
 string
 mastermidibus::get_midi_out_bus_name( int a_bus )
 {
-    if ( m_buses_out_active[a_bus] && a_bus < m_num_out_buses )
+    if ( a_bus < m_num_out_buses && m_buses_out_active[a_bus] )
     {
         return m_buses_out[a_bus]->get_name();
     }
@@ -1332,7 +1561,8 @@ mastermidibus::is_more_input( )
     int size=0;
 
 #ifdef HAVE_LIBASOUND
-    size = snd_seq_event_input_pending(m_alsa_seq, 0);
+    if ( m_alsa_seq != NULL )
+        size = snd_seq_event_input_pending(m_alsa_seq, 0);
 #endif
     unlock();
 
@@ -19,6 +19,7 @@
 //-----------------------------------------------------------------------------
 
 #include "midibus_portmidi.h"
+#include "perfstats.h"
 
 #ifdef __WIN32__
 
@@ -38,6 +39,7 @@ midibus::midibus( char a_id, char a_pm_num, const char *a_client_name )
 
     m_name = tmp;
     m_pms = NULL;
+    memset( m_note_bits, 0, sizeof(m_note_bits) );
 }
 
 int
@@ -131,7 +133,7 @@ midibus::~midibus()
 /* takes an native event, encodes to alsa event,
    puts it in the queue */
 void
-midibus::play( event *a_e24, unsigned char a_channel )
+midibus::play( const event *a_e24, unsigned char a_channel )
 {
     lock();
 
@@ -145,6 +147,7 @@ midibus::play( event *a_e24, unsigned char a_channel )
     buffer[0] = a_e24->get_status();
     buffer[0] += (a_channel & 0x0F);
     a_e24->get_data( &buffer[1], &buffer[2] );
+    note_bits_update( buffer[0], buffer[1], buffer[2] );
 
     event.message = Pm_Message(buffer[0], buffer[1], buffer[2]);
 
@@ -153,6 +156,84 @@ midibus::play( event *a_e24, unsigned char a_channel )
     unlock();
 }
 
+void
+midibus::note_bits_update( unsigned char a_status, unsigned char a_note,
+                           unsigned char a_velocity )
+{
+    unsigned char kind = a_status & 0xF0;
+    unsigned char channel = a_status & 0x0F;
+    uint32_t bit = 1u << (a_note & 0x1F);
+    uint32_t *word = &m_note_bits[channel][(a_note & 0x7F) >> 5];
+
+    if ( kind == EVENT_NOTE_ON && a_velocity > 0 )
+        *word |= bit;
+    else if ( kind == EVENT_NOTE_OFF || kind == EVENT_NOTE_ON )
+        *word &= ~bit;
+}
+
+void
+midibus::note_off( unsigned char a_note, unsigned char a_channel )
+{
+    PmEvent event;
+    event.timestamp = 0;
+    event.message = Pm_Message( EVENT_NOTE_OFF + (a_channel & 0x0F),
+                                a_note & 0x7F, 0 );
+
+    Pm_Write( m_pms, &event, 1 );
+}
+
+bool
+midibus::release_note( unsigned char a_note, unsigned char a_channel )
+{
+    bool sent = false;
+
+    lock();
+
+    uint32_t bit = 1u << (a_note & 0x1F);
+    uint32_t *word = &m_note_bits[a_channel & 0x0F][(a_note & 0x7F) >> 5];
+
+    if ( *word & bit )
+    {
+        *word &= ~bit;
+        note_off( a_note, a_channel );
+        sent = true;
+    }
+
+    unlock();
+
+    return sent;
+}
+
+int
+midibus::all_notes_off()
+{
+    int count = 0;
+
+    lock();
+
+    for ( int channel = 0; channel < 16; channel++ )
+    {
+        for ( int w = 0; w < c_midibus_note_words; w++ )
+        {
+            uint32_t bits = m_note_bits[channel][w];
+
+            while ( bits )
+            {
+                int b = __builtin_ctz( bits );
+                bits &= bits - 1;
+
+                note_off( (w << 5) + b, channel );
+                count++;
+            }
+            m_note_bits[channel][w] = 0;
+        }
+    }
+
+    unlock();
+
+    return count;
+}
+
 inline long
 min ( long a, long b )
 {
@@ -427,12 +508,14 @@ mastermidibus::flush()
 }
 
 /* fills the array with our buses */
-mastermidibus::mastermidibus()
+mastermidibus::mastermidibus( bool a_open )
 {
     /* set initial number buses */
     m_num_out_buses = 0;
     m_num_in_buses = 0;
 
+    m_capture = NULL;
+
     for( int i=0; i<c_maxBuses; ++i )
     {
         m_buses_in_active[i] = false;
@@ -530,22 +613,92 @@ mastermidibus::sysex( event *a_ev )
 {
     lock();
 
-    for ( int i=0; i<m_num_out_buses; i++ )
-        m_buses_out[i]->sysex( a_ev );
+    /* only passed through from the input, it is not part of the song,
+       so a render drops it rather than send it out in the middle */
+    if ( m_capture == NULL )
+    {
+        for ( int i=0; i<m_num_out_buses; i++ )
+            m_buses_out[i]->sysex( a_ev );
+
+        flush();
+    }
 
-    flush();
     unlock();
 }
 
 void
-mastermidibus::play( unsigned char a_bus, event *a_e24, unsigned char a_channel )
+mastermidibus::set_capture( vector < render_event > *a_capture )
 {
     lock();
-    if ( m_buses_out_active[a_bus] && a_bus < m_num_out_buses )
+    m_capture = a_capture;
+    unlock();
+}
+
+/* caller holds the lock */
+void
+mastermidibus::capture( unsigned char a_bus, unsigned char a_status,
+                        unsigned char a_d0, unsigned char a_d1 )
+{
+    render_event e;
+    e.m_bus = a_bus;
+    e.m_status = a_status;
+    e.m_data[0] = a_d0;
+    e.m_data[1] = a_d1;
+
+    m_capture->push_back( e );
+}
+
+void
+mastermidibus::play( unsigned char a_bus, const event *a_e24, unsigned char a_channel )
+{
+    lock();
+    if ( m_capture != NULL )
+    {
+        unsigned char d0, d1;
+        a_e24->get_data( &d0, &d1 );
+        capture( a_bus, a_e24->get_status() + (a_channel & 0x0F), d0, d1 );
+    }
+    else if ( a_bus < m_num_out_buses && m_buses_out_active[a_bus] )
     {
         m_buses_out[a_bus]->play( a_e24, a_channel );
+        global_perfstats.add_bus_event( a_bus );
+    }
+    unlock();
+}
+
+bool
+mastermidibus::release_note( unsigned char a_bus, unsigned char a_note,
+                             unsigned char a_channel )
+{
+    bool sent = false;
+
+    lock();
+    if ( m_capture != NULL )
+    {
+        capture( a_bus, EVENT_NOTE_OFF + (a_channel & 0x0F), a_note, 0 );
+        sent = true;
+    }
+    else if ( a_bus < m_num_out_buses && m_buses_out_active[a_bus] )
+    {
+        sent = m_buses_out[a_bus]->release_note( a_note, a_channel );
     }
     unlock();
+
+    return sent;
+}
+
+void
+mastermidibus::all_notes_off()
+{
+    lock();
+
+    for ( int i=0; i < m_num_out_buses; i++ )
+    {
+        if ( m_buses_out_active[i] )
+            m_buses_out[i]->all_notes_off();
+    }
+
+    unlock();
 }
 
 void
@@ -556,7 +709,7 @@ mastermidibus::set_clock( unsigned char a_bus, clock_e a_clock_type )
     {
         m_init_clock[a_bus] = a_clock_type;
     }
-    if ( m_buses_out_active[a_bus] && a_bus < m_num_out_buses )
+    if ( a_bus < m_num_out_buses && m_buses_out_active[a_bus] )
     {
         m_buses_out[a_bus]->set_clock( a_clock_type );
     }
@@ -566,7 +719,7 @@ mastermidibus::set_clock( unsigned char a_bus, clock_e a_clock_type )
 clock_e
 mastermidibus::get_clock( unsigned char a_bus )
 {
-    if ( m_buses_out_active[a_bus] && a_bus < m_num_out_buses )
+    if ( a_bus < m_num_out_buses && m_buses_out_active[a_bus] )
     {
         return m_buses_out[a_bus]->get_clock();
     }
@@ -615,7 +768,7 @@ mastermidibus::get_input( unsigned char a_bus )
 string
 mastermidibus::get_midi_out_bus_name( int a_bus )
 {
-    if ( m_buses_out_active[a_bus] && a_bus < m_num_out_buses )
+    if ( a_bus < m_num_out_buses && m_buses_out_active[a_bus] )
     {
         return m_buses_out[a_bus]->get_name();
     }
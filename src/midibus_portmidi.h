@@ -26,6 +26,8 @@ class mastermidibus;
 #ifdef __WIN32__
 
 #include <string>
+#include <stdint.h>
+#include <string.h>
 
 #include "portmidi.h"
 #include "event.h"
@@ -37,6 +39,30 @@ const int c_midibus_output_size = 0x100000;
 const int c_midibus_input_size =  0x100000;
 const int c_midibus_sysex_chunk = 0x100;
 
+/* 128 notes per channel, 32 per word */
+const int c_midibus_note_words = 4;
+
+/* one event as it left the output stage, see perform::render(). The
+   bus fills in bus, status (with channel) and data, perform the times.
+   m_status 0xFF is a tempo change to m_bpm */
+struct render_event
+{
+    long m_tick;            /* song position */
+    long m_render_tick;     /* ticks since the render started, keeps counting through loops */
+    double m_time_us;
+    unsigned char m_bus;
+    unsigned char m_status;
+    unsigned char m_data[2];
+    double m_bpm;
+
+    render_event() :
+        m_tick(0), m_render_tick(0), m_time_us(0.0),
+        m_bus(0), m_status(0), m_bpm(0.0)
+    {
+        m_data[0] = m_data[1] = 0;
+    }
+};
+
 enum clock_e
 {
     e_clock_off,
@@ -63,6 +89,13 @@ private:
     /* last tick */
     long m_lasttick;
 
+    /* one bit per sounding note, per channel */
+    uint32_t m_note_bits[16][c_midibus_note_words];
+
+    void note_bits_update( unsigned char a_status, unsigned char a_note,
+                           unsigned char a_velocity );
+    void note_off( unsigned char a_note, unsigned char a_channel );
+
     /* locking */
     seq42_mutex m_mutex;
 
@@ -88,7 +121,7 @@ public:
     int get_id();
 
     /* puts an event in the queue */
-    void play( event *a_e24, unsigned char a_channel );
+    void play( const event *a_e24, unsigned char a_channel );
     void sysex( event *a_e24 );
 
     int poll_for_midi( );
@@ -108,6 +141,9 @@ public:
     void flush();
     //void remove_queued_on_events( int a_tag );
 
+    bool release_note( unsigned char a_note, unsigned char a_channel );
+    int all_notes_off();
+
     /* master midi bus sets up the bus */
     friend class mastermidibus;
 
@@ -167,6 +203,12 @@ private:
     sequence *m_seq;
     vector < sequence *> m_vector_sequence;
 
+    /* when set, play() appends here instead of sending */
+    vector < render_event > *m_capture;
+
+    void capture( unsigned char a_bus, unsigned char a_status,
+                  unsigned char a_d0, unsigned char a_d1 );
+
     /* locking */
     seq42_mutex m_mutex;
 
@@ -176,7 +218,8 @@ private:
 
 public:
 
-    mastermidibus();
+    /* portmidi opens no device before init(), so a_open changes nothing */
+    mastermidibus( bool a_open = true );
     ~mastermidibus();
     //midibus *get_default_bus();
     //midibus *get_bus( int a_bus );
@@ -230,7 +273,14 @@ public:
 
     void sysex( event *a_event );
 
-    void play( unsigned char a_bus, event *a_e24, unsigned char a_channel );
+    void play( unsigned char a_bus, const event *a_e24, unsigned char a_channel );
+
+    /* offline rendering, NULL goes back to the ports */
+    void set_capture( vector < render_event > *a_capture );
+
+    bool release_note( unsigned char a_bus, unsigned char a_note,
+                       unsigned char a_channel );
+    void all_notes_off();
 
     void set_clock( unsigned char a_bus, clock_e a_clock_type );
     clock_e get_clock( unsigned char a_bus );
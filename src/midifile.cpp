@@ -20,12 +20,14 @@
 
 #include "midifile.h"
 #include <iostream>
-#include <gtkmm/messagedialog.h>
 #include <math.h>
+#include <thread>
 
 midifile::midifile(const Glib::ustring& a_name) :
     m_pos(0),
-    m_name(a_name)
+    m_name(a_name),
+    m_d(NULL),
+    m_size(0)
 {
 }
 
@@ -58,9 +60,13 @@ midifile::read_short ()
     return ret;
 }
 
+/* past the end of the file reads as 0 */
 unsigned char
 midifile::read_byte ()
 {
+    if (m_pos >= m_size)
+        return 0;
+
     return m_d[m_pos++];
 }
 
@@ -86,493 +92,622 @@ midifile::read_var ()
     return ret;
 }
 
-bool midifile::parse (perform * a_perf, int screen_set)
+/* reads one MTrk chunk, nothing past its end. Like midifile's own
+   readers, past the end reads as 0 */
+class midi_track_reader
 {
-    /* open binary file */
-    ifstream file(m_name.c_str(), ios::in | ios::binary | ios::ate);
 
-    if (!file.is_open ())
+private:
+
+    const unsigned char *m_d;
+    unsigned long m_size;
+    unsigned long m_pos;
+
+public:
+
+    midi_track_reader( const unsigned char *a_data, unsigned long a_size ) :
+        m_d(a_data),
+        m_size(a_size),
+        m_pos(0)
     {
-        a_perf->error_message_gtk("Error opening MIDI file");
-        return false;
     }
 
-    unsigned int file_size = file.tellg ();
+    bool at_end()
+    {
+        return m_pos >= m_size;
+    }
 
-    if(file_size < sizeof(unsigned long))
+    unsigned char peek_byte()
     {
-        Glib::ustring message = "Error - Invalid file size: ";
-        message += NumberToString(file_size);
-        a_perf->error_message_gtk(message);
-        file.close ();
-        return false;
+        return at_end() ? 0 : m_d[m_pos];
     }
 
-    /* run to start */
-    file.seekg (0, ios::beg);
+    unsigned char read_byte()
+    {
+        return at_end() ? 0 : m_d[m_pos++];
+    }
 
-    /* alloc data */
-    try
+    unsigned short read_short()
     {
-        m_d.resize(file_size);
+        unsigned short ret = read_byte() << 8;
+        return ret + read_byte();
     }
-    catch(std::bad_alloc& ex)
+
+    unsigned long read_long()
     {
-        a_perf->error_message_gtk("Memory allocation failed");
-        return false;
+        unsigned long ret = (unsigned long) read_byte() << 24;
+        ret += read_byte() << 16;
+        ret += read_byte() << 8;
+        return ret + read_byte();
     }
-    file.read ((char *) &m_d[0], file_size);
-    file.close ();
-    
-    /* for import tempo, time signature verify change */
-    long bp_measure = a_perf->get_bp_measure();
-    long bw = a_perf->get_bw();
-    double bpm = a_perf->get_start_tempo();
 
-    /* set position to 0 */
-    m_pos = 0;
+    unsigned long read_var()
+    {
+        unsigned long ret = 0;
+        unsigned char c;
 
-    /* chunk info */
-    unsigned long ID;
-    unsigned long TrackLength;
+        while (((c = read_byte()) & 0x80) != 0x00 && !at_end())
+            ret = (ret << 7) + (c & 0x7F);
 
-    /* time */
-    unsigned long Delta;
-    unsigned long RunningTime;
-    unsigned long CurrentTime;
+        return (ret << 7) + (c & 0x7F);
+    }
 
-    unsigned short Format;			/* 0,1,2 */
-    unsigned short NumTracks;
-    unsigned short ppqn;
+    void skip( unsigned long a_len )
+    {
+        m_pos = ( a_len < m_size - m_pos ) ? m_pos + a_len : m_size;
+    }
+};
 
-    /* track name from file */
-    char TrackName[256];
+/* builds the seq42 track for chunk a_index of a_job. It runs on the
+   decode threads, so it only touches the track it builds and the
+   result, anything for the perform is left in the result */
+void
+midifile::decode_track( midi_decode_job *a_job, unsigned a_index )
+{
+    midi_track_result &result = a_job->m_results[a_index];
 
-    /* used in small loops */
-    int i;
+    /* magic number 'MTrk' */
+    if (a_job->m_id[a_index] != 0x4D54726B)
+        return;
 
-    /* track pointer */
-    track * a_track;
-    event e;
+    midi_track_reader r(m_d + a_job->m_start[a_index], a_job->m_size[a_index]);
 
-    /* read in header */
-    ID = read_long ();
-    TrackLength = read_long ();
-    Format = read_short ();
-    NumTracks = read_short ();
-    ppqn = read_short ();
+    unsigned short ppqn = a_job->m_ppqn;
+    bool done = false;
 
-    //printf( "[%8lX] len[%ld] fmt[%d] num[%d] ppqn[%d]\n",
-    //      ID, TrackLength, Format, NumTracks, ppqn );
+    /* events */
+    unsigned char status = 0, type, data[2], laststatus;
+    long len;
+    unsigned long proprietary = 0;
 
-    /* magic number 'MThd' */
-    if (ID != 0x4D546864)
-    {
-        Glib::ustring message = "Invalid MIDI header detected: ";
-        message += Ulong_To_String_Hex(ID);
-        a_perf->error_message_gtk(message);
-        return false;
-    }
+    /* time */
+    unsigned long Delta = 0;
+    unsigned long RunningTime = 0;
+    unsigned long CurrentTime = 0;
 
-    /* we are only supporting format 1 for now */
-    if (Format != 1)
-    {
-        Glib::ustring message = "Unsupported MIDI format detected: ";
-        message += NumberToString(Format);
-        a_perf->error_message_gtk(message);
-        return false;
-    }
+    /* track name from file */
+    char TrackName[256];
 
-    /* We should be good to load now   */
-    a_perf->push_perf_undo(true);   // true for import file
+    event e;
 
-    /* seq24 screen set import */
-    int screen_set_start = 0;
-    unsigned short Track_End = NumTracks;
-    if(screen_set >= 0)
-    {
-        screen_set_start = screen_set * SEQ24_SCREEN_SET_SIZE;
+    /* we know we have a good track, so we can create
+       a new seq42 track to dump it */
+    track *a_track = new track();
+    result.m_track = a_track;
 
-        if((screen_set_start + SEQ24_SCREEN_SET_SIZE) < Track_End)
-            Track_End = screen_set_start + SEQ24_SCREEN_SET_SIZE;
-    }
+    a_track->set_name((char*)"Midi Import");
+    a_track->set_master_midi_bus (&a_job->m_perf->m_master_bus);
 
-    /* for each Track in the midi file */
-    int track_count = 0; // necessary for screen set offset
+    int seq_idx = a_track->new_sequence();
+    sequence *seq = a_track->get_sequence(seq_idx);
+
+    /* most events are a delta and two or three bytes, grow once,
+       sort_events() gives back what was not used */
+    seq->reserve_events(a_job->m_size[a_index] / 3);
 
-    for (int curTrack = 0; curTrack < NumTracks; curTrack++)
+    /* this gets each event in the Trk */
+    while (!done)
     {
-        /* done for each track */
-        bool done = false;
+        /* no end of track event, end it after the last one */
+        if (r.at_end())
+        {
+            seq->sort_events();
+            seq->set_length (CurrentTime, false);
+            break;
+        }
 
-        /* events */
-        unsigned char status = 0, type, data[2], laststatus;
-        long len;
-        unsigned long proprietary = 0;
+        /* get time delta */
+        Delta = r.read_var ();
 
-        /* Get ID + Length */
-        ID = read_long ();
-        TrackLength = read_long ();
-        //printf( "[%8lX] len[%8lX]\n", ID,  TrackLength );
+        /* get status */
+        laststatus = status;
+        status = r.peek_byte();
 
-        /* Seq24 import using screen set */
-        if(track_count >= c_max_track || curTrack >= Track_End ||
-           (screen_set >= 0 && track_count >= (SEQ24_SCREEN_SET_SIZE - 1)))
+        /* is it a status bit ? */
+        if ((status & 0x80) == 0x00)
         {
-            m_pos += TrackLength; // eat the unused tracks
-            continue;
+            /* no, its a running status */
+            status = laststatus;
         }
-
-        /* magic number 'MTrk' */
-        if (ID == 0x4D54726B)
+        else
         {
-            /* we know we have a good track, so we can create
-               a new seq42 track to dump it */
+            /* its a status, increment */
+            r.read_byte();
+        }
 
-            a_track = new track();
+        /* set the members in event */
+        e.set_status (status);
 
-            if (a_track == NULL)
+        RunningTime += Delta;
+        /* current time is ppqn according to the file,
+           we have to adjust it to our own ppqn.
+           PPQN / ppqn gives us the ratio */
+        CurrentTime = (RunningTime * c_ppqn) / ppqn;
+
+        e.set_timestamp (CurrentTime);
+
+        /* switch on the channelless status */
+        switch (status & 0xF0)
+        {
+        /* case for those with 2 data bytes */
+        case EVENT_NOTE_OFF:
+        case EVENT_NOTE_ON:
+        case EVENT_AFTERTOUCH:
+        case EVENT_CONTROL_CHANGE:
+        case EVENT_PITCH_WHEEL:
+            data[0] = r.read_byte ();
+            data[1] = r.read_byte ();
+
+            // some files have vel=0 as note off
+            if ((status & 0xF0) == EVENT_NOTE_ON && data[1] == 0)
             {
-                a_perf->error_message_gtk("Memory allocation failed");
-                return false;
+                e.set_status (EVENT_NOTE_OFF);
             }
 
-            a_track->set_name((char*)"Midi Import");
-            a_track->set_master_midi_bus (&a_perf->m_master_bus);
+            /* set data and add */
+            e.set_data (data[0], data[1]);
+            seq->add_event_no_sort (&e);                                // for speed will be sorted later at track end (case 0x2f)
 
-            int seq_idx = a_track->new_sequence();
-            sequence *seq = a_track->get_sequence(seq_idx);
+            /* set midi channel */
+            a_track->set_midi_channel (status & 0x0F);
+            break;
+        /* one data item */
+        case EVENT_PROGRAM_CHANGE:
+        case EVENT_CHANNEL_PRESSURE:
+            data[0] = r.read_byte ();
 
-            /* reset time */
-            RunningTime = 0;
+            /* set data and add */
+            e.set_data (data[0]);
+            seq->add_event_no_sort (&e);                                // for speed will be sorted later at track end (case 0x2f)
 
-            /* this gets each event in the Trk */
-            while (!done)
+            /* set midi channel */
+            a_track->set_midi_channel (status & 0x0F);
+            break;
+        /* meta midi events ---  this should be FF !!!!!  */
+        case 0xF0:
+            if (status == 0xFF)
             {
-                /* get time delta */
-                Delta = read_var ();
-
-                /* get status */
-                laststatus = status;
-                status = m_d[m_pos];
+                // get meta type
+                type = r.read_byte ();
+                len = r.read_var ();
 
-                /* is it a status bit ? */
-                if ((status & 0x80) == 0x00)
-                {
-                    /* no, its a running status */
-                    status = laststatus;
-                }
-                else
+                switch (type)
                 {
-                    /* its a status, increment */
-                    m_pos++;
-                }
-
-                /* set the members in event */
-                e.set_status (status);
-
-                RunningTime += Delta;
-                /* current time is ppqn according to the file,
-                   we have to adjust it to our own ppqn.
-                   PPQN / ppqn gives us the ratio */
-                CurrentTime = (RunningTime * c_ppqn) / ppqn;
+                // proprietary
+                case 0x7f:
 
-                //printf( "D[%6ld] [%6ld] %02X\n", Delta, CurrentTime, status);
-                e.set_timestamp (CurrentTime);
+                    // FF 7F len data
+                    if (len > 4)
+                    {
+                        proprietary = r.read_long ();
+                        len -= 4;
+                    }
 
-                /* switch on the channelless status */
-                switch (status & 0xF0)
-                {
-                /* case for those with 2 data bytes */
-                case EVENT_NOTE_OFF:
-                case EVENT_NOTE_ON:
-                case EVENT_AFTERTOUCH:
-                case EVENT_CONTROL_CHANGE:
-                case EVENT_PITCH_WHEEL:
-                    data[0] = read_byte ();
-                    data[1] = read_byte ();
-
-                    // some files have vel=0 as note off
-                    if ((status & 0xF0) == EVENT_NOTE_ON && data[1] == 0)
+                    if (proprietary == c_midibus)
+                    {
+                        a_track->set_midi_bus (r.read_byte ());
+                        len--;
+                    }
+                    else if (proprietary == c_midich)
+                    {
+                        a_track->set_midi_channel (r.read_byte ());
+                        len--;
+                    }
+                    else if (proprietary == c_timesig)
+                    {
+                        seq->set_bp_measure (r.read_byte ());
+                        seq->set_bw (r.read_byte ());
+                        len -= 2;
+                    }
+                    else if (proprietary == c_transpose)
                     {
-                        e.set_status (EVENT_NOTE_OFF);
+                        a_track->set_transposable (r.read_byte ());
+                        len--;
                     }
+                    else if (proprietary == c_triggers)
+                    {
+                        int num_triggers = len / 4;
+
+                        for (int i = 0; i < num_triggers; i += 2)
+                        {
+                            unsigned long on = r.read_long ();
+                            unsigned long length = (r.read_long () - on);
+                            len -= 8;
+                            a_track->add_trigger(on, length, 0, false);
+                        }
+                    }
+                    else if (proprietary == c_triggers_new)
+                    {
+                        int num_triggers = len / 12;
 
-                    //printf( "%02X %02X\n", data[0], data[1] );
+                        for (int i = 0; i < num_triggers; i++)
+                        {
+                            unsigned long on = r.read_long ();
+                            unsigned long off = r.read_long ();
+                            unsigned long length = off - on + 1;
+                            unsigned long offset = r.read_long ();
 
-                    /* set data and add */
-                    e.set_data (data[0], data[1]);
-                    seq->add_event_no_sort (&e);                                // for speed will be sorted later at track end (case 0x2f)
+                            len -= 12;
+                            a_track->add_trigger (on, length, offset, false);
+                        }
+                    }
 
-                    /* set midi channel */
-                    a_track->set_midi_channel (status & 0x0F);
+                    /* eat the rest */
+                    if (len > 0)
+                        r.skip(len);
                     break;
-                /* one data item */
-                case EVENT_PROGRAM_CHANGE:
-                case EVENT_CHANNEL_PRESSURE:
-                    data[0] = read_byte ();
-                    //printf( "%02X\n", data[0] );
-
-                    /* set data and add */
-                    e.set_data (data[0]);
-                    seq->add_event_no_sort (&e);                                // for speed will be sorted later at track end (case 0x2f)
-
-                    /* set midi channel */
-                    a_track->set_midi_channel (status & 0x0F);
-                    break;
-                /* meta midi events ---  this should be FF !!!!!  */
-                case 0xF0:
-                    if (status == 0xFF)
+
+                case 0x58:    /* Time Signature  bp_measure / bw */
+                    /*
+                        If the midi file contains both proprietary (c_timesig)
+                        and Midi type 0x58 then it came from seq42 or seq32.
+                        In this case the Midi type is parsed first (because it is listed first)
+                        then it gets overwritten by the proprietary, above.
+                    */
+                    if (len == 4)
                     {
-                        // get meta type
-                        type = read_byte ();
-                        len = read_var ();
+                        long import_bp_measure = long(r.read_byte());   // nn
+                        int logbase2 = int(r.read_byte());              // dd
 
-                        //printf( "%02X %08X ", type, (int) len );
+                        r.read_byte();                                  // cc eat it
+                        r.read_byte();                                  // bb eat it
 
-                        switch (type)
-                        {
-                        // proprietary
-                        case 0x7f:
-
-                            // FF 7F len data
-                            if (len > 4)
-                            {
-                                proprietary = read_long ();
-                                len -= 4;
-                            }
-
-                            if (proprietary == c_midibus)
-                            {
-                                a_track->set_midi_bus (read_byte ());
-                                len--;
-                            }
-                            else if (proprietary == c_midich)
-                            {
-                                a_track->set_midi_channel (read_byte ());
-                                len--;
-                            }
-                            else if (proprietary == c_timesig)
-                            {
-                                seq->set_bp_measure (read_byte ());
-                                seq->set_bw (read_byte ());
-                                len -= 2;
-                            }
-                            else if (proprietary == c_transpose)
-                            {
-                                a_track->set_transposable (read_byte ());
-                                len--;
-                            }
-                            else if (proprietary == c_triggers)
-                            {
-                                int num_triggers = len / 4;
-
-                                for (int i = 0; i < num_triggers; i += 2)
-                                {
-                                    unsigned long on = read_long ();
-                                    unsigned long length = (read_long () - on);
-                                    len -= 8;
-                                    a_track->add_trigger(on, length, 0, false);
-                                }
-                            }
-                            else if (proprietary == c_triggers_new)
-                            {
-                                int num_triggers = len / 12;
-
-                                //printf( "num_triggers[%d]\n", num_triggers );
-                                for (int i = 0; i < num_triggers; i++)
-                                {
-                                    unsigned long on = read_long ();
-                                    unsigned long off = read_long ();
-                                    unsigned long length = off - on + 1;
-                                    unsigned long offset = read_long ();
-
-                                    //printf( "< start[%d] end[%d] offset[%d]\n",
-                                    //        on, off, offset );
-
-                                    len -= 12;
-                                    a_track->add_trigger (on, length, offset, false);
-                                }
-                            }
-
-                            /* eat the rest */
-                            m_pos += len;
-                            break;
-
-                        case 0x58:    /* Time Signature  bp_measure / bw */
-                            /*
-                                If the midi file contains both proprietary (c_timesig)
-                                and Midi type 0x58 then it came from seq42 or seq32.
-                                In this case the Midi type is parsed first (because it is listed first)
-                                then it gets overwritten by the proprietary, above.
-                            */
-                            if (len == 4)
-                            {
-                                long import_bp_measure = long(read_byte());     // nn
-                                int logbase2 = int(read_byte());                // dd
-
-                                read_byte();                                    // cc eat it
-                                read_byte();                                    // bb eat it
-
-                                long import_bw = long(pow2(logbase2));          // convert dd to bw
-
-                                if(import_bp_measure == 0 || import_bw == 0)    // spec assumes 4 x 4 as we do
-                                    break;
-
-                                if(curTrack == 0)                               // set for main perform if first track
-                                {
-                                    bp_measure = import_bp_measure;             // these will be checked for user approval if different
-                                    bw = import_bw;                             // from current project amounts along with bpm
-                                }
-
-                                seq->set_bp_measure(import_bp_measure);         // sets the sequence always
-                                seq->set_bw(import_bw);
-
-                                /*printf
-                                (
-                                   "Time Signature set to %d/%d\n",
-                                    int(seq->get_bp_measure()),
-                                    int(seq->get_bw())
-                                );*/
-                            }
-                            else
-                                m_pos += len;           /* eat it           */
-                            break;
+                        long import_bw = long(pow2(logbase2));          // convert dd to bw
 
-                        case 0x51:                      /* Set Tempo  = bpm      */
-                            if (len == 3)
-                            {
-                                unsigned tempo = unsigned(read_byte());
-                                tempo = (tempo * 256) + unsigned(read_byte());
-                                tempo = (tempo * 256) + unsigned(read_byte());
-                                //printf("tempo %d\n",tempo);
-                                if(tempo == 0 || curTrack != 0)          /* Midi spec & seq42 assumes 120 bpm if tempo == 0 */
-                                    break;                               /* If not first track don't use because we
-                                                                            don't support tempo change */
-
-                                bpm = (double) 60000000.0 / tempo;              // this will be checked for user approval with time signature
-                                //printf("BPM (SMF) set to %f\n", bpm);
-                            }
-                            else
-                                m_pos += len;           /* eat it           */
+                        if(import_bp_measure == 0 || import_bw == 0)    // spec assumes 4 x 4 as we do
                             break;
 
-                        /* Trk Done */
-                        case 0x2f:
-
-                            // If delta is 0, then another event happened at the same time
-                            // as the track end.  the sequence class will discard the last
-                            // note.  This is a fix for that.   Native Seq42 file will always
-                            // have a Delta >= 1
-                            if ( Delta == 0 )
-                            {
-                                CurrentTime += 1;
-                            }
-
-                            seq->sort_events();                                 // sort now after all events added
-                            
-                            seq->set_length (CurrentTime, false);
-                            seq->zero_markers ();
-                            done = true;
-                            break;
+                        /* used for main perform if first track */
+                        result.m_has_timesig = true;
+                        result.m_bp_measure = import_bp_measure;
+                        result.m_bw = import_bw;
 
-                        /* Track name */
-                        case 0x03:
-                            for (i = 0; i < len; i++)
-                            {
-                                TrackName[i] = read_byte ();
-                            }
+                        seq->set_bp_measure(import_bp_measure);         // sets the sequence always
+                        seq->set_bw(import_bw);
+                    }
+                    else
+                        r.skip(len);            /* eat it           */
+                    break;
 
-                            TrackName[i] = '\0';
+                case 0x51:                      /* Set Tempo  = bpm      */
+                    if (len == 3)
+                    {
+                        unsigned tempo = unsigned(r.read_byte());
+                        tempo = (tempo * 256) + unsigned(r.read_byte());
+                        tempo = (tempo * 256) + unsigned(r.read_byte());
 
-                            //printf("Import track: [%s]\n", TrackName );
-                            seq->set_name (TrackName);
+                        if(tempo == 0)                                  /* Midi spec & seq42 assumes 120 bpm if tempo == 0 */
                             break;
 
-                        /* sequence number */
-                        case 0x00:
-                            if (len == 0x00)
-                                track_count = 0;
-                            else
-                            {
-                                int seq_number = read_short();
-                                //printf ( "seq_number[%d]\n",  seq_number );
-                                if(screen_set >= 0)
-                                {
-                                    seq_number -= (screen_set * 32);
-                                }
-                                track_count = seq_number;
-                            }
-
-                            //printf ( "track_count [%d]\n", track_count );
+                        /* used if first track, we don't support tempo change */
+                        result.m_has_tempo = true;
+                        result.m_bpm = (double) 60000000.0 / tempo;
+                    }
+                    else
+                        r.skip(len);            /* eat it           */
+                    break;
 
-                            break;
+                /* Trk Done */
+                case 0x2f:
 
-                        default:
-                            for (i = 0; i < len; i++)
-                            {
-                                read_byte();
-                            }
-                            break;
-                        }
-                    }
-                    else if(status == 0xF0)
+                    // If delta is 0, then another event happened at the same time
+                    // as the track end.  the sequence class will discard the last
+                    // note.  This is a fix for that.   Native Seq42 file will always
+                    // have a Delta >= 1
+                    if ( Delta == 0 )
                     {
-                        /* sysex */
-                        len = read_var ();
+                        CurrentTime += 1;
+                    }
+
+                    seq->sort_events();                                 // sort now after all events added
 
-                        /* skip it */
-                        m_pos += len;
+                    seq->set_length (CurrentTime, false);
+                    seq->zero_markers ();
+                    done = true;
+                    break;
 
-                        fprintf(stderr, "Warning, no support for SYSEX messages, discarding.\n");
+                /* Track name */
+                case 0x03:
+                {
+                    int i;
+                    for (i = 0; i < len && i < (int) sizeof(TrackName) - 1; i++)
+                    {
+                        TrackName[i] = r.read_byte ();
                     }
+
+                    TrackName[i] = '\0';
+                    r.skip(len - i);
+
+                    seq->set_name (TrackName);
+                    break;
+                }
+
+                /* sequence number */
+                case 0x00:
+                    result.m_has_track_count = true;
+
+                    if (len == 0x00)
+                        result.m_track_count = 0;
                     else
                     {
-                        //fprintf(stderr, "Unexpected system event : 0x%.2X", status);
-                        Glib::ustring message = "Unexpected system event : ";
-                        message += Ulong_To_String_Hex((unsigned long)status);
-                        a_perf->error_message_gtk(message);
-                        return false;
+                        int seq_number = r.read_short();
+                        if(a_job->m_screen_set >= 0)
+                        {
+                            seq_number -= (a_job->m_screen_set * 32);
+                        }
+                        result.m_track_count = seq_number;
                     }
 
                     break;
 
                 default:
-                    //fprintf(stderr, "Unsupported MIDI event: %hhu\n", status);
-                    Glib::ustring message = "Unsupported MIDI event:  ";
-                    message += Ulong_To_String_Hex((unsigned long)status);
-                    a_perf->error_message_gtk(message);
-                    return false;
+                    r.skip(len);
                     break;
                 }
-            }			/* while ( !done loading Trk chunk */
-
-            /* the track has been filled - add it */
-            if(track_count < c_max_track  &&
-               (screen_set < 0 || (screen_set >= 0 && (track_count < SEQ24_SCREEN_SET_SIZE) && (track_count >= 0))))
+            }
+            else if(status == 0xF0)
             {
-                a_perf->add_track(a_track,track_count);
+                /* sysex */
+                len = r.read_var ();
+
+                /* skip it */
+                r.skip(len);
+
+                fprintf(stderr, "Warning, no support for SYSEX messages, discarding.\n");
             }
-            else // for seq24/32 screen set import we can't tell the screen set until we load the track
+            else
             {
-                delete a_track; // Not in the correct screen set or > c_max_track
+                result.m_error = "Unexpected system event : ";
+                result.m_error += Ulong_To_String_Hex((unsigned long)status);
+                return;
             }
+
+            break;
+
+        default:
+            result.m_error = "Unsupported MIDI event:  ";
+            result.m_error += Ulong_To_String_Hex((unsigned long)status);
+            return;
         }
+    }			/* while ( !done loading Trk chunk */
+}
 
-        /* don't know what kind of chunk */
-        else
+void
+midifile::decode_tracks( midi_decode_job *a_job )
+{
+    while (true)
+    {
+        a_job->m_mutex.lock();
+        unsigned index = a_job->m_next++;
+        a_job->m_mutex.unlock();
+
+        if (index >= a_job->m_results.size())
+            break;
+
+        decode_track(a_job, index);
+    }
+}
+
+void *
+midi_decode_thread_func( void *a_job )
+{
+    midi_decode_job *job = (midi_decode_job *) a_job;
+    job->m_file->decode_tracks(job);
+    return 0;
+}
+
+bool midifile::parse (perform * a_perf, int screen_set)
+{
+    /* map the file, the tracks are decoded in place */
+    mapped_file file;
+
+    if (!file.open(m_name.c_str()))
+    {
+        a_perf->error_message("Error opening MIDI file");
+        return false;
+    }
+
+    m_d = (const unsigned char *) file.get_data();
+    m_size = file.get_size();
+
+    if(m_size < sizeof(unsigned long))
+    {
+        Glib::ustring message = "Error - Invalid file size: ";
+        message += NumberToString(m_size);
+        a_perf->error_message(message);
+        return false;
+    }
+
+    /* for import tempo, time signature verify change */
+    long bp_measure = a_perf->get_bp_measure();
+    long bw = a_perf->get_bw();
+    double bpm = a_perf->get_start_tempo();
+
+    /* set position to 0 */
+    m_pos = 0;
+
+    /* chunk info */
+    unsigned long ID;
+    unsigned long TrackLength;
+
+    unsigned short Format;			/* 0,1,2 */
+    unsigned short NumTracks;
+    unsigned short ppqn;
+
+    /* read in header */
+    ID = read_long ();
+    TrackLength = read_long ();
+    Format = read_short ();
+    NumTracks = read_short ();
+    ppqn = read_short ();
+
+    //printf( "[%8lX] len[%ld] fmt[%d] num[%d] ppqn[%d]\n",
+    //      ID, TrackLength, Format, NumTracks, ppqn );
+
+    /* magic number 'MThd' */
+    if (ID != 0x4D546864)
+    {
+        Glib::ustring message = "Invalid MIDI header detected: ";
+        message += Ulong_To_String_Hex(ID);
+        a_perf->error_message(message);
+        return false;
+    }
+
+    /* we are only supporting format 1 for now */
+    if (Format != 1)
+    {
+        Glib::ustring message = "Unsupported MIDI format detected: ";
+        message += NumberToString(Format);
+        a_perf->error_message(message);
+        return false;
+    }
+
+    /* find all the chunks first, a chunk that runs past the end of
+       the file is cut short, and the ones after it are not there */
+    midi_decode_job job;
+    job.m_file = this;
+    job.m_perf = a_perf;
+    job.m_ppqn = ppqn;
+    job.m_screen_set = screen_set;
+    job.m_next = 0;
+
+    for (int curTrack = 0; curTrack < NumTracks && m_size - m_pos >= 8; curTrack++)
+    {
+        ID = read_long ();
+        TrackLength = read_long ();
+
+        if (TrackLength > m_size - m_pos)
+            TrackLength = m_size - m_pos;
+
+        job.m_id.push_back(ID);
+        job.m_start.push_back(m_pos);
+        job.m_size.push_back(TrackLength);
+
+        m_pos += TrackLength;
+    }
+
+    job.m_results.resize(job.m_id.size());
+
+    /* the tracks are decoded on as many threads as there are cores, when
+       there is enough to decode for it to pay */
+    unsigned threads = thread::hardware_concurrency();
+    if (threads > job.m_results.size())
+        threads = job.m_results.size();
+    if (m_size < c_midi_parallel_bytes)
+        threads = 1;
+
+    vector<pthread_t> decoders;
+    for (unsigned i = 1; i < threads; i++)
+    {
+        pthread_t decoder;
+        if (pthread_create(&decoder, NULL, midi_decode_thread_func, &job) == 0)
+            decoders.push_back(decoder);
+    }
+
+    decode_tracks(&job);
+
+    for (unsigned i = 0; i < decoders.size(); i++)
+        pthread_join(decoders[i], NULL);
+
+    /* We should be good to load now   */
+    a_perf->push_perf_undo(true);   // true for import file
+
+    /* seq24 screen set import */
+    unsigned short Track_End = NumTracks;
+    if(screen_set >= 0)
+    {
+        int screen_set_start = screen_set * SEQ24_SCREEN_SET_SIZE;
+
+        if((screen_set_start + SEQ24_SCREEN_SET_SIZE) < Track_End)
+            Track_End = screen_set_start + SEQ24_SCREEN_SET_SIZE;
+    }
+
+    /* the decoded tracks go in, in file order, as the slot each one
+       goes in and whether it is used depend on the ones before it */
+    int track_count = 0; // necessary for screen set offset
+    bool ret = true;
+
+    for (unsigned curTrack = 0; curTrack < job.m_results.size(); curTrack++)
+    {
+        midi_track_result &result = job.m_results[curTrack];
+
+        /* Seq24 import using screen set */
+        if(!ret || track_count >= c_max_track || curTrack >= Track_End ||
+           (screen_set >= 0 && track_count >= (SEQ24_SCREEN_SET_SIZE - 1)))
+        {
+            delete result.m_track; // the unused tracks
+            continue;
+        }
+
+        if (result.m_track == NULL)
         {
             /* its not a MTrk, we don't know how to deal with it,
                so we just eat it */
-            fprintf(stderr, "Unsupported MIDI header detected: %8lX\n", ID);
-            m_pos += TrackLength;
-            done = true;
+            fprintf(stderr, "Unsupported MIDI header detected: %8lX\n", job.m_id[curTrack]);
+            continue;
+        }
+
+        if (result.m_error != "")
+        {
+            a_perf->error_message(result.m_error);
+            delete result.m_track;
+            ret = false;
+            continue;
         }
-    }				/* for(each track) */
 
-    //printf ( "file_size[%d] m_pos[%d]\n", file_size, m_pos );
+        if (result.m_has_track_count)
+            track_count = result.m_track_count;
+
+        if (curTrack == 0)                      // set for main perform if first track
+        {
+            if (result.m_has_timesig)
+            {
+                bp_measure = result.m_bp_measure;   // these will be checked for user approval if different
+                bw = result.m_bw;                   // from current project amounts along with bpm
+            }
+
+            if (result.m_has_tempo)
+                bpm = result.m_bpm;                 // this will be checked for user approval with time signature
+        }
+
+        /* the track has been filled - add it */
+        if(track_count < c_max_track  &&
+           (screen_set < 0 || (screen_set >= 0 && (track_count < SEQ24_SCREEN_SET_SIZE) && (track_count >= 0))))
+        {
+            a_perf->add_track(result.m_track,track_count);
+        }
+        else // for seq24/32 screen set import we can't tell the screen set until we load the track
+        {
+            delete result.m_track; // Not in the correct screen set or > c_max_track
+        }
+    }
+
+    if (!ret)
+        return false;
+
+    //printf ( "m_size[%lu] m_pos[%lu]\n", m_size, m_pos );
 
-    if ((file_size - m_pos) > (int) sizeof (unsigned long))
+    if ((m_size - m_pos) > (int) sizeof (unsigned long))
     {
         ID = read_long ();
         if (ID == c_midictrl) // Not used: SEQ24 stuff -  change m_pos to correct position for c_bpmtag
@@ -594,7 +729,7 @@ bool midifile::parse (perform * a_perf, int screen_set)
         }
     }
 
-    if ((file_size - m_pos) > (int) sizeof (unsigned long)) // SEQ24 stuff for matching
+    if ((m_size - m_pos) > (int) sizeof (unsigned long)) // SEQ24 stuff for matching
     {
         /* Get ID + Length */
         ID = read_long ();
@@ -611,7 +746,7 @@ bool midifile::parse (perform * a_perf, int screen_set)
         }
     }
 
-    if ((file_size - m_pos) > (int) sizeof (unsigned int))
+    if ((m_size - m_pos) > (int) sizeof (unsigned int))
     {
         /* Get ID + Length */ 
         ID = read_long ();
@@ -625,7 +760,7 @@ bool midifile::parse (perform * a_perf, int screen_set)
     }
 
     // read in the mute group info -- SEQ24 stuff
-    if ((file_size - m_pos) > (int) sizeof (unsigned long))
+    if ((m_size - m_pos) > (int) sizeof (unsigned long))
     {
         ID = read_long ();
         if (ID == c_mutegroups)
@@ -651,7 +786,7 @@ bool midifile::parse (perform * a_perf, int screen_set)
         }
     }
 
-    if ((file_size - m_pos) > (int) sizeof (unsigned int))
+    if ((m_size - m_pos) > (int) sizeof (unsigned int))
     {
         /* Get ID + Length */
         ID = read_long ();
@@ -661,7 +796,7 @@ bool midifile::parse (perform * a_perf, int screen_set)
         }
     }
 
-    if ((file_size - m_pos) > (int) sizeof (unsigned int))
+    if ((m_size - m_pos) > (int) sizeof (unsigned int))
     {
         /* Get ID + Length */
         ID = read_long ();
@@ -671,7 +806,7 @@ bool midifile::parse (perform * a_perf, int screen_set)
         }
     }
 
-    if ((file_size - m_pos) > (int) sizeof (unsigned int))
+    if ((m_size - m_pos) > (int) sizeof (unsigned int))
     {
         /* Get ID + Length */
         ID = read_long ();
@@ -683,7 +818,7 @@ bool midifile::parse (perform * a_perf, int screen_set)
             
             if(length > 0)
             {
-                use_tempo_map = verify_tempo_map();
+                use_tempo_map = verify_tempo_map(a_perf);
                 if(use_tempo_map)
                     a_perf->m_list_total_marker.clear();
             }
@@ -725,7 +860,7 @@ bool midifile::parse (perform * a_perf, int screen_set)
 
     if(is_changed)
     {
-        if(verify_change_tempo_timesig(bpm, bp_measure, bw))
+        if(verify_change_tempo_timesig(a_perf, bpm, bp_measure, bw))
         {
             a_perf->set_start_tempo(bpm);
             a_perf->set_bp_measure(bp_measure);
@@ -739,31 +874,31 @@ bool midifile::parse (perform * a_perf, int screen_set)
 void
 midifile::write_long (unsigned long a_x)
 {
-    write_byte ((a_x & 0xFF000000) >> 24);
-    write_byte ((a_x & 0x00FF0000) >> 16);
-    write_byte ((a_x & 0x0000FF00) >> 8);
-    write_byte ((a_x & 0x000000FF));
+    m_out.put_long (a_x);
 }
 
 void
 midifile::write_mid (unsigned long a_x)
 {
-    write_byte ((a_x & 0xFF0000) >> 16);
-    write_byte ((a_x & 0x00FF00) >> 8);
-    write_byte ((a_x & 0x0000FF));
+    m_out.put_mid (a_x);
 }
 
 void
 midifile::write_short (unsigned short a_x)
 {
-    write_byte ((a_x & 0xFF00) >> 8);
-    write_byte ((a_x & 0x00FF));
+    m_out.put_short (a_x);
 }
 
 void
 midifile::write_byte (unsigned char a_x)
 {
-    m_l.push_back (a_x);
+    m_out.put_byte (a_x);
+}
+
+void
+midifile::write_var (unsigned long a_x)
+{
+    m_out.put_var (a_x);
 }
 
 void
@@ -816,7 +951,7 @@ bool midifile::write_sequences (perform * a_perf, sequence *a_solo_seq)
     if(type == E_MIDI_SEQ24_FORMAT)         // no need to count when solo
     {
         /* get number of track sequences */
-        for (int i = 0; i < c_max_track; i++)
+        for (int i = 0; i < a_perf->get_track_slots(); i++)
         {
             if (a_perf->is_active_track(i) && !a_perf->get_track(i)->get_song_mute())
             {
@@ -831,7 +966,7 @@ bool midifile::write_sequences (perform * a_perf, sequence *a_solo_seq)
 
     numtracks = 0;                          // reset for seq->fill_list position
 
-    for (int curTrack = 0; curTrack < c_max_track; curTrack++)
+    for (int curTrack = 0; curTrack < a_perf->get_track_slots(); curTrack++)
     {
         if ((a_perf->is_active_track(curTrack) && !a_perf->get_track(curTrack)->get_song_mute()) ||
             type == E_MIDI_SOLO_SEQUENCE)
@@ -851,17 +986,8 @@ bool midifile::write_sequences (perform * a_perf, sequence *a_solo_seq)
                 if(type == E_MIDI_SEQ24_FORMAT)
                     seq = a_perf->get_track(curTrack)->get_sequence(a_seq);
 
-                list<char> l;
-                seq->fill_list (&l, numtracks, write_triggers);
-
-                /* magic number 'MTrk' */
-                write_long (0x4D54726B);
-
-                int size_tempo_time_sig = 0;
-                if(numtracks == 0)
-                    size_tempo_time_sig = 15; // size, (s/b 19(total) - 4(trk end) = 15 bytes)
-
-                write_long (l.size () + size_tempo_time_sig);
+                /* magic number 'MTrk', the length is filled in at the end */
+                size_t start = m_out.begin_chunk (0x4D54726B);
 
                 /*
                     Add the bpm and timesignature stuff here to the first track (0).
@@ -874,11 +1000,9 @@ bool midifile::write_sequences (perform * a_perf, sequence *a_solo_seq)
                     write_tempo(a_perf);
                 }
 
-                while (l.size () > 0)
-                {
-                    write_byte (l.back ());
-                    l.pop_back ();
-                }
+                seq->fill_list (&m_out, numtracks, write_triggers);
+
+                m_out.end_chunk (start);
                 
                 if(type == E_MIDI_SOLO_SEQUENCE)
                     break;
@@ -940,26 +1064,8 @@ bool midifile::write_sequences (perform * a_perf, sequence *a_solo_seq)
            // don't need start frame since it will be re-calculated on load
         }
     }
-    /* open binary file */
-    ofstream file (m_name.c_str (), ios::out | ios::binary | ios::trunc);
-
-    if (!file.is_open ())
-        return false;
-
-    /* enable bufferization */
-    char file_buffer[1024];
-    file.rdbuf()->pubsetbuf(file_buffer, sizeof file_buffer);
-
-    for (list < unsigned char >::iterator i = m_l.begin ();
-            i != m_l.end (); i++)
-    {
-        char c = *i;
-        file.write(&c, 1);
-    }
-
-    m_l.clear ();
-
-    return true;
+    /* the whole file in one write */
+    return m_out.write (m_name.c_str ());
 }
 
 bool midifile::write_song (perform *a_perf, file_type_e type ,track *a_solo_track)
@@ -972,7 +1078,7 @@ bool midifile::write_song (perform *a_perf, file_type_e type ,track *a_solo_trac
     {
         if(a_solo_track == nullptr) // sanity check - should only happen with song export
         {
-            a_perf->error_message_gtk("Cannot export track or trigger - none selected");
+            a_perf->error_message("Cannot export track or trigger - none selected");
             return true;    // true so we don't generate a second error about "Error writing file".
         }
     }
@@ -981,7 +1087,7 @@ bool midifile::write_song (perform *a_perf, file_type_e type ,track *a_solo_trac
     {
     case E_MIDI_SONG_FORMAT:
         /* get number of tracks  */
-        for (int i = 0; i < c_max_track; i++)
+        for (int i = 0; i < a_perf->get_track_slots(); i++)
         {
             if(a_perf->track_is_song_exportable(i))
                 numtracks++;
@@ -991,7 +1097,7 @@ bool midifile::write_song (perform *a_perf, file_type_e type ,track *a_solo_trac
     case E_MIDI_SOLO_TRIGGER:
         if(a_solo_track->get_trigger_export() == nullptr) // sanity check - should never happen
         {
-            a_perf->error_message_gtk("Cannot export trigger - none selected");
+            a_perf->error_message("Cannot export trigger - none selected");
             return true;    // true so we don't generate a second error about "Error writing file".
         }
         numtracks = 1;
@@ -1005,7 +1111,7 @@ bool midifile::write_song (perform *a_perf, file_type_e type ,track *a_solo_trac
         }
         else
         {
-            a_perf->error_message_gtk("Cannot export track!\nDoes it have triggers?\nIs it muted?\nAny sequences?");
+            a_perf->error_message("Cannot export track!\nDoes it have triggers?\nIs it muted?\nAny sequences?");
             return true;    // true so we don't generate a second error about "Error writing file".
         }
         break;
@@ -1016,7 +1122,7 @@ bool midifile::write_song (perform *a_perf, file_type_e type ,track *a_solo_trac
     
     if(numtracks == 0)
     {
-        a_perf->error_message_gtk("There are NO exportable tracks!\nDo any have triggers?\nAre all tracks muted?\nAny sequences?");
+        a_perf->error_message("There are NO exportable tracks!\nDo any have triggers?\nAre all tracks muted?\nAny sequences?");
         return true;        // true so we don't generate a second error about "Error writing file".
     }
 
@@ -1027,7 +1133,7 @@ bool midifile::write_song (perform *a_perf, file_type_e type ,track *a_solo_trac
 
     numtracks = 0;      // reset for seq->fill_list position
 
-    for (int curTrack = 0; curTrack < c_max_track; curTrack++)
+    for (int curTrack = 0; curTrack < a_perf->get_track_slots(); curTrack++)
     {
         if(a_perf->track_is_song_exportable(curTrack) || type == E_MIDI_SOLO_TRIGGER || type == E_MIDI_SOLO_TRACK)
         {
@@ -1042,10 +1148,23 @@ bool midifile::write_song (perform *a_perf, file_type_e type ,track *a_solo_trac
             
             trigger *a_trig = NULL;
             std::vector<trigger> trig_vect;
-            list<char> l;
             sequence * seq = NULL;
             int vect_size = 1;                          // for solo trigger
             
+            /* magic number 'MTrk', the length is filled in at the end */
+            size_t start = m_out.begin_chunk (0x4D54726B);
+
+            /*
+                Add the bpm and timesignature stuff here to the first track (0).
+                So we don't have an extra one...
+            */
+
+            if(numtracks == 0)
+            {
+                write_time_sig(a_perf);
+                write_tempo(a_perf);
+            }
+
             if(type == E_MIDI_SONG_FORMAT || type == E_MIDI_SOLO_TRACK)
             {
                 a_track->get_trak_triggers(trig_vect);  // all triggers for the track
@@ -1060,8 +1179,8 @@ bool midifile::write_song (perform *a_perf, file_type_e type ,track *a_solo_trac
                     if(seq == NULL)
                         continue;                       // keep checking until we find one
 
-                    seq->seq_number_fill_list( &l, numtracks );
-                    seq->seq_name_fill_list( &l );
+                    seq->seq_number_fill_list( &m_out, numtracks );
+                    seq->seq_name_fill_list( &m_out );
 
                     break;                              // we found one so get out
                 }
@@ -1070,8 +1189,8 @@ bool midifile::write_song (perform *a_perf, file_type_e type ,track *a_solo_trac
                 {
                     seq = a_perf->get_track(curTrack)->get_sequence(0); // so just use the first one
 
-                    seq->seq_number_fill_list( &l, numtracks );
-                    seq->seq_name_fill_list( &l );
+                    seq->seq_number_fill_list( &m_out, numtracks );
+                    seq->seq_name_fill_list( &m_out );
                 }
 
                 // now for each trigger get sequence and add events to list char below - fill_list one by one in order,
@@ -1089,7 +1208,7 @@ bool midifile::write_song (perform *a_perf, file_type_e type ,track *a_solo_trac
                     if(trigger_seq == NULL) // skip empty triggers
                         continue;
 
-                    prev_timestamp = trigger_seq->song_fill_list_seq_event(&l,a_trig,prev_timestamp, type); // put events on list
+                    prev_timestamp = trigger_seq->song_fill_list_seq_event(&m_out,a_trig,prev_timestamp, type); // put events on list
                 }
 
                 /* calculate sequence length */
@@ -1107,7 +1226,7 @@ bool midifile::write_song (perform *a_perf, file_type_e type ,track *a_solo_trac
                     can be used in other projects, this method is very convenient. The common items can
                     be kept in one file and exported all, individually, or in part by creating triggers and muting.
                 */
-                seq->song_fill_list_seq_trigger(&l,a_trig,total_seq_length,prev_timestamp); // the big sequence trigger
+                seq->song_fill_list_seq_trigger(&m_out,a_trig,total_seq_length,prev_timestamp); // the big sequence trigger
             }
             else                                                                // solo trigger export
             {
@@ -1115,10 +1234,10 @@ bool midifile::write_song (perform *a_perf, file_type_e type ,track *a_solo_trac
                 
                 seq = a_track->get_sequence(a_trig->m_sequence);                // get trigger sequence
                 
-                seq->seq_number_fill_list( &l, numtracks );                     // write sequence number (will be 0)
-                seq->seq_name_fill_list( &l );                                  // write sequence name
+                seq->seq_number_fill_list( &m_out, numtracks );                     // write sequence number (will be 0)
+                seq->seq_name_fill_list( &m_out );                                  // write sequence name
                 
-                long time_stamp = seq->song_fill_list_seq_event(&l,a_trig,0, type);   // put events on list (last zero is previous timestamp)
+                long time_stamp = seq->song_fill_list_seq_event(&m_out,a_trig,0, type);   // put events on list (last zero is previous timestamp)
                 
                 /* find the total new sequence length of export */
                 long total_seq_length = a_trig->m_tick_end - a_trig->m_tick_start;
@@ -1130,37 +1249,11 @@ bool midifile::write_song (perform *a_perf, file_type_e type ,track *a_solo_trac
                 //printf("tri start %ld: end %ld: offset %ld\n", a_trig->m_tick_start, a_trig->m_tick_end, a_trig->m_offset);
                 //printf("trigger_length: %ld  time_stamp: %ld\n",total_seq_length, time_stamp);
                 
-                seq->meta_track_end(&l, total_seq_length);                      // write end track
+                seq->meta_track_end(&m_out, total_seq_length);                      // write end track
                 a_track->set_trigger_export(nullptr);                           // clear the pointer
             }
             
-            /* magic number 'MTrk' */
-            write_long (0x4D54726B);
-
-            int size_tempo_time_sig = 0;
-            if(numtracks == 0)
-                size_tempo_time_sig = 15; // size, (s/b 19(total) - 4(trk end) = 15 bytes)
-
-            write_long (l.size () + size_tempo_time_sig);
-
-            /*
-                Add the bpm and timesignature stuff here to the first track (0).
-                So we don't have an extra one...
-            */
-
-            if(numtracks == 0)
-            {
-                write_time_sig(a_perf);
-                write_tempo(a_perf);
-            }
-
-            //printf("MTrk len[%d]\n", l.size());
-
-            while (l.size () > 0)
-            {
-                write_byte (l.back ());
-                l.pop_back ();
-            }
+            m_out.end_chunk (start);
             
             if(type == E_MIDI_SOLO_TRIGGER || type == E_MIDI_SOLO_TRACK)
                 break;
@@ -1171,26 +1264,8 @@ bool midifile::write_song (perform *a_perf, file_type_e type ,track *a_solo_trac
             break;
     }
 
-    /* open binary file */
-    ofstream file (m_name.c_str (), ios::out | ios::binary | ios::trunc);
-
-    if (!file.is_open ())
-        return false;
-
-    /* enable bufferization */
-    char file_buffer[1024];
-    file.rdbuf()->pubsetbuf(file_buffer, sizeof file_buffer);
-
-    for (list < unsigned char >::iterator i = m_l.begin ();
-            i != m_l.end (); i++)
-    {
-        char c = *i;
-        file.write(&c, 1);
-    }
-
-    m_l.clear ();
-
-    return true;
+    /* the whole file in one write */
+    return m_out.write (m_name.c_str ());
 }
 
 /**
@@ -1207,6 +1282,56 @@ bool midifile::write_song (perform *a_perf, file_type_e type ,track *a_solo_trac
  *      Returns 2 raised to the logbase2 power.
  */
 
+bool
+midifile::write_render (perform *a_perf, const std::vector<render_event> &a_log)
+{
+    write_header(1);
+
+    /* reserve for a short delta and three bytes an event */
+    m_out.reserve(a_log.size() * 4 + 64);
+
+    /* magic number 'MTrk', the length is filled in at the end */
+    size_t start = m_out.begin_chunk (0x4D54726B);
+
+    write_time_sig(a_perf);
+
+    long prev_tick = 0;
+
+    for (unsigned i = 0; i < a_log.size(); i++)
+    {
+        const render_event &e = a_log[i];
+
+        write_var(e.m_render_tick - prev_tick);
+        prev_tick = e.m_render_tick;
+
+        if (e.m_status == 0xFF)
+        {
+            write_short(0xFF51);
+            write_byte(0x03);
+            write_mid((unsigned long)(60000000 / e.m_bpm));
+            continue;
+        }
+
+        write_byte(e.m_status);
+        write_byte(e.m_data[0]);
+
+        /* program change and channel pressure have one data byte */
+        unsigned char kind = e.m_status & 0xF0;
+        if (kind != EVENT_PROGRAM_CHANGE && kind != EVENT_CHANNEL_PRESSURE)
+            write_byte(e.m_data[1]);
+    }
+
+    /* end of track */
+    write_byte(0x00);
+    write_short(0xFF2F);
+    write_byte(0x00);
+
+    m_out.end_chunk (start);
+
+    /* the whole file in one write */
+    return m_out.write (m_name.c_str ());
+}
+
 int
 midifile::pow2 (int logbase2)
 {
@@ -1233,7 +1358,7 @@ midifile::Ulong_To_String_Hex ( unsigned long Number )
 }
 
 bool
-midifile::verify_change_tempo_timesig(double tempo, long bp_measure, long bw)
+midifile::verify_change_tempo_timesig(perform *a_perf, double tempo, long bp_measure, long bw)
 {
     std::string str_number = "";
     Glib::ustring message = "From Import file:  ";
@@ -1251,21 +1376,11 @@ midifile::verify_change_tempo_timesig(double tempo, long bp_measure, long bw)
     message += "\n\nTempo or time signature is different from current project!\n\n";
     message += "Do you want to change the current project tempo and time signature to the import values?";
 
-    Gtk::MessageDialog warning(message,
-                           false,
-                           Gtk::MESSAGE_WARNING, Gtk::BUTTONS_YES_NO, true);
-
-    auto result = warning.run();
-
-    if (result == Gtk::RESPONSE_NO )
-    {
-        return false;
-    }
-    return true;
+    return a_perf->ask_question( message );  // yes when nobody to ask
 }
 
 bool
-midifile::verify_tempo_map()
+midifile::verify_tempo_map(perform *a_perf)
 {
     Glib::ustring message = "From Import file:  ";
     message += m_name.c_str();
@@ -1273,17 +1388,7 @@ midifile::verify_tempo_map()
     message += "\n\nFile contains a tempo map!\n\n";
     message += "Do you want to change the current project tempo map to the import values?";
 
-    Gtk::MessageDialog warning(message,
-                           false,
-                           Gtk::MESSAGE_WARNING, Gtk::BUTTONS_YES_NO, true);
-
-    auto result = warning.run();
-
-    if (result == Gtk::RESPONSE_NO )
-    {
-        return false;
-    }
-    return true;
+    return a_perf->ask_question( message );
 }
 
 void
@@ -21,23 +21,84 @@
 #pragma once
 
 #include "perform.h"
+#include "chunk.h"
+#include "mutex.h"
 #include <fstream>
 #include <string>
 #include <list>
 #include <vector>
 
+class midifile;
+class perform;
+class track;
+
+/* what one MTrk chunk decoded to */
+struct midi_track_result
+{
+    /* NULL for a chunk that is not a MTrk */
+    track *m_track;
+
+    /* set if decoding stopped on something we can not import */
+    Glib::ustring m_error;
+
+    /* the sequence number meta event, it picks the track slot */
+    bool m_has_track_count;
+    int m_track_count;
+
+    /* the last time signature and tempo, used from the first track */
+    bool m_has_timesig;
+    long m_bp_measure;
+    long m_bw;
+    bool m_has_tempo;
+    double m_bpm;
+
+    midi_track_result() :
+        m_track(NULL),
+        m_has_track_count(false),
+        m_track_count(0),
+        m_has_timesig(false),
+        m_bp_measure(4),
+        m_bw(4),
+        m_has_tempo(false),
+        m_bpm(0.0)
+    {
+    }
+};
+
+/* the MTrk chunks found in the file, shared by the decode threads */
+struct midi_decode_job
+{
+    midifile *m_file;
+    perform *m_perf;
+    unsigned short m_ppqn;
+    int m_screen_set;
+
+    /* where each chunk's data starts, its size and ID */
+    vector<unsigned long> m_start;
+    vector<unsigned long> m_size;
+    vector<unsigned long> m_id;
+
+    vector<midi_track_result> m_results;
+
+    /* the next chunk to decode */
+    seq42_mutex m_mutex;
+    unsigned m_next;
+};
+
 class midifile
 {
 
 private:
 
-    int m_pos;
+    unsigned long m_pos;
     const std::string m_name;
 
-    /* holds our data */
-    std::vector<unsigned char> m_d;
+    /* holds our data, mapped from the file */
+    const unsigned char *m_d;
+    unsigned long m_size;
 
-    list<unsigned char> m_l;
+    /* the file being written */
+    midi_writer m_out;
 
     unsigned long read_long();
     unsigned short read_short();
@@ -48,16 +109,19 @@ private:
     void write_mid( unsigned long );
     void write_short( unsigned short );
     void write_byte( unsigned char );
+    void write_var( unsigned long );
 
     void write_header( int numtracks);
     void write_tempo(perform * a_perf);
     void write_time_sig(perform * a_perf);
     int pow2 (int logbase2);
     Glib::ustring Ulong_To_String_Hex( unsigned long Number );
-    bool verify_change_tempo_timesig(double tempo, long bp_measure, long bw);
-    bool verify_tempo_map();
+    bool verify_change_tempo_timesig(perform *a_perf, double tempo, long bp_measure, long bw);
+    bool verify_tempo_map(perform *a_perf);
     void adjust_sequence_measure_snap(long &length, sequence *a_seq);
 
+    void decode_track( midi_decode_job *a_job, unsigned a_index );
+
 public:
 
     midifile(const Glib::ustring&);
@@ -65,8 +129,14 @@ public:
     ~midifile();
 
     bool parse( perform *a_perf, int screen_set );
+
+    /* run on each decode thread, takes chunks until none are left */
+    void decode_tracks( midi_decode_job *a_job );
     bool write_sequences( perform *a_perf, sequence *a_solo_seq = nullptr );
     bool write_song( perform *a_perf, file_type_e type,track *a_track );
+
+    /* single track file of what perform::render() captured */
+    bool write_render( perform *a_perf, const std::vector<render_event> &a_log );
     
     /* used for bpm rounding precision*/
     inline double round( double val )
@@ -76,3 +146,5 @@ public:
     }
 
 };
+
+extern void *midi_decode_thread_func(void *a_job);
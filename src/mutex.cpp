@@ -20,9 +20,232 @@
 
 #include "mutex.h"
 
+#ifdef LOCK_STATS
+#include <time.h>
+#include <vector>
+#include <algorithm>
+#endif
+
 const pthread_mutex_t seq42_mutex::recmutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
 const pthread_cond_t condition_var::cond  = PTHREAD_COND_INITIALIZER;
 
+#ifdef LOCK_STATS
+
+/* guards the instance list and the names, plain so it does not count itself */
+static pthread_mutex_t s_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static seq42_mutex *s_registry = NULL;
+
+static thread_local bool t_output_thread = false;
+
+static long
+lock_now_us()
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (now.tv_sec * 1000000) + (now.tv_nsec / 1000);
+}
+
+seq42_mutex::seq42_mutex( )
+{
+    m_mutex_lock = recmutex;
+    reset_stats();
+    register_lock();
+}
+
+seq42_mutex::seq42_mutex( const seq42_mutex& a_rhs )
+{
+    m_mutex_lock = recmutex;
+    reset_stats();
+    register_lock();
+}
+
+seq42_mutex&
+seq42_mutex::operator=( const seq42_mutex& a_rhs )
+{
+    /* keep our own pthread mutex, name and numbers */
+    return *this;
+}
+
+seq42_mutex::~seq42_mutex( )
+{
+    unregister_lock();
+}
+
+void
+seq42_mutex::reset_stats( )
+{
+    m_name = "";
+    m_count = 0;
+    m_contended = 0;
+    m_wait_total_us = 0;
+    m_wait_max_us = 0;
+    m_hold_max_us = 0;
+    m_out_contended = 0;
+    m_out_wait_total_us = 0;
+    m_out_wait_max_us = 0;
+    m_depth = 0;
+    m_hold_start_us = 0;
+}
+
+void
+seq42_mutex::register_lock( )
+{
+    pthread_mutex_lock( &s_registry_lock );
+
+    m_prev = NULL;
+    m_next = s_registry;
+    if ( s_registry != NULL )
+        s_registry->m_prev = this;
+    s_registry = this;
+
+    pthread_mutex_unlock( &s_registry_lock );
+}
+
+void
+seq42_mutex::unregister_lock( )
+{
+    pthread_mutex_lock( &s_registry_lock );
+
+    if ( m_prev != NULL )
+        m_prev->m_next = m_next;
+    else
+        s_registry = m_next;
+
+    if ( m_next != NULL )
+        m_next->m_prev = m_prev;
+
+    pthread_mutex_unlock( &s_registry_lock );
+}
+
+/* the counters are only touched while holding m_mutex_lock */
+void
+seq42_mutex::lock( )
+{
+    if ( pthread_mutex_trylock( &m_mutex_lock ) != 0 )
+    {
+        long start_us = lock_now_us();
+        pthread_mutex_lock( &m_mutex_lock );
+        long wait_us = lock_now_us() - start_us;
+
+        m_contended++;
+        m_wait_total_us += wait_us;
+        if ( wait_us > m_wait_max_us )
+            m_wait_max_us = wait_us;
+
+        if ( t_output_thread )
+        {
+            m_out_contended++;
+            m_out_wait_total_us += wait_us;
+            if ( wait_us > m_out_wait_max_us )
+                m_out_wait_max_us = wait_us;
+        }
+    }
+
+    m_count++;
+
+    if ( m_depth++ == 0 )
+        m_hold_start_us = lock_now_us();
+}
+
+void
+seq42_mutex::unlock( )
+{
+    if ( --m_depth == 0 )
+    {
+        long hold_us = lock_now_us() - m_hold_start_us;
+        if ( hold_us > m_hold_max_us )
+            m_hold_max_us = hold_us;
+    }
+
+    pthread_mutex_unlock( &m_mutex_lock );
+}
+
+void
+seq42_mutex::set_name( const char *a_prefix, const char *a_name )
+{
+    pthread_mutex_lock( &s_registry_lock );
+    m_name = a_prefix;
+    m_name += a_name;
+    pthread_mutex_unlock( &s_registry_lock );
+}
+
+void
+seq42_mutex::set_output_thread( )
+{
+    t_output_thread = true;
+}
+
+struct lock_report_line
+{
+    std::string m_name;
+    long m_count;
+    long m_contended;
+    long m_wait_total_us;
+    long m_wait_max_us;
+    long m_hold_max_us;
+    long m_out_contended;
+    long m_out_wait_total_us;
+    long m_out_wait_max_us;
+};
+
+static bool
+lock_report_cmp( const lock_report_line& a, const lock_report_line& b )
+{
+    if ( a.m_out_wait_total_us != b.m_out_wait_total_us )
+        return a.m_out_wait_total_us > b.m_out_wait_total_us;
+
+    return a.m_wait_total_us > b.m_wait_total_us;
+}
+
+/* numbers are read without taking each lock, close enough for a report */
+void
+seq42_mutex::report( std::string *a_out )
+{
+    std::vector<lock_report_line> lines;
+
+    pthread_mutex_lock( &s_registry_lock );
+
+    for ( seq42_mutex *m = s_registry; m != NULL; m = m->m_next )
+    {
+        if ( m->m_count == 0 )
+            continue;
+
+        lock_report_line line;
+        line.m_name = (m->m_name != "") ? m->m_name : "(unnamed)";
+        line.m_count = m->m_count;
+        line.m_contended = m->m_contended;
+        line.m_wait_total_us = m->m_wait_total_us;
+        line.m_wait_max_us = m->m_wait_max_us;
+        line.m_hold_max_us = m->m_hold_max_us;
+        line.m_out_contended = m->m_out_contended;
+        line.m_out_wait_total_us = m->m_out_wait_total_us;
+        line.m_out_wait_max_us = m->m_out_wait_max_us;
+        lines.push_back( line );
+    }
+
+    pthread_mutex_unlock( &s_registry_lock );
+
+    std::sort( lines.begin(), lines.end(), lock_report_cmp );
+
+    string_printf( a_out, "-- locks, by output thread wait --\n" );
+    string_printf( a_out, "%-24s %10s %9s %11s %9s %9s | %9s %11s %9s\n",
+             "name", "count", "contended", "wait_us", "wait_max", "hold_max",
+             "out_cont", "out_wait_us", "out_max" );
+
+    for ( unsigned i = 0; i < lines.size(); i++ )
+    {
+        lock_report_line &l = lines[i];
+
+        string_printf( a_out, "%-24.24s %10ld %9ld %11ld %9ld %9ld | %9ld %11ld %9ld\n",
+                 l.m_name.c_str(), l.m_count, l.m_contended,
+                 l.m_wait_total_us, l.m_wait_max_us, l.m_hold_max_us,
+                 l.m_out_contended, l.m_out_wait_total_us, l.m_out_wait_max_us );
+    }
+}
+
+#else // LOCK_STATS
+
 seq42_mutex::seq42_mutex( )
 {
     m_mutex_lock = recmutex;
@@ -40,6 +263,23 @@ seq42_mutex::unlock( )
     pthread_mutex_unlock( &m_mutex_lock );
 }
 
+void
+seq42_mutex::set_name( const char *a_prefix, const char *a_name )
+{
+}
+
+void
+seq42_mutex::set_output_thread( )
+{
+}
+
+void
+seq42_mutex::report( std::string *a_out )
+{
+}
+
+#endif // LOCK_STATS
+
 condition_var::condition_var( )
 {
     m_cond = cond;
@@ -54,5 +294,17 @@ condition_var::signal( )
 void
 condition_var::wait( )
 {
+#ifdef LOCK_STATS
+    /* the lock is given up while waiting, that is not holding it */
+    long hold_us = lock_now_us() - m_hold_start_us;
+    if ( hold_us > m_hold_max_us )
+        m_hold_max_us = hold_us;
+
+    pthread_cond_wait( &m_cond, &m_mutex_lock );
+
+    m_count++;
+    m_hold_start_us = lock_now_us();
+#else
     pthread_cond_wait( &m_cond, &m_mutex_lock );
+#endif
 }
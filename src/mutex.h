@@ -23,6 +23,19 @@
 #include "globals.h"
 
 #include <pthread.h>
+#include <stdio.h>
+#include <string>
+
+/*
+ *  With ./configure --enable-lock-stats (LOCK_STATS) every seq42_mutex
+ *  counts its acquisitions, the contended ones, the time spent waiting
+ *  for it and the longest time it was held. Waits done by the output
+ *  thread are kept apart, seq42_mutex::report() lists the locks sorted
+ *  by how long the output thread waited on them.
+ *
+ *  Without it set_name() and report() are empty and lock()/unlock()
+ *  are the bare pthread calls.
+ */
 
 class seq42_mutex
 {
@@ -31,6 +44,34 @@ private:
 
     static const pthread_mutex_t recmutex;
 
+#ifdef LOCK_STATS
+    std::string m_name;
+
+    long m_count;
+    long m_contended;
+    long m_wait_total_us;
+    long m_wait_max_us;
+    long m_hold_max_us;
+
+    long m_out_contended;
+    long m_out_wait_total_us;
+    long m_out_wait_max_us;
+
+    /* recursion depth and when the outermost lock() got it */
+    int m_depth;
+    long m_hold_start_us;
+
+    /* all live instances, for report() */
+    seq42_mutex *m_next;
+    seq42_mutex *m_prev;
+
+    void register_lock();
+    void unregister_lock();
+    void reset_stats();
+
+    friend class condition_var;
+#endif
+
 protected:
 
     /* mutex lock */
@@ -40,8 +81,24 @@ public:
 
     seq42_mutex();
 
+#ifdef LOCK_STATS
+    /* a copy is a new lock, it does not take over the stats */
+    seq42_mutex( const seq42_mutex& a_rhs );
+    seq42_mutex& operator=( const seq42_mutex& a_rhs );
+    ~seq42_mutex();
+#endif
+
     void lock();
     void unlock();
+
+    /* tag shown in the report, a_prefix + a_name, e.g. "seq " and the
+       sequence name. Plain pointers so nothing is built without LOCK_STATS */
+    void set_name( const char *a_prefix, const char *a_name = "" );
+
+    /* call from the output thread so its waits are counted apart */
+    static void set_output_thread();
+
+    static void report( std::string *a_out );
 };
 
 class condition_var : public seq42_mutex
@@ -144,6 +144,24 @@ optionsfile::parse( perform *a_perf )
     sscanf( m_line, "%ld", &flag );
     global_manual_alsa_ports = (bool) flag;
 
+    /* compact events */
+    flag = global_compact_events;
+    line_after( &file, "[compact-events]" );
+    sscanf( m_line, "%ld", &flag );
+    global_compact_events = (bool) flag;
+
+    /* lazy load */
+    flag = global_lazy_load;
+    line_after( &file, "[lazy-load]" );
+    sscanf( m_line, "%ld", &flag );
+    global_lazy_load = (bool) flag;
+
+    /* edit journal */
+    flag = global_journal;
+    line_after( &file, "[journal]" );
+    sscanf( m_line, "%ld", &flag );
+    global_journal = (bool) flag;
+
     /* last used dir */
     line_after( &file, "[last-used-dir]" );
     //FIXME: check for a valid path is missing
@@ -234,6 +252,24 @@ optionsfile::write( perform *a_perf  )
     file << "# not connect to other clients\n";
     file << global_manual_alsa_ports << "\n";
 
+    /* compact events */
+    file << "\n\n\n[compact-events]\n";
+    file << "# set to 0 to save song file events unpacked, as fixed\n";
+    file << "# size records\n";
+    file << global_compact_events << "\n";
+
+    /* lazy load */
+    file << "\n\n\n[lazy-load]\n";
+    file << "# set to 1 to read in the events of a sequence only when it\n";
+    file << "# is about to play, is edited or is exported\n";
+    file << global_lazy_load << "\n";
+
+    /* edit journal */
+    file << "\n\n\n[journal]\n";
+    file << "# set to 1 to keep changes not yet saved in <song>.journal,\n";
+    file << "# they are offered back when the song is opened after a crash\n";
+    file << global_journal << "\n";
+
     /* interaction-method */
     int x = 0;
     file << "\n\n\n[interaction-method]\n";
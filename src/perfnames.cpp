@@ -20,6 +20,7 @@
 #include "perfnames.h"
 #include "mainwnd.h"
 #include "font.h"
+#include "trace.h"
 
 perfnames::perfnames( perform *a_perf, mainwnd *a_main, Adjustment *a_vadjust ):
     trackmenu(a_perf, a_main),
@@ -49,9 +50,6 @@ perfnames::perfnames( perform *a_perf, mainwnd *a_main, Adjustment *a_vadjust ):
     m_vadjust->signal_value_changed().connect( mem_fun( *(this), &perfnames::change_vert ));
 
     set_double_buffered( false );
-
-    for( int i=0; i<c_max_track; ++i )
-        m_track_active[i]=false;
 }
 
 void
@@ -64,14 +62,6 @@ perfnames::on_realize()
     m_window = get_window();
     m_gc = Gdk::GC::create( m_window );
     m_window->clear();
-
-    m_pixmap = Gdk::Pixmap::create
-    (
-        m_window,
-        c_names_x,
-        c_names_y  * c_max_track + 1,
-        -1
-    );
 }
 
 void
@@ -107,7 +97,7 @@ perfnames::draw_track( int track )
 {
     int i = track - m_track_offset;
 
-    if ( track < c_max_track )
+    if ( track < m_mainperf->get_track_rows() )
     {
         m_gc->set_foreground(m_black);
         m_window->draw_rectangle
@@ -135,8 +125,6 @@ perfnames::draw_track( int track )
 
         if ( m_mainperf->is_active_track( track ))
         {
-            m_track_active[track]=true;
-
             char str[20];
             snprintf
             (
@@ -231,8 +219,8 @@ perfnames::convert_y( int a_y, int *a_trk)
     *a_trk = a_y / c_names_y;
     *a_trk  += m_track_offset;
 
-    if ( *a_trk >= c_max_track )
-        *a_trk = c_max_track - 1;
+    if ( *a_trk >= m_mainperf->get_track_rows() )
+        *a_trk = m_mainperf->get_track_rows() - 1;
 
     if ( *a_trk < 0 )
         *a_trk = 0;
@@ -307,6 +295,8 @@ perfnames::on_size_allocate(Gtk::Allocation &a_r )
 void
 perfnames::redraw_dirty_tracks()
 {
+    TRACE_SCOPE( "perfnames::redraw_dirty_tracks" );
+
     int y_s = 0;
     int y_f = m_window_y / c_names_y;
 
@@ -314,7 +304,7 @@ perfnames::redraw_dirty_tracks()
     {
         int trk = y + m_track_offset; // 4am
 
-        if ( trk < c_max_track)
+        if ( trk < m_mainperf->get_track_rows() )
         {
             bool dirty = (m_mainperf->is_dirty_names( trk ));
 
@@ -55,8 +55,6 @@ private:
     Glib::RefPtr<Gdk::Window>   m_window;
     Gdk::Color    m_black, m_white, m_grey, m_red;
 
-    Glib::RefPtr<Gdk::Pixmap>   m_pixmap;
-
     perform      *m_mainperf;
 
     Adjustment   *m_vadjust;
@@ -65,8 +63,6 @@ private:
 
     int          m_track_offset;
 
-    bool         m_track_active[c_max_track];
-
     void on_realize();
     bool on_expose_event(GdkEventExpose* a_ev);
     bool on_button_press_event(GdkEventButton* a_ev);
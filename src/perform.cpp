@@ -21,29 +21,39 @@
 #include "perform.h"
 #include "midibus.h"
 #include "event.h"
+#include "perfstats.h"
+#include "trace.h"
 #include <stdio.h>
 #include <fstream>
+#include <algorithm>
+#include <sys/stat.h>
 #ifndef __WIN32__
 #  include <time.h>
 #endif // __WIN32__
 #include <sched.h>
+#include <signal.h>
 
 //For keys
-#include <gtkmm/accelkey.h>
-#include <gtkmm/messagedialog.h>
+#include <gdk/gdkkeysyms.h>
 
-using namespace Gtk;
+ff_rw_type_e FF_RW_button_type = FF_RW_RELEASE;
 
-perform::perform()
+/* songs before version 8 are read through the global int sizes, which
+   a song before version 5 changes while it is read. Held while one is
+   read and while a song is written, whatever thread does it */
+static seq42_mutex s_int_size_mutex;
+
+/* without a_open_midi the master bus makes no sequencer client, for
+   the converter, which only reads and writes files */
+perform::perform( bool a_open_midi ) :
+    m_master_bus( a_open_midi )
 {
-    for (int i=0; i< c_max_track; i++)
-    {
-        m_tracks[i] = NULL;
-        m_tracks_active[i]      = false;
-        m_was_active_edit[i]    = false;
-        m_was_active_perf[i]    = false;
-        m_was_active_names[i]   = false;
-    }
+    m_tracks.reserve( c_max_track );
+    m_active_tracks.reserve( c_max_track );
+    m_tracks_active.reserve( c_max_track );
+    m_play_tracks = make_shared< const vector<track *> >();
+
+    m_ui = NULL;
 
     m_setlist_stop_mark = false;
     m_setlist_mode = false;
@@ -55,6 +65,12 @@ perform::perform()
     m_seqlist_raise = false;
     m_looping = false;
     m_reposition = false;
+    m_mutex.set_name( "perform" );
+    m_condition_var.set_name( "perform condition" );
+    m_preload_cond.set_name( "perform preload" );
+    m_save_cond.set_name( "perform save" );
+    m_save_write.set_name( "perform save write" );
+
     m_inputing = true;
     m_outputing = true;
     m_tick = 0;
@@ -100,6 +116,17 @@ perform::perform()
 
     m_out_thread_launched = false;
     m_in_thread_launched = false;
+    m_preload_thread_launched = false;
+    m_preloading = true;
+    m_save_thread_launched = false;
+    m_saving = true;
+    m_save_state = SAVE_IDLE;
+    m_save_written = 0;
+    m_save_total = 0;
+    m_journal_mtime = 0;
+    m_journal_size = 0;
+    m_journal_bytes = 0;
+    m_journal_compacted_bytes = 0;
 
     m_playback_mode = false;
     m_follow_transport = true;
@@ -110,10 +137,6 @@ perform::perform()
 
     m_have_undo = false; // for button sensitive
     m_have_redo = false; // for button sensitive
-    m_undo_track_count = 0;
-    m_redo_track_count = 0;
-    m_undo_perf_count = 0;
-    m_redo_perf_count = 0;
 }
 
 void perform::init()
@@ -251,25 +274,29 @@ void perform::deinit_jack()
 
 bool perform::clear_all()
 {
-    for (int i=0; i< c_max_track; i++ )
+    for (unsigned n=0; n< m_active_tracks.size(); n++ )
     {
-        if ( is_active_track(i) )
+        if ( is_track_in_edit(m_active_tracks[n]) )
         {
-            if ( m_tracks[i] != NULL && is_track_in_edit(i) )
-            {
-                return false;
-            }
+            return false;
         }
     }
 
+    /* the journal is for the song going away */
+    journal_close();
+
     reset_sequences();
 
-    for (int i=0; i< c_max_track; i++ )
+    /* the output thread sees the whole song go at once */
+    for (int i=0; i< get_track_slots(); i++ )
     {
         if ( is_active_track(i) )
-            delete_track( i );
+            retire_track( i );
     }
 
+    publish_play_tracks();
+    free_retired_tracks();
+
     undo_vect.clear();
     redo_vect.clear();
     set_have_undo();
@@ -283,12 +310,15 @@ bool perform::clear_all()
 
 track* perform::get_track( int a_trk )
 {
+    if ( a_trk < 0 || a_trk >= get_track_slots() )
+        return NULL;
+
     return m_tracks[a_trk];
 }
 
 sequence* perform::get_sequence( int a_trk, int a_seq )
 {
-    track *a_track = m_tracks[a_trk];
+    track *a_track = get_track(a_trk);
     if(a_track == NULL)
     {
         return NULL;
@@ -301,13 +331,12 @@ sequence* perform::get_sequence( int a_trk, int a_seq )
 
 int perform::get_track_index( track *a_track )
 {
-    for (int i=0; i< c_max_track; i++ )
+    for (unsigned n=0; n< m_active_tracks.size(); n++ )
     {
-        if ( is_active_track(i) )
-            if(m_tracks[i] == a_track)
-            {
-                return i;
-            }
+        if(m_tracks[m_active_tracks[n]] == a_track)
+        {
+            return m_active_tracks[n];
+        }
     }
     return -1;
 }
@@ -319,22 +348,20 @@ void perform::set_reposition(bool a_pos_type)
 
 void perform::set_song_mute( mute_op op  )
 {
-    for (int i=0; i< c_max_track; i++ )
+    for (unsigned n=0; n< m_active_tracks.size(); n++ )
     {
-        if ( is_active_track(i) )
+        int i = m_active_tracks[n];
+        if(op == MUTE_ON)
         {
-            if(op == MUTE_ON)
-            {
-                m_tracks[i]->set_song_mute( true );
-            }
-            else if(op == MUTE_OFF)
-            {
-                m_tracks[i]->set_song_mute( false );
-            }
-            else if(op == MUTE_TOGGLE)
-            {
-                m_tracks[i]->set_song_mute( ! m_tracks[i]->get_song_mute() );
-            }
+            m_tracks[i]->set_song_mute( true );
+        }
+        else if(op == MUTE_OFF)
+        {
+            m_tracks[i]->set_song_mute( false );
+        }
+        else if(op == MUTE_TOGGLE)
+        {
+            m_tracks[i]->set_song_mute( ! m_tracks[i]->get_song_mute() );
         }
     }
 }
@@ -352,14 +379,32 @@ perform::~perform()
     if (m_in_thread_launched )
         pthread_join( m_in_thread, NULL );
 
-    for (int i=0; i< c_max_track; i++ )
+    m_preload_cond.lock();
+    m_preloading = false;
+    m_preload_cond.signal();
+    m_preload_cond.unlock();
+
+    if (m_preload_thread_launched )
+        pthread_join( m_preload_thread, NULL );
+
+    /* a save that was asked for still gets written */
+    m_save_cond.lock();
+    m_saving = false;
+    m_save_cond.signal();
+    m_save_cond.unlock();
+
+    if (m_save_thread_launched )
+        pthread_join( m_save_thread, NULL );
+
+    for (unsigned n=0; n< m_active_tracks.size(); n++ )
     {
-        if ( is_active_track(i) )
-        {
-            delete m_tracks[i];
-            m_tracks[i] = NULL;
-        }
+        int i = m_active_tracks[n];
+        delete m_tracks[i];
+        m_tracks[i] = NULL;
     }
+
+    for (unsigned n=0; n< m_retired_tracks.size(); n++ )
+        delete m_retired_tracks[n];
 }
 
 void
@@ -553,6 +598,7 @@ void perform::add_track( track *a_track, int a_pref )
             is_active_track(a_pref) == false &&
             a_pref >= 0 )
     {
+        grow_tracks(a_pref + 1);
         m_tracks[a_pref] = a_track;
         set_active(a_pref, true);
 
@@ -563,6 +609,7 @@ void perform::add_track( track *a_track, int a_pref )
         {
             if ( is_active_track(i) == false )
             {
+                grow_tracks(i + 1);
                 m_tracks[i] = a_track;
                 set_active(i,true);
                 break;
@@ -571,24 +618,146 @@ void perform::add_track( track *a_track, int a_pref )
     }
 }
 
-void perform::set_active( int a_track, bool a_active )
+/* adds empty slots up to a_slots, within the reserved capacity so the
+   output thread never sees the storage move */
+void perform::grow_tracks( int a_slots )
 {
-    if ( a_track < 0 || a_track >= c_max_track )
+    if ( a_slots > c_max_track )
+        a_slots = c_max_track;
+
+    if ( a_slots <= get_track_slots() )
         return;
 
+    m_tracks.resize( a_slots, NULL );
+    m_tracks_active.resize( a_slots, false );
+    m_was_active_edit.resize( a_slots, false );
+    m_was_active_perf.resize( a_slots, false );
+    m_was_active_names.resize( a_slots, false );
+    m_track_snapshot.resize( a_slots );
+}
+
+int perform::get_track_slots()
+{
+    return m_tracks.size();
+}
+
+int perform::get_track_rows()
+{
+    int rows = get_track_slots() + 1;
+
+    if ( rows < c_track_rows )
+        rows = c_track_rows;
+    if ( rows > c_max_track )
+        rows = c_max_track;
+
+    return rows;
+}
+
+void perform::set_active( int a_track, bool a_active )
+{
+    if ( mark_active( a_track, a_active ) )
+        publish_play_tracks();
+}
+
+/* set_active() without telling the output thread, so several changes
+   can reach it in one publish_play_tracks(). False if nothing changed */
+bool perform::mark_active( int a_track, bool a_active )
+{
+    if ( a_track < 0 || a_track >= get_track_slots() )
+        return false;
+
     //printf ("set_active %d\n", a_active );
 
-    if ( m_tracks_active[ a_track ] == true && a_active == false )
+    if ( m_tracks_active[ a_track ] == a_active )
+        return false;
+
+    /* keep the active list in slot order */
+    vector<int>::iterator it = lower_bound( m_active_tracks.begin(),
+                                            m_active_tracks.end(), a_track );
+    if ( a_active )
+    {
+        m_active_tracks.insert( it, a_track );
+    }
+    else
     {
+        m_active_tracks.erase( it );
         set_was_active(a_track);
     }
 
     m_tracks_active[ a_track ] = a_active;
+
+    return true;
+}
+
+/* replaces the list the output thread walks with the current active
+   tracks. The old list goes on the watch list, since the output thread
+   may still be half way through it */
+void perform::publish_play_tracks()
+{
+    vector<track *> *list = new vector<track *>;
+    list->reserve( m_active_tracks.size() );
+
+    for (unsigned n=0; n< m_active_tracks.size(); n++ )
+        list->push_back( m_tracks[m_active_tracks[n]] );
+
+    shared_ptr< const vector<track *> > play_tracks( list );
+
+    m_mutex.lock();
+    m_old_play_tracks.push_back( m_play_tracks );
+    m_play_tracks.swap( play_tracks );
+    m_mutex.unlock();
+}
+
+/* the list to walk, hold it for one pass then hand it back with
+   release_play_tracks(). Both take the lock, so freeing a retired
+   track is ordered after the last pass that could see it */
+shared_ptr< const vector<track *> > perform::get_play_tracks()
+{
+    m_mutex.lock();
+    shared_ptr< const vector<track *> > list = m_play_tracks;
+    m_mutex.unlock();
+
+    return list;
+}
+
+void perform::release_play_tracks( shared_ptr< const vector<track *> > *a_list )
+{
+    m_mutex.lock();
+    a_list->reset();
+    m_mutex.unlock();
+}
+
+/* deletes the tracks taken out by delete_track() once no old list is
+   held any more. Called from the gui thread */
+void perform::free_retired_tracks()
+{
+    vector<track *> retired;
+
+    m_mutex.lock();
+
+    unsigned held = 0;
+    for (unsigned n=0; n< m_old_play_tracks.size(); n++ )
+    {
+        if ( !m_old_play_tracks[n].expired() )
+            m_old_play_tracks[held++] = m_old_play_tracks[n];
+    }
+    m_old_play_tracks.resize( held );
+
+    if ( held == 0 )
+        retired.swap( m_retired_tracks );
+
+    m_mutex.unlock();
+
+    for (unsigned n=0; n< retired.size(); n++ )
+    {
+        retired[n]->set_playing_off();
+        delete retired[n];
+    }
 }
 
 void perform::set_was_active( int a_track )
 {
-    if ( a_track < 0 || a_track >= c_max_track )
+    if ( a_track < 0 || a_track >= get_track_slots() )
         return;
 
     //printf( "was_active true\n" );
@@ -600,7 +769,7 @@ void perform::set_was_active( int a_track )
 
 bool perform::is_active_track( int a_track )
 {
-    if ( a_track < 0 || a_track >= c_max_track )
+    if ( a_track < 0 || a_track >= get_track_slots() )
         return false;
 
     return m_tracks_active[ a_track ];
@@ -608,7 +777,7 @@ bool perform::is_active_track( int a_track )
 
 bool perform::is_dirty_perf (int a_track)
 {
-    if ( a_track < 0 || a_track >= c_max_track )
+    if ( a_track < 0 || a_track >= get_track_slots() )
         return false;
 
     if ( is_active_track(a_track) )
@@ -624,7 +793,7 @@ bool perform::is_dirty_perf (int a_track)
 
 bool perform::is_dirty_names (int a_track)
 {
-    if ( a_track < 0 || a_track >= c_max_track )
+    if ( a_track < 0 || a_track >= get_track_slots() )
         return false;
 
     if ( is_active_track(a_track) )
@@ -701,25 +870,41 @@ int  perform::get_swing_amount16( )
 
 void perform::delete_track( int a_num )
 {
-    if ( m_tracks[a_num] != NULL &&
+    if ( get_track(a_num) != NULL &&
             !is_track_in_edit(a_num) )
     {
-        set_active(a_num, false);
-        m_tracks[a_num]->set_playing_off( );
-        delete m_tracks[a_num];
-        m_tracks[a_num] = NULL;
+        retire_track( a_num );
+        publish_play_tracks();
+        free_retired_tracks();
     }
 }
 
+/* empties the slot. The output thread may still be playing the track,
+   so it is only deleted once the list it is in has been let go. The
+   caller publishes */
+void perform::retire_track( int a_num )
+{
+    track *a_track = m_tracks[a_num];
+    m_tracks[a_num] = NULL;
+    mark_active( a_num, false );
+
+    m_mutex.lock();
+    m_retired_tracks.push_back( a_track );
+    m_mutex.unlock();
+}
+
 bool perform::is_track_in_edit( int a_num )
 {
-    return ( (m_tracks[a_num] != NULL) &&
+    return ( (get_track(a_num) != NULL) &&
              ( m_tracks[a_num]->get_editing() ||  m_tracks[a_num]->get_sequence_editing() )
            );
 }
 
 void perform::new_track( int a_track )
 {
+    assert( a_track >= 0 && a_track < c_max_track );
+
+    grow_tracks( a_track + 1 );
     m_tracks[ a_track ] = new track();
     m_tracks[ a_track ]->set_master_midi_bus( &m_master_bus );
     set_active(a_track, true);
@@ -731,62 +916,217 @@ void perform::print()
     printf("bpm[%f]\n", get_bpm());
     printf("swing8[%d]\n", get_swing_amount8());
     printf("swing16[%d]\n", get_swing_amount16());
-    for (int i = 0; i < c_max_track; i++)
+    for (unsigned n=0; n< m_active_tracks.size(); n++ )
     {
-        if (is_active_track(i))
-        {
-            printf("--------------------\n");
-            printf("track[%d] at %p\n", i, &(m_tracks[i]));
-            m_tracks[i]->print();
-        }
+        int i = m_active_tracks[n];
+        printf("--------------------\n");
+        printf("track[%d] at %p\n", i, &(m_tracks[i]));
+        m_tracks[i]->print();
     }
     //m_master_bus.print();
 }
 
-void perform::error_message_gtk( Glib::ustring message)
+void
+perform::set_ui( perform_ui *a_ui )
+{
+    m_ui = a_ui;
+}
+
+void
+perform::error_message( const Glib::ustring& a_message )
+{
+    /* no display to put a dialog on */
+    if ( m_ui == NULL )
+    {
+        printf( "Error: %s\n", a_message.c_str() );
+        return;
+    }
+
+    m_ui->error_message( a_message );
+}
+
+bool
+perform::ask_question( const Glib::ustring& a_message )
+{
+    if ( m_ui == NULL )
+        return true;
+
+    return m_ui->ask_question( a_message );
+}
+
+void
+perform::quit()
 {
-    Gtk::MessageDialog errdialog
-    (
-        message,
-        false,
-        Gtk::MESSAGE_ERROR,
-        Gtk::BUTTONS_OK,
-        true
-    );
-    errdialog.run();
+    if ( m_ui == NULL )
+        raise( SIGTERM );   // headless main loop quits on it
+    else
+        m_ui->quit();
 }
 
 void perform::play( long a_tick )
 {
+    TRACE_SCOPE( "perform::play" );
+
     /* just run down the list of sequences and have them dump */
 
     if(global_song_start_mode && !m_usemidiclock)  // only allow in song mode when not following midi clock
         tempo_change();
 
     m_tick = a_tick;
-    for (int i=0; i< c_max_track; i++ )
-    {
-        if ( is_active_track(i) )
-        {
-            assert( m_tracks[i] );
-            m_tracks[i]->play( a_tick, m_playback_mode );
-        }
-    }
+    play_tracks( a_tick );
 
     /* flush the bus */
     m_master_bus.flush();
 }
 
-void perform::set_orig_ticks( long a_tick  )
+void perform::play_tracks( long a_tick )
+{
+    shared_ptr< const vector<track *> > list = get_play_tracks();
+
+    for (unsigned n=0; n< list->size(); n++ )
+        (*list)[n]->play( a_tick, m_playback_mode );
+
+    release_play_tracks( &list );
+}
+
+static bool
+sort_tempo_marker( const tempo_mark &a, const tempo_mark &b )
+{
+    return a.tick < b.tick;
+}
+
+bool perform::render( vector<render_event> *a_log, long a_start_tick,
+                      long a_end_tick, int a_loops )
 {
-    for (int i=0; i< c_max_track; i++ )
+    if ( global_is_running )
+        return false;
+
+    bool playback_mode = m_playback_mode;
+    m_playback_mode = true;
+
+    /* our own copy, the play list is eaten by tempo_change() */
+    list<tempo_mark> markers = m_list_total_marker;
+    markers.sort( &sort_tempo_marker );
+
+    double bpm = m_master_bus.get_bpm();
+    if ( markers.size() )
+        bpm = markers.begin()->bpm;
+
+    list<tempo_mark>::iterator next_marker = markers.begin();
+
+    /* play() won't read lazily loaded sequences in, so do it now */
+    long first_tick = (m_looping && get_left_tick() < a_start_tick) ?
+        get_left_tick() : a_start_tick;
+
+    for ( unsigned n = 0; n < m_active_tracks.size(); n++ )
+        get_track( m_active_tracks[n] )->materialize( first_tick, a_end_tick );
+
+    reset_sequences();
+
+    m_master_bus.set_capture( a_log );
+
+    set_orig_ticks( a_start_tick );
+
+    long tick = a_start_tick;
+    long render_tick = 0;
+    double time_us = 0.0;
+    int loops_done = 0;
+
+    while ( tick < a_end_tick )
     {
-        if ( is_active_track(i) == true )
+        /* L/R looping, same as output_func() */
+        if ( m_looping && loops_done < a_loops && tick >= get_right_tick() )
         {
-            assert( m_tracks[i] );
-            m_tracks[i]->set_orig_tick( a_tick );
+            loops_done++;
+
+            reset_sequences();
+            set_orig_ticks( get_left_tick() );
+            tick = get_left_tick();
+
+            /* back to the tempo in effect at the left marker */
+            next_marker = markers.begin();
+            while ( next_marker != markers.end() && (long) next_marker->tick <= tick )
+            {
+                if ( next_marker->bpm != STOP_MARKER )
+                    bpm = next_marker->bpm;
+                next_marker++;
+            }
+
+            render_event e;
+            e.m_status = 0xFF;
+            e.m_bpm = bpm;
+            e.m_tick = tick;
+            e.m_render_tick = render_tick;
+            e.m_time_us = time_us;
+            a_log->push_back( e );
         }
+
+        bool stop = false;
+        while ( next_marker != markers.end() && (long) next_marker->tick <= tick )
+        {
+            if ( next_marker->bpm == STOP_MARKER )
+            {
+                stop = true;
+                break;
+            }
+
+            bpm = next_marker->bpm;
+            next_marker++;
+
+            render_event e;
+            e.m_status = 0xFF;
+            e.m_bpm = bpm;
+            e.m_tick = tick;
+            e.m_render_tick = render_tick;
+            e.m_time_us = time_us;
+            a_log->push_back( e );
+        }
+
+        if ( stop )
+            break;
+
+        size_t first = a_log->size();
+
+        play_tracks( tick );
+
+        for ( size_t i = first; i < a_log->size(); i++ )
+        {
+            (*a_log)[i].m_tick = tick;
+            (*a_log)[i].m_render_tick = render_tick;
+            (*a_log)[i].m_time_us = time_us;
+        }
+
+        time_us += 60000000.0 / (bpm * (4.0 / m_bw) * c_ppqn);
+        tick++;
+        render_tick++;
     }
+
+    /* note offs for whatever is still hanging, at the end time */
+    size_t first = a_log->size();
+
+    reset_sequences();
+
+    for ( size_t i = first; i < a_log->size(); i++ )
+    {
+        (*a_log)[i].m_tick = tick;
+        (*a_log)[i].m_render_tick = render_tick;
+        (*a_log)[i].m_time_us = time_us;
+    }
+
+    m_master_bus.set_capture( NULL );
+    m_playback_mode = playback_mode;
+
+    return true;
+}
+
+void perform::set_orig_ticks( long a_tick  )
+{
+    shared_ptr< const vector<track *> > list = get_play_tracks();
+
+    for (unsigned n=0; n< list->size(); n++ )
+        (*list)[n]->set_orig_tick( a_tick );
+
+    release_play_tracks( &list );
 }
 
 void perform::tempo_change()
@@ -828,13 +1168,11 @@ void perform::move_triggers( bool a_direction )
     {
         long distance = m_right_tick - m_left_tick;
 
-        for (int i=0; i< c_max_track; i++ )
+        for (unsigned n=0; n< m_active_tracks.size(); n++ )
         {
-            if ( is_active_track(i) == true )
-            {
-                assert( m_tracks[i] );
-                m_tracks[i]->move_triggers( m_left_tick, distance, a_direction );
-            }
+            int i = m_active_tracks[n];
+            assert( m_tracks[i] );
+            m_tracks[i]->move_triggers( m_left_tick, distance, a_direction );
         }
     }
 }
@@ -878,13 +1216,11 @@ void perform::pop_bpm_redo()
 void perform::push_trigger_undo()
 {
     m_mutex.lock();
-    for (int i=0; i< c_max_track; i++ )
+    for (unsigned n=0; n< m_active_tracks.size(); n++ )
     {
-        if ( is_active_track(i) == true )
-        {
-            assert( m_tracks[i] );
-            m_tracks[i]->push_trigger_undo( );
-        }
+        int i = m_active_tracks[n];
+        assert( m_tracks[i] );
+        m_tracks[i]->push_trigger_undo( );
     }
     undo_type a_undo;
     a_undo.track = -1; // all tracks
@@ -901,13 +1237,11 @@ void perform::push_trigger_undo()
 void perform::pop_trigger_undo()
 {
     m_mutex.lock();
-    for (int i=0; i< c_max_track; i++ )
+    for (unsigned n=0; n< m_active_tracks.size(); n++ )
     {
-        if ( is_active_track(i) == true )
-        {
-            assert( m_tracks[i] );
-            m_tracks[i]->pop_trigger_undo( );
-        }
+        int i = m_active_tracks[n];
+        assert( m_tracks[i] );
+        m_tracks[i]->pop_trigger_undo( );
     }
 
     undo_type a_undo;
@@ -924,13 +1258,11 @@ void perform::pop_trigger_undo()
 void perform::pop_trigger_redo()
 {
     m_mutex.lock();
-    for (int i=0; i< c_max_track; i++ )
+    for (unsigned n=0; n< m_active_tracks.size(); n++ )
     {
-        if ( is_active_track(i) == true )
-        {
-            assert( m_tracks[i] );
-            m_tracks[i]->pop_trigger_redo( );
-        }
+        int i = m_active_tracks[n];
+        assert( m_tracks[i] );
+        m_tracks[i]->pop_trigger_redo( );
     }
 
     undo_type a_undo;
@@ -1009,18 +1341,9 @@ void perform::pop_trigger_redo( int a_track )
 void perform::push_track_undo( int a_track )
 {
     m_mutex.lock();
-    if ( is_active_track(a_track) == true ) // merge, cross track, track cut
-    {
-        assert( m_tracks[a_track] );
+    /* merge, cross track, track cut - or NULL on track paste for later delete */
+    m_undo_tracks.push_back( snapshot_track( a_track ) );
 
-        m_undo_tracks[m_undo_track_count] = *(m_tracks[a_track]);
-        m_undo_track_count++;
-    }
-    else // track paste - set name to null for later delete
-    {
-        m_undo_tracks[m_undo_track_count].m_is_NULL = true;
-        m_undo_track_count++;
-    }
     undo_type a_undo;
     a_undo.track = a_track;
     a_undo.type = c_undo_track;
@@ -1039,7 +1362,10 @@ void perform::pop_track_undo( int a_track )
     if ( is_active_track(a_track) == true ) // cross track, merge seq, paste track
     {
         if(is_track_in_edit(a_track)) // don't allow since track will be changed
+        {
+            m_mutex.unlock();
             return;
+        }
 
         assert( m_tracks[a_track] );
 
@@ -1051,14 +1377,12 @@ void perform::pop_track_undo( int a_track )
         bool transpose = m_tracks[a_track]->get_transposable();
         /* end track edit items */
 
-        m_redo_tracks[m_redo_track_count] = *(get_track(a_track ));
+        m_redo_tracks.push_back( snapshot_track( a_track ) );
 
-        delete_track(a_track); // must delete or junk leftover on copy - also for paste track undo
+        restore_track( a_track, m_undo_tracks.back() ); // NULL for paste track undo
 
-        if(!m_undo_tracks[m_undo_track_count - 1].m_is_NULL) // cross track, merge track
+        if( m_undo_tracks.back() ) // cross track, merge track
         {
-            new_track( a_track );
-            *(get_track( a_track )) = m_undo_tracks[m_undo_track_count - 1];
             assert( m_tracks[a_track] );
 
             /* reset the track edit items */
@@ -1072,18 +1396,15 @@ void perform::pop_track_undo( int a_track )
             get_track( a_track )->set_dirty();
         }
     }
-    else  // cut track - set NULL name to redo, create new track for undo
+    else  // cut track - set NULL to redo, create new track for undo
     {
-        m_redo_tracks[m_redo_track_count].m_is_NULL = true;
+        m_redo_tracks.push_back( shared_ptr<track>() );
 
-        new_track( a_track  );
+        restore_track( a_track, m_undo_tracks.back() );
         assert( m_tracks[a_track] );
-        *(get_track(a_track )) = m_undo_tracks[m_undo_track_count - 1];
-        get_track( a_track )->set_dirty();
     }
 
-    m_undo_track_count--;
-    m_redo_track_count++;
+    m_undo_tracks.pop_back();
 
     undo_type a_undo;
     a_undo.track = a_track;
@@ -1102,7 +1423,10 @@ void perform::pop_track_redo( int a_track )
     if ( is_active_track(a_track) == true ) // cross track, merge seq, cut track
     {
         if(is_track_in_edit(a_track)) // don't allow since track will be changed
+        {
+            m_mutex.unlock();
             return;
+        }
 
         assert( m_tracks[a_track] );
 
@@ -1114,14 +1438,13 @@ void perform::pop_track_redo( int a_track )
         bool transpose = m_tracks[a_track]->get_transposable();
         /* end track edit items */
 
-        m_undo_tracks[m_undo_track_count] = *(get_track(a_track ));
+        m_undo_tracks.push_back( snapshot_track( a_track ) );
 
-        delete_track(a_track); // must delete or junk leftover on copy - also for cut track redo
+        restore_track( a_track, m_redo_tracks.back() ); // NULL for cut track redo
 
-        if(!m_redo_tracks[m_redo_track_count - 1].m_is_NULL) // cross track, merge track
+        if( m_redo_tracks.back() ) // cross track, merge track
         {
-            new_track( a_track );
-            *(get_track( a_track )) = m_redo_tracks[m_redo_track_count - 1];
+            assert( m_tracks[a_track] );
 
             /* reset the track edit items */
             get_track(a_track)->set_song_mute(mute);
@@ -1136,16 +1459,13 @@ void perform::pop_track_redo( int a_track )
     }
     else   // paste track - set NULL to undo, create track for redo
     {
-        m_undo_tracks[m_undo_track_count].m_is_NULL = true;
+        m_undo_tracks.push_back( shared_ptr<track>() );
 
-        new_track( a_track  );
+        restore_track( a_track, m_redo_tracks.back() );
         assert( m_tracks[a_track] );
-        *(get_track(a_track )) = m_redo_tracks[m_redo_track_count - 1];
-        get_track( a_track )->set_dirty();
     }
 
-    m_undo_track_count++;
-    m_redo_track_count--;
+    m_redo_tracks.pop_back();
 
     undo_type a_undo;
     a_undo.track = a_track;
@@ -1162,16 +1482,12 @@ void
 perform::push_perf_undo(bool a_import)
 {
     m_mutex.lock();
-    for(int i = 0; i < c_max_track; i++)
+    m_undo_perf.push_back( undo_redo_perf_tracks() );
+
+    vector< shared_ptr<track> > &perf_tracks = m_undo_perf.back().perf_tracks;
+    for(int i = 0; i < get_track_slots(); i++)
     {
-        if ( is_active_track(i) == true )
-        {
-            undo_perf[m_undo_perf_count].perf_tracks[i] = *get_track(i);
-        }
-        else
-        {
-            undo_perf[m_undo_perf_count].perf_tracks[i].m_is_NULL = true;
-        }
+        perf_tracks.push_back( snapshot_track( i ) );
     }
 
     undo_type a_undo;
@@ -1183,7 +1499,6 @@ perform::push_perf_undo(bool a_import)
         m_list_undo.push( m_list_total_marker );
     }
 
-    m_undo_perf_count++;
     a_undo.track = -1;
 
     undo_vect.push_back(a_undo);
@@ -1197,33 +1512,20 @@ void
 perform::pop_perf_undo(bool a_import)
 {
     m_mutex.lock();
-    for(int i = 0; i < c_max_track; i++)//now delete and replace
-    {
-        if ( is_active_track(i) == true )
-        {
-            redo_perf[m_redo_perf_count].perf_tracks[i] = *get_track(i);// push redo
-
-            delete_track(i);
-            if(!undo_perf[m_undo_perf_count-1].perf_tracks[i].m_is_NULL)
-            {
-                new_track(i);
-                *get_track(i) = undo_perf[m_undo_perf_count-1].perf_tracks[i];
-                get_track(i)->set_dirty();
-            }
-        }
-        else
-        {
-            redo_perf[m_redo_perf_count].perf_tracks[i].m_is_NULL = true; // push redo
+    m_redo_perf.push_back( undo_redo_perf_tracks() );
 
-            if(!undo_perf[m_undo_perf_count-1].perf_tracks[i].m_is_NULL)
-            {
-                new_track(i);
-                *get_track(i) = undo_perf[m_undo_perf_count-1].perf_tracks[i];
-                get_track(i)->set_dirty();
-            }
-        }
+    vector< shared_ptr<track> > &redo_tracks = m_redo_perf.back().perf_tracks;
+    vector< shared_ptr<track> > &undo_tracks = m_undo_perf.back().perf_tracks;
+    /* slots added since the snapshot are emptied */
+    undo_tracks.resize( get_track_slots() );
+    for(int i = 0; i < get_track_slots(); i++)//now delete and replace
+    {
+        redo_tracks.push_back( snapshot_track( i ) ); // push redo
+        restore_track( i, undo_tracks[i] );
     }
 
+    m_undo_perf.pop_back();
+
     undo_type a_undo;
     a_undo.type = c_undo_perf;
 
@@ -1236,9 +1538,6 @@ perform::pop_perf_undo(bool a_import)
         set_tempo_load(true);// used by mainwnd timeout to call m_tempo->load_tempo_list();
     }
 
-    m_undo_perf_count--;
-    m_redo_perf_count++;
-
     a_undo.track = -1;
 
     undo_vect.pop_back();
@@ -1252,33 +1551,19 @@ void
 perform::pop_perf_redo(bool a_import)
 {
     m_mutex.lock();
-    for(int i = 0; i < c_max_track; i++)//now delete and replace
-    {
-        if ( is_active_track(i) == true )
-        {
-            undo_perf[m_undo_perf_count].perf_tracks[i] = *get_track(i); // push undo
-
-            delete_track(i);
-            if(!redo_perf[m_redo_perf_count-1].perf_tracks[i].m_is_NULL)
-            {
-                new_track(i);
-                *get_track(i) = redo_perf[m_redo_perf_count-1].perf_tracks[i];
-                get_track(i)->set_dirty();
-            }
-        }
-        else
-        {
-            undo_perf[m_undo_perf_count].perf_tracks[i].m_is_NULL = true; // push undo
+    m_undo_perf.push_back( undo_redo_perf_tracks() );
 
-            if(!redo_perf[m_redo_perf_count-1].perf_tracks[i].m_is_NULL)
-            {
-                new_track(i);
-                *get_track(i) = redo_perf[m_redo_perf_count-1].perf_tracks[i];
-                get_track(i)->set_dirty();
-            }
-        }
+    vector< shared_ptr<track> > &undo_tracks = m_undo_perf.back().perf_tracks;
+    vector< shared_ptr<track> > &redo_tracks = m_redo_perf.back().perf_tracks;
+    redo_tracks.resize( get_track_slots() );
+    for(int i = 0; i < get_track_slots(); i++)//now delete and replace
+    {
+        undo_tracks.push_back( snapshot_track( i ) ); // push undo
+        restore_track( i, redo_tracks[i] );
     }
 
+    m_redo_perf.pop_back();
+
     undo_type a_undo;
     a_undo.type = c_undo_perf;
 
@@ -1291,9 +1576,6 @@ perform::pop_perf_redo(bool a_import)
         set_tempo_load(true); // used by mainwnd timeout to call m_tempo->load_tempo_list();
     }
 
-    m_undo_perf_count++;
-    m_redo_perf_count--;
-
     a_undo.track = -1;
 
     redo_vect.pop_back();
@@ -1303,23 +1585,70 @@ perform::pop_perf_redo(bool a_import)
     m_mutex.unlock();
 }
 
+/* snapshot of a track for undo, NULL for an empty slot. While the track
+   still matches the last snapshot taken or restored for its slot, that
+   one is shared instead of copied. */
+shared_ptr<track>
+perform::snapshot_track( int a_track )
+{
+    if ( is_active_track(a_track) == false )
+        return shared_ptr<track>();
+
+    assert( m_tracks[a_track] );
+
+    shared_ptr<track> snapshot = m_track_snapshot[a_track].lock();
+    if ( snapshot && m_tracks[a_track]->matches( *snapshot ) )
+        return snapshot;
+
+    snapshot.reset( new track() );
+    *snapshot = *(m_tracks[a_track]);
+    m_track_snapshot[a_track] = snapshot;
+
+    return snapshot;
+}
+
+/* puts a snapshot back in the slot, a NULL snapshot leaves it empty.
+   A track that already matches the snapshot is left alone. */
 void
-perform::check_max_undo_redo()
+perform::restore_track( int a_track, const shared_ptr<track>& a_snapshot )
 {
-    m_mutex.lock();
-    if(m_undo_track_count > c_max_undo_track || m_redo_track_count > c_max_undo_track ||
-            m_undo_perf_count > c_max_undo_perf || m_redo_perf_count > c_max_undo_perf )
+    if ( a_snapshot && is_active_track(a_track) &&
+            m_tracks[a_track]->matches( *a_snapshot ) )
     {
-        m_undo_track_count = 0;
-        m_redo_track_count = 0;
-        m_undo_perf_count = 0;
-        m_redo_perf_count = 0;
+        m_track_snapshot[a_track] = a_snapshot;
+        return;
+    }
+
+    delete_track(a_track); // must delete or junk leftover on copy
+
+    if ( a_snapshot )
+    {
+        new_track(a_track);
+        *get_track(a_track) = *a_snapshot;
+        get_track(a_track)->set_dirty();
+        m_track_snapshot[a_track] = a_snapshot;
+    }
+}
+
+void
+perform::check_max_undo_redo()
+{
+    m_mutex.lock();
+    /* full means reset */
+    if((int)m_undo_tracks.size() >= c_max_undo_track ||
+            (int)m_redo_tracks.size() >= c_max_undo_track ||
+            (int)m_undo_perf.size() >= c_max_undo_perf ||
+            (int)m_redo_perf.size() >= c_max_undo_perf )
+    {
+        m_undo_tracks.clear();
+        m_redo_tracks.clear();
+        m_undo_perf.clear();
+        m_redo_perf.clear();
         undo_vect.clear();
         redo_vect.clear();
-        for(int i = 0; i < c_max_track; i++)
+        for (unsigned n=0; n< m_active_tracks.size(); n++ )
         {
-            if ( is_active_track(i) == true )
-                m_tracks[i]->clear_trigger_undo_redo();
+            m_tracks[m_active_tracks[n]]->clear_trigger_undo_redo();
         }
     }
     m_mutex.unlock();
@@ -1337,6 +1666,8 @@ perform::set_have_undo()
     else
     {
         m_have_undo = false;
+        m_undo_tracks.clear();
+        m_undo_perf.clear();
     }
     global_is_modified = true; // once true, always true unless file save
 }
@@ -1352,6 +1683,8 @@ perform::set_have_redo()
     else
     {
         m_have_redo = false;
+        m_redo_tracks.clear();
+        m_redo_perf.clear();
     }
 }
 
@@ -1362,13 +1695,11 @@ void perform::copy_triggers( )
     {
         long distance = m_right_tick - m_left_tick;
 
-        for (int i=0; i< c_max_track; i++ )
+        for (unsigned n=0; n< m_active_tracks.size(); n++ )
         {
-            if ( is_active_track(i) == true )
-            {
-                assert( m_tracks[i] );
-                m_tracks[i]->copy_triggers( m_left_tick, distance );
-            }
+            int i = m_active_tracks[n];
+            assert( m_tracks[i] );
+            m_tracks[i]->copy_triggers( m_left_tick, distance );
         }
     }
 }
@@ -1706,6 +2037,49 @@ perform::set_tempo_load(bool a_load)
     m_load_tempo_list = a_load;
 }
 
+/* what tempo::load_tempo_list() does for the gui, used when there is
+   no tempo widget (headless) */
+void
+perform::load_tempo_list()
+{
+    m_list_total_marker.sort( &sort_tempo_marker );
+
+    m_list_no_stop_markers.clear();
+
+    list<tempo_mark>::iterator i;
+    for ( i = m_list_total_marker.begin(); i != m_list_total_marker.end(); ++i )
+    {
+        if ( (*i).bpm != STOP_MARKER )
+            m_list_no_stop_markers.push_back( (*i) );
+    }
+
+#ifdef JACK_SUPPORT
+    /* jack start frames, stop markers don't count */
+    if ( m_list_no_stop_markers.size() )
+    {
+        list<tempo_mark>::iterator n = m_list_no_stop_markers.begin();
+        for ( i = ++m_list_no_stop_markers.begin(); i != m_list_no_stop_markers.end(); ++i, ++n )
+        {
+            (*i).start = tick_to_jack_frame( (*i).tick - (*n).tick, (*n).bpm, this );
+            (*i).start += (*n).start;
+        }
+    }
+
+    /* copy the starts back, stops keep theirs */
+    list<tempo_mark>::iterator s = m_list_no_stop_markers.begin();
+    for ( i = m_list_total_marker.begin(); i != m_list_total_marker.end(); ++i )
+    {
+        if ( (*i).bpm != STOP_MARKER && s != m_list_no_stop_markers.end() )
+        {
+            (*i).start = (*s).start;
+            ++s;
+        }
+    }
+#endif // JACK_SUPPORT
+
+    m_list_play_marker = m_list_total_marker;
+}
+
 void
 perform::set_start_tempo(double a_bpm)
 {
@@ -1733,6 +2107,9 @@ perform::get_start_tempo()
 
 void perform::inner_start(bool a_state)
 {
+    /* this runs on the jack and input threads too, so nothing is read
+       in here. What is not read in yet stays silent until the next
+       materialize_ahead() from the gui timer or the headless loop */
     m_condition_var.lock();
 
     if (!global_is_running)
@@ -1758,40 +2135,41 @@ void perform::inner_stop(bool a_midi_clock)
 
 void perform::off_sequences()
 {
-    for (int i = 0; i < c_max_track; i++)
-    {
-        if (is_active_track(i))
-        {
-            assert(m_tracks[i]);
-            m_tracks[i]->set_playing_off();
-        }
-    }
+    /* silence whatever is sounding in one batch, the sequences
+       then find their notes already released */
+    m_master_bus.all_notes_off();
+
+    shared_ptr< const vector<track *> > list = get_play_tracks();
+
+    for (unsigned n=0; n< list->size(); n++ )
+        (*list)[n]->set_playing_off();
+
+    release_play_tracks( &list );
 }
 
 void perform::all_notes_off()
 {
-    for (int i=0; i< c_max_track; i++)
-    {
-        if (is_active_track(i))
-        {
-            assert(m_tracks[i]);
-            m_tracks[i]->off_playing_notes();
-        }
-    }
-    /* flush the bus */
-    m_master_bus.flush();
+    /* one note off per sounding note, one flush */
+    m_master_bus.all_notes_off();
+
+    /* and let the sequences forget what they had on */
+    shared_ptr< const vector<track *> > list = get_play_tracks();
+
+    for (unsigned n=0; n< list->size(); n++ )
+        (*list)[n]->off_playing_notes();
+
+    release_play_tracks( &list );
 }
 
 void perform::reset_sequences()
 {
-    for (int i=0; i< c_max_track; i++)
-    {
-        if (is_active_track(i))
-        {
-            assert( m_tracks[i] );
-            m_tracks[i]->reset_sequences(m_playback_mode);
-        }
-    }
+    shared_ptr< const vector<track *> > list = get_play_tracks();
+
+    for (unsigned n=0; n< list->size(); n++ )
+        (*list)[n]->reset_sequences(m_playback_mode);
+
+    release_play_tracks( &list );
+
     /* flush the bus */
     m_master_bus.flush();
 }
@@ -1836,16 +2214,14 @@ long perform::get_max_trigger()
 {
     long ret = 0, t;
 
-    for (int i=0; i< c_max_track; i++ )
+    for (unsigned n=0; n< m_active_tracks.size(); n++ )
     {
-        if ( is_active_track(i) == true )
-        {
-            assert( m_tracks[i] );
+        int i = m_active_tracks[n];
+        assert( m_tracks[i] );
 
-            t = m_tracks[i]->get_max_trigger( );
-            if ( t > ret )
-                ret = t;
-        }
+        t = m_tracks[i]->get_max_trigger( );
+        if ( t > ret )
+            ret = t;
     }
 
     return ret;
@@ -1881,6 +2257,9 @@ void* output_thread_func(void *a_pef )
 #ifdef __WIN32__
     timeBeginPeriod(1);
 #endif
+    TRACE_THREAD( "output" );
+    seq42_mutex::set_output_thread();
+
     p->output_func();
 #ifdef __WIN32__
     timeEndPeriod(1);
@@ -2014,7 +2393,9 @@ bool perform::jack_session_event()
     jack_session_reply( m_jack_client, m_jsession_ev );
 
     if( m_jsession_ev->type == JackSessionSaveAndQuit )
-        Gtk::Main::quit();
+    {
+        quit();
+    }
 
     jack_session_event_free (m_jsession_ev);
 
@@ -2056,9 +2437,6 @@ void perform::output_func()
         /* current time */
         struct timespec current;
 
-        struct timespec stats_loop_start;
-        struct timespec stats_loop_finish;
-
         /* difference between last and current */
         struct timespec delta;
 #else
@@ -2067,9 +2445,6 @@ void perform::output_func()
         /* current time */
         long current;
 
-        long stats_loop_start = 0;
-        long stats_loop_finish = 0;
-
         /* difference between last and current */
         long delta;
 #endif // __WIN32__
@@ -2081,16 +2456,7 @@ void perform::output_func()
         long delta_tick_frac = 0;
 
         long stats_total_tick = 0;
-
-        long stats_loop_index = 0;
-        long stats_min = 0x7FFFFFFF;
-        long stats_max = 0;
-        long stats_avg = 0;
         long stats_last_clock_us = 0;
-        long stats_clock_width_us = 0;
-
-        long stats_all[100];
-        long stats_clock[100];
 
         bool jack_stopped = false;
         bool dumping = false;
@@ -2123,12 +2489,6 @@ void perform::output_func()
 
 #endif // JACK_SUPPORT
 
-        for( int i=0; i<100; i++ )
-        {
-            stats_all[i] = 0;
-            stats_clock[i] = 0;
-        }
-
         /* if we are in the performance view, we care
            about starting from the offset */
         if ( m_playback_mode && !m_jack_running)
@@ -2156,6 +2516,8 @@ void perform::output_func()
 
         while( global_is_running )
         {
+            TRACE_SCOPE( "perform::output_func" );
+
             /************************************
 
               Get delta time ( current - last )
@@ -2166,15 +2528,6 @@ void perform::output_func()
 
              **************************************/
 
-            if ( global_stats )
-            {
-#ifndef __WIN32__
-                clock_gettime(CLOCK_REALTIME, &stats_loop_start);
-#else
-                stats_loop_start = timeGetTime();
-#endif // __WIN32__
-            }
-
             /* delta time */
 #ifndef __WIN32__
             clock_gettime(CLOCK_REALTIME, &current);
@@ -2463,12 +2816,8 @@ void perform::output_func()
 #else
                             long current_us = current * 1000;
 #endif // __WIN32__
-                            stats_clock_width_us = current_us - stats_last_clock_us;
+                            global_perfstats.add_clock_period( current_us - stats_last_clock_us );
                             stats_last_clock_us = current_us;
-
-                            int index = stats_clock_width_us / 300;
-                            if ( index >= 100 ) index = 99;
-                            stats_clock[index]++;
                         }
                         stats_total_tick++;
                     }
@@ -2498,6 +2847,9 @@ void perform::output_func()
             //printf( "        elapsed_us[%ld]\n", elapsed_us );
 #endif // __WIN32__
 
+            /* time spent in play() and friends this time around */
+            global_perfstats.add_loop( elapsed_us );
+
             /* now, we want to trigger every c_thread_trigger_width_ms,
                and it took us delta_us to play() */
 
@@ -2522,71 +2874,35 @@ void perform::output_func()
                 delta.tv_sec =  (delta_us / 1000000);
                 delta.tv_nsec = (delta_us % 1000000) * 1000;
 
+                long sleep_start_us = global_stats ? perfstats::now_us() : 0;
+
                 //printf("sleeping() ");
-                nanosleep( &delta, NULL );
+                {
+                    TRACE_SCOPE( "sleep" );
+                    nanosleep( &delta, NULL );
+                }
+
+                if ( global_stats )
+                    global_perfstats.add_wake_late( perfstats::now_us() - sleep_start_us - delta_us );
             }
 #else
             if ( delta_us > 0 )
             {
                 delta =  (delta_us / 1000);
 
+                long sleep_start_us = global_stats ? perfstats::now_us() : 0;
+
                 //printf("           sleeping() [0x%x]\n", delta);
                 Sleep(delta);
-            }
-#endif // __WIN32__
 
-            else
-            {
                 if ( global_stats )
-                    printf ("underrun\n" );
+                    global_perfstats.add_wake_late( perfstats::now_us() - sleep_start_us - delta_us );
             }
-
-            if ( global_stats )
-            {
-#ifndef __WIN32__
-                clock_gettime(CLOCK_REALTIME, &stats_loop_finish);
-#else
-                stats_loop_finish = timeGetTime();
 #endif // __WIN32__
-            }
 
-            if ( global_stats )
+            else
             {
-#ifndef __WIN32__
-                delta.tv_sec  =  (stats_loop_finish.tv_sec  - stats_loop_start.tv_sec  );
-                delta.tv_nsec =  (stats_loop_finish.tv_nsec - stats_loop_start.tv_nsec );
-                long delta_us = (delta.tv_sec * 1000000) + (delta.tv_nsec / 1000);
-#else
-                delta = stats_loop_finish - stats_loop_start;
-                long delta_us = delta * 1000;
-#endif // __WIN32__
-
-                int index = delta_us / 100;
-                if ( index >= 100  ) index = 99;
-
-                stats_all[index]++;
-
-                if ( delta_us > stats_max )
-                    stats_max = delta_us;
-                if ( delta_us < stats_min )
-                    stats_min = delta_us;
-
-                stats_avg += delta_us;
-                stats_loop_index++;
-
-                if ( stats_loop_index > 200 )
-                {
-                    stats_loop_index = 0;
-                    stats_avg /= 200;
-
-                    printf("stats_avg[%ld]us stats_min[%ld]us"
-                           " stats_max[%ld]us\n", stats_avg,
-                           stats_min, stats_max);
-
-                    stats_min = 0x7FFFFFFF;
-                    stats_max = 0;
-                    stats_avg = 0;
-                }
+                global_perfstats.add_underrun();
             }
 
             if (jack_stopped)
@@ -2595,20 +2911,10 @@ void perform::output_func()
 
         if (global_stats)
         {
-            printf("\n\n-- trigger width --\n");
-            for (int i=0; i<100; i++ )
-            {
-                printf( "[%3d][%8ld]\n", i * 100, stats_all[i] );
-            }
-            printf("\n\n-- clock width --\n" );
             double bpm  = m_master_bus.get_bpm();
 
-            printf("optimal: [%f]us\n", ((c_ppqn / 24)* 60000000 / c_ppqn / bpm));
-
-            for ( int i=0; i<100; i++ )
-            {
-                printf( "[%3d][%8ld]\n", i * 300, stats_clock[i] );
-            }
+            global_perfstats.print( stdout );
+            printf("optimal clock_period: [%f]us\n", ((c_ppqn / 24)* 60000000 / c_ppqn / bpm));
         }
 
         /* m_tick is the progress play tick that displays the progress line */
@@ -2677,6 +2983,8 @@ void* input_thread_func(void *a_pef )
     timeBeginPeriod(1);
 #endif
 
+    TRACE_THREAD( "input" );
+
     p->input_func();
 
 #ifdef __WIN32__
@@ -2694,6 +3002,8 @@ void perform::input_func()
     {
         if ( m_master_bus.poll_for_midi() > 0 )
         {
+            TRACE_SCOPE( "perform::input_func" );
+
             do
             {
                 if (m_master_bus.get_midi_event(&ev) )
@@ -3226,6 +3536,65 @@ perform::track_is_song_exportable(int a_track)
 }
 
 
+void
+perform::print_memory( FILE *a_file, bool a_detail )
+{
+    fputs( get_memory_report( a_detail ).c_str(), a_file );
+}
+
+std::string
+perform::get_memory_report( bool a_detail )
+{
+    std::string report;
+
+    long total_events = 0;
+    long total_bytes = 0;
+    long total_undo = 0;
+
+    string_printf( &report, "-- seq42 memory, %d bytes per event --\n", (int) sizeof(event) );
+
+    for ( unsigned n = 0; n < m_active_tracks.size(); n++ )
+    {
+        int i = m_active_tracks[n];
+        track *a_track = m_tracks[i];
+
+        long track_events = 0;
+        long track_bytes = a_track->get_memory_bytes();
+        long track_undo = 0;
+
+        unsigned int seqs = a_track->get_number_of_sequences();
+
+        for ( unsigned int s = 0; s < seqs; s++ )
+        {
+            long events, bytes, undo;
+            sequence *a_seq = a_track->get_sequence( s );
+            a_seq->get_memory_bytes( &events, &bytes, &undo );
+
+            if ( a_detail )
+            {
+                string_printf( &report, "  seq %-24.24s events %8ld bytes %10ld undo %10ld\n",
+                               a_seq->get_name(), events, bytes, undo );
+            }
+
+            track_events += events;
+            track_bytes += bytes;
+            track_undo += undo;
+        }
+
+        string_printf( &report, "track %3d %-20.20s seqs %3u events %8ld bytes %10ld undo %10ld\n",
+                       i + 1, a_track->get_name(), seqs, track_events, track_bytes, track_undo );
+
+        total_events += track_events;
+        total_bytes += track_bytes;
+        total_undo += track_undo;
+    }
+
+    string_printf( &report, "total     %3d tracks                 events %8ld bytes %10ld undo %10ld\n",
+                   (int) m_active_tracks.size(), total_events, total_bytes, total_undo );
+
+    return report;
+}
+
 std::string
 perform::current_date_time()
 {
@@ -3246,14 +3615,68 @@ perform::current_date_time()
     return mystring;
 }
 
-bool
-perform::save( const Glib::ustring& a_filename )
+static bool
+get_file_stamp( const Glib::ustring& a_filename, time_t *a_mtime, off_t *a_size )
+{
+    struct stat info;
+    if ( stat(a_filename.c_str(), &info) != 0 )
+        return false;
+
+    *a_mtime = info.st_mtime;
+    *a_size = info.st_size;
+    return true;
+}
+
+/* a copy of all save writes, the tracks cost little as their
+   sequences share the events until one of them is changed */
+shared_ptr<song_snapshot>
+perform::take_snapshot()
 {
+    shared_ptr<song_snapshot> song = make_shared<song_snapshot>();
+
     m_mutex.lock();
 
-    ofstream file (a_filename.c_str (), ios::out | ios::binary | ios::trunc);
+    song->m_tempo_marks = m_list_total_marker;
+    song->m_bp_measure = get_bp_measure();
+    song->m_bw = get_bw();
+    song->m_swing_amount8 = get_swing_amount8();
+    song->m_swing_amount16 = get_swing_amount16();
 
-    if (!file.is_open ()) return false;
+    for (unsigned n=0; n< m_active_tracks.size(); n++ )
+    {
+        int i = m_active_tracks[n];
+        song->m_slots.push_back(i);
+        song->m_tracks.push_back(snapshot_track(i));
+    }
+
+    m_mutex.unlock();
+
+    return song;
+}
+
+/* written to a temp file first, so a failed save leaves the old file */
+bool
+perform::write_snapshot( const shared_ptr<song_snapshot>& a_song, const Glib::ustring& a_filename )
+{
+    m_save_write.lock();
+
+    m_save_cond.lock();
+    m_save_written = 0;
+    m_save_total = a_song->m_tracks.size();
+    m_save_cond.unlock();
+
+    Glib::ustring temp = a_filename + ".tmp";
+
+    ofstream file (temp.c_str (), ios::out | ios::binary | ios::trunc);
+
+    if (!file.is_open ())
+    {
+        m_save_write.unlock();
+        return false;
+    }
+
+    /* the int sizes, in case an old song is being read meanwhile */
+    s_int_size_mutex.lock();
 
     /* file version 5 */
     file.write((const char *) &c_file_identification, sizeof(uint64_t)); // magic number file ID
@@ -3272,10 +3695,10 @@ perform::save( const Glib::ustring& a_filename )
     file.write((const char *) &c_file_version, global_file_int_size);
 
     /* version 7 use tempo list */
-    uint32_t list_size = m_list_total_marker.size();
+    uint32_t list_size = a_song->m_tempo_marks.size();
     file.write((const char *) &list_size, sizeof(list_size));
     list<tempo_mark>::iterator i;
-    for ( i = m_list_total_marker.begin(); i != m_list_total_marker.end(); i++ )
+    for ( i = a_song->m_tempo_marks.begin(); i != a_song->m_tempo_marks.end(); i++ )
     {
         file.write((const char * ) &(*i).tick, sizeof((*i).tick));
         file.write((const char * ) &(*i).bpm, sizeof((*i).bpm));
@@ -3284,126 +3707,1013 @@ perform::save( const Glib::ustring& a_filename )
         // we don't need to write the start frame since it will be recalculated when loaded.
     }
 
-    int bp_measure = get_bp_measure(); // version 4
+    int bp_measure = a_song->m_bp_measure; // version 4
     file.write((const char *) &bp_measure, global_file_int_size);
 
-    int bw = get_bw();                 // version 4
+    int bw = a_song->m_bw;                 // version 4
     file.write((const char *) &bw, global_file_int_size);
 
-    int swing_amount8 = get_swing_amount8();
+    int swing_amount8 = a_song->m_swing_amount8;
     file.write((const char *) &swing_amount8, global_file_int_size);
-    int swing_amount16 = get_swing_amount16();
+    int swing_amount16 = a_song->m_swing_amount16;
     file.write((const char *) &swing_amount16, global_file_int_size);
 
-    int active_tracks = 0;
-    for (int i=0; i< c_max_track; i++ )
-    {
-        if ( is_active_track(i) ) active_tracks++;
-    }
+    int active_tracks = a_song->m_tracks.size();
     file.write((const char *) &active_tracks, global_file_int_size);
 
-    for (int i=0; i< c_max_track; i++ )
+    bool ret = true;
+    for (unsigned n=0; n< a_song->m_tracks.size() && ret; n++ )
     {
-        if ( is_active_track(i) )
-        {
-            int trk_idx = i; // file version 3
-            file.write((const char *) &trk_idx, global_file_int_size);
+        int trk_idx = a_song->m_slots[n]; // file version 3
+        file.write((const char *) &trk_idx, global_file_int_size);
 
-            if(! get_track(i)->save(&file))
-            {
-                return false;
-            }
-        }
+        ret = a_song->m_tracks[n]->save(&file);
+
+        m_save_cond.lock();
+        m_save_written = n + 1;
+        m_save_cond.unlock();
     }
 
     file.close();
 
-    m_mutex.unlock();
-    return true;
+    s_int_size_mutex.unlock();
+
+    if ( !ret || file.fail() || !replace_file(temp.c_str(), a_filename.c_str()) )
+    {
+        remove(temp.c_str());
+        ret = false;
+    }
+
+    if ( ret )
+        journal_saved(a_song, a_filename);
+
+    m_save_write.unlock();
+    return ret;
 }
 
 bool
-perform::load( const Glib::ustring& a_filename )
+perform::save( const Glib::ustring& a_filename )
 {
-    ifstream file (a_filename.c_str (), ios::in | ios::binary);
-
-    if (!file.is_open ()) return false;
+    shared_ptr<song_snapshot> song = take_snapshot();
 
-    bool ret = true;
+    /* an older snapshot still waiting would be written over this one,
+       so this save takes its place and tells how it went */
+    m_save_cond.lock();
+    bool replaced = m_save_pending && m_save_pending_filename == a_filename;
+    if ( replaced )
+        m_save_pending.reset();
+    m_save_cond.unlock();
 
-    int64_t file_id = 0;
-    file.read((char *) &file_id, sizeof(int64_t));
+    bool ret = write_snapshot(song, a_filename);
 
-    if(file_id != c_file_identification) // if it does not match, maybe its old file so reset to beginning
+    if ( replaced )
     {
-        file.clear();
-        file.seekg(0, ios::beg);
-        /* since we are checking for the < version 5 files now, then reset int sizes to original */
-        global_file_int_size = sizeof(int);
-        global_file_long_int_size = sizeof(long);
+        m_save_cond.lock();
+        if ( !m_save_pending )
+        {
+            m_save_filename = a_filename;
+            m_save_state = ret ? SAVE_DONE : SAVE_FAILED;
+        }
+        m_save_cond.unlock();
     }
-    else    // we have version 5 or greater file
-    {
-        char program_version[global_VERSION_array_size +1];
-        file.read(program_version,sizeof(char)* global_VERSION_array_size);
-        program_version[global_VERSION_array_size] = '\0';
 
-        char time[global_time_array_size +1];
-        file.read(time,sizeof(char)* global_time_array_size);
-        time[global_time_array_size] = '\0';
+    return ret;
+}
 
-        printf("SEQ42 Release Version [%s]\n", program_version);
-        printf("File Created [%s]\n", time);
-    }
+void
+perform::save_async( const Glib::ustring& a_filename )
+{
+    shared_ptr<song_snapshot> song = take_snapshot();
 
-    int version;
-    file.read((char *) &version, global_file_int_size);
+    m_save_cond.lock();
 
-    printf("File Version [%d]\n",version);
+    /* one still waiting is for an older song, this one replaces it */
+    m_save_pending = song;
+    m_save_pending_filename = a_filename;
+    m_save_filename = a_filename;
+    m_save_state = SAVE_RUNNING;
 
-    if (version < 0 || version > c_file_version)
+    if ( !m_save_thread_launched )
     {
-        fprintf(stderr, "Invalid file version detected: %d\n", version);
-        /*reset to defaults */
-        global_file_int_size = sizeof(int32_t);
-        global_file_long_int_size = sizeof(int32_t);
-        file.close();
-        return false;
+        if ( pthread_create(&m_save_thread, NULL, save_thread_func, this) == 0 )
+            m_save_thread_launched = true;
     }
 
-    if(version > 6) // version 7 uses tempo markers
-    {
-        uint32_t list_size;
-        file.read((char *) &list_size, sizeof(list_size));
+    m_save_cond.signal();
+    m_save_cond.unlock();
 
-        tempo_mark marker;
-        for(unsigned i = 0; i < list_size; ++i)
-        {
-            file.read((char *) &marker.tick, sizeof(marker.tick));
-            file.read((char *) &marker.bpm, sizeof(marker.bpm));
-            file.read((char *) &marker.bw, sizeof(marker.bw));
-            file.read((char *) &marker.bp_measure, sizeof(marker.bp_measure));
-            // we don't need start marker since set_tempo_load() will recalculate it
+    if ( !m_save_thread_launched )
+    {
+        /* no thread, save it here */
+        m_save_cond.lock();
+        m_save_pending.reset();
+        m_save_cond.unlock();
 
-            m_list_total_marker.push_back(marker);
-        }
+        bool ok = write_snapshot(song, a_filename);
 
-        set_tempo_load(true);
+        m_save_cond.lock();
+        m_save_state = ok ? SAVE_DONE : SAVE_FAILED;
+        m_save_cond.unlock();
     }
-    else
-    {
-        if(version > 5)
-        {
-            double bpm; // file version 6 uses double
-            file.read((char *) &bpm, sizeof(bpm));
-            set_start_tempo(bpm);
-        }
-        else
-        {
-            int bpm;    // prior to version 6 uses int
-            file.read((char *) &bpm, global_file_int_size);
-            set_start_tempo(bpm);
+}
+
+save_state_e
+perform::get_save_state( Glib::ustring *a_filename, int *a_percent )
+{
+    m_save_cond.lock();
+
+    save_state_e state = m_save_state;
+    *a_filename = m_save_filename;
+    *a_percent = m_save_total > 0 ? m_save_written * 100 / m_save_total : 0;
+
+    if ( m_save_state == SAVE_DONE || m_save_state == SAVE_FAILED )
+        m_save_state = SAVE_IDLE;
+
+    m_save_cond.unlock();
+
+    return state;
+}
+
+void
+perform::save_func()
+{
+    m_save_cond.lock();
+
+    while ( true )
+    {
+        if ( !m_save_pending && !m_journal_pending )
+        {
+            if ( !m_saving )
+                break;
+
+            m_save_cond.wait();
+            continue;
+        }
+
+        /* a save goes first, the journal carries on from what it wrote */
+        if ( !m_save_pending )
+        {
+            shared_ptr<song_snapshot> song = m_journal_pending;
+            m_journal_pending.reset();
+
+            m_save_cond.unlock();
+            write_journal(song);
+            m_save_cond.lock();
+            continue;
+        }
+
+        shared_ptr<song_snapshot> song = m_save_pending;
+        Glib::ustring filename = m_save_pending_filename;
+        m_save_pending.reset();
+
+        m_save_cond.unlock();
+
+        bool ok = write_snapshot(song, filename);
+
+        m_save_cond.lock();
+
+        if ( !ok )
+            fprintf(stderr, "Error writing file: %s\n", filename.c_str());
+
+        /* a newer save asked for in the meantime is still to come */
+        if ( !m_save_pending )
+        {
+            m_save_filename = filename;
+            m_save_state = ok ? SAVE_DONE : SAVE_FAILED;
+        }
+    }
+
+    m_save_cond.unlock();
+}
+
+void*
+save_thread_func(void *a_pef )
+{
+    perform *p = (perform *) a_pef;
+    assert(p);
+
+    p->save_func();
+
+    return 0;
+}
+
+const int32_t c_journal_song = 1;
+const int32_t c_journal_track = 2;
+const int32_t c_journal_sequence = 3;
+const int32_t c_journal_triggers = 4;
+const int32_t c_journal_track_settings = 5;
+
+/* magic, version and the stamp of the song file it goes with */
+const size_t c_journal_header_size = sizeof(int64_t) * 3 + sizeof(int32_t);
+
+static Glib::ustring
+journal_name( const Glib::ustring& a_filename )
+{
+    return a_filename + ".journal";
+}
+
+static void
+put_journal_header( chunk_writer *a_out, time_t a_mtime, off_t a_size )
+{
+    int64_t mtime = a_mtime;
+    int64_t size = a_size;
+
+    a_out->put(&c_journal_identification, sizeof(int64_t));
+    a_out->put_int(c_file_version);
+    a_out->put(&mtime, sizeof(int64_t));
+    a_out->put(&size, sizeof(int64_t));
+}
+
+/* the file version the journal was written with, 0 if it is not a
+   journal for a_filename as it is on disk now */
+static int32_t
+check_journal_header( const char *a_data, size_t a_size, const Glib::ustring& a_filename )
+{
+    chunk_reader header(a_data, a_size);
+
+    int64_t file_id = 0, mtime = 0, size = 0;
+    int32_t version = 0;
+    header.get(&file_id, sizeof(int64_t));
+    header.get_int(&version);
+    header.get(&mtime, sizeof(int64_t));
+    header.get(&size, sizeof(int64_t));
+
+    time_t file_mtime = 0;
+    off_t file_size = 0;
+
+    if ( !header.good() || file_id != (int64_t) c_journal_identification ||
+            version < 8 || version > c_file_version ||
+            !get_file_stamp(a_filename, &file_mtime, &file_size) ||
+            mtime != (int64_t) file_mtime || size != (int64_t) file_size )
+        return 0;
+
+    return version;
+}
+
+static bool
+same_tempo( const list<tempo_mark>& a_one, const list<tempo_mark>& a_two )
+{
+    if ( a_one.size() != a_two.size() )
+        return false;
+
+    list<tempo_mark>::const_iterator i = a_one.begin(), j = a_two.begin();
+    for ( ; i != a_one.end(); i++, j++ )
+    {
+        if ( i->tick != j->tick || i->bpm != j->bpm ||
+                i->bw != j->bw || i->bp_measure != j->bp_measure )
+            return false;
+    }
+
+    return true;
+}
+
+/* records what a_to has that a_from does not, false if nothing. The
+   snapshot of a track that did not change is the same one, so a track
+   is looked at only when its snapshot is new. Within it a sequence that
+   did not change still shares its events, so only the sequences,
+   triggers and settings that differ go in. A track that gained or lost
+   sequences goes in whole */
+static bool
+put_journal_records( chunk_writer *a_out, song_snapshot *a_from, song_snapshot *a_to )
+{
+    bool changed = false;
+
+    if ( a_from->m_slots != a_to->m_slots ||
+            a_from->m_bp_measure != a_to->m_bp_measure ||
+            a_from->m_bw != a_to->m_bw ||
+            a_from->m_swing_amount8 != a_to->m_swing_amount8 ||
+            a_from->m_swing_amount16 != a_to->m_swing_amount16 ||
+            !same_tempo(a_from->m_tempo_marks, a_to->m_tempo_marks) )
+    {
+        size_t start = a_out->begin_chunk();
+        a_out->put_int(c_journal_song);
+
+        uint32_t list_size = a_to->m_tempo_marks.size();
+        a_out->put(&list_size, sizeof(list_size));
+        list<tempo_mark>::iterator i;
+        for ( i = a_to->m_tempo_marks.begin(); i != a_to->m_tempo_marks.end(); i++ )
+        {
+            a_out->put(&(*i).tick, sizeof((*i).tick));
+            a_out->put(&(*i).bpm, sizeof((*i).bpm));
+            a_out->put(&(*i).bw, sizeof((*i).bw));
+            a_out->put(&(*i).bp_measure, sizeof((*i).bp_measure));
+        }
+
+        a_out->put_int(a_to->m_bp_measure);
+        a_out->put_int(a_to->m_bw);
+        a_out->put_int(a_to->m_swing_amount8);
+        a_out->put_int(a_to->m_swing_amount16);
+
+        a_out->put_int(a_to->m_slots.size());
+        for ( unsigned n = 0; n < a_to->m_slots.size(); n++ )
+            a_out->put_int(a_to->m_slots[n]);
+
+        a_out->end_chunk(start);
+        changed = true;
+    }
+
+    vector<track *> before(c_max_track, NULL);
+    for ( unsigned n = 0; n < a_from->m_slots.size(); n++ )
+        before[a_from->m_slots[n]] = a_from->m_tracks[n].get();
+
+    for ( unsigned n = 0; n < a_to->m_slots.size(); n++ )
+    {
+        track *from = before[a_to->m_slots[n]];
+        track *to = a_to->m_tracks[n].get();
+
+        if ( from == to )
+            continue;
+
+        if ( from != NULL &&
+                from->get_number_of_sequences() == to->get_number_of_sequences() )
+        {
+            if ( !to->same_settings(*from) )
+            {
+                size_t start = a_out->begin_chunk();
+                a_out->put_int(c_journal_track_settings);
+                a_out->put_int(a_to->m_slots[n]);
+
+                size_t settings_start = a_out->begin_chunk();
+                to->save_settings(a_out);
+                a_out->end_chunk(settings_start);
+
+                a_out->end_chunk(start);
+                changed = true;
+            }
+
+            for ( unsigned s = 0; s < to->get_number_of_sequences(); s++ )
+            {
+                if ( to->get_sequence(s)->same_snapshot(*from->get_sequence(s)) )
+                    continue;
+
+                size_t start = a_out->begin_chunk();
+                a_out->put_int(c_journal_sequence);
+                a_out->put_int(a_to->m_slots[n]);
+                a_out->put_int(s);
+
+                size_t seq_start = a_out->begin_chunk();
+                to->get_sequence(s)->save(a_out);
+                a_out->end_chunk(seq_start);
+
+                a_out->end_chunk(start);
+                changed = true;
+            }
+
+            if ( !to->same_triggers(*from) )
+            {
+                size_t start = a_out->begin_chunk();
+                a_out->put_int(c_journal_triggers);
+                a_out->put_int(a_to->m_slots[n]);
+
+                size_t trigger_start = a_out->begin_chunk();
+                to->save_triggers(a_out);
+                a_out->end_chunk(trigger_start);
+
+                a_out->end_chunk(start);
+                changed = true;
+            }
+
+            continue;
+        }
+
+        size_t start = a_out->begin_chunk();
+        a_out->put_int(c_journal_track);
+        a_out->put_int(a_to->m_slots[n]);
+
+        size_t track_start = a_out->begin_chunk();
+        a_to->m_tracks[n]->save(a_out);
+        a_out->end_chunk(track_start);
+
+        a_out->end_chunk(start);
+        changed = true;
+    }
+
+    return changed;
+}
+
+/* appends what changed since the last call. Once the journal has grown
+   well past its last compacted size it is written again, with only what
+   differs from the song file */
+void
+perform::write_journal( const shared_ptr<song_snapshot>& a_song )
+{
+    m_save_write.lock();
+    m_save_cond.lock();
+
+    Glib::ustring filename = m_journal_filename;
+    shared_ptr<song_snapshot> saved = m_journal_saved;
+    shared_ptr<song_snapshot> written = m_journal_written;
+    time_t mtime = m_journal_mtime;
+    off_t size = m_journal_size;
+    size_t bytes = m_journal_bytes;
+    size_t compacted_bytes = m_journal_compacted_bytes;
+
+    m_save_cond.unlock();
+
+    if ( filename == "" || !written )
+    {
+        m_save_write.unlock();
+        return;
+    }
+
+    Glib::ustring journal = journal_name(filename);
+    chunk_writer records;
+    bool ok = true;
+
+    if ( !put_journal_records(&records, written.get(), a_song.get()) )
+    {
+        m_save_write.unlock();
+        return;
+    }
+
+    if ( bytes + records.get_size() > c_journal_compact_bytes &&
+            bytes + records.get_size() > 2 * compacted_bytes )
+    {
+        chunk_writer out;
+        put_journal_header(&out, mtime, size);
+        bool changed = put_journal_records(&out, saved.get(), a_song.get());
+
+        if ( !changed )
+        {
+            remove(journal.c_str());
+            bytes = compacted_bytes = 0;
+        }
+        else
+        {
+            Glib::ustring temp = journal + ".tmp";
+            ofstream file (temp.c_str (), ios::out | ios::binary | ios::trunc);
+            file.write(out.get_data(), out.get_size());
+            file.close();
+
+            ok = !file.fail() && replace_file(temp.c_str(), journal.c_str());
+            if ( !ok )
+                remove(temp.c_str());
+
+            bytes = compacted_bytes = out.get_size();
+        }
+    }
+    else
+    {
+        chunk_writer out;
+        if ( bytes == 0 )
+            put_journal_header(&out, mtime, size);
+
+        out.put(records.get_data(), records.get_size());
+
+        ofstream file (journal.c_str (), ios::out | ios::binary | ios::app);
+        file.write(out.get_data(), out.get_size());
+        file.close();
+
+        ok = !file.fail() && sync_file(journal.c_str());
+        bytes += out.get_size();
+    }
+
+    if ( !ok )
+        fprintf(stderr, "Error writing journal: %s\n", journal.c_str());
+
+    /* not moved on, so what failed is tried again next time */
+    m_save_cond.lock();
+    if ( ok )
+    {
+        m_journal_written = a_song;
+        m_journal_bytes = bytes;
+        m_journal_compacted_bytes = compacted_bytes;
+    }
+    m_save_cond.unlock();
+
+    m_save_write.unlock();
+}
+
+/* the song file now has a_song, the journal starts over from it.
+   Called with m_save_write held */
+void
+perform::journal_saved( const shared_ptr<song_snapshot>& a_song, const Glib::ustring& a_filename )
+{
+    if ( !global_journal )
+        return;
+
+    m_save_cond.lock();
+
+    /* saved under another name, the journal goes with it */
+    if ( m_journal_filename != "" && m_journal_filename != a_filename )
+        remove(journal_name(m_journal_filename).c_str());
+
+    remove(journal_name(a_filename).c_str());
+
+    if ( get_file_stamp(a_filename, &m_journal_mtime, &m_journal_size) )
+    {
+        m_journal_filename = a_filename;
+        m_journal_saved = a_song;
+        m_journal_written = a_song;
+    }
+    else
+    {
+        m_journal_filename = "";
+        m_journal_saved.reset();
+        m_journal_written.reset();
+    }
+
+    m_journal_bytes = 0;
+    m_journal_compacted_bytes = 0;
+
+    m_save_cond.unlock();
+}
+
+bool
+perform::has_journal( const Glib::ustring& a_filename )
+{
+    mapped_file mapped;
+    if ( !mapped.open(journal_name(a_filename).c_str()) )
+        return false;
+
+    return mapped.get_size() > c_journal_header_size &&
+        check_journal_header(mapped.get_data(), mapped.get_size(), a_filename) != 0;
+}
+
+/* puts the journal records back, up to the first one that is not
+   whole, as the last one may have been cut short by a crash */
+bool
+perform::replay_journal( const char *a_data, size_t a_size, const Glib::ustring& a_filename )
+{
+    int32_t version = 0;
+    if ( a_size <= c_journal_header_size ||
+            (version = check_journal_header(a_data, a_size, a_filename)) == 0 )
+        return false;
+
+    chunk_reader file(a_data + c_journal_header_size, a_size - c_journal_header_size);
+    chunk_reader record;
+    int records = 0;
+
+    while ( file.get_chunk(&record) )
+    {
+        int32_t type = 0;
+        record.get_int(&type);
+
+        if ( type == c_journal_song )
+        {
+            list<tempo_mark> marks;
+            uint32_t list_size = 0;
+            record.get(&list_size, sizeof(list_size));
+
+            tempo_mark marker;
+            for(unsigned i = 0; i < list_size && record.good(); ++i)
+            {
+                record.get(&marker.tick, sizeof(marker.tick));
+                record.get(&marker.bpm, sizeof(marker.bpm));
+                record.get(&marker.bw, sizeof(marker.bw));
+                record.get(&marker.bp_measure, sizeof(marker.bp_measure));
+
+                marks.push_back(marker);
+            }
+
+            int32_t bp_measure = 4, bw = 4, swing_amount8 = 0, swing_amount16 = 0;
+            record.get_int(&bp_measure);
+            record.get_int(&bw);
+            record.get_int(&swing_amount8);
+            record.get_int(&swing_amount16);
+
+            int32_t slots = 0;
+            record.get_int(&slots);
+
+            vector<bool> keep(c_max_track, false);
+            for ( int n = 0; n < slots && record.good(); n++ )
+            {
+                int32_t slot = -1;
+                record.get_int(&slot);
+                if ( slot >= 0 && slot < c_max_track )
+                    keep[slot] = true;
+            }
+
+            if ( !record.good() )
+                break;
+
+            m_list_total_marker = marks;
+            set_tempo_load(true);
+
+            set_bp_measure(bp_measure);
+            set_bw(bw);
+            set_swing_amount8(swing_amount8);
+            set_swing_amount16(swing_amount16);
+
+            for ( int i = 0; i < get_track_slots(); i++ )
+            {
+                if ( is_active_track(i) && !keep[i] )
+                    delete_track(i);
+            }
+        }
+        else if ( type == c_journal_track )
+        {
+            int32_t slot = -1;
+            record.get_int(&slot);
+
+            chunk_reader chunk;
+            if ( !record.get_chunk(&chunk) || slot < 0 || slot >= c_max_track )
+                break;
+
+            track *a_track = new track();
+            if ( !a_track->load(&chunk, version) )
+            {
+                delete a_track;
+                break;
+            }
+
+            if ( is_active_track(slot) )
+                delete_track(slot);
+
+            put_track(slot, a_track);
+        }
+        else if ( type == c_journal_sequence )
+        {
+            int32_t slot = -1, index = -1;
+            record.get_int(&slot);
+            record.get_int(&index);
+
+            chunk_reader chunk;
+            if ( !record.get_chunk(&chunk) || !is_active_track(slot) )
+                break;
+
+            track *a_track = get_track(slot);
+            sequence *a_seq = a_track->get_sequence(index);
+            if ( a_seq == NULL )
+                break;
+
+            sequence loaded;
+            loaded.set_track(a_track);
+            if ( !loaded.load(&chunk, version) )
+                break;
+
+            loaded.verify_and_link();
+            *a_seq = loaded;
+            a_track->set_dirty();
+        }
+        else if ( type == c_journal_triggers )
+        {
+            int32_t slot = -1;
+            record.get_int(&slot);
+
+            chunk_reader chunk;
+            if ( !record.get_chunk(&chunk) || !is_active_track(slot) ||
+                    !get_track(slot)->load_triggers(&chunk) )
+                break;
+        }
+        else if ( type == c_journal_track_settings )
+        {
+            int32_t slot = -1;
+            record.get_int(&slot);
+
+            chunk_reader chunk;
+            if ( !record.get_chunk(&chunk) || !is_active_track(slot) ||
+                    !get_track(slot)->load_settings(&chunk) )
+                break;
+        }
+        else
+            break;
+
+        records++;
+    }
+
+    printf("Recovered %d changes from [%s]\n", records, journal_name(a_filename).c_str());
+
+    return records > 0;
+}
+
+void
+perform::journal_open( const Glib::ustring& a_filename, bool a_replay )
+{
+    /* no write of the journal while it is switched over */
+    m_save_write.lock();
+
+    shared_ptr<song_snapshot> saved = take_snapshot();
+    shared_ptr<song_snapshot> written = saved;
+    Glib::ustring journal = journal_name(a_filename);
+    size_t bytes = 0;
+
+    if ( a_replay )
+    {
+        mapped_file mapped;
+        if ( mapped.open(journal.c_str()) &&
+                replay_journal(mapped.get_data(), mapped.get_size(), a_filename) )
+        {
+            written = take_snapshot();
+            bytes = mapped.get_size();
+        }
+    }
+
+    if ( bytes == 0 )
+        remove(journal.c_str());
+
+    m_save_cond.lock();
+
+    m_journal_filename = "";
+    m_journal_saved.reset();
+    m_journal_written.reset();
+    m_journal_pending.reset();
+    m_journal_bytes = bytes;
+    m_journal_compacted_bytes = 0;
+
+    if ( global_journal &&
+            get_file_stamp(a_filename, &m_journal_mtime, &m_journal_size) )
+    {
+        m_journal_filename = a_filename;
+        m_journal_saved = saved;
+        m_journal_written = written;
+    }
+
+    m_save_cond.unlock();
+    m_save_write.unlock();
+}
+
+void
+perform::journal_close( bool a_discard )
+{
+    m_save_write.lock();
+    m_save_cond.lock();
+
+    if ( a_discard && m_journal_filename != "" )
+        remove(journal_name(m_journal_filename).c_str());
+
+    m_journal_filename = "";
+    m_journal_saved.reset();
+    m_journal_written.reset();
+    m_journal_pending.reset();
+    m_journal_bytes = 0;
+    m_journal_compacted_bytes = 0;
+
+    m_save_cond.unlock();
+    m_save_write.unlock();
+}
+
+void
+perform::journal_tick()
+{
+    m_save_cond.lock();
+    bool journaling = ( m_journal_filename != "" );
+    m_save_cond.unlock();
+
+    if ( !journaling )
+        return;
+
+    shared_ptr<song_snapshot> song = take_snapshot();
+
+    m_save_cond.lock();
+
+    m_journal_pending = song;
+
+    if ( !m_save_thread_launched )
+    {
+        if ( pthread_create(&m_save_thread, NULL, save_thread_func, this) == 0 )
+            m_save_thread_launched = true;
+    }
+
+    m_save_cond.signal();
+    m_save_cond.unlock();
+
+    /* no thread, write it here */
+    if ( !m_save_thread_launched )
+    {
+        m_save_cond.lock();
+        m_journal_pending.reset();
+        m_save_cond.unlock();
+
+        write_journal(song);
+    }
+}
+
+bool
+perform::load( const Glib::ustring& a_filename )
+{
+    /* read apart from us and then installed, or already read by the
+       setlist preload */
+    shared_ptr<song_file> song = take_preloaded(a_filename);
+
+    if ( !song )
+    {
+        song = make_shared<song_file>();
+        if ( !song->read(a_filename, global_lazy_load) )
+            return false;
+    }
+
+    return install_song(song.get());
+}
+
+/* takes over what a_song read in, its tracks are ours afterwards */
+bool
+perform::install_song( song_file *a_song )
+{
+    bool ret = a_song->m_good;
+
+    m_list_total_marker.insert(m_list_total_marker.end(),
+            a_song->m_tempo_marks.begin(), a_song->m_tempo_marks.end());
+    set_tempo_load(true);
+
+    set_bp_measure(a_song->m_bp_measure);
+    set_bw(a_song->m_bw);
+    set_swing_amount8(a_song->m_swing_amount8);
+    set_swing_amount16(a_song->m_swing_amount16);
+
+    for ( int i = 0; i < (int) a_song->m_tracks.size(); i++ )
+    {
+        track *a_track = a_song->m_tracks[i];
+        if ( a_track == NULL )
+            continue;
+
+        a_song->m_tracks[i] = NULL;
+
+        if ( is_active_track(i) )
+        {
+            fprintf(stderr, "Invalid track number detected: %d\n", i);
+            delete a_track;
+            ret = false;
+            continue;
+        }
+
+        place_track( i, a_track );
+    }
+
+    /* and sees the whole song arrive at once */
+    publish_play_tracks();
+
+    return ret;
+}
+
+/* a_new goes in the empty slot a_track, it is ours afterwards */
+void
+perform::put_track( int a_track, track *a_new )
+{
+    place_track( a_track, a_new );
+    publish_play_tracks();
+}
+
+/* put_track() without telling the output thread */
+void
+perform::place_track( int a_track, track *a_new )
+{
+    grow_tracks( a_track + 1 );
+    m_tracks[ a_track ] = a_new;
+    m_tracks[ a_track ]->set_master_midi_bus( &m_master_bus );
+    mark_active( a_track, true );
+}
+
+song_file::song_file() :
+    m_mtime(0),
+    m_size(0),
+    m_good(true),
+    m_bp_measure(4),
+    m_bw(4),
+    m_swing_amount8(0),
+    m_swing_amount16(0)
+{
+}
+
+song_file::~song_file()
+{
+    for ( unsigned i = 0; i < m_tracks.size(); i++ )
+        delete m_tracks[i];
+}
+
+bool
+song_file::read( const Glib::ustring& a_filename, bool a_lazy )
+{
+    /* stamped before reading, so a change while we read shows up later */
+    if ( !get_file_stamp(a_filename, &m_mtime, &m_size) )
+        return false;
+
+    m_filename = a_filename;
+
+    mapped_file mapped;
+    if ( !mapped.open(a_filename.c_str()) )
+        return read_stream(a_filename);
+
+    const char *data = mapped.get_data();
+    size_t version_at = sizeof(int64_t) + global_VERSION_array_size +
+        global_time_array_size;
+
+    int64_t file_id = 0;
+    int32_t version = 0;
+    if ( mapped.get_size() >= version_at + sizeof(int32_t) )
+    {
+        memcpy(&file_id, data, sizeof(int64_t));
+        memcpy(&version, data + version_at, sizeof(int32_t));
+    }
+
+    if ( file_id != c_file_identification || version < 8 )
+        return read_stream(a_filename);
+
+    m_good = read_chunks(data, mapped.get_size(), a_lazy);
+    return true;
+}
+
+bool
+song_file::is_current()
+{
+    time_t mtime = 0;
+    off_t size = 0;
+
+    return get_file_stamp(m_filename, &mtime, &size) &&
+        mtime == m_mtime && size == m_size;
+}
+
+/* reads a file before version 8 a field at a time. Any thread may do it,
+   the global int sizes are held meanwhile */
+bool
+song_file::read_stream( const Glib::ustring& a_filename )
+{
+    ifstream file (a_filename.c_str (), ios::in | ios::binary);
+
+    if (!file.is_open ()) return false;
+
+    s_int_size_mutex.lock();
+    bool ret = read_stream( &file );
+    s_int_size_mutex.unlock();
+
+    return ret;
+}
+
+/* false only if it is not a song at all, m_good says how the rest went */
+bool
+song_file::read_stream( ifstream *a_file )
+{
+    ifstream &file = *a_file;
+
+    bool ret = true;
+
+    int64_t file_id = 0;
+    file.read((char *) &file_id, sizeof(int64_t));
+
+    if(file_id != c_file_identification) // if it does not match, maybe its old file so reset to beginning
+    {
+        file.clear();
+        file.seekg(0, ios::beg);
+        /* since we are checking for the < version 5 files now, then reset int sizes to original */
+        global_file_int_size = sizeof(int);
+        global_file_long_int_size = sizeof(long);
+    }
+    else    // we have version 5 or greater file
+    {
+        char program_version[global_VERSION_array_size +1];
+        file.read(program_version,sizeof(char)* global_VERSION_array_size);
+        program_version[global_VERSION_array_size] = '\0';
+
+        char time[global_time_array_size +1];
+        file.read(time,sizeof(char)* global_time_array_size);
+        time[global_time_array_size] = '\0';
+
+        printf("SEQ42 Release Version [%s]\n", program_version);
+        printf("File Created [%s]\n", time);
+    }
+
+    int version;
+    file.read((char *) &version, global_file_int_size);
+
+    printf("File Version [%d]\n",version);
+
+    if (version < 0 || version > c_file_version)
+    {
+        fprintf(stderr, "Invalid file version detected: %d\n", version);
+        /*reset to defaults */
+        global_file_int_size = sizeof(int32_t);
+        global_file_long_int_size = sizeof(int32_t);
+        file.close();
+        return false;
+    }
+
+    if(version > 6) // version 7 uses tempo markers
+    {
+        uint32_t list_size;
+        file.read((char *) &list_size, sizeof(list_size));
+
+        tempo_mark marker;
+        for(unsigned i = 0; i < list_size; ++i)
+        {
+            file.read((char *) &marker.tick, sizeof(marker.tick));
+            file.read((char *) &marker.bpm, sizeof(marker.bpm));
+            file.read((char *) &marker.bw, sizeof(marker.bw));
+            file.read((char *) &marker.bp_measure, sizeof(marker.bp_measure));
+            // we don't need start marker since set_tempo_load() will recalculate it
+
+            m_tempo_marks.push_back(marker);
+        }
+    }
+    else
+    {
+        /* a single starting marker, as set_start_tempo() makes */
+        tempo_mark marker;
+        marker.tick = STARTING_MARKER;
+
+        if(version > 5)
+        {
+            double bpm; // file version 6 uses double
+            file.read((char *) &bpm, sizeof(bpm));
+            marker.bpm = bpm;
+        }
+        else
+        {
+            int bpm;    // prior to version 6 uses int
+            file.read((char *) &bpm, global_file_int_size);
+            marker.bpm = bpm;
         }
+
+        m_tempo_marks.push_back(marker);
     }
 
     int bp_measure = 4;
@@ -3412,7 +4722,7 @@ perform::load( const Glib::ustring& a_filename )
         file.read((char *) &bp_measure, global_file_int_size);
     }
 
-    set_bp_measure(bp_measure);
+    m_bp_measure = bp_measure;
 
     int bw = 4;
     if(version > 3)
@@ -3420,7 +4730,7 @@ perform::load( const Glib::ustring& a_filename )
         file.read((char *) &bw, global_file_int_size);
     }
 
-    set_bw(bw);
+    m_bw = bw;
 
     int swing_amount8 = 0;
     if(version > 1)
@@ -3428,14 +4738,14 @@ perform::load( const Glib::ustring& a_filename )
         file.read((char *) &swing_amount8, global_file_int_size);
     }
 
-    set_swing_amount8(swing_amount8);
+    m_swing_amount8 = swing_amount8;
     int swing_amount16 = 0;
     if(version > 1)
     {
         file.read((char *) &swing_amount16, global_file_int_size);
     }
 
-    set_swing_amount16(swing_amount16);
+    m_swing_amount16 = swing_amount16;
 
     int active_tracks;
     file.read((char *) &active_tracks, global_file_int_size);
@@ -3449,8 +4759,19 @@ perform::load( const Glib::ustring& a_filename )
             file.read((char *) &trk_index, global_file_int_size);
         }
 
-        new_track(trk_index);
-        if(! get_track(trk_index)->load(&file, version))
+        if ( trk_index < 0 || trk_index >= c_max_track ||
+                (trk_index < (int) m_tracks.size() && m_tracks[trk_index] != NULL) )
+        {
+            fprintf(stderr, "Invalid track number detected: %d\n", trk_index);
+            ret = false;
+            break;
+        }
+
+        if ( trk_index >= (int) m_tracks.size() )
+            m_tracks.resize(trk_index + 1, NULL);
+
+        m_tracks[trk_index] = new track();
+        if(! m_tracks[trk_index]->load(&file, version))
         {
             ret = false;
         }
@@ -3466,18 +4787,165 @@ perform::load( const Glib::ustring& a_filename )
         global_file_long_int_size = sizeof(int32_t);
     }
 
+    m_good = ret;
+    return true;
+}
+
+/* reads a version 8 or later file that is already in memory. The track chunks
+   are read in place, each one is checked before anything is built from
+   it and one that is damaged is left out, the others still load */
+bool
+song_file::read_chunks( const char *a_data, size_t a_size, bool a_lazy )
+{
+    chunk_reader file(a_data, a_size);
+
+    bool ret = true;
+
+    int64_t file_id = 0;
+    file.get(&file_id, sizeof(int64_t));
+
+    char program_version[global_VERSION_array_size +1];
+    file.get(program_version, sizeof(char)* global_VERSION_array_size);
+    program_version[global_VERSION_array_size] = '\0';
+
+    char time[global_time_array_size +1];
+    file.get(time, sizeof(char)* global_time_array_size);
+    time[global_time_array_size] = '\0';
+
+    printf("SEQ42 Release Version [%s]\n", program_version);
+    printf("File Created [%s]\n", time);
+
+    int32_t version = 0;
+    file.get_int(&version);
+
+    printf("File Version [%d]\n",version);
+
+    if (version < 0 || version > c_file_version)
+    {
+        fprintf(stderr, "Invalid file version detected: %d\n", version);
+        return false;
+    }
+
+    uint32_t list_size = 0;
+    file.get(&list_size, sizeof(list_size));
+
+    tempo_mark marker;
+    for(unsigned i = 0; i < list_size && file.good(); ++i)
+    {
+        file.get(&marker.tick, sizeof(marker.tick));
+        file.get(&marker.bpm, sizeof(marker.bpm));
+        file.get(&marker.bw, sizeof(marker.bw));
+        file.get(&marker.bp_measure, sizeof(marker.bp_measure));
+
+        m_tempo_marks.push_back(marker);
+    }
+
+    int32_t bp_measure = 4;
+    file.get_int(&bp_measure);
+    m_bp_measure = bp_measure;
+
+    int32_t bw = 4;
+    file.get_int(&bw);
+    m_bw = bw;
+
+    int32_t swing_amount8 = 0;
+    file.get_int(&swing_amount8);
+    m_swing_amount8 = swing_amount8;
+
+    int32_t swing_amount16 = 0;
+    file.get_int(&swing_amount16);
+    m_swing_amount16 = swing_amount16;
+
+    int32_t active_tracks = 0;
+    file.get_int(&active_tracks);
+
+    if ( !file.good() )
+    {
+        fprintf(stderr, "Truncated file header\n");
+        return false;
+    }
+
+    for (int i=0; i< active_tracks; i++ )
+    {
+        int32_t trk_index = i;
+        file.get_int(&trk_index);
+
+        chunk_reader chunk;
+        if ( !file.get_chunk(&chunk) )
+        {
+            fprintf(stderr, "Truncated file, track %d is missing\n", trk_index);
+            ret = false;
+            break;
+        }
+
+        if ( trk_index < 0 || trk_index >= c_max_track ||
+                (trk_index < (int) m_tracks.size() && m_tracks[trk_index] != NULL) )
+        {
+            fprintf(stderr, "Invalid track number detected: %d\n", trk_index);
+            ret = false;
+            continue;
+        }
+
+        if ( trk_index >= (int) m_tracks.size() )
+            m_tracks.resize(trk_index + 1, NULL);
+
+        m_tracks[trk_index] = new track();
+        if(! m_tracks[trk_index]->load(&chunk, version, a_lazy))
+        {
+            ret = false;
+        }
+    }
+
     return ret;
 }
 
+/* reads in the lazily loaded sequences the song will get to soon,
+   so the output thread does not have to. Called from the timer */
+void
+perform::materialize_ahead()
+{
+    long tick = global_is_running ? m_tick : m_starting_tick;
+
+    /* tracks deleted while a pass was running, this is the gui thread */
+    free_retired_tracks();
+
+    /* the published list, a track in it is not freed while it is held */
+    shared_ptr< const vector<track *> > list = get_play_tracks();
+
+    for (unsigned n=0; n< list->size(); n++ )
+    {
+        (*list)[n]->materialize(tick, tick + c_materialize_ahead_ticks);
+
+        if ( m_looping )
+            (*list)[n]->materialize(m_left_tick, m_left_tick + c_materialize_ahead_ticks);
+    }
+
+    release_play_tracks( &list );
+}
+
 void
 perform::delete_unused_sequences()
 {
     push_perf_undo();
-    for (int i=0; i< c_max_track; i++ )
+    for (unsigned n=0; n< m_active_tracks.size(); n++ )
     {
-        if ( is_active_track(i) )
+        track *a_track = get_track(m_active_tracks[n]);
+
+        for(unsigned int i=0; i<a_track->get_number_of_sequences(); i++)
         {
-            get_track(i)->delete_unused_sequences();
+            if(a_track->get_trigger_count_for_seqidx(i) == 0)
+            {
+                Glib::ustring message = "From track: ";
+                message += a_track->get_name();
+                message += "\nSequence:  ";
+                message += a_track->get_sequence(i)->get_name();
+                message += "\n\nWill be deleted!\nAre you sure?";
+
+                if (!ask_question(message))
+                    continue; // next sequence
+
+                a_track->delete_sequence(i);
+            }
         }
     }
 }
@@ -3486,24 +4954,20 @@ void
 perform::create_triggers()
 {
     push_perf_undo();
-    for (int i=0; i< c_max_track; i++ )
+    for (unsigned n=0; n< m_active_tracks.size(); n++ )
     {
-        if ( is_active_track(i) )
-        {
-            get_track(i)->create_triggers(m_left_tick, m_right_tick);
-        }
+        int i = m_active_tracks[n];
+        get_track(i)->create_triggers(m_left_tick, m_right_tick);
     }
 }
 
 void
 perform::apply_song_transpose()
 {
-    for (int i=0; i< c_max_track; i++ )
+    for (unsigned n=0; n< m_active_tracks.size(); n++ )
     {
-        if ( is_active_track(i) )
-        {
-            get_track(i)->apply_song_transpose();
-        }
+        int i = m_active_tracks[n];
+        get_track(i)->apply_song_transpose();
     }
 }
 /**
@@ -3568,6 +5032,9 @@ perform::add_recent_file (const std::string & fname)
 void perform::set_setlist_mode(bool mode)
 {
     m_setlist_mode = mode;
+
+    if ( !m_setlist_mode )
+        preload_setlist();
 }
 
 bool perform::get_setlist_mode()
@@ -3575,6 +5042,16 @@ bool perform::get_setlist_mode()
     return m_setlist_mode;
 }
 
+bool perform::get_setlist_stop_mark()
+{
+    return m_setlist_stop_mark;
+}
+
+void perform::set_setlist_stop_mark( bool a_mark )
+{
+    m_setlist_stop_mark = a_mark;
+}
+
 void perform::set_setlist_file(const Glib::ustring& fn)
 {   
     printf("Opening setlist %s\n",fn.c_str());
@@ -3606,7 +5083,7 @@ void perform::set_setlist_file(const Glib::ustring& fn)
         }
         else                                                // if we did not get anything
         {
-            error_message_gtk("No files listed in setlist!\n");
+            error_message("No files listed in setlist!\n");
             set_setlist_mode(false);                        // abandon ship
         }
     }
@@ -3614,7 +5091,7 @@ void perform::set_setlist_file(const Glib::ustring& fn)
     {
         Glib::ustring message = "Unable to open setlist file\n";
         message += m_setlist_file; 
-        error_message_gtk(message);
+        error_message(message);
         set_setlist_mode(false);                            // abandon ship
     }
 }
@@ -3638,6 +5115,136 @@ bool perform::set_setlist_index(int index)
         return false;
 
     m_setlist_current_idx = index;
-    
+
+    preload_setlist();
+
     return true;
 }
+
+/* asks the preload thread for the setlist entries either side of the
+   current one, and lets go of any it read that are not wanted now */
+void
+perform::preload_setlist()
+{
+    m_preload_cond.lock();
+
+    m_preload_wanted.clear();
+    m_preload_keep = "";
+
+    if ( m_setlist_mode && m_setlist_current_idx < m_setlist_nfiles )
+    {
+        m_preload_keep = m_setlist_fileset[m_setlist_current_idx];
+
+        if ( m_setlist_current_idx + 1 < m_setlist_nfiles )
+            m_preload_wanted.push_back(m_setlist_fileset[m_setlist_current_idx + 1]);
+
+        if ( m_setlist_current_idx > 0 )
+            m_preload_wanted.push_back(m_setlist_fileset[m_setlist_current_idx - 1]);
+    }
+
+    for ( unsigned i = 0; i < m_preloaded.size(); )
+    {
+        const Glib::ustring& name = m_preloaded[i].first;
+
+        if ( name != m_preload_keep &&
+                find(m_preload_wanted.begin(), m_preload_wanted.end(), name) ==
+                m_preload_wanted.end() )
+            m_preloaded.erase(m_preloaded.begin() + i);
+        else
+            i++;
+    }
+
+    if ( !m_preload_thread_launched && m_preload_wanted.size() )
+    {
+        if ( pthread_create(&m_preload_thread, NULL, preload_thread_func, this) == 0 )
+            m_preload_thread_launched = true;
+    }
+
+    m_preload_cond.signal();
+    m_preload_cond.unlock();
+}
+
+/* the preloaded a_filename, if it is there and still what is on disk */
+shared_ptr<song_file>
+perform::take_preloaded( const Glib::ustring& a_filename )
+{
+    shared_ptr<song_file> song;
+
+    m_preload_cond.lock();
+
+    for ( unsigned i = 0; i < m_preloaded.size(); i++ )
+    {
+        if ( m_preloaded[i].first == a_filename )
+        {
+            song = m_preloaded[i].second;
+            m_preloaded.erase(m_preloaded.begin() + i);
+            break;
+        }
+    }
+
+    m_preload_cond.unlock();
+
+    if ( song && !song->is_current() )
+        song.reset();
+
+    return song;
+}
+
+void
+perform::preload_func()
+{
+    m_preload_cond.lock();
+
+    while ( m_preloading )
+    {
+        Glib::ustring filename;
+
+        for ( unsigned i = 0; i < m_preload_wanted.size() && filename == ""; i++ )
+        {
+            filename = m_preload_wanted[i];
+
+            for ( unsigned j = 0; j < m_preloaded.size(); j++ )
+            {
+                if ( m_preloaded[j].first == filename )
+                {
+                    filename = "";
+                    break;
+                }
+            }
+        }
+
+        if ( filename == "" )
+        {
+            m_preload_cond.wait();
+            continue;
+        }
+
+        /* read in full, off the lock so a jump is not held up by it */
+        m_preload_cond.unlock();
+
+        shared_ptr<song_file> song = make_shared<song_file>();
+        if ( !song->read(filename, false) )
+            song.reset();
+
+        m_preload_cond.lock();
+
+        /* it may not be wanted any more after the time it took */
+        if ( filename == m_preload_keep ||
+                find(m_preload_wanted.begin(), m_preload_wanted.end(), filename) !=
+                m_preload_wanted.end() )
+            m_preloaded.push_back(make_pair(filename, song));
+    }
+
+    m_preload_cond.unlock();
+}
+
+void*
+preload_thread_func(void *a_pef )
+{
+    perform *p = (perform *) a_pef;
+    assert(p);
+
+    p->preload_func();
+
+    return 0;
+}
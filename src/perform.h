@@ -33,6 +33,8 @@ class perform;
 #   include <unistd.h>
 #endif
 #include <pthread.h>
+#include <sys/types.h>
+#include <memory>
 
 /* if we have jack, include the jack headers */
 #ifdef JACK_SUPPORT
@@ -68,9 +70,11 @@ struct undo_type
     int track;
 };
 
+/* one snapshot per track slot, NULL for an empty slot. Snapshots of
+   unchanged tracks are shared with the previous undo entry. */
 struct undo_redo_perf_tracks
 {
-    track perf_tracks[c_max_track];
+    vector< shared_ptr<track> > perf_tracks;
 };
 
 struct tempo_mark
@@ -86,6 +90,73 @@ struct tempo_mark
         }
 };
 
+/* a song file read in apart from any perform, so it can be done on
+   another thread and then handed over with perform::install_song() */
+class song_file
+{
+public:
+
+    Glib::ustring m_filename;
+
+    /* when and how big the file was when it was read */
+    time_t m_mtime;
+    off_t m_size;
+
+    /* false if some of it was damaged, what could be read is still here */
+    bool m_good;
+
+    /* by track slot, NULL for an empty one. The tracks still here are
+       deleted with us */
+    vector<track *> m_tracks;
+
+    list<tempo_mark> m_tempo_marks;
+    int m_bp_measure;
+    int m_bw;
+    int m_swing_amount8;
+    int m_swing_amount16;
+
+    song_file();
+    ~song_file();
+
+    /* false if the file can not be opened or is not a song. Files
+       before version 8 are read in full, a_lazy is for the later ones */
+    bool read( const Glib::ustring& a_filename, bool a_lazy );
+
+    /* false if the file has changed on disk since it was read */
+    bool is_current();
+
+private:
+
+    bool read_chunks( const char *a_data, size_t a_size, bool a_lazy );
+    bool read_stream( const Glib::ustring& a_filename );
+    bool read_stream( ifstream *a_file );
+
+    song_file( const song_file& );
+    song_file& operator=( const song_file& );
+};
+
+/* what save writes, taken under the lock and written out after it is
+   let go. The tracks are shared with the undo snapshots */
+struct song_snapshot
+{
+    vector<int> m_slots;
+    vector< shared_ptr<track> > m_tracks;
+
+    list<tempo_mark> m_tempo_marks;
+    int m_bp_measure;
+    int m_bw;
+    int m_swing_amount8;
+    int m_swing_amount16;
+};
+
+enum save_state_e
+{
+    SAVE_IDLE,
+    SAVE_RUNNING,
+    SAVE_DONE,
+    SAVE_FAILED
+};
+
 #ifdef JACK_SUPPORT
 /*  Bar and beat start at 1. */
 struct BBT
@@ -129,6 +200,20 @@ struct time_sig
 #define STOP_MARKER         0.0
 #define STARTING_MARKER     0
 
+/* what the engine needs from whoever drives it. mainwnd puts these up
+   as dialogs; without one errors are printed, questions are answered
+   yes and quit raises SIGTERM for the headless loop */
+class perform_ui
+{
+public:
+
+    virtual ~perform_ui() {}
+
+    virtual void error_message( const Glib::ustring& a_message ) = 0;
+    virtual bool ask_question( const Glib::ustring& a_message ) = 0;
+    virtual void quit() = 0;
+};
+
 class perform
 {
 public:
@@ -143,10 +228,16 @@ public:
 
     unsigned int 	m_key_setlist_next;
     unsigned int 	m_key_setlist_prev;
-    bool                m_setlist_stop_mark;
+
+    /* set by the output thread on a stop marker, the gui or headless
+       loop jumps to the next file once transport has stopped */
+    bool get_setlist_stop_mark();
+    void set_setlist_stop_mark( bool a_mark );
     // end selist public
 private:
 
+    bool m_setlist_stop_mark;
+
     //Setlist mode
     bool m_setlist_mode;
     Glib::ustring m_setlist_file;
@@ -156,29 +247,48 @@ private:
     // end selist private
 
     /* vector of tracks */
-    track *m_tracks[c_max_track];
-    track m_clipboard;
-    track m_undo_tracks[c_max_undo_track];
-    track m_redo_tracks[c_max_undo_track];
-    int m_undo_track_count;
-    int m_redo_track_count;
-
-    undo_redo_perf_tracks undo_perf[c_max_undo_perf];
-    undo_redo_perf_tracks redo_perf[c_max_undo_perf];
-    int m_undo_perf_count;
-    int m_redo_perf_count;
-
-    bool m_tracks_active[ c_max_track ];
+    /* track slots, NULL when empty. Grown as tracks are added, but the
+       capacity is reserved up front since the output thread walks them
+       without the lock. */
+    vector<track *> m_tracks;
+
+    /* the active slots in order, what the engine loops walk */
+    vector<int> m_active_tracks;
+
+    /* what the output thread walks: a copy of the active tracks that is
+       never changed, only replaced whole under m_mutex. The lists that
+       were replaced stay listed until nobody holds them any more, and
+       deleted tracks wait in m_retired_tracks until then. */
+    shared_ptr< const vector<track *> > m_play_tracks;
+    vector< weak_ptr< const vector<track *> > > m_old_play_tracks;
+    vector<track *> m_retired_tracks;
+
+    /* undo snapshots are only allocated when pushed, NULL for an empty slot */
+    vector< shared_ptr<track> > m_undo_tracks;
+    vector< shared_ptr<track> > m_redo_tracks;
+
+    vector<undo_redo_perf_tracks> m_undo_perf;
+    vector<undo_redo_perf_tracks> m_redo_perf;
+
+    /* the last snapshot taken or restored for each slot, reused while
+       the track still matches it */
+    vector< weak_ptr<track> > m_track_snapshot;
+
+    /* read off the gui thread too, so no packed bits */
+    vector<char> m_tracks_active;
     bool m_seqlist_open;
     bool m_seqlist_raise;
 
-    bool m_was_active_edit[ c_max_track ];
-    bool m_was_active_perf[ c_max_track ];
-    bool m_was_active_names[ c_max_track ];
+    vector<bool> m_was_active_edit;
+    vector<bool> m_was_active_perf;
+    vector<bool> m_was_active_names;
 
     /* our midibus */
     mastermidibus m_master_bus;
 
+    /* dialogs, NULL when headless */
+    perform_ui *m_ui;
+
     /* pthread info */
     pthread_t m_out_thread;
     pthread_t m_in_thread;
@@ -246,6 +356,67 @@ private:
 
     std::vector<std::string> m_recent_files;
 
+    void grow_tracks( int a_slots );
+
+    bool mark_active( int a_track, bool a_active );
+    void retire_track( int a_num );
+    void publish_play_tracks();
+    shared_ptr< const vector<track *> > get_play_tracks();
+    void release_play_tracks( shared_ptr< const vector<track *> > *a_list );
+    void free_retired_tracks();
+
+    bool install_song( song_file *a_song );
+
+    /* the setlist entries either side of the current one, read in ahead
+       by the preload thread. A NULL song is a file that could not be */
+    pthread_t m_preload_thread;
+    bool m_preload_thread_launched;
+    bool m_preloading;
+    condition_var m_preload_cond;
+    vector<Glib::ustring> m_preload_wanted;
+    Glib::ustring m_preload_keep;
+    vector< pair< Glib::ustring, shared_ptr<song_file> > > m_preloaded;
+
+    void preload_setlist();
+    shared_ptr<song_file> take_preloaded( const Glib::ustring& a_filename );
+
+    /* the save thread, writes out snapshots so nothing waits on the disk.
+       m_save_write is held while a file is written, so one save at a time */
+    pthread_t m_save_thread;
+    bool m_save_thread_launched;
+    bool m_saving;
+    condition_var m_save_cond;
+    seq42_mutex m_save_write;
+    shared_ptr<song_snapshot> m_save_pending;
+    Glib::ustring m_save_pending_filename;
+    Glib::ustring m_save_filename;
+    save_state_e m_save_state;
+    int m_save_written;
+    int m_save_total;
+
+    shared_ptr<song_snapshot> take_snapshot();
+    bool write_snapshot( const shared_ptr<song_snapshot>& a_song, const Glib::ustring& a_filename );
+
+    /* the edit journal, <song>.journal, holds what changed since the song
+       file was written. It is written on the save thread and, like the
+       save, guarded by m_save_cond. m_journal_saved is the song as in the
+       file, m_journal_written as far as the journal goes */
+    Glib::ustring m_journal_filename;
+    time_t m_journal_mtime;
+    off_t m_journal_size;
+    shared_ptr<song_snapshot> m_journal_saved;
+    shared_ptr<song_snapshot> m_journal_written;
+    shared_ptr<song_snapshot> m_journal_pending;
+    size_t m_journal_bytes;
+    size_t m_journal_compacted_bytes;
+
+    void write_journal( const shared_ptr<song_snapshot>& a_song );
+    void journal_saved( const shared_ptr<song_snapshot>& a_song, const Glib::ustring& a_filename );
+    bool replay_journal( const char *a_data, size_t a_size, const Glib::ustring& a_filename );
+
+    void put_track( int a_track, track *a_new );
+    void place_track( int a_track, track *a_new );
+
     void inner_start( bool a_state );
     void inner_stop(bool a_midi_clock = false);
 
@@ -255,8 +426,6 @@ public:
     vector<undo_type> undo_vect;
     vector<undo_type> redo_vect;
 
-    track m_tracks_clipboard[c_max_track];
-    
     /* m_list_play_marker is used to trigger bpm or stops when running in play().
      * As each marker is encountered, it's value is used, then it is erased.
      * It is reset at stop, or when any new marker is set or removed by user.
@@ -299,7 +468,7 @@ public:
     unsigned int m_key_seqlist;
     unsigned int m_key_follow_trans;
 
-    perform();
+    perform( bool a_open_midi = true );
     ~perform();
 
     void start_playing();
@@ -380,20 +549,32 @@ public:
     void pop_perf_undo(bool a_import = false);
     void pop_perf_redo(bool a_import = false);
 
+    shared_ptr<track> snapshot_track( int a_track );
+    void restore_track( int a_track, const shared_ptr<track>& a_snapshot );
+
     void check_max_undo_redo();
     void set_have_undo();
     void set_have_redo();
 
     void print();
-    void error_message_gtk( Glib::ustring message);
+
+    void set_ui( perform_ui *a_ui );
+    void error_message( const Glib::ustring& a_message );
+    bool ask_question( const Glib::ustring& a_message );
+    void quit();
 
     void start( bool a_state );
     void stop();
 
+    /* only from the gui timer or the headless loop, the thread that
+       deletes sequences and tracks */
+    void materialize_ahead();
+
     bool get_tempo_reset();
     void set_tempo_reset(bool a_reset);
     bool get_tempo_load();
     void set_tempo_load(bool a_load);
+    void load_tempo_list();
     double get_start_tempo();
     void set_start_tempo(double a_bpm);
 
@@ -407,6 +588,10 @@ public:
     void set_active(int a_track, bool a_active);
     void set_was_active( int a_track );
     bool is_active_track(int a_track);
+    /* number of track slots, all active tracks are below it */
+    int get_track_slots();
+    /* rows to show, one empty row past the last slot */
+    int get_track_rows();
     bool is_dirty_perf (int a_sequence);
     bool is_dirty_names (int a_sequence);
 
@@ -414,8 +599,17 @@ public:
 
     /* plays all notes to Current tick */
     void play( long a_tick );
+    void play_tracks( long a_tick );
     void set_orig_ticks( long a_tick  );
 
+    /* plays the song from a_start_tick to a_end_tick in song mode on a
+       virtual clock, one tick at a time, into a_log instead of the ports.
+       Tempo markers, mutes, swing and transpose apply as in real playback.
+       If looping is on, the L/R section is played a_loops times first.
+       Fails if the sequencer is running */
+    bool render( vector<render_event> *a_log, long a_start_tick,
+                 long a_end_tick, int a_loops = 0 );
+
     void tempo_change();
 
     track *get_track( int a_trk );
@@ -449,6 +643,8 @@ public:
 
     void output_func();
     void input_func();
+    void preload_func();
+    void save_func();
 
     unsigned short combine_bytes(unsigned char First, unsigned char Second);
     void parse_sysex(event a_e);
@@ -458,9 +654,28 @@ public:
     bool track_is_song_exportable(int a_track);
 
     std::string current_date_time();
+
+    /* where the memory goes, per track and with a_detail per sequence */
+    void print_memory( FILE *a_file, bool a_detail = true );
+    std::string get_memory_report( bool a_detail = false );
     bool save( const Glib::ustring& a_filename );
     bool load( const Glib::ustring& a_filename );
 
+    /* saves on the save thread, get_save_state() tells how it went.
+       SAVE_DONE and SAVE_FAILED are told once, then it is SAVE_IDLE */
+    void save_async( const Glib::ustring& a_filename );
+    save_state_e get_save_state( Glib::ustring *a_filename, int *a_percent );
+
+    /* true if a_filename has a journal of changes that were never saved */
+    bool has_journal( const Glib::ustring& a_filename );
+    /* starts the journal for the song just loaded from a_filename, with
+       a_replay the changes in its journal are put back first */
+    void journal_open( const Glib::ustring& a_filename, bool a_replay );
+    /* stops the journal, with a_discard its file is removed too */
+    void journal_close( bool a_discard = false );
+    /* queues what changed since the last call for the journal */
+    void journal_tick();
+
     friend class midifile;
     friend class optionsfile;
     friend class options;
@@ -523,6 +738,8 @@ public:
 /* located in perform.C */
 extern void *output_thread_func(void *a_p);
 extern void *input_thread_func(void *a_p);
+extern void *preload_thread_func(void *a_p);
+extern void *save_thread_func(void *a_p);
 
 /* located in mainwnd.h */
 extern ff_rw_type_e FF_RW_button_type;
@@ -21,6 +21,7 @@
 #include "perfroll.h"
 #include "seqedit.h"
 #include "font.h"
+#include "trace.h"
 
 
 perfroll::perfroll( perform *a_perf,
@@ -47,6 +48,7 @@ perfroll::perfroll( perform *a_perf,
     m_roll_length_ticks(0),
     m_drop_y(0),
     m_drop_track(0),
+    m_track_rows(0),
 
     m_vadjust(a_vadjust),
     m_hadjust(a_hadjust),
@@ -79,9 +81,6 @@ perfroll::perfroll( perform *a_perf,
     set_size_request( 10, 10 );
 
     set_double_buffered( false );
-
-    for( int i=0; i<c_max_track; ++i )
-        m_track_active[i]=false;
 }
 
 perfroll::~perfroll( )
@@ -178,13 +177,15 @@ perfroll::update_sizes()
         m_hadjust->set_value( h_max_value );
     }
 
+    m_track_rows = m_mainperf->get_track_rows();
+
     m_vadjust->set_lower( 0 );
-    m_vadjust->set_upper( c_max_track );
+    m_vadjust->set_upper( m_track_rows );
     m_vadjust->set_page_size( m_window_y / c_names_y );
     m_vadjust->set_step_increment( 1 );
     m_vadjust->set_page_increment( 1 );
 
-    int v_max_value = c_max_track - (m_window_y / c_names_y);
+    int v_max_value = m_track_rows - (m_window_y / c_names_y);
 
     if ( m_vadjust->get_value() > v_max_value )
     {
@@ -367,12 +368,10 @@ void perfroll::draw_track_on( Glib::RefPtr<Gdk::Drawable> a_draw, int a_track )
     long tick_offset = m_4bar_offset * c_ppqn * 16;
     long x_offset = tick_offset / m_perf_scale_x;
 
-    if ( a_track < c_max_track )
+    if ( a_track < m_track_rows )
     {
         if ( m_mainperf->is_active_track( a_track ))
         {
-            m_track_active[a_track] = true;
-
             track *trk =  m_mainperf->get_track( a_track );
             trk->reset_draw_trigger_marker();
             a_track -= m_track_offset;
@@ -598,8 +597,14 @@ perfroll::on_expose_event(GdkEventExpose* e)
 void
 perfroll::redraw_dirty_tracks()
 {
+    TRACE_SCOPE( "perfroll::redraw_dirty_tracks" );
+
     bool draw = false;
 
+    /* a track added on the last row adds a row */
+    if ( m_track_rows != m_mainperf->get_track_rows() )
+        update_sizes();
+
     int y_s = 0;
     int y_f = m_window_y / c_names_y;
 
@@ -929,7 +934,7 @@ perfroll::on_key_press_event(GdkEventKey* a_p0)
                     /* for cross-track trigger paste we need to clear all previous trigger copies
                        or the cross track routine will just grab the earliest one if leftover */
 
-                    for ( int t=0; t<c_max_track; ++t )
+                    for ( int t=0; t<m_mainperf->get_track_slots(); ++t )
                     {
                         if (! m_mainperf->is_active_track( t ))
                         {
@@ -1001,8 +1006,8 @@ perfroll::convert_xy( int a_x, int a_y, long *a_tick, int *a_track)
     *a_tick += tick_offset;
     *a_track  += m_track_offset;
 
-    if ( *a_track >= c_max_track )
-        *a_track = c_max_track - 1;
+    if ( *a_track >= m_track_rows )
+        *a_track = m_track_rows - 1;
 
     if ( *a_track < 0 )
         *a_track = 0;
@@ -1118,7 +1123,7 @@ perfroll::del_trigger( track *a_track, long a_tick )
 void
 perfroll::paste_trigger_mouse(long a_tick)
 {
-    for ( int t=0; t<c_max_track; ++t )
+    for ( int t=0; t<m_mainperf->get_track_slots(); ++t )
     {
         if (! m_mainperf->is_active_track( t ))
         {
@@ -1255,7 +1260,7 @@ perfroll::trigger_menu_popup(GdkEventButton* a_ev, perfroll& ths)
 
         Menu *copy_seq_menu = NULL;
         char name[40];
-        for ( int t=0; t<c_max_track; ++t )
+        for ( int t=0; t<ths.m_mainperf->get_track_slots(); ++t )
         {
             if (! ths.m_mainperf->is_active_track( t ))
             {
@@ -97,7 +97,8 @@ private:
     long         m_drop_tick_trigger_offset;
     int          m_drop_track;
 
-    bool         m_track_active[c_max_track];
+    /* rows the scroll range was set for */
+    int          m_track_rows;
 
     Adjustment   *m_vadjust;
     Adjustment   *m_hadjust;
@@ -0,0 +1,350 @@
+//----------------------------------------------------------------------------
+//
+//  This file is part of seq42.
+//
+//  seq42 is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  seq42 is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with seq42; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+//-----------------------------------------------------------------------------
+
+#include "perfstats.h"
+
+#include <time.h>
+
+#ifdef __WIN32__
+#   include <windows.h>
+#endif
+
+perfstats global_perfstats;
+std::string global_stats_file = "";
+
+stats_histogram::stats_histogram()
+{
+    reset();
+}
+
+void
+stats_histogram::reset()
+{
+    m_count = 0;
+    m_min = 0;
+    m_max = 0;
+    m_sum = 0;
+
+    for ( int i = 0; i < c_stats_buckets; i++ )
+        m_buckets[i] = 0;
+}
+
+void
+stats_histogram::add( long a_us )
+{
+    if ( a_us < 0 )
+        a_us = 0;
+
+    /* index is the number of significant bits */
+    int index = 0;
+    unsigned long v = a_us;
+    while ( v && index < c_stats_buckets - 1 )
+    {
+        v >>= 1;
+        index++;
+    }
+    m_buckets[index]++;
+
+    if ( m_count == 0 || a_us < m_min )
+        m_min = a_us;
+    if ( a_us > m_max )
+        m_max = a_us;
+
+    m_sum += a_us;
+    m_count++;
+}
+
+long
+stats_histogram::get_avg() const
+{
+    if ( m_count == 0 )
+        return 0;
+
+    return (long)(m_sum / m_count);
+}
+
+long
+stats_histogram::get_percentile( int a_percent ) const
+{
+    if ( m_count == 0 )
+        return 0;
+
+    long wanted = (long)(((long long) m_count * a_percent + 99) / 100);
+    long seen = 0;
+
+    for ( int i = 0; i < c_stats_buckets; i++ )
+    {
+        seen += m_buckets[i];
+        if ( seen >= wanted )
+        {
+            /* don't report more than we have seen */
+            long edge = (i == 0) ? 1 : (1L << i);
+            return (edge < m_max) ? edge : m_max;
+        }
+    }
+
+    return m_max;
+}
+
+void
+stats_histogram::print( std::string *a_out, const char *a_name ) const
+{
+    string_printf( a_out,
+             "%-14s count %ld min %ld avg %ld p50 %ld p99 %ld max %ld\n",
+             a_name, m_count, m_min, get_avg(),
+             get_percentile( 50 ), get_percentile( 99 ), m_max );
+
+    for ( int i = 0; i < c_stats_buckets; i++ )
+    {
+        if ( m_buckets[i] == 0 )
+            continue;
+
+        long low = (i == 0) ? 0 : (1L << (i - 1));
+        long high = (1L << i) - 1;
+
+        string_printf( a_out, "  [%8ld-%8ld]us %8ld\n", low, high, m_buckets[i] );
+    }
+}
+
+perfstats::perfstats()
+{
+    m_mutex.set_name( "perfstats" );
+    reset();
+}
+
+void
+perfstats::lock()
+{
+    m_mutex.lock();
+}
+
+void
+perfstats::unlock()
+{
+    m_mutex.unlock();
+}
+
+void
+perfstats::reset()
+{
+    lock();
+
+    m_loop.reset();
+    m_wake_late.reset();
+    m_clock_period.reset();
+    m_drain.reset();
+
+    m_underruns = 0;
+
+    for ( int i = 0; i < c_maxBuses; i++ )
+    {
+        m_bus_events[i] = 0;
+        m_bus_events_last[i] = 0;
+        m_bus_rate[i] = 0;
+    }
+
+    m_reset_us = now_us();
+    m_rate_last_us = m_reset_us;
+
+    unlock();
+}
+
+void
+perfstats::add_loop( long a_us )
+{
+    if ( !global_stats )
+        return;
+
+    lock();
+    m_loop.add( a_us );
+    unlock();
+}
+
+void
+perfstats::add_wake_late( long a_us )
+{
+    if ( !global_stats )
+        return;
+
+    lock();
+    m_wake_late.add( a_us );
+    unlock();
+}
+
+void
+perfstats::add_clock_period( long a_us )
+{
+    if ( !global_stats )
+        return;
+
+    lock();
+    m_clock_period.add( a_us );
+    unlock();
+}
+
+void
+perfstats::add_drain( long a_us )
+{
+    if ( !global_stats )
+        return;
+
+    lock();
+    m_drain.add( a_us );
+    unlock();
+}
+
+void
+perfstats::add_underrun()
+{
+    if ( !global_stats )
+        return;
+
+    lock();
+    m_underruns++;
+    unlock();
+}
+
+void
+perfstats::add_bus_event( int a_bus )
+{
+    if ( !global_stats || a_bus < 0 || a_bus >= c_maxBuses )
+        return;
+
+    lock();
+    m_bus_events[a_bus]++;
+    unlock();
+}
+
+void
+perfstats::snapshot( perfstats *a_copy )
+{
+    lock();
+
+    long now = now_us();
+    long elapsed = now - m_rate_last_us;
+
+    if ( elapsed > 0 )
+    {
+        for ( int i = 0; i < c_maxBuses; i++ )
+        {
+            m_bus_rate[i] = (long)((long long)(m_bus_events[i] - m_bus_events_last[i])
+                                   * 1000000 / elapsed);
+            m_bus_events_last[i] = m_bus_events[i];
+        }
+        m_rate_last_us = now;
+    }
+
+    a_copy->m_loop = m_loop;
+    a_copy->m_wake_late = m_wake_late;
+    a_copy->m_clock_period = m_clock_period;
+    a_copy->m_drain = m_drain;
+    a_copy->m_underruns = m_underruns;
+
+    for ( int i = 0; i < c_maxBuses; i++ )
+    {
+        a_copy->m_bus_events[i] = m_bus_events[i];
+        a_copy->m_bus_events_last[i] = m_bus_events_last[i];
+        a_copy->m_bus_rate[i] = m_bus_rate[i];
+    }
+
+    a_copy->m_rate_last_us = m_rate_last_us;
+    a_copy->m_reset_us = m_reset_us;
+
+    unlock();
+}
+
+void
+perfstats::print( FILE *a_file )
+{
+    fputs( get_report().c_str(), a_file );
+}
+
+/* the report is built from a snapshot so the output thread is never
+   held up by the formatting */
+std::string
+perfstats::get_report()
+{
+    std::string report;
+
+    perfstats copy;
+    snapshot( &copy );
+
+    string_printf( &report, "-- seq42 stats, %.1fs since reset --\n",
+                   (now_us() - copy.m_reset_us) / 1000000.0 );
+
+    copy.m_loop.print( &report, "loop" );
+    copy.m_wake_late.print( &report, "wake_late" );
+    copy.m_clock_period.print( &report, "clock_period" );
+    copy.m_drain.print( &report, "drain" );
+
+    string_printf( &report, "underruns      %ld\n", copy.m_underruns );
+
+    for ( int i = 0; i < c_maxBuses; i++ )
+    {
+        if ( copy.m_bus_events[i] == 0 )
+            continue;
+
+        string_printf( &report, "bus[%2d]        events %ld rate %ld/s\n",
+                       i, copy.m_bus_events[i], copy.m_bus_rate[i] );
+    }
+
+    /* empty unless built with --enable-lock-stats */
+    seq42_mutex::report( &report );
+
+    return report;
+}
+
+/* write to a temp file and rename, so a reader never sees half a report */
+bool
+perfstats::write_file( const std::string& a_filename )
+{
+    std::string tmp = a_filename + ".tmp";
+
+    FILE *file = fopen( tmp.c_str(), "w" );
+    if ( file == NULL )
+    {
+        printf( "Error writing [%s]\n", tmp.c_str() );
+        return false;
+    }
+
+    print( file );
+    fclose( file );
+
+    if ( rename( tmp.c_str(), a_filename.c_str() ) != 0 )
+    {
+        printf( "Error writing [%s]\n", a_filename.c_str() );
+        return false;
+    }
+
+    return true;
+}
+
+long
+perfstats::now_us()
+{
+#ifndef __WIN32__
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (now.tv_sec * 1000000) + (now.tv_nsec / 1000);
+#else
+    return timeGetTime() * 1000;
+#endif // __WIN32__
+}
@@ -0,0 +1,119 @@
+//----------------------------------------------------------------------------
+//
+//  This file is part of seq42.
+//
+//  seq42 is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  seq42 is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with seq42; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <stdio.h>
+#include <string>
+
+#include "globals.h"
+#include "mutex.h"
+
+/* bucket 0 holds < 1us, bucket n holds [2^(n-1), 2^n) us, the last
+   one everything bigger (~17 min) */
+const int c_stats_buckets = 32;
+
+/* how often the stats file is rewritten */
+const int c_stats_file_interval_ms = 2000;
+
+class stats_histogram
+{
+
+public:
+
+    long m_count;
+    long m_min;
+    long m_max;
+    long long m_sum;
+
+    long m_buckets[c_stats_buckets];
+
+    stats_histogram();
+
+    void reset();
+    void add( long a_us );
+
+    long get_avg() const;
+
+    /* upper edge of the bucket holding the a_percent'th value */
+    long get_percentile( int a_percent ) const;
+
+    void print( std::string *a_out, const char *a_name ) const;
+};
+
+/* everything --stats keeps track of. The output thread writes, the
+   gui reads a copy through snapshot(), all calls are no-ops unless
+   global_stats is set */
+class perfstats
+{
+
+private:
+
+    /* time the output thread spent in one loop, play to sleep */
+    stats_histogram m_loop;
+    /* how much later than asked for we came out of the sleep */
+    stats_histogram m_wake_late;
+    /* time between two midi clocks */
+    stats_histogram m_clock_period;
+    /* time spent draining the alsa output */
+    stats_histogram m_drain;
+
+    long m_underruns;
+
+    long m_bus_events[c_maxBuses];
+
+    /* for events/sec, counts at the previous snapshot */
+    long m_bus_events_last[c_maxBuses];
+    long m_bus_rate[c_maxBuses];
+    long m_rate_last_us;
+
+    long m_reset_us;
+
+    seq42_mutex m_mutex;
+
+    void lock();
+    void unlock();
+
+public:
+
+    perfstats();
+
+    void reset();
+
+    void add_loop( long a_us );
+    void add_wake_late( long a_us );
+    void add_clock_period( long a_us );
+    void add_drain( long a_us );
+    void add_underrun();
+    void add_bus_event( int a_bus );
+
+    /* updates the per bus rates, then copies everything into a_copy */
+    void snapshot( perfstats *a_copy );
+
+    void print( FILE *a_file );
+    std::string get_report();
+    bool write_file( const std::string& a_filename );
+
+    /* monotonic clock for the above */
+    static long now_us();
+};
+
+extern perfstats global_perfstats;
+extern std::string global_stats_file;
@@ -18,9 +18,13 @@
 //
 //-----------------------------------------------------------------------------
 
+#include <algorithm>
 #include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
 
 #ifdef __WIN32__
 #    include "configwin32.h"
@@ -28,6 +32,11 @@
 #    include "config.h"
 #endif
 
+#ifdef __WIN32__
+#    include <windows.h>
+#endif
+
+#include "convert.h"
 #include "font.h"
 #ifdef LASH_SUPPORT
 #    include "lash.h"
@@ -36,6 +45,8 @@
 #include "midifile.h"
 #include "optionsfile.h"
 #include "perform.h"
+#include "perfstats.h"
+#include "trace.h"
 #include "userfile.h"
 
 /* struct for command parsing */
@@ -46,6 +57,10 @@ static struct
     {"showmidi",     0, 0, 's'},
     {"show_keys",     0, 0, 'k' },
     {"stats",     0, 0, 'S' },
+    {"stats_file", required_argument, 0, 'F' },
+#ifdef TRACE_SUPPORT
+    {"trace_file", required_argument, 0, 'T' },
+#endif
     {"priority", 0, 0, 'p' },
     {"ignore",required_argument, 0, 'i'},
     {"interaction_method",required_argument, 0, 'x'},
@@ -60,46 +75,31 @@ static struct
     {"use_sysex", 0, 0, 'u'},
     {"version", 0, 0, 'v'},
     {"client_name", required_argument, 0, 'n'},
+    {"render", required_argument, 0, 'R'},
+    {"headless", 0, 0, 'H'},
+    {"export_song", 0, 0, 'E'},
+    {"import_midi", 0, 0, 'I'},
+    {"output_dir", required_argument, 0, 'o'},
+    {"workers", required_argument, 0, 'w'},
     {0, 0, 0, 0}
 };
 
 static const char versiontext[] = PACKAGE " " VERSION "\n";
 
-bool global_manual_alsa_ports = false;
-bool global_showmidi = false;
-bool global_priority = false;
 bool global_device_ignore = false;
 int global_device_ignore_num = 0;
-bool global_stats = false;
-bool global_pass_sysex = false;
-bool global_use_sysex = false;
-Glib::ustring global_filename = "";
-Glib::ustring last_used_dir ="/";
-Glib::ustring last_midi_dir ="/";
 std::string config_filename = ".seq42rc";
 std::string user_filename = ".seq42usr";
-Glib::ustring global_client_name = "seq42"; // default
 Glib::ustring setlist_file = "";
-bool global_print_keys = false;
-interaction_method_e global_interactionmethod = e_seq42_interaction;
-
-bool global_with_jack_transport = false;
-bool global_with_jack_master = false;
-bool global_with_jack_master_cond = false;
-bool global_song_start_mode = true;
+Glib::ustring render_file = "";
+bool convert_export = false;
+bool convert_import = false;
+Glib::ustring convert_dir = "";
+int convert_workers = 0;
 bool setlist_mode = false;
 
-Glib::ustring global_jack_session_uuid = "";
-
-user_midi_bus_definition   global_user_midi_bus_definitions[c_maxBuses];
-user_instrument_definition global_user_instrument_definitions[c_max_instruments];
-
 font *p_font_renderer;
 
-#ifdef LASH_SUPPORT
-lash *lash_driver = NULL;
-#endif
-
 #ifdef __WIN32__
 #   define HOME "HOMEPATH"
 #   define SLASH "\\"
@@ -108,13 +108,239 @@ lash *lash_driver = NULL;
 #   define SLASH "/"
 #endif
 
+static volatile sig_atomic_t headless_quit = 0;
+#ifdef TRACE_SUPPORT
+static volatile sig_atomic_t headless_trace_dump = 0;
+#endif
+
+static void
+headless_signal( int a_signal )
+{
+#if defined TRACE_SUPPORT && !defined __WIN32__
+    if ( a_signal == SIGUSR2 )
+    {
+        headless_trace_dump = 1;
+        return;
+    }
+#endif
+    headless_quit = 1;
+}
+
+/* mainwnd::open_file() without the window */
+static bool
+headless_open_file( perform *a_perf, const Glib::ustring& a_fn )
+{
+    if ( !a_perf->clear_all() )
+        return false;
+
+    if ( !a_perf->load( a_fn ) )
+    {
+        printf( "Error reading file: %s\n", a_fn.c_str() );
+        global_filename = "";
+        return false;
+    }
+
+    global_filename = a_fn;
+    global_is_modified = false;
+
+    /* the gui tempo widget normally does this */
+    a_perf->set_tempo_load( false );
+    a_perf->load_tempo_list();
+    a_perf->set_bpm( a_perf->get_start_tempo() );
+
+    printf( "Loaded [%s]\n", a_fn.c_str() );
+
+    return true;
+}
+
+static bool
+headless_setlist_jump( perform *a_perf, int a_jmp )
+{
+    if ( !a_perf->set_setlist_index( a_perf->get_setlist_index() + a_jmp ) )
+        return false;
+
+    return headless_open_file( a_perf, a_perf->get_setlist_current_file() );
+}
+
+static bool
+has_extension( const Glib::ustring& a_fn, const char *a_ext )
+{
+    Glib::ustring ext( a_ext );
+
+    return a_fn.size() > ext.size() &&
+        a_fn.substr( a_fn.size() - ext.size() ).lowercase() == ext;
+}
+
+static bool
+is_convert_input( const Glib::ustring& a_fn )
+{
+    if ( convert_export )
+        return has_extension( a_fn, ".s42" );
+
+    return has_extension( a_fn, ".mid" ) || has_extension( a_fn, ".midi" );
+}
+
+/* a file, or the songs or midi files in a directory */
+static void
+convert_add_input( converter *a_conv, const Glib::ustring& a_path )
+{
+    if ( !Glib::file_test( a_path, Glib::FILE_TEST_IS_DIR ) )
+    {
+        a_conv->add( a_path, a_conv->get_output_name( a_path, convert_dir ) );
+        return;
+    }
+
+    vector<Glib::ustring> names;
+
+    try
+    {
+        Glib::Dir dir( a_path );
+        for ( Glib::DirIterator i = dir.begin(); i != dir.end(); ++i )
+        {
+            if ( is_convert_input( *i ) )
+                names.push_back( Glib::build_filename( a_path, *i ) );
+        }
+    }
+    catch ( const Glib::FileError& )
+    {
+        printf( "Error reading directory [%s]\n", a_path.c_str() );
+        return;
+    }
+
+    sort( names.begin(), names.end() );
+
+    for ( unsigned i = 0; i < names.size(); i++ )
+        a_conv->add( names[i], a_conv->get_output_name( names[i], convert_dir ) );
+}
+
+/* --export_song and --import_midi: the files given, the ones in the
+   directories given and the setlist, converted across all cores */
+static bool
+convert_files( perform *a_perf, int argc, char *argv[] )
+{
+    converter conv( convert_export ? CONVERT_SONG_TO_MIDI : CONVERT_MIDI_TO_SONG );
+
+    const char *out_ext = convert_export ? ".mid" : ".s42";
+
+    /* seq42 --export_song in.s42 out.mid */
+    if ( argc - optind == 2 && convert_dir == "" && !setlist_mode &&
+            has_extension( argv[optind + 1], out_ext ) &&
+            !Glib::file_test( argv[optind], Glib::FILE_TEST_IS_DIR ) )
+    {
+        conv.add( argv[optind], argv[optind + 1] );
+    }
+    else
+    {
+        for ( int i = optind; i < argc; i++ )
+            convert_add_input( &conv, argv[i] );
+
+        if ( setlist_mode )
+        {
+            a_perf->set_setlist_file( setlist_file );
+
+            for ( int i = 0; a_perf->set_setlist_index( i ); i++ )
+                convert_add_input( &conv, a_perf->get_setlist_current_file() );
+        }
+    }
+
+    if ( conv.get_count() == 0 )
+    {
+        printf( "Nothing to convert, give files, directories or a setlist\n" );
+        return false;
+    }
+
+    return conv.run( convert_workers );
+}
+
+/* stands in for kit.run() and the mainwnd timer: the input and output
+   threads do the playing, started by midi start or jack transport */
+static void
+headless_run( perform *a_perf )
+{
+    signal( SIGINT, headless_signal );
+    signal( SIGTERM, headless_signal );
+#if defined TRACE_SUPPORT && !defined __WIN32__
+    signal( SIGUSR2, headless_signal );
+#endif
+
+    printf( "Running headless, Ctrl-C to quit\n" );
+
+    long stats_ms = 0;
+
+    while ( !headless_quit )
+    {
+#ifndef __WIN32__
+        struct timespec delta;
+        delta.tv_sec = 0;
+        delta.tv_nsec = c_redraw_ms * 1000000;
+        nanosleep( &delta, NULL );
+#else
+        Sleep( c_redraw_ms );
+#endif // __WIN32__
+
+        a_perf->materialize_ahead();
+
+        if ( a_perf->get_tempo_load() )
+        {
+            a_perf->set_tempo_load( false );
+            a_perf->load_tempo_list();
+            a_perf->set_bpm( a_perf->get_start_tempo() );
+        }
+
+        if ( a_perf->get_tempo_reset() )
+        {
+            a_perf->m_list_play_marker = a_perf->m_list_total_marker;
+            a_perf->set_tempo_reset( false );
+            a_perf->set_bpm( a_perf->get_start_tempo() );
+        }
+
+        /* wait for transport to stop before loading, like the gui */
+        if ( a_perf->get_setlist_stop_mark() && !global_is_running )
+        {
+            a_perf->set_setlist_stop_mark( false );
+            headless_setlist_jump( a_perf, 1 );
+        }
+
+#ifdef TRACE_SUPPORT
+        if ( headless_trace_dump )
+        {
+            headless_trace_dump = 0;
+            trace_dump( global_trace_file );
+        }
+#endif
+
+        if ( global_stats_file != "" )
+        {
+            stats_ms += c_redraw_ms;
+            if ( stats_ms >= c_stats_file_interval_ms )
+            {
+                stats_ms = 0;
+                global_perfstats.write_file( global_stats_file );
+            }
+        }
+    }
+
+    a_perf->stop_playing();
+}
+
 
 int
 main (int argc, char *argv[])
 {
+    /* headless must not touch gtk, it would want a display */
+    for ( int i = 1; i < argc; i++ )
+    {
+        if ( strcmp( argv[i], "-H" ) == 0 || strcmp( argv[i], "--headless" ) == 0 ||
+                strcmp( argv[i], "-E" ) == 0 || strcmp( argv[i], "--export_song" ) == 0 ||
+                strcmp( argv[i], "-I" ) == 0 || strcmp( argv[i], "--import_midi" ) == 0 )
+            global_headless = true;
+    }
+
     /* Scan the argument vector and strip off all parameters known to
      * GTK+. */
-    Gtk::Main kit(argc, argv);
+    Gtk::Main *kit = NULL;
+    if ( !global_headless )
+        kit = new Gtk::Main(argc, argv);
 
     /*prepare global MIDI definitions*/
     for ( int i=0; i<c_maxBuses; i++ )
@@ -145,7 +371,7 @@ main (int argc, char *argv[])
         /* getopt_long stores the option index here. */
         int option_index = 0;
 
-        c = getopt_long (argc, argv, "Chi:jJkmM:pPsSuU:vx:X:n:", long_options, &option_index);
+        c = getopt_long (argc, argv, "ChHEIF:i:jJkmM:o:pPR:sSuT:U:vw:x:X:n:", long_options, &option_index);
 
         /* Detect the end of the options. */
         if (c == -1)
@@ -175,17 +401,64 @@ main (int argc, char *argv[])
             printf( "                          modes are available (0 = live mode)\n");
             printf( "                                              (1 = song mode) (default)\n" );
             printf( "   -n, --client_name <name>: Set alsa client name: Default = seq42\n");
+            printf( "   -R, --render <file.mid>: play the song given as file offline and save what\n" );
+            printf( "                            would have been sent as a midi file, then exit.\n" );
+            printf( "                            Sysex passed through from the input is dropped\n" );
+            printf( "   -H, --headless: no gui, load the file and play on midi start or\n" );
+            printf( "                   jack transport until SIGINT/SIGTERM\n" );
+            printf( "   -E, --export_song: save each .s42 file given as a midi song file, then exit.\n" );
+            printf( "                      Give in.s42 out.mid, or files, directories and -X setlist\n" );
+            printf( "   -I, --import_midi: save each midi file given as a .s42 file, then exit.\n" );
+            printf( "                      Give in.mid out.s42, or files and directories\n" );
+            printf( "   -o, --output_dir <dir>: where -E and -I write, default next to each file\n" );
+            printf( "   -w, --workers <number>: files converted at once, default one a core\n" );
             printf( "   -S, --stats: show statistics\n" );
+            printf( "   -F, --stats_file <file>: rewrite statistics to file every %d seconds (implies -S)\n",
+                    c_stats_file_interval_ms / 1000 );
+#ifdef TRACE_SUPPORT
+            printf( "   -T, --trace_file <file>: trace dump written on SIGUSR2 and exit\n" );
+#endif
             printf( "   -U, --jack_session_uuid <uuid>: set uuid for jack session\n" );
             printf( "\n\n\n" );
 
             return EXIT_SUCCESS;
             break;
 
+        case 'H':
+            global_headless = true;
+            break;
+
+        case 'E':
+            convert_export = true;
+            break;
+
+        case 'I':
+            convert_import = true;
+            break;
+
+        case 'o':
+            convert_dir = Glib::ustring(optarg);
+            break;
+
+        case 'w':
+            convert_workers = atoi( optarg );
+            break;
+
         case 'S':
             global_stats = true;
             break;
 
+        case 'F':
+            global_stats = true;
+            global_stats_file = optarg;
+            break;
+
+#ifdef TRACE_SUPPORT
+        case 'T':
+            global_trace_file = optarg;
+            break;
+#endif
+
         case 's':
             global_showmidi = true;
             break;
@@ -256,6 +529,10 @@ main (int argc, char *argv[])
             global_interactionmethod = (interaction_method_e)atoi( optarg );
             break;
 
+        case 'R':
+            render_file = Glib::ustring(optarg);
+            break;
+
         case 'X':
             setlist_mode = true;
             setlist_file = Glib::ustring(optarg);
@@ -266,8 +543,8 @@ main (int argc, char *argv[])
         }
     } /* end while */
 
-    /* the main performance object */
-    perform p;
+    /* the main performance object, with no midi client when converting */
+    perform p( !(convert_export || convert_import) );
 
     /* read user preferences files */
     if ( getenv( HOME ) != NULL )
@@ -304,35 +581,86 @@ main (int argc, char *argv[])
     else
         printf( "Error calling getenv( \"%s\" )\n", HOME );
 
+    /* conversion needs no midi ports, jack or window */
+    if (convert_export || convert_import)
+    {
+        if (convert_export && convert_import)
+        {
+            printf("Give one of --export_song and --import_midi\n");
+            return EXIT_FAILURE;
+        }
+
+        return convert_files(&p, argc, argv) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     p.init();
 
     p.launch_input_thread();
     p.launch_output_thread();
     p.init_jack();
 
-    p_font_renderer = new font();
+    mainwnd *seq42_window = NULL;
 
-    mainwnd seq42_window( &p );
+    if (!global_headless)
+    {
+        p_font_renderer = new font();
+        seq42_window = new mainwnd( &p );
+    }
 
     if (optind < argc)
     {
-        if (Glib::file_test(argv[optind], Glib::FILE_TEST_EXISTS))
-            seq42_window.open_file(argv[optind]);
-        else
+        if (!Glib::file_test(argv[optind], Glib::FILE_TEST_EXISTS))
             printf("File not found: %s\n", argv[optind]);
+        else if (global_headless)
+            headless_open_file(&p, argv[optind]);
+        else
+            seq42_window->open_file(argv[optind]);
+    }
+
+    if (render_file != "")
+    {
+        bool result = false;
+
+        if (global_filename == "")
+        {
+            printf("Nothing to render, give a .s42 file\n");
+        }
+        else
+        {
+            vector<render_event> log;
+
+            if (p.render(&log, 0, p.get_max_trigger()))
+            {
+                midifile f(render_file);
+                result = f.write_render(&p, log);
+
+                printf("Rendered %d events to [%s]\n", (int) log.size(), render_file.c_str());
+            }
+
+            if (!result)
+                printf("Error writing [%s]\n", render_file.c_str());
+        }
+
+        p.deinit_jack();
+
+        return result ? EXIT_SUCCESS : EXIT_FAILURE;
     }
 
     if(setlist_mode)
     {
         p.set_setlist_mode(setlist_mode);
         p.set_setlist_file(setlist_file);
-        if(seq42_window.verify_setlist_dialog())
+        if(global_headless)
+        {
+            headless_setlist_jump(&p, 0);
+        }
+        else if(seq42_window->verify_setlist_dialog())
         {
-            seq42_window.setlist_verify();
+            seq42_window->setlist_verify();
         }
         else
         {
-            seq42_window.setlist_jump(0);
+            seq42_window->setlist_jump(0);
         }
     }
     
@@ -340,7 +668,26 @@ main (int argc, char *argv[])
 #ifdef LASH_SUPPORT
     lash_driver->start( &p );
 #endif
-    kit.run(seq42_window);
+    if (global_headless)
+    {
+        TRACE_THREAD( "main" );
+        headless_run(&p);
+    }
+    else
+    {
+        TRACE_THREAD( "gui" );
+        kit->run(*seq42_window);
+    }
+
+#ifdef TRACE_SUPPORT
+    trace_dump( global_trace_file );
+#endif
+
+#ifdef LOCK_STATS
+    std::string locks;
+    seq42_mutex::report( &locks );
+    fputs( locks.c_str(), stdout );
+#endif
 
     p.deinit_jack();
 
@@ -366,6 +713,9 @@ main (int argc, char *argv[])
     delete lash_driver;
 #endif
 
+    delete seq42_window;
+    delete kit;
+
     return 0;
 }
 
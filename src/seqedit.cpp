@@ -1033,7 +1033,7 @@ seqedit::popup_sequence_menu()
     m_menu_sequences->items().push_back( SeparatorElem( ));
 
     char name[40];
-    for ( int t=0; t<c_max_track; ++t )
+    for ( int t=0; t<m_mainperf->get_track_slots(); ++t )
     {
         if (! m_mainperf->is_active_track( t ))
         {
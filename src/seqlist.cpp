@@ -157,7 +157,7 @@ seqlist::update_model()
 {
     m_refTreeModel->clear();
     Gtk::TreeModel::Row row;
-    for(int i=0; i< c_max_track; i++ )
+    for(int i=0; i< m_perf->get_track_slots(); i++ )
     {
         if ( m_perf->is_active_track(i) )
         {
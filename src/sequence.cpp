@@ -18,13 +18,303 @@
 //
 //-----------------------------------------------------------------------------
 #include "sequence.h"
-#include "seqedit.h"
+#include "trace.h"
 #include <stdlib.h>
 #include <fstream>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
 
-list < event > sequence::m_list_clipboard;
+vector < event > sequence::m_list_clipboard;
+
+/* see take_damaged_count() */
+static std::atomic<int> s_damaged_count( 0 );
+
+/* orders indices by the events they point at, for sort_list() */
+struct event_index_less
+{
+    vector<event> *m_events;
+
+    event_index_less( vector<event> *a_events ) : m_events(a_events) {}
+
+    bool operator()( long a, long b ) const
+    {
+        return (*m_events)[a] < (*m_events)[b];
+    }
+};
+
+/* one empty body for all new sequences and those without undo,
+   edit_events() takes a sequence its own at the first change */
+static const shared_ptr< vector<event> > &
+empty_events( )
+{
+    static const shared_ptr< vector<event> > empty = make_shared< vector<event> >();
+
+    return empty;
+}
+
+/* how a sequence chunk holds its events, from version 9 */
+const int32_t c_events_records = 0;
+const int32_t c_events_packed = 1;
+
+/* a packed event is the time since the one before as a varint, with
+   the low bit set when a status byte follows. Then the first data
+   byte, its high bit set when the second one is 0 and left out */
+const int c_max_packed_event = c_max_varint_size + 3;
+
+/* only events in time order, with data bytes in range, can be packed */
+static bool
+can_pack_events( const vector<event> &a_events )
+{
+    uint32_t last = 0;
+    for ( unsigned long i = 0; i < a_events.size(); i++ )
+    {
+        event_record record;
+        a_events[i].get_record( &record );
+
+        if ( record.m_timestamp < last ||
+                record.m_timestamp - last >= 0x80000000 ||
+                ((record.m_data[0] | record.m_data[1]) & 0x80) )
+            return false;
+
+        last = record.m_timestamp;
+    }
+
+    return true;
+}
+
+static size_t
+pack_events( const vector<event> &a_events, char *a_out )
+{
+    char *out = a_out;
+    uint32_t last = 0;
+    int status = -1;
+
+    for ( unsigned long i = 0; i < a_events.size(); i++ )
+    {
+        event_record record;
+        a_events[i].get_record( &record );
+
+        bool new_status = record.m_status != status;
+        out += put_varint( out, (record.m_timestamp - last) << 1 | new_status );
+
+        if ( new_status )
+            *out++ = record.m_status;
+
+        if ( record.m_data[1] == 0 )
+            *out++ = record.m_data[0] | 0x80;
+        else
+        {
+            *out++ = record.m_data[0];
+            *out++ = record.m_data[1];
+        }
+
+        last = record.m_timestamp;
+        status = record.m_status;
+    }
+
+    return out - a_out;
+}
+
+/* reads c_max_packed_event bytes at most, the caller sees they are
+   there. The choices are made with masks, not branches, they follow
+   the music and would mostly be guessed wrong */
+static inline const char *
+unpack_event( const char *a_in, event_record *a_record )
+{
+    uint32_t value;
+    const char *in = get_varint( a_in, &value );
+
+    a_record->m_timestamp += value >> 1;
+
+    int new_status = value & 1;
+    unsigned char status = *in;
+    a_record->m_status = (status & -new_status) |
+                         (a_record->m_status & (new_status - 1));
+    in += new_status;
+
+    unsigned char data0 = in[0];
+    unsigned char data1 = in[1];
+    int has_data1 = !(data0 & 0x80);
+    a_record->m_data[0] = data0 & 0x7F;
+    a_record->m_data[1] = data1 & -has_data1;
+
+    return in + 1 + has_data1;
+}
+
+/* false if the bytes do not hold exactly a_count events */
+static bool
+unpack_events( const char *a_in, size_t a_size, event *a_events, uint32_t a_count )
+{
+    const char *in = a_in;
+    const char *end = a_in + a_size;
+
+    event_record record;
+    record.m_timestamp = 0;
+    record.m_status = 0;
+    record.m_reserved = 0;
+
+    uint32_t i = 0;
+    for ( ; i < a_count && end - in >= c_max_packed_event; i++ )
+    {
+        in = unpack_event( in, &record );
+        a_events[i].set_record( record );
+    }
+
+    if ( i == a_count )
+        return in == end;
+
+    /* the last few bytes are copied out with room after them */
+    char tail[2 * c_max_packed_event] = { 0 };
+    size_t tail_size = end - in;
+    if ( tail_size > sizeof(tail) - c_max_packed_event )
+        return false;
+
+    memcpy( tail, in, tail_size );
+
+    const char *tail_in = tail;
+    for ( ; i < a_count; i++ )
+    {
+        tail_in = unpack_event( tail_in, &record );
+        if ( tail_in > tail + tail_size )
+            return false;
+
+        a_events[i].set_record( record );
+    }
+
+    return tail_in == tail + tail_size;
+}
+
+event_delta::event_delta( ) :
+    m_hunks(make_shared< const vector<event_hunk> >()),
+    m_bytes(0)
+{
+}
+
+void
+event_delta::diff( const vector<event> &a_old, const vector<event> &a_new )
+{
+    unsigned long i = 0;
+    unsigned long j = 0;
+
+    vector<event_hunk> hunks;
+    m_bytes = 0;
+
+    while ( i < a_old.size() || j < a_new.size() )
+    {
+        if ( i < a_old.size() && j < a_new.size() && a_old[i] == a_new[j] )
+        {
+            i++;
+            j++;
+            continue;
+        }
+
+        event_hunk hunk;
+        hunk.m_index = i;
+
+        /* both are sorted, so walk them like a merge until
+           they line up again */
+        while ( i < a_old.size() || j < a_new.size() )
+        {
+            if ( j == a_new.size() ||
+                    ( i < a_old.size() && a_old[i] < a_new[j] ) )
+            {
+                hunk.m_removed.push_back( a_old[i++] );
+            }
+            else if ( i == a_old.size() || a_new[j] < a_old[i] )
+            {
+                hunk.m_inserted.push_back( a_new[j++] );
+            }
+            else if ( a_old[i] == a_new[j] )
+            {
+                break;
+            }
+            else
+            {
+                /* same place, changed data */
+                hunk.m_removed.push_back( a_old[i++] );
+                hunk.m_inserted.push_back( a_new[j++] );
+            }
+        }
+
+        m_bytes += sizeof(event_hunk);
+
+        for ( unsigned long k = 0; k < hunk.m_removed.size(); k++ )
+            m_bytes += hunk.m_removed[k].get_memory_bytes();
+
+        for ( unsigned long k = 0; k < hunk.m_inserted.size(); k++ )
+            m_bytes += hunk.m_inserted[k].get_memory_bytes();
+
+        hunks.push_back( hunk );
+    }
+
+    m_hunks = make_shared< const vector<event_hunk> >( std::move( hunks ) );
+}
+
+/* one pass, the events between the hunks are copied over as they are */
+void
+event_delta::replay( const vector<event> &a_events, vector<event> *a_result,
+                     bool a_revert )
+{
+    vector<event> &result = *a_result;
+    vector<event_hunk>::const_iterator h;
+
+    result.clear();
+    result.reserve( a_events.size() );
+
+    unsigned long from = 0;
+    long shift = 0;
+
+    for ( h = m_hunks->begin(); h != m_hunks->end(); h++ )
+    {
+        const vector<event> &take = a_revert ? (*h).m_inserted : (*h).m_removed;
+        const vector<event> &put = a_revert ? (*h).m_removed : (*h).m_inserted;
+
+        /* going back, the indices are off by what the hunks before added */
+        unsigned long index = (*h).m_index + (a_revert ? shift : 0);
+
+        result.insert( result.end(), a_events.begin() + from, a_events.begin() + index );
+        result.insert( result.end(), put.begin(), put.end() );
+
+        from = index + take.size();
+        shift += (long) (*h).m_inserted.size() - (long) (*h).m_removed.size();
+    }
+
+    result.insert( result.end(), a_events.begin() + from, a_events.end() );
+}
+
+void
+event_delta::apply( const vector<event> &a_events, vector<event> *a_result )
+{
+    replay( a_events, a_result, false );
+}
+
+void
+event_delta::revert( const vector<event> &a_events, vector<event> *a_result )
+{
+    replay( a_events, a_result, true );
+}
+
+bool
+event_delta::empty( )
+{
+    return m_hunks->size() == 0;
+}
+
+long
+event_delta::get_bytes( )
+{
+    return m_bytes;
+}
 
 sequence::sequence( ) :
+    m_list_event(empty_events()),
+    m_file_damaged(false),
+    m_undo_anchor(empty_events()),
+    m_hold_undo(false),
+
+    m_draw_index(0),
+
     m_playing(false),
     m_recording(false),
     m_quanized_rec(false),
@@ -57,24 +347,61 @@ sequence::sequence( ) :
     /* no notes are playing */
     for (int i=0; i< c_midi_notes; i++ )
         m_playing_notes[i] = 0;
+    m_num_playing_notes = 0;
+
+    m_mutex.set_name( "seq ", m_name.c_str() );
 }
 
-void
-sequence::set_hold_undo (bool a_hold)
+const vector<event> &
+sequence::read_events ()
 {
-    list<event>::iterator i;
+    if ( m_file_events && !m_file_damaged )
+        materialize();
 
-    lock();
+    return *m_list_event;
+}
+
+vector<event> &
+sequence::edit_events ()
+{
+    if ( m_file_events && !m_file_damaged )
+        materialize();
 
-    if(a_hold)
+    /* an edit replaces what could not be read in */
+    if ( m_file_damaged )
     {
-        for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
-        {
-            m_list_undo_hold.push_back( (*i) );
-        }
+        m_file_events.reset();
+        m_file_damaged = false;
     }
-    else
-       m_list_undo_hold.clear( );
+
+    if ( m_list_event.use_count() > 1 )
+        m_list_event = make_shared< vector<event> >( *m_list_event );
+
+    return *m_list_event;
+}
+
+/* for an edit that holds its undo point. The point is pushed before
+   the events are taken, so the anchor keeps them as they were and
+   the first step of the edit can be undone too */
+vector<event> &
+sequence::edit_held_events ()
+{
+    if ( !m_hold_undo )
+        set_hold_undo( true );
+
+    return edit_events();
+}
+
+void
+sequence::set_hold_undo (bool a_hold)
+{
+    lock();
+
+    /* the first change of a drag, remember where it started */
+    if ( a_hold && !m_hold_undo )
+        push_undo();
+
+    m_hold_undo = a_hold;
 
     unlock();
 }
@@ -82,20 +409,32 @@ sequence::set_hold_undo (bool a_hold)
 int
 sequence::get_hold_undo ()
 {
-    return m_list_undo_hold.size();
+    return m_hold_undo;
 }
 
+/* the new undo point starts out as an empty delta, the edit that
+   follows is folded into it by sync_undo() at the next push or pop */
 void
 sequence::push_undo(bool a_hold)
 {
     lock();
-    if(a_hold)
-        m_list_undo.push( m_list_undo_hold );
-    else
-        m_list_undo.push( m_list_event );
 
-    unlock();
+    /* a held undo point was pushed when the drag started */
+    if ( !a_hold )
+    {
+        sync_undo();
+
+        m_list_undo.push_back( event_delta() );
+        m_list_redo.clear();
+        read_events();
+        m_undo_anchor = m_list_event;
+
+        trim_undo();
+    }
+
     set_have_undo();
+    set_have_redo();
+    unlock();
 }
 
 void
@@ -105,16 +444,23 @@ sequence::pop_undo()
 
     if (m_list_undo.size() > 0 )
     {
-        m_list_redo.push( m_list_event );
-        m_list_event = m_list_undo.top();
-        m_list_undo.pop();
+        sync_undo();
+
+        shared_ptr< vector<event> > events = make_shared< vector<event> >();
+        m_list_undo.back().revert( read_events(), events.get() );
+        m_list_event = events;
+        m_undo_anchor = m_list_event;
+
+        m_list_redo.push_back( m_list_undo.back() );
+        m_list_undo.pop_back();
+
         verify_and_link();
         unselect();
     }
 
-    unlock();
     set_have_undo();
     set_have_redo();
+    unlock();
 }
 
 void
@@ -124,16 +470,107 @@ sequence::pop_redo()
 
     if (m_list_redo.size() > 0 )
     {
-        m_list_undo.push( m_list_event );
-        m_list_event = m_list_redo.top();
-        m_list_redo.pop();
+        sync_undo();
+
+        shared_ptr< vector<event> > events = make_shared< vector<event> >();
+        m_list_redo.back().apply( read_events(), events.get() );
+        m_list_event = events;
+        m_undo_anchor = m_list_event;
+
+        m_list_undo.push_back( m_list_redo.back() );
+        m_list_redo.pop_back();
+
         verify_and_link();
         unselect();
     }
 
-    unlock();
     set_have_redo();
     set_have_undo();
+    unlock();
+}
+
+/*
+    Anything done to the events since the anchor, usually the edit that
+    came after push_undo(), goes into the newest undo delta, and the
+    newest redo delta is made to start from the events as they are now.
+*/
+void
+sequence::sync_undo()
+{
+    if ( m_list_undo.empty() && m_list_redo.empty() )
+        return;
+
+    const vector<event> &events = read_events();
+
+    /* still the anchor's body, nothing was edited */
+    if ( m_list_event == m_undo_anchor )
+        return;
+
+    event_delta drift;
+    drift.diff( *m_undo_anchor, events );
+
+    if ( drift.empty() )
+        return;
+
+    if ( m_list_undo.size() )
+    {
+        if ( m_list_undo.back().empty() )
+        {
+            m_list_undo.back() = drift;
+        }
+        else
+        {
+            vector<event> before;
+            m_list_undo.back().revert( *m_undo_anchor, &before );
+            m_list_undo.back().diff( before, events );
+        }
+    }
+
+    if ( m_list_redo.size() )
+    {
+        vector<event> after;
+        m_list_redo.back().apply( *m_undo_anchor, &after );
+        m_list_redo.back().diff( events, after );
+    }
+
+    m_undo_anchor = m_list_event;
+
+    trim_undo();
+}
+
+/* drops the oldest undo, then the furthest redo, the newest undo is
+   always kept */
+void
+sequence::trim_undo()
+{
+    long bytes = 0;
+    deque<event_delta>::iterator i;
+
+    for ( i = m_list_undo.begin(); i != m_list_undo.end(); i++ )
+        bytes += (*i).get_bytes();
+
+    for ( i = m_list_redo.begin(); i != m_list_redo.end(); i++ )
+        bytes += (*i).get_bytes();
+
+    /* the anchor only costs a copy once an edit has split it from
+       the events */
+    if ( m_undo_anchor != m_list_event )
+        bytes += m_undo_anchor->capacity() * sizeof(event);
+
+    while ( bytes > c_max_undo_seq_bytes && m_list_undo.size() > 1 )
+    {
+        bytes -= m_list_undo.front().get_bytes();
+        m_list_undo.pop_front();
+    }
+
+    while ( bytes > c_max_undo_seq_bytes && m_list_redo.size() > 0 )
+    {
+        bytes -= m_list_redo.front().get_bytes();
+        m_list_redo.pop_front();
+    }
+
+    if ( m_list_undo.empty() && m_list_redo.empty() )
+        m_undo_anchor = empty_events();
 }
 
 void
@@ -212,14 +649,27 @@ sequence::~sequence()
 
 }
 
-/* adds event in sorted manner */
+/* adds event in sorted manner, in front of any equal ones */
 void
 sequence::add_event( const event *a_e )
 {
     lock();
 
-    m_list_event.push_front( *a_e );
-    m_list_event.sort( );
+    vector<event> &events = edit_events();
+
+    vector<event>::iterator i =
+        lower_bound( events.begin(), events.end(), *a_e );
+    long index = i - events.begin();
+
+    events.insert( i, *a_e );
+    events[index].clear_link();
+
+    /* everything behind it moved up one */
+    for ( i = events.begin(); i != events.end(); i++ )
+    {
+        if ( (*i).get_linked() >= index )
+            (*i).link( (*i).get_linked() + 1 );
+    }
 
     reset_draw_marker();
 
@@ -234,8 +684,23 @@ sequence::add_event_no_sort( const event *a_e )
 {
     lock();
 
-    m_list_event.push_front( *a_e );
- 
+    vector<event> &events = edit_events();
+
+    events.push_back( *a_e );
+    events.back().clear_link();
+
+    unlock();
+}
+
+/* room for a_count more, so a load or import grows the events once */
+void
+sequence::reserve_events( long a_count )
+{
+    lock();
+
+    vector<event> &events = edit_events();
+    events.reserve( events.size() + a_count );
+
     unlock();
 }
 
@@ -245,13 +710,114 @@ sequence::sort_events()
 {
     lock();
 
-    m_list_event.sort();
+    sort_list();
+
+    /* give back what a reserve guessed too much */
+    vector<event> &events = edit_events();
+    if ( events.capacity() > events.size() + events.size() / 8 )
+        events.shrink_to_fit();
+
     reset_draw_marker();
     set_dirty();
-    
+
     unlock();
 }
 
+// helper function, does not lock/unlock
+void
+sequence::remap_links( const vector<long> &a_map )
+{
+    vector<event> &events = edit_events();
+
+    vector<event>::iterator i;
+
+    for ( i = events.begin(); i != events.end(); i++ )
+    {
+        if ( (*i).is_linked() )
+            (*i).link( a_map[(*i).get_linked()] );
+    }
+}
+
+// helper function, does not lock/unlock
+void
+sequence::sort_list()
+{
+    vector<event> &events = edit_events();
+
+    long size = events.size();
+
+    /* files and most imports come in order already */
+    bool sorted_already = true;
+    for ( long i = 1; i < size && sorted_already; i++ )
+        sorted_already = !(events[i] < events[i - 1]);
+
+    if ( sorted_already )
+        return;
+
+    vector<long> order( size );
+    for ( long i = 0; i < size; i++ )
+        order[i] = i;
+
+    stable_sort( order.begin(), order.end(), event_index_less( &events ) );
+
+    vector<event> sorted;
+    sorted.reserve( size );
+
+    vector<long> map( size );
+    for ( long i = 0; i < size; i++ )
+    {
+        sorted.push_back( events[order[i]] );
+        map[order[i]] = i;
+    }
+
+    events.swap( sorted );
+    remap_links( map );
+}
+
+// helper function, does not lock/unlock
+// the new events come in unlinked, callers verify_and_link() afterwards
+void
+sequence::merge_events( vector<event> *a_events )
+{
+    vector<event> &events = edit_events();
+
+    stable_sort( a_events->begin(), a_events->end() );
+
+    long size = events.size();
+
+    vector<event> merged;
+    merged.reserve( size + a_events->size() );
+
+    vector<long> map( size );
+
+    long i = 0;
+    vector<event>::iterator n = a_events->begin();
+
+    while ( i < size || n != a_events->end() )
+    {
+        /* on a tie ours go first, like list::merge() */
+        if ( i < size &&
+                ( n == a_events->end() || !((*n) < events[i]) ) )
+        {
+            map[i] = merged.size();
+            merged.push_back( events[i] );
+            i++;
+        }
+        else
+        {
+            merged.push_back( *n );
+            merged.back().clear_link();
+            n++;
+        }
+    }
+
+    events.swap( merged );
+    remap_links( map );
+
+    reset_draw_marker();
+    set_dirty();
+}
+
 void
 sequence::set_orig_tick( long a_tick )
 {
@@ -283,8 +849,14 @@ sequence::get_trigger_offset()
 void
 sequence::play(long a_tick, trigger *a_trigger)
 {
+    TRACE_SCOPE( "sequence::play" );
+
     lock();
 
+    /* never read in here, the output thread can't wait for it. Until
+       materialize_ahead() gets to it the sequence plays nothing */
+    const vector<event> &events = *m_list_event;
+
     long times_played  = m_last_tick / m_length;
     long offset_base   = times_played * m_length;
     long trigger_offset = 0;
@@ -333,11 +905,35 @@ sequence::play(long a_tick, trigger *a_trigger)
     unsigned long offset_timestamp;
 
     /* play the notes in our frame */
-    if ( m_playing )
+    if ( m_playing && events.size() )
     {
-        list<event>::iterator e = m_list_event.begin();
+        /* skip the passes that are all before the frame, then jump
+           to the first event that can be in it. Swing only ever moves
+           an event later, and by less than a quarter note */
+        long first_tick = start_tick_offset - offset_base;
+        if ( swing_amount )
+            first_tick -= c_ppqn;
+
+        while ( first_tick >= m_length )
+        {
+            first_tick -= m_length;
+            offset_base += m_length;
+        }
 
-        while ( e != m_list_event.end())
+        event first;
+        first.set_timestamp( first_tick < 0 ? 0 : first_tick );
+        first.set_status( EVENT_PROGRAM_CHANGE ); // lowest rank
+
+        vector<event>::const_iterator e =
+            lower_bound( events.begin(), events.end(), first );
+
+        if ( e == events.end() )
+        {
+            e = events.begin();
+            offset_base += m_length;
+        }
+
+        while ( e != events.end())
         {
             orig_event_timestamp = (*e).get_timestamp();
             swung_event_timestamp = orig_event_timestamp;
@@ -409,9 +1005,9 @@ sequence::play(long a_tick, trigger *a_trigger)
             e++;
 
             /* did we hit the end ? */
-            if ( e == m_list_event.end() )
+            if ( e == events.end() )
             {
-                e = m_list_event.begin();
+                e = events.begin();
                 offset_base += m_length;
             }
         }
@@ -443,85 +1039,23 @@ sequence::zero_markers()
 void
 sequence::verify_and_link()
 {
-    list<event>::iterator i;
-    list<event>::iterator on;
-    list<event>::iterator off;
-    bool end_found = false;
+    vector<event>::iterator i;
 
     lock();
 
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+    vector<event> &events = edit_events();
+
+    for ( i = events.begin(); i != events.end(); i++ )
     {
         (*i).clear_link();
         (*i).unmark();
     }
 
-    on = m_list_event.begin();
-
     /* pair ons and offs */
-    while ( on != m_list_event.end() )
-    {
-        /* check for a note on, then look for its
-           note off */
-        if ( (*on).is_note_on() )
-        {
-            /* get next possible off note */
-            off = on;
-            off++;
-            end_found = false;
-
-            while ( off != m_list_event.end() )
-            {
-                /* is a off event, == notes, and is not marked  */
-                if ( (*off).is_note_off()                  &&
-                        (*off).get_note() == (*on).get_note() &&
-                        ! (*off).is_marked()                  )
-                {
-                    /* link + mark */
-                    (*on).link( &(*off) );
-                    (*off).link( &(*on) );
-                    (*on).mark(  );
-                    (*off).mark( );
-                    end_found = true;
-
-                    break;
-                }
-                off++;
-            }
-            if (!end_found)
-            {
-                off = m_list_event.begin();
-
-                while ( off != on)
-                {
-                    if ( (*off).is_note_off()                  &&
-                            (*off).get_note() == (*on).get_note() &&
-                            ! (*off).is_marked()                  )
-                    {
-                        /* link + mark */
-                        (*on).link( &(*off) );
-                        (*off).link( &(*on) );
-                        (*on).mark(  );
-                        (*off).mark( );
-                        end_found = true;
-
-                        break;
-                    }
-                    off++;
-                }
-            }
-        }
-        on++;
-    }
-
-    /* unmark all */
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
-    {
-        (*i).unmark();
-    }
+    link_new();
 
     /* kill those not in range */
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+    for ( i = events.begin(); i != events.end(); i++ )
     {
         /* if our current time stamp is greater than or equal to the length */
 
@@ -531,7 +1065,7 @@ sequence::verify_and_link()
             /* we have to prune it */
             (*i).mark();
             if ( (*i).is_linked() )
-                (*i).get_linked()->mark();
+                events[(*i).get_linked()].mark();
         }
     }
 
@@ -539,134 +1073,170 @@ sequence::verify_and_link()
     unlock();
 }
 
+/*
+    Links the note ONs and OFFs that are not linked yet, in one pass.
+    Each ON gets the first free OFF of its note after it, or if there
+    is none, the first free one from the start of the sequence.
+    Pending ONs are kept per note, oldest first, and OFFs that nothing
+    was waiting for are kept for the wrap around.
+*/
 void
 sequence::link_new( )
 {
-    list<event>::iterator on;
-    list<event>::iterator off;
-    bool end_found = false;
+    /* heads and tails of the per note queues, the queues are chained
+       by index through one array so a load makes one allocation */
+    long ons_head[c_num_keys];
+    long ons_tail[c_num_keys];
+    long offs_head[c_num_keys];
+    long offs_tail[c_num_keys];
+
+    for ( int note = 0; note < c_num_keys; note++ )
+    {
+        ons_head[note] = ons_tail[note] = -1;
+        offs_head[note] = offs_tail[note] = -1;
+    }
 
     lock();
 
-    on = m_list_event.begin();
+    vector<event> &events = edit_events();
 
-    /* pair ons and offs */
-    while ( on != m_list_event.end())
+    long size = events.size();
+
+    vector<long> next( size, -1 );
+
+    for ( long i = 0; i < size; i++ )
     {
-        /* check for a note on, then look for its
-           note off */
-        if ( (*on).is_note_on() &&
-                ! (*on).is_linked() )
-        {
-            /* get next element */
-            off = on;
-            off++;
-            end_found = false;
+        event &e = events[i];
 
-            while ( off != m_list_event.end())
-            {
-                /* is a off event, == notes, and isnt
-                      selected  */
-                if ( (*off).is_note_off()                    &&
-                        (*off).get_note() == (*on).get_note() &&
-                        ! (*off).is_linked() )
-                {
-                    /* link */
-                    (*on).link( &(*off) );
-                    (*off).link( &(*on) );
-                    end_found = true;
+        if ( e.is_linked() )
+            continue;
 
-                    break;
-                }
-                off++;
-            }
+        int note = e.get_note();
 
-            if (!end_found)
+        if ( e.is_note_on() )
+        {
+            if ( ons_tail[note] < 0 )
+                ons_head[note] = i;
+            else
+                next[ons_tail[note]] = i;
+            ons_tail[note] = i;
+        }
+        else if ( e.is_note_off() )
+        {
+            if ( ons_head[note] >= 0 )
             {
-                off = m_list_event.begin();
-                while ( off != on)
-                {
-                    /* is a off event, == notes, and isnt
-                          selected  */
-                    if ( (*off).is_note_off()                    &&
-                            (*off).get_note() == (*on).get_note() &&
-                            ! (*off).is_linked() )
-                    {
-                        /* link */
-                        (*on).link( &(*off) );
-                        (*off).link( &(*on) );
-                        end_found = true;
+                long on = ons_head[note];
 
-                        break;
-                    }
-                    off++;
-                }
+                ons_head[note] = next[on];
+                if ( ons_head[note] < 0 )
+                    ons_tail[note] = -1;
+
+                events[on].link( i );
+                e.link( on );
+            }
+            else
+            {
+                if ( offs_tail[note] < 0 )
+                    offs_head[note] = i;
+                else
+                    next[offs_tail[note]] = i;
+                offs_tail[note] = i;
             }
         }
-        on++;
     }
+
+    /* wrap around, ONs still waiting take the OFFs from the start */
+    for ( int note = 0; note < c_num_keys; note++ )
+    {
+        long on = ons_head[note];
+        long off = offs_head[note];
+
+        for ( ; on >= 0 && off >= 0; on = next[on], off = next[off] )
+        {
+            events[on].link( off );
+            events[off].link( on );
+        }
+    }
+
     unlock();
 }
 
 // helper function, does not lock/unlock, unsafe to call without them
-// supply iterator from m_list_event...
 // lock();  remove();  reset_draw_marker(); unlock()
 void
-sequence::remove(list<event>::iterator i)
+sequence::remove( long a_index )
 {
+    vector<event> &events = edit_events();
+
+    event &e = events[a_index];
+
     /* if its a note off, and that note is currently
        playing, send a note off */
-    if ( (*i).is_note_off()  &&
-            m_playing_notes[ (*i).get_note()] > 0 )
+    if ( e.is_note_off()  &&
+            m_playing_notes[ e.get_note()] > 0 )
     {
-        get_master_midi_bus()->play( get_midi_bus(), &(*i), get_midi_channel() );
-        m_playing_notes[(*i).get_note()]--;
+        get_master_midi_bus()->play( get_midi_bus(), &e, get_midi_channel() );
+        m_playing_notes[e.get_note()]--;
+        m_num_playing_notes--;
     }
-    m_list_event.erase(i);
-}
+    events.erase( events.begin() + a_index );
 
-// helper function, does not lock/unlock, unsafe to call without them
-// supply iterator from m_list_event...
-// lock();  remove();  reset_draw_marker(); unlock()
-// finds e in m_list_event, removes the first iterator matching that.
-void
-sequence::remove( event* e )
-{
-    list<event>::iterator i = m_list_event.begin();
-    while( i != m_list_event.end() )
+    /* everything behind it moved down one */
+    vector<event>::iterator i;
+    for ( i = events.begin(); i != events.end(); i++ )
     {
-        if (e == &(*i))
-        {
-            remove( i );
-            return;
-        }
-        ++i;
+        if ( (*i).get_linked() == a_index )
+            (*i).clear_link();
+        else if ( (*i).get_linked() > a_index )
+            (*i).link( (*i).get_linked() - 1 );
     }
 }
 
+/* one pass, the kept events are moved down over the removed ones */
 void
 sequence::remove_marked()
 {
-    list<event>::iterator i, t;
-
     lock();
 
-    i = m_list_event.begin();
-    while( i != m_list_event.end() )
+    vector<event> &events = edit_events();
+
+    long size = events.size();
+    long kept = 0;
+
+    vector<long> map( size );
+
+    for ( long i = 0; i < size; i++ )
     {
-        if ((*i).is_marked())
+        event &e = events[i];
+
+        if ( e.is_marked() )
         {
-            t = i;
-            t++;
-            remove( i );
-            i = t;
+            /* if its a note off, and that note is currently
+               playing, send a note off */
+            if ( e.is_note_off()  &&
+                    m_playing_notes[ e.get_note()] > 0 )
+            {
+                get_master_midi_bus()->play( get_midi_bus(), &e, get_midi_channel() );
+                m_playing_notes[e.get_note()]--;
+                m_num_playing_notes--;
+            }
+            map[i] = -1;
         }
         else
         {
-            i++;
+            if ( kept != i )
+                events[kept] = e;
+
+            map[i] = kept++;
         }
     }
 
+    if ( kept != size )
+    {
+        events.resize( kept );
+        remap_links( map );
+    }
+
     reset_draw_marker();
 
     unlock();
@@ -675,13 +1245,15 @@ sequence::remove_marked()
 bool
 sequence::mark_selected()
 {
-    list<event>::iterator i;
+    vector<event>::iterator i;
     bool have_selected = false;
 
     lock();
 
-    i = m_list_event.begin();
-    while( i != m_list_event.end() )
+    vector<event> &events = edit_events();
+
+    i = events.begin();
+    while( i != events.end() )
     {
         if ((*i).is_selected())
         {
@@ -700,15 +1272,27 @@ sequence::mark_selected()
 void
 sequence::unpaint_all( )
 {
-    list<event>::iterator i;
+    vector<event>::iterator i;
 
     lock();
 
-    i = m_list_event.begin();
-    while( i != m_list_event.end() )
+    /* the editors call this on every click, keep sharing the
+       events if there is nothing to clear */
+    bool painted = false;
+    const vector<event> &events = read_events();
+    for ( unsigned long n = 0; n < events.size() && !painted; n++ )
+        painted = events[n].is_painted();
+
+    if ( painted )
     {
-        (*i).unpaint();
-        i++;
+        vector<event> &events = edit_events();
+
+        i = events.begin();
+        while( i != events.end() )
+        {
+            (*i).unpaint();
+            i++;
+        }
     }
     unlock();
 }
@@ -718,7 +1302,7 @@ void
 sequence::get_selected_box( long *a_tick_s, int *a_note_h,
                             long *a_tick_f, int *a_note_l )
 {
-    list<event>::iterator i;
+    vector<event>::const_iterator i;
 
     *a_tick_s = c_maxbeats * c_ppqn;
     *a_tick_f = 0;
@@ -731,7 +1315,9 @@ sequence::get_selected_box( long *a_tick_s, int *a_note_h,
 
     lock();
 
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+    const vector<event> &events = read_events();
+
+    for ( i = events.begin(); i != events.end(); i++ )
     {
         if( (*i).is_selected() )
         {
@@ -759,7 +1345,7 @@ sequence::get_clipboard_box( long *a_tick_s, int *a_note_h,
     if ( m_list_clipboard.size() == 0 )
         return false;
 
-    list<event>::iterator i;
+    vector<event>::iterator i;
 
     *a_tick_s = c_maxbeats * c_ppqn;
     *a_tick_f = 0;
@@ -795,11 +1381,13 @@ sequence::get_num_selected_notes( )
 {
     int ret = 0;
 
-    list<event>::iterator i;
+    vector<event>::const_iterator i;
 
     lock();
 
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+    const vector<event> &events = read_events();
+
+    for ( i = events.begin(); i != events.end(); i++ )
     {
         if( (*i).is_note_on()                &&
                 (*i).is_selected() )
@@ -819,11 +1407,13 @@ sequence::get_num_selected_events( unsigned char a_status,
                                    unsigned char a_cc )
 {
     int ret = 0;
-    list<event>::iterator i;
+    vector<event>::const_iterator i;
 
     lock();
 
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+    const vector<event> &events = read_events();
+
+    for ( i = events.begin(); i != events.end(); i++ )
     {
         if( (*i).get_status()    == a_status )
         {
@@ -848,13 +1438,15 @@ int
 sequence::select_even_or_odd_notes(int note_len, bool even)
 {
     int ret = 0;
-    list<event>::iterator i;
+    vector<event>::iterator i;
     long tick = 0;
     int is_even = 0;
     event *note_off;
     unselect();
     lock();
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+
+    vector<event> &events = edit_events();
+    for ( i = events.begin(); i != events.end(); i++ )
     {
         if ( (*i).is_note_on() )
         {
@@ -875,7 +1467,7 @@ sequence::select_even_or_odd_notes(int note_len, bool even)
 
                     if ( (*i).is_linked() )
                     {
-                        note_off = (*i).get_linked();
+                        note_off = &events[(*i).get_linked()];
                         note_off->select();
                         ret++;
                     }
@@ -898,11 +1490,13 @@ sequence::select_note_events( long a_tick_s, int a_note_h,
     long tick_s = 0;
     long tick_f = 0;
 
-    list<event>::iterator i;
+    vector<event>::iterator i;
 
     lock();
 
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+    vector<event> &events = edit_events();
+
+    for ( i = events.begin(); i != events.end(); i++ )
     {
         if((*i).get_status() != EVENT_NOTE_ON && (*i).get_status() != EVENT_NOTE_OFF )
             continue;   // necessary since channel pressure and control change use d0 for
@@ -915,7 +1509,7 @@ sequence::select_note_events( long a_tick_s, int a_note_h,
         {
             if ( (*i).is_linked() )
             {
-                event *ev = (*i).get_linked();
+                event *ev = &events[(*i).get_linked()];
 
                 if ( (*i).is_note_off() )
                 {
@@ -987,8 +1581,11 @@ sequence::select_note_events( long a_tick_s, int a_note_h,
 
                     if ( a_action == e_remove_one )
                     {
-                        remove( &(*i) );
-                        remove( ev );
+                        /* the later one first, it does not move the other */
+                        long index = i - events.begin();
+                        long linked = (*i).get_linked();
+                        remove( index > linked ? index : linked );
+                        remove( index > linked ? linked : index );
                         reset_draw_marker();
                         ret++;
                         break;
@@ -1045,7 +1642,7 @@ sequence::select_note_events( long a_tick_s, int a_note_h,
 
                     if ( a_action == e_remove_one )
                     {
-                        remove( &(*i) );
+                        remove( i - events.begin() );
                         reset_draw_marker();
                         ret++;
                         break;
@@ -1066,11 +1663,13 @@ int
 sequence::select_linked (long a_tick_s, long a_tick_f, unsigned char a_status)
 {
     int ret = 0;
-    list<event>::iterator i;
+    vector<event>::iterator i;
 
     lock();
 
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+    vector<event> &events = edit_events();
+
+    for ( i = events.begin(); i != events.end(); i++ )
     {
         if( (*i).get_status()    == a_status &&
                 (*i).get_timestamp() >= a_tick_s &&
@@ -1079,9 +1678,9 @@ sequence::select_linked (long a_tick_s, long a_tick_f, unsigned char a_status)
             if((*i).is_linked())
             {
                 if((*i).is_selected())
-                    (*i).get_linked()->select();
+                    events[(*i).get_linked()].select();
                 else
-                    (*i).get_linked()->unselect();
+                    events[(*i).get_linked()].unselect();
 
                 ret++;
             }
@@ -1101,15 +1700,17 @@ sequence::select_event_handle( long a_tick_s, long a_tick_f,
     bool have_selection = false;
 
     int ret=0;
-    list<event>::iterator i;
+    vector<event>::iterator i;
 
     lock();
 
+    vector<event> &events = edit_events();
+
     if(a_status == EVENT_NOTE_ON)
         if( get_num_selected_events(a_status, a_cc) )
             have_selection = true;
 
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+    for ( i = events.begin(); i != events.end(); i++ )
     {
         if( (*i).get_status()    == a_status &&
                 (*i).get_timestamp() >= a_tick_s &&
@@ -1146,7 +1747,7 @@ sequence::select_event_handle( long a_tick_s, long a_tick_f,
                                 (*i).select( );   // only this one
                                 if(ret)           // if we have a marked (unselected) one then clear it
                                 {
-                                    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+                                    for ( i = events.begin(); i != events.end(); i++ )
                                     {
                                         if((*i).is_marked())
                                         {
@@ -1197,7 +1798,7 @@ sequence::select_event_handle( long a_tick_s, long a_tick_f,
      have_selection will be set to false if we found a selected one in range  */
     if(ret && have_selection)
     {
-        for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+        for ( i = events.begin(); i != events.end(); i++ )
         {
             if((*i).is_marked())
             {
@@ -1225,11 +1826,13 @@ sequence::select_events( long a_tick_s, long a_tick_f,
                          unsigned char a_cc, select_action_e a_action)
 {
     int ret=0;
-    list<event>::iterator i;
+    vector<event>::iterator i;
 
     lock();
 
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+    vector<event> &events = edit_events();
+
+    for ( i = events.begin(); i != events.end(); i++ )
     {
         if( (*i).get_status()    == a_status &&
                 (*i).get_timestamp() >= a_tick_s &&
@@ -1285,7 +1888,7 @@ sequence::select_events( long a_tick_s, long a_tick_f,
 
                 if ( a_action == e_remove_one )
                 {
-                    remove( &(*i) );
+                    remove( i - events.begin() );
                     reset_draw_marker();
                     ret++;
                     break;
@@ -1303,9 +1906,11 @@ sequence::select_all()
 {
     lock();
 
-    list<event>::iterator i;
+    vector<event> &events = edit_events();
+
+    vector<event>::iterator i;
 
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+    for ( i = events.begin(); i != events.end(); i++ )
         (*i).select( );
 
     unlock();
@@ -1317,9 +1922,19 @@ sequence::unselect()
 {
     lock();
 
-    list<event>::iterator i;
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
-        (*i).unselect();
+    bool selected = false;
+    const vector<event> &events = read_events();
+    for ( unsigned long n = 0; n < events.size() && !selected; n++ )
+        selected = events[n].is_selected();
+
+    if ( selected )
+    {
+        vector<event> &events = edit_events();
+
+        vector<event>::iterator i;
+        for ( i = events.begin(); i != events.end(); i++ )
+            (*i).unselect();
+    }
 
     unlock();
 }
@@ -1336,12 +1951,15 @@ sequence::move_selected_notes( long a_delta_tick, int a_delta_note )
     event e;
     bool noteon=false;
     long timestamp=0;
+    vector<event> moved_events;
 
     lock();
 
-    list<event>::iterator i;
+    vector<event> &events = edit_events();
+
+    vector<event>::iterator i;
 
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+    for ( i = events.begin(); i != events.end(); i++ )
     {
         /* is it being moved ? */
         if ( (*i).is_marked() )
@@ -1387,12 +2005,13 @@ sequence::move_selected_notes( long a_delta_tick, int a_delta_note )
                 e.set_note( e.get_note() + a_delta_note );
                 e.select();
 
-                add_event( &e );
+                moved_events.push_back( e );
             }
         }
     }
 
     remove_marked();
+    merge_events( &moved_events );
     verify_and_link();
 
     unlock();
@@ -1408,16 +2027,19 @@ sequence::stretch_selected( long a_delta_tick )
     push_undo();
 
     event *e, new_e;
+    vector<event> stretched_events;
 
     lock();
 
-    list<event>::iterator i;
+    vector<event> &events = edit_events();
+
+    vector<event>::iterator i;
 
     int old_len = 0, new_len = 0;
     int first_ev = 0x7fffffff;
     int last_ev = 0x00000000;
 
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+    for ( i = events.begin(); i != events.end(); i++ )
     {
         if ( (*i).is_selected() )
         {
@@ -1442,7 +2064,7 @@ sequence::stretch_selected( long a_delta_tick )
     {
         mark_selected();
 
-        for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+        for ( i = events.begin(); i != events.end(); i++ )
         {
             if ( (*i).is_marked() )
             {
@@ -1454,11 +2076,12 @@ sequence::stretch_selected( long a_delta_tick )
 
                 new_e.unmark();
 
-                add_event( &new_e );
+                stretched_events.push_back( new_e );
             }
         }
 
         remove_marked();
+        merge_events( &stretched_events );
         verify_and_link();
     }
 
@@ -1475,19 +2098,22 @@ sequence::grow_selected( long a_delta_tick )
     push_undo();
 
     event *on, *off, e;
+    vector<event> grown_events;
 
     lock();
 
-    list<event>::iterator i;
+    vector<event> &events = edit_events();
 
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+    vector<event>::iterator i;
+
+    for ( i = events.begin(); i != events.end(); i++ )
     {
         if ( (*i).is_marked() &&
                 (*i).is_note_on() &&
                 (*i).is_linked() )
         {
             on = &(*i);
-            off = (*i).get_linked();
+            off = &events[(*i).get_linked()];
 
             long length =
                 off->get_timestamp() +
@@ -1522,11 +2148,12 @@ sequence::grow_selected( long a_delta_tick )
             e.unmark();
 
             e.set_timestamp( length );
-            add_event( &e );
+            grown_events.push_back( e );
         }
     }
 
     remove_marked();
+    merge_events( &grown_events );
     verify_and_link();
 
     unlock();
@@ -1537,12 +2164,14 @@ sequence::increment_selected( unsigned char a_status, unsigned char a_control )
 {
     lock();
 
-    list<event>::iterator i;
-
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+    /* the events are only taken for editing once the undo point is
+       held, see edit_held_events() */
+    for ( size_t n = 0; n < read_events().size(); n++ )
     {
-        if ( (*i).is_selected() &&
-                (*i).get_status() == a_status )
+        const event &e = read_events()[n];
+
+        if ( e.is_selected() &&
+                e.get_status() == a_status )
         {
             if ( a_status == EVENT_NOTE_ON ||
                     a_status == EVENT_NOTE_OFF ||
@@ -1550,19 +2179,13 @@ sequence::increment_selected( unsigned char a_status, unsigned char a_control )
                     a_status == EVENT_CONTROL_CHANGE ||
                     a_status == EVENT_PITCH_WHEEL )
             {
-                if(!get_hold_undo())
-                    set_hold_undo(true);
-
-                (*i).increment_data2();
+                edit_held_events()[n].increment_data2();
             }
 
             if ( a_status == EVENT_PROGRAM_CHANGE ||
                     a_status == EVENT_CHANNEL_PRESSURE )
             {
-                if(!get_hold_undo())
-                    set_hold_undo(true);
-
-                (*i).increment_data1();
+                edit_held_events()[n].increment_data1();
             }
         }
     }
@@ -1575,12 +2198,14 @@ sequence::decrement_selected(unsigned char a_status, unsigned char a_control )
 {
     lock();
 
-    list<event>::iterator i;
-
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+    /* the events are only taken for editing once the undo point is
+       held, see edit_held_events() */
+    for ( size_t n = 0; n < read_events().size(); n++ )
     {
-        if ( (*i).is_selected() &&
-                (*i).get_status() == a_status )
+        const event &e = read_events()[n];
+
+        if ( e.is_selected() &&
+                e.get_status() == a_status )
         {
             if ( a_status == EVENT_NOTE_ON ||
                     a_status == EVENT_NOTE_OFF ||
@@ -1588,19 +2213,13 @@ sequence::decrement_selected(unsigned char a_status, unsigned char a_control )
                     a_status == EVENT_CONTROL_CHANGE ||
                     a_status == EVENT_PITCH_WHEEL )
             {
-                if(!get_hold_undo())
-                    set_hold_undo(true);
-
-                (*i).decrement_data2();
+                edit_held_events()[n].decrement_data2();
             }
 
             if ( a_status == EVENT_PROGRAM_CHANGE ||
                     a_status == EVENT_CHANNEL_PRESSURE )
             {
-                if(!get_hold_undo())
-                    set_hold_undo(true);
-
-                (*i).decrement_data1();
+                edit_held_events()[n].decrement_data1();
             }
         }
     }
@@ -1618,9 +2237,11 @@ sequence::randomize_selected( unsigned char a_status, unsigned char a_control, i
 
     lock();
 
-    list<event>::iterator i;
+    vector<event> &events = edit_events();
+
+    vector<event>::iterator i;
 
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+    for ( i = events.begin(); i != events.end(); i++ )
     {
         if ( (*i).is_selected() &&
                 (*i).get_status() == a_status )
@@ -1676,9 +2297,11 @@ sequence::adjust_data_handle( unsigned char a_status, int a_data )
 
     lock();
 
-    list<event>::iterator i;
+    vector<event> &events = edit_events();
+
+    vector<event>::iterator i;
 
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+    for ( i = events.begin(); i != events.end(); i++ )
     {
         if ( (*i).is_selected() &&
                 (*i).get_status() == a_status )
@@ -1714,13 +2337,15 @@ sequence::adjust_data_handle( unsigned char a_status, int a_data )
 void
 sequence::copy_selected()
 {
-    list<event>::iterator i;
+    vector<event>::const_iterator i;
 
     lock();
 
+    const vector<event> &events = read_events();
+
     m_list_clipboard.clear( );
 
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+    for ( i = events.begin(); i != events.end(); i++ )
     {
         if ( (*i).is_selected() )
         {
@@ -1728,11 +2353,14 @@ sequence::copy_selected()
         }
     }
 
-    long first_tick = (*m_list_clipboard.begin()).get_timestamp();
+    long first_tick = 0;
+    if ( m_list_clipboard.size() )
+        first_tick = m_list_clipboard.front().get_timestamp();
 
-    for ( i = m_list_clipboard.begin(); i != m_list_clipboard.end(); i++ )
+    vector<event>::iterator c;
+    for ( c = m_list_clipboard.begin(); c != m_list_clipboard.end(); c++ )
     {
-        (*i).set_timestamp((*i).get_timestamp() - first_tick );
+        (*c).set_timestamp((*c).get_timestamp() - first_tick );
     }
 
     unlock();
@@ -1741,11 +2369,18 @@ sequence::copy_selected()
 void
 sequence::paste_selected( long a_tick, int a_note )
 {
-    list<event>::iterator i;
+    vector<event>::iterator i;
     int highest_note = 0;
 
-    lock();
-    list<event> clipboard = m_list_clipboard;
+    lock();
+
+    if ( m_list_clipboard.size() == 0 )
+    {
+        unlock();
+        return;
+    }
+
+    vector<event> clipboard = m_list_clipboard;
 
     for ( i = clipboard.begin(); i != clipboard.end(); i++ )
     {
@@ -1767,8 +2402,7 @@ sequence::paste_selected( long a_tick, int a_note )
         }
     }
 
-    m_list_event.merge( clipboard );
-    m_list_event.sort();
+    merge_events( &clipboard );
 
     verify_and_link();
 
@@ -1777,6 +2411,45 @@ sequence::paste_selected( long a_tick, int a_note )
     unlock();
 }
 
+#define PI (3.14159265359)
+
+double
+sequence::wave_func(double a_angle, int wave_type)
+{
+    double result = 0.0;
+    switch (wave_type)
+    {
+    case WAVE_SINE:
+        result = sin(a_angle * PI * 2.0);
+        break;
+
+    case WAVE_SAWTOOTH:
+        result = (a_angle - int(a_angle)) * 2.0 - 1.0;
+        break;
+
+    case WAVE_REVERSE_SAWTOOTH:
+        result = (a_angle - int(a_angle)) * -2.0 + 1.0;
+        break;
+
+    case WAVE_TRIANGLE:
+    {
+        double tmp = a_angle * 2.0;
+        result = (tmp - int(tmp));
+        if ((int(tmp)) % 2 == 1)
+            result = 1.0 - result;
+
+        result = result * 2.0 - 1.0;
+        break;
+    }
+    default:
+        break;
+    }
+    /*
+     * printf("y[%s](%f)=%f\n", wave_type_name(wavetype).c_str(), angle, result);
+     */
+    return result;
+}
+
 void sequence::change_event_data_lfo(double a_value, double a_range,
                                      double a_speed, double a_phase, int a_wave,
                                      unsigned char a_status,
@@ -1785,27 +2458,30 @@ void sequence::change_event_data_lfo(double a_value, double a_range,
     lock();
 
     unsigned char d0, d1;
-    list<event>::iterator i;
 
     /* change only selected events, if any */
     bool have_selection = false;
     if( get_num_selected_events(a_status, a_cc) )
         have_selection = true;
 
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+    /* the events are only taken for editing once the undo point is
+       held, see edit_held_events() */
+    for ( size_t n = 0; n < read_events().size(); n++ )
     {
+        const event &r = read_events()[n];
+
         /* initially false */
         bool set = false;
-        (*i).get_data( &d0, &d1 );
+        r.get_data( &d0, &d1 );
 
         /* correct status and not CC */
         if ( a_status != EVENT_CONTROL_CHANGE &&
-                (*i).get_status() == a_status )
+                r.get_status() == a_status )
             set = true;
 
         /* correct status and correct cc */
         if ( a_status == EVENT_CONTROL_CHANGE &&
-                (*i).get_status() == a_status &&
+                r.get_status() == a_status &&
                 d0 == a_cc )
             set = true;
 
@@ -1815,13 +2491,12 @@ void sequence::change_event_data_lfo(double a_value, double a_range,
 //            set = false;
 
         /* in selection? */
-        if ( have_selection && (!(*i).is_selected()) )
+        if ( have_selection && (!r.is_selected()) )
             set = false;
 
         if ( set )
         {
-            if(!get_hold_undo())
-                set_hold_undo(true);
+            event &e = edit_held_events()[n];
 
             //float weight;
 
@@ -1829,7 +2504,7 @@ void sequence::change_event_data_lfo(double a_value, double a_range,
             /* no divide by 0 */
 //            if( a_tick_f == a_tick_s )
 //                a_tick_f = a_tick_s + 1;
-            int tick = (*i).get_timestamp();
+            int tick = e.get_timestamp();
 
             //printf("ticks: %d %d %d\n", a_tick_s, tick, a_tick_f);
             //printf("datas: %d %d\n", a_data_s, a_data_f);
@@ -1837,7 +2512,7 @@ void sequence::change_event_data_lfo(double a_value, double a_range,
 //            int newdata = ((tick-a_tick_s)*a_data_f + (a_tick_f-tick)*a_data_s)
 //                /(a_tick_f - a_tick_s);
 
-            int newdata = a_value + lfownd::wave_func((a_speed * (double)tick / (double) m_length * (double) m_time_beat_width + a_phase), a_wave) * a_range;
+            int newdata = a_value + wave_func((a_speed * (double)tick / (double) m_length * (double) m_time_beat_width + a_phase), a_wave) * a_range;
 
             if ( newdata < 0 ) newdata = 0;
             if ( newdata > 127 ) newdata = 127;
@@ -1863,7 +2538,7 @@ void sequence::change_event_data_lfo(double a_value, double a_range,
             if ( a_status == EVENT_PITCH_WHEEL )
                 d1 = newdata;
 
-            (*i).set_data( d0, d1 );
+            e.set_data( d0, d1 );
         }
     }
 
@@ -1881,43 +2556,45 @@ sequence::change_event_data_range( long a_tick_s, long a_tick_f,
     lock();
 
     unsigned char d0, d1;
-    list<event>::iterator i;
 
     /* change only selected events, if any */
     bool have_selection = false;
     if( get_num_selected_events(a_status, a_cc) )
         have_selection = true;
 
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+    /* the events are only taken for editing once the undo point is
+       held, see edit_held_events() */
+    for ( size_t n = 0; n < read_events().size(); n++ )
     {
+        const event &r = read_events()[n];
+
         /* initially false */
         bool set = false;
-        (*i).get_data( &d0, &d1 );
+        r.get_data( &d0, &d1 );
 
         /* correct status and not CC */
         if ( a_status != EVENT_CONTROL_CHANGE &&
-                (*i).get_status() == a_status )
+                r.get_status() == a_status )
             set = true;
 
         /* correct status and correct cc */
         if ( a_status == EVENT_CONTROL_CHANGE &&
-                (*i).get_status() == a_status &&
+                r.get_status() == a_status &&
                 d0 == a_cc )
             set = true;
 
         /* in range? */
-        if ( !((*i).get_timestamp() >= a_tick_s &&
-                (*i).get_timestamp() <= a_tick_f ))
+        if ( !(r.get_timestamp() >= a_tick_s &&
+                r.get_timestamp() <= a_tick_f ))
             set = false;
 
         /* in selection? */
-        if ( have_selection && (!(*i).is_selected()) )
+        if ( have_selection && (!r.is_selected()) )
             set = false;
 
         if ( set )
         {
-            if(!get_hold_undo())
-                set_hold_undo(true);
+            event &e = edit_held_events()[n];
 
             //float weight;
 
@@ -1936,7 +2613,7 @@ sequence::change_event_data_range( long a_tick_s, long a_tick_f,
                ((1.0f - weight) * (float) a_data_s ));
                */
 
-            int tick = (*i).get_timestamp();
+            int tick = e.get_timestamp();
 
             //printf("ticks: %d %d %d\n", a_tick_s, tick, a_tick_f);
             //printf("datas: %d %d\n", a_data_s, a_data_f);
@@ -1968,7 +2645,7 @@ sequence::change_event_data_range( long a_tick_s, long a_tick_f,
             if ( a_status == EVENT_PITCH_WHEEL )
                 d1 = newdata;
 
-            (*i).set_data( d0, d1 );
+            e.set_data( d0, d1 );
         }
     }
 
@@ -1980,6 +2657,8 @@ sequence::add_note( long a_tick, long a_length, int a_note, bool a_paint)
 {
     lock();
 
+    vector<event> &events = edit_events();
+
     event e;
     bool ignore = false;
 
@@ -1992,8 +2671,8 @@ sequence::add_note( long a_tick, long a_length, int a_note, bool a_paint)
          * overlap the one we want to add */
         if ( a_paint )
         {
-            list<event>::iterator i,t;
-            for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+            vector<event>::iterator i,t;
+            for ( i = events.begin(); i != events.end(); i++ )
             {
                 if ( (*i).is_painted() &&
                         (*i).is_note_on() &&
@@ -2009,7 +2688,7 @@ sequence::add_note( long a_tick, long a_length, int a_note, bool a_paint)
 
                     if ( (*i).is_linked())
                     {
-                        (*i).get_linked()->mark();
+                        events[(*i).get_linked()].mark();
                     }
 
                     set_dirty();
@@ -2065,6 +2744,8 @@ sequence::add_event( long a_tick,
 {
     lock();
 
+    vector<event> &events = edit_events();
+
     if ( a_tick >= 0 )
     {
         event e;
@@ -2074,8 +2755,8 @@ sequence::add_event( long a_tick,
          * overlap the one we want to add */
         if ( a_paint )
         {
-            list<event>::iterator i,t;
-            for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+            vector<event>::iterator i,t;
+            for ( i = events.begin(); i != events.end(); i++ )
             {
                 if ( (*i).is_painted() &&
                         (*i).get_timestamp() == a_tick )
@@ -2084,7 +2765,7 @@ sequence::add_event( long a_tick,
 
                     if ( (*i).is_linked())
                     {
-                        (*i).get_linked()->mark();
+                        events[(*i).get_linked()].mark();
                     }
 
                     set_dirty();
@@ -2261,9 +2942,11 @@ bool sequence::intersectNotes( long position, long position_note, long& start, l
 {
     lock();
 
-    list<event>::iterator on = m_list_event.begin();
-    list<event>::iterator off = m_list_event.begin();
-    while ( on != m_list_event.end() )
+    const vector<event> &events = read_events();
+
+    vector<event>::const_iterator on = events.begin();
+    vector<event>::const_iterator off = events.begin();
+    while ( on != events.end() )
     {
         if (position_note == (*on).get_note() &&
                 (*on).is_note_on())
@@ -2271,13 +2954,14 @@ bool sequence::intersectNotes( long position, long position_note, long& start, l
             // find next "off" event for the note
             off = on;
             ++off;
-            while (off != m_list_event.end() &&
+            while (off != events.end() &&
                     ((*on).get_note() != (*off).get_note() || (*off).is_note_on()))
             {
                 ++off;
             }
 
-            if ((*on).get_note() == (*off).get_note() && (*off).is_note_off() &&
+            if (off != events.end() &&
+                    (*on).get_note() == (*off).get_note() && (*off).is_note_off() &&
                     (*on).get_timestamp() <= position && position <= (*off).get_timestamp())
             {
                 start = (*on).get_timestamp();
@@ -2298,8 +2982,10 @@ bool sequence::intersectEvents( long posstart, long posend, long status, long& s
 {
     lock();
 
-    list<event>::iterator on = m_list_event.begin();
-    while ( on != m_list_event.end() )
+    const vector<event> &events = read_events();
+
+    vector<event>::const_iterator on = events.begin();
+    while ( on != events.end() )
     {
         //printf( "intersect   looking for:%ld  found:%ld\n", status, (*on).get_status() );
         if (status == (*on).get_status())
@@ -2324,7 +3010,7 @@ sequence::reset_draw_marker()
 {
     lock();
 
-    m_iterator_draw = m_list_event.begin();
+    m_draw_index = 0;
 
     unlock();
 }
@@ -2334,10 +3020,12 @@ sequence::get_lowest_note_event()
 {
     lock();
 
+    const vector<event> &events = read_events();
+
     int ret = 127;
-    list<event>::iterator i;
+    vector<event>::const_iterator i;
 
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+    for ( i = events.begin(); i != events.end(); i++ )
     {
         if ( (*i).is_note_on() || (*i).is_note_off() )
             if ( (*i).get_note() < ret )
@@ -2354,10 +3042,12 @@ sequence::get_highest_note_event()
 {
     lock();
 
+    const vector<event> &events = read_events();
+
     int ret = 0;
-    list<event>::iterator i;
+    vector<event>::const_iterator i;
 
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+    for ( i = events.begin(); i != events.end(); i++ )
     {
         if ( (*i).is_note_on() || (*i).is_note_off() )
             if ( (*i).get_note() > ret )
@@ -2376,47 +3066,55 @@ sequence::get_next_note_event( long *a_tick_s,
                                bool *a_selected,
                                int  *a_velocity  )
 {
+    lock();
+
+    const vector<event> &events = read_events();
+
     draw_type ret = DRAW_FIN;
     *a_tick_f = 0;
 
-    while (  m_iterator_draw  != m_list_event.end() )
+    while (  m_draw_index < events.size() )
     {
-        *a_tick_s   = (*m_iterator_draw).get_timestamp();
-        *a_note     = (*m_iterator_draw).get_note();
-        *a_selected = (*m_iterator_draw).is_selected();
-        *a_velocity = (*m_iterator_draw).get_note_velocity();
+        *a_tick_s   = events[m_draw_index].get_timestamp();
+        *a_note     = events[m_draw_index].get_note();
+        *a_selected = events[m_draw_index].is_selected();
+        *a_velocity = events[m_draw_index].get_note_velocity();
 
         /* note on, so its linked */
-        if( (*m_iterator_draw).is_note_on() &&
-                (*m_iterator_draw).is_linked() )
+        if( events[m_draw_index].is_note_on() &&
+                events[m_draw_index].is_linked() )
         {
-            *a_tick_f   = (*m_iterator_draw).get_linked()->get_timestamp();
+            *a_tick_f   = events[events[m_draw_index].get_linked()].get_timestamp();
 
             ret = DRAW_NORMAL_LINKED;
-            m_iterator_draw++;
+            m_draw_index++;
+            unlock();
             return ret;
         }
 
-        else if( (*m_iterator_draw).is_note_on() &&
-                 (! (*m_iterator_draw).is_linked()) )
+        else if( events[m_draw_index].is_note_on() &&
+                 (! events[m_draw_index].is_linked()) )
         {
             ret = DRAW_NOTE_ON;
-            m_iterator_draw++;
+            m_draw_index++;
+            unlock();
             return ret;
         }
 
-        else if( (*m_iterator_draw).is_note_off() &&
-                 (! (*m_iterator_draw).is_linked()) )
+        else if( events[m_draw_index].is_note_off() &&
+                 (! events[m_draw_index].is_linked()) )
         {
             ret = DRAW_NOTE_OFF;
-            m_iterator_draw++;
+            m_draw_index++;
+            unlock();
             return ret;
         }
 
         /* keep going until we hit null or find a NoteOn */
-        m_iterator_draw++;
+        m_draw_index++;
     }
 
+    unlock();
     return DRAW_FIN;
 }
 
@@ -2424,18 +3122,24 @@ bool
 sequence::get_next_event( unsigned char *a_status,
                           unsigned char *a_cc)
 {
+    lock();
+
+    const vector<event> &events = read_events();
+
     unsigned char j;
 
-    while (  m_iterator_draw  != m_list_event.end() )
+    while (  m_draw_index < events.size() )
     {
-        *a_status = (*m_iterator_draw).get_status();
-        (*m_iterator_draw).get_data( a_cc, &j );
+        *a_status = events[m_draw_index].get_status();
+        events[m_draw_index].get_data( a_cc, &j );
 
         /* we have a good one */
         /* update and return */
-        m_iterator_draw++;
+        m_draw_index++;
+        unlock();
         return true;
     }
+    unlock();
     return false;
 }
 
@@ -2447,29 +3151,33 @@ sequence::get_next_event( unsigned char a_status,
                           unsigned char *a_D1,
                           bool *a_selected, int type )
 {
-    while (  m_iterator_draw  != m_list_event.end() )
+    lock();
+
+    const vector<event> &events = read_events();
+
+    while (  m_draw_index < events.size() )
     {
         /* note on, so its linked */
-        if( (*m_iterator_draw).get_status() == a_status )
+        if( events[m_draw_index].get_status() == a_status )
         {
-            if(type == UNSELECTED_EVENTS && (*m_iterator_draw).is_selected() == true)
+            if(type == UNSELECTED_EVENTS && events[m_draw_index].is_selected() == true)
             {
                 /* keep going until we hit null or find one */
-                m_iterator_draw++;
+                m_draw_index++;
                 continue;
             }
 
             /* selected events */
-            if(type > 0 && (*m_iterator_draw).is_selected() == false)
+            if(type > 0 && events[m_draw_index].is_selected() == false)
             {
                 /* keep going until we hit null or find one */
-                m_iterator_draw++;
+                m_draw_index++;
                 continue;
             }
 
-            (*m_iterator_draw).get_data( a_D0, a_D1 );
-            *a_tick   = (*m_iterator_draw).get_timestamp();
-            *a_selected = (*m_iterator_draw).is_selected();
+            events[m_draw_index].get_data( a_D0, a_D1 );
+            *a_tick   = events[m_draw_index].get_timestamp();
+            *a_selected = events[m_draw_index].is_selected();
 
             /* either we have a control change with the right CC
                or its a different type of event */
@@ -2479,13 +3187,15 @@ sequence::get_next_event( unsigned char a_status,
             {
                 /* we have a good one */
                 /* update and return */
-                m_iterator_draw++;
+                m_draw_index++;
+                unlock();
                 return true;
             }
         }
         /* keep going until we hit null or find a NoteOn */
-        m_iterator_draw++;
+        m_draw_index++;
     }
+    unlock();
     return false;
 }
 
@@ -2494,7 +3204,9 @@ sequence::remove_all()
 {
     lock();
 
-    m_list_event.clear();
+    vector<event> &events = edit_events();
+
+    events.clear();
 
     unlock();
 }
@@ -2503,13 +3215,17 @@ sequence&
 sequence::operator= (const sequence& a_rhs)
 {
     //printf("in sequence::operator=()\n");
-    lock();
+    lock_pair( a_rhs );
 
     /* dont copy to self */
     if (this != &a_rhs)
     {
+        /* shared until one of us changes them */
         m_list_event   = a_rhs.m_list_event;
+        m_file_events  = a_rhs.m_file_events;
+        m_file_damaged = a_rhs.m_file_damaged;
         m_name         = a_rhs.m_name;
+        m_mutex.set_name( "seq ", m_name.c_str() );
         m_length       = a_rhs.m_length;
         m_swing_mode   = a_rhs.m_swing_mode;
 
@@ -2522,24 +3238,127 @@ sequence::operator= (const sequence& a_rhs)
 
         m_list_undo  = a_rhs.m_list_undo;
         m_list_redo  = a_rhs.m_list_redo;
+        m_undo_anchor = a_rhs.m_undo_anchor;
         m_have_undo  = a_rhs.m_have_undo;
         m_have_redo  = a_rhs.m_have_redo;
 
         /* no notes are playing */
         for (int i=0; i< c_midi_notes; i++ )
             m_playing_notes[i] = 0;
+        m_num_playing_notes = 0;
 
         /* reset */
         zero_markers( );
     }
 
-    verify_and_link();
+    /* the events come linked and in range from a_rhs, relinking
+       them here would only take them out of sharing */
 
-    unlock();
+    unlock_pair( a_rhs );
 
     return *this;
 }
 
+/* same events and settings as a_rhs, the undo lists are not compared
+   since they always lead back to what we hold now */
+bool
+sequence::matches (sequence& a_rhs)
+{
+    /* nothing is read in here, a_rhs is a snapshot the save thread
+       may be writing. Blocks still pending compare by pointer */
+    lock_pair( a_rhs );
+
+    bool same = m_name == a_rhs.m_name &&
+                m_length == a_rhs.m_length &&
+                m_swing_mode == a_rhs.m_swing_mode &&
+                m_time_beats_per_measure == a_rhs.m_time_beats_per_measure &&
+                m_time_beat_width == a_rhs.m_time_beat_width &&
+                m_file_events == a_rhs.m_file_events &&
+                (m_list_event == a_rhs.m_list_event ||
+                 *m_list_event == *a_rhs.m_list_event);
+
+    unlock_pair( a_rhs );
+
+    return same;
+}
+
+bool
+sequence::same_snapshot (sequence& a_rhs)
+{
+    lock_pair( a_rhs );
+
+    bool same = m_name == a_rhs.m_name &&
+                m_length == a_rhs.m_length &&
+                m_swing_mode == a_rhs.m_swing_mode &&
+                m_time_beats_per_measure == a_rhs.m_time_beats_per_measure &&
+                m_time_beat_width == a_rhs.m_time_beat_width &&
+                m_file_events == a_rhs.m_file_events &&
+                m_list_event == a_rhs.m_list_event;
+
+    unlock_pair( a_rhs );
+
+    return same;
+}
+
+/* capacity is counted, what the vectors hold on to is what we use */
+void
+sequence::get_memory_bytes (long *a_num_events, long *a_event_bytes, long *a_undo_bytes)
+{
+    lock();
+
+    /* events still to be read in are counted as they are kept */
+    const vector<event> &events = *m_list_event;
+    const vector<event> &anchor = *m_undo_anchor;
+
+    /* shared events are counted in full by each sharer, divide
+       them out so the totals add up */
+    long sharers = m_list_event.use_count();
+    long anchor_sharers = m_undo_anchor.use_count();
+
+    long event_bytes = (events.capacity() - events.size()) * sizeof(event);
+
+    for ( unsigned long i = 0; i < events.size(); i++ )
+        event_bytes += events[i].get_memory_bytes();
+
+    event_bytes = sizeof(sequence) + event_bytes / sharers;
+
+    long num_events = events.size();
+
+    if ( m_file_events )
+    {
+        num_events += m_file_events->m_count;
+        event_bytes += (sizeof(file_events) + m_file_events->m_bytes.capacity()) /
+            m_file_events.use_count();
+    }
+
+    long undo_bytes = 0;
+
+    /* while it is our events body it is already counted above */
+    if ( m_undo_anchor != m_list_event )
+    {
+        undo_bytes = (anchor.capacity() - anchor.size()) * sizeof(event);
+
+        for ( unsigned long i = 0; i < anchor.size(); i++ )
+            undo_bytes += anchor[i].get_memory_bytes();
+
+        undo_bytes /= anchor_sharers;
+    }
+
+    deque<event_delta>::iterator d;
+
+    for ( d = m_list_undo.begin(); d != m_list_undo.end(); d++ )
+        undo_bytes += (*d).get_bytes();
+
+    for ( d = m_list_redo.begin(); d != m_list_redo.end(); d++ )
+        undo_bytes += (*d).get_bytes();
+
+    *a_num_events = num_events;
+    *a_event_bytes = event_bytes;
+    *a_undo_bytes = undo_bytes;
+
+    unlock();
+}
+
 void
 sequence::lock( )
 {
@@ -2552,6 +3371,28 @@ sequence::unlock( )
     m_mutex.unlock();
 }
 
+void
+sequence::lock_pair( const sequence& a_other )
+{
+    if ( this < &a_other )
+    {
+        m_mutex.lock();
+        a_other.m_mutex.lock();
+    }
+    else
+    {
+        a_other.m_mutex.lock();
+        m_mutex.lock();
+    }
+}
+
+void
+sequence::unlock_pair( const sequence& a_other )
+{
+    a_other.m_mutex.unlock();
+    m_mutex.unlock();
+}
+
 const char*
 sequence::get_name()
 {
@@ -2738,6 +3579,7 @@ void
 sequence::set_name( char *a_name )
 {
     m_name = a_name;
+    m_mutex.set_name( "seq ", m_name.c_str() );
     set_dirty();
     global_seqlist_need_update = true;
 }
@@ -2746,6 +3588,7 @@ void
 sequence::set_name( string a_name )
 {
     m_name = a_name;
+    m_mutex.set_name( "seq ", m_name.c_str() );
     set_dirty();
     global_seqlist_need_update = true;
 }
@@ -2771,16 +3614,18 @@ sequence::get_master_midi_bus( )
 void
 sequence::print()
 {
+    const vector<event> &events = read_events();
+
     printf("name[%s]\n", m_name.c_str()  );
     printf("swing_mode[%d]\n", m_swing_mode );
 
-    for( list<event>::iterator i = m_list_event.begin(); i != m_list_event.end(); i++ )
+    for( vector<event>::const_iterator i = events.begin(); i != events.end(); i++ )
         (*i).print();
-    printf("events[%zd]\n\n",m_list_event.size());
+    printf("events[%zd]\n\n",events.size());
 }
 
 void
-sequence::put_event_on_bus( event *a_e )
+sequence::put_event_on_bus( const event *a_e )
 {
     lock();
     mastermidibus * a_mmb = get_master_midi_bus();
@@ -2791,6 +3636,7 @@ sequence::put_event_on_bus( event *a_e )
     if ( a_e->is_note_on() )
     {
         m_playing_notes[note]++;
+        m_num_playing_notes++;
     }
     if ( a_e->is_note_off() )
     {
@@ -2801,6 +3647,7 @@ sequence::put_event_on_bus( event *a_e )
         else
         {
             m_playing_notes[note]--;
+            m_num_playing_notes--;
         }
     }
 
@@ -2819,24 +3666,30 @@ void
 sequence::off_playing_notes()
 {
     lock();
-    mastermidibus * a_mmb = get_master_midi_bus();
-
-    event e;
 
-    for ( int x=0; x< c_midi_notes; x++ )
+    if ( m_num_playing_notes > 0 )
     {
-        while( m_playing_notes[x] > 0 )
-        {
-            e.set_status( EVENT_NOTE_OFF );
-            e.set_data( x, 0 );
+        mastermidibus * a_mmb = get_master_midi_bus();
+        bool sent = false;
 
-            a_mmb->play( get_midi_bus(), &e, get_midi_channel() );
+        /* the bus knows what is really sounding, so a note held twice
+           here, or already silenced by a panic, is not sent again */
+        for ( int x=0; x< c_midi_notes && m_num_playing_notes > 0; x++ )
+        {
+            if ( m_playing_notes[x] > 0 )
+            {
+                if ( a_mmb->release_note( get_midi_bus(), x, get_midi_channel() ) )
+                    sent = true;
 
-            m_playing_notes[x]--;
+                m_num_playing_notes -= m_playing_notes[x];
+                m_playing_notes[x] = 0;
+            }
         }
-    }
+        m_num_playing_notes = 0;
 
-    a_mmb->flush();
+        if ( sent )
+            a_mmb->flush();
+    }
 
     unlock();
 }
@@ -2848,10 +3701,12 @@ sequence::select_events( unsigned char a_status, unsigned char a_cc, bool a_inve
 {
     lock();
 
+    vector<event> &events = edit_events();
+
     unsigned char d0, d1;
-    list<event>::iterator i;
+    vector<event>::iterator i;
 
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+    for ( i = events.begin(); i != events.end(); i++ )
     {
         /* initially false */
         bool set = false;
@@ -2894,11 +3749,13 @@ sequence::transpose_notes( int a_steps, int a_scale )
     push_undo();
 
     event e;
-    list<event> transposed_events;
+    vector<event> transposed_events;
 
     lock();
 
-    list<event>::iterator i;
+    vector<event> &events = edit_events();
+
+    vector<event>::iterator i;
 
     const int *transpose_table = NULL;
 
@@ -2912,7 +3769,7 @@ sequence::transpose_notes( int a_steps, int a_scale )
         transpose_table = &c_scales_transpose_up[a_scale][0];
     }
 
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+    for ( i = events.begin(); i != events.end(); i++ )
     {
         /* is it being moved ? */
         if ( ((*i).get_status() ==  EVENT_NOTE_ON ||
@@ -2940,7 +3797,7 @@ sequence::transpose_notes( int a_steps, int a_scale )
 
             e.set_note( note );
 
-            transposed_events.push_front(e);
+            transposed_events.push_back(e);
         }
         else
         {
@@ -2949,8 +3806,7 @@ sequence::transpose_notes( int a_steps, int a_scale )
     }
 
     remove_marked();
-    transposed_events.sort();
-    m_list_event.merge( transposed_events);
+    merge_events( &transposed_events );
 
     verify_and_link();
 
@@ -2966,13 +3822,15 @@ sequence::shift_notes( int a_ticks )
     push_undo();
 
     event e;
-    list<event> shifted_events;
+    vector<event> shifted_events;
 
     lock();
 
-    list<event>::iterator i;
+    vector<event> &events = edit_events();
+
+    vector<event>::iterator i;
 
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+    for ( i = events.begin(); i != events.end(); i++ )
     {
         /* is it being moved ? */
         if ( ((*i).get_status() ==  EVENT_NOTE_ON ||
@@ -2997,13 +3855,12 @@ sequence::shift_notes( int a_ticks )
             //printf("in shift_notes; a_ticks=%d  timestamp=%06ld  shift_timestamp=%06ld (mlength=%ld)\n",
             // a_ticks, e.get_timestamp(), timestamp, m_length);
             e.set_timestamp(timestamp);
-            shifted_events.push_front(e);
+            shifted_events.push_back(e);
         }
     }
 
     remove_marked();
-    shifted_events.sort();
-    m_list_event.merge( shifted_events);
+    merge_events( &shifted_events );
 
     verify_and_link();
 
@@ -3024,11 +3881,13 @@ sequence::quanize_events( unsigned char a_status, unsigned char a_cc,
 
     lock();
 
+    vector<event> &events = edit_events();
+
     unsigned char d0, d1;
-    list<event>::iterator i;
-    list<event> quantized_events;
+    vector<event>::iterator i;
+    vector<event> quantized_events;
 
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+    for ( i = events.begin(); i != events.end(); i++ )
     {
         /* initially false */
         bool set = false;
@@ -3074,7 +3933,7 @@ sequence::quanize_events( unsigned char a_status, unsigned char a_cc,
             }
 
             e.set_timestamp( e.get_timestamp() + timestamp_delta );
-            quantized_events.push_front(e);
+            quantized_events.push_back(e);
 
             /*
                 since the only events that are linked are notes and the status of all note calls to
@@ -3083,9 +3942,9 @@ sequence::quanize_events( unsigned char a_status, unsigned char a_cc,
 
             if ( (*i).is_linked() && a_linked ) // note OFF's only
             {
-                f = *(*i).get_linked();
+                f = events[(*i).get_linked()];
                 f.unmark();
-                (*i).get_linked()->select();
+                events[(*i).get_linked()].select();
 
                 //printf("timestamp before [%ld]: timestamp_delta [%ld]: m_length [%ld]\n", f.get_timestamp(), timestamp_delta, m_length);
 
@@ -3114,14 +3973,13 @@ sequence::quanize_events( unsigned char a_status, unsigned char a_cc,
 
                 f.set_timestamp( adjusted_timestamp );
 
-                quantized_events.push_front(f);
+                quantized_events.push_back(f);
             }
         }
     }
 
     remove_marked();
-    quantized_events.sort();
-    m_list_event.merge(quantized_events);
+    merge_events( &quantized_events );
     verify_and_link();
     unlock();
 }
@@ -3139,9 +3997,11 @@ sequence::multiply_pattern( float a_multiplier )
 
     lock();
 
-    list<event>::iterator i;
+    vector<event> &events = edit_events();
+
+    vector<event>::iterator i;
 
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+    for ( i = events.begin(); i != events.end(); i++ )
     {
         long timestamp = (*i).get_timestamp();
         if ( (*i).get_status() ==  EVENT_NOTE_OFF)
@@ -3159,6 +4019,8 @@ sequence::multiply_pattern( float a_multiplier )
         (*i).set_timestamp(timestamp);
     }
 
+    /* the modulo can wrap events past the ones before them */
+    sort_list();
     verify_and_link();
     unlock();
 
@@ -3173,12 +4035,14 @@ void
 sequence::reverse_pattern()
 {
     lock();
+
+    vector<event> &events = edit_events();
     event e1,e2;
 
-    list<event>::iterator i;
-    list<event> reversed_events;
+    vector<event>::iterator i;
+    vector<event> reversed_events;
 
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+    for ( i = events.begin(); i != events.end(); i++ )
     {
         /* only do for note ONs and OFFs */
         if((*i).get_status() !=  EVENT_NOTE_ON && (*i).get_status() !=  EVENT_NOTE_OFF)
@@ -3198,9 +4062,9 @@ sequence::reverse_pattern()
 
         if ( (*i).is_linked() )                             // should all be linked!
         {
-            e2 = *(*i).get_linked();
+            e2 = events[(*i).get_linked()];
 
-            (*i).get_linked()->mark();                      // so we don't duplicate and for later remove
+            events[(*i).get_linked()].mark();                      // so we don't duplicate and for later remove
 
             calulate_reverse(e2);
         }
@@ -3213,13 +4077,12 @@ sequence::reverse_pattern()
         e1.set_note_velocity(e2.get_note_velocity());
         e2.set_note_velocity(a_vel);
 
-        reversed_events.push_front(e1);
-        reversed_events.push_front(e2);
+        reversed_events.push_back(e1);
+        reversed_events.push_back(e2);
     }
 
     remove_marked();
-    reversed_events.sort();
-    m_list_event.merge(reversed_events);
+    merge_events( &reversed_events );
     verify_and_link();
     unlock();
 }
@@ -3255,133 +4118,99 @@ sequence::calulate_reverse(event &a_e)
 
 
 void
-addListVar( list<char> *a_list, long a_var )
-{
-    long buffer;
-    buffer = a_var & 0x7F;
-
-    /* we shift it right 7, if there is
-       still set bits, encode into buffer
-       in reverse order */
-    while ( ( a_var >>= 7) )
-    {
-        buffer <<= 8;
-        buffer |= ((a_var & 0x7F) | 0x80);
-    }
-
-    while (true)
-    {
-        a_list->push_front( (char) buffer & 0xFF );
-
-        if (buffer & 0x80)
-            buffer >>= 8;
-        else
-            break;
-    }
-}
-
-void
-addLongList( list<char> *a_list, long a_x )
-{
-    a_list->push_front(  (a_x & 0xFF000000) >> 24 );
-    a_list->push_front(  (a_x & 0x00FF0000) >> 16 );
-    a_list->push_front(  (a_x & 0x0000FF00) >> 8  );
-    a_list->push_front(  (a_x & 0x000000FF)       );
-}
-
-void
-sequence::seq_number_fill_list( list<char> *a_list, int a_pos )
+sequence::seq_number_fill_list( midi_writer *a_out, int a_pos )
 {
-    /* clear list */
-    *a_list = list<char>();
-
     /* sequence number */
-    addListVar( a_list, 0 );
-    a_list->push_front( 0xFF );
-    a_list->push_front( 0x00 );
-    a_list->push_front( 0x02 );
-    a_list->push_front( (a_pos & 0xFF00) >> 8 );
-    a_list->push_front( (a_pos & 0x00FF)      );
+    a_out->put_var( 0 );
+    a_out->put_byte( 0xFF );
+    a_out->put_byte( 0x00 );
+    a_out->put_byte( 0x02 );
+    a_out->put_byte( (a_pos & 0xFF00) >> 8 );
+    a_out->put_byte( (a_pos & 0x00FF) );
 }
 
 void
-sequence::seq_name_fill_list( list<char> *a_list )
+sequence::seq_name_fill_list( midi_writer *a_out )
 {
-    addListVar( a_list, 0 );
-    a_list->push_front( 0xFF );
-    a_list->push_front( 0x03 );
+    a_out->put_var( 0 );
+    a_out->put_byte( 0xFF );
+    a_out->put_byte( 0x03 );
 
     int length =  m_name.length();
 
     if ( length > 0x7F )
         length = 0x7f;
 
-    a_list->push_front( length );
+    a_out->put_byte( length );
 
-    for ( int i=0; i< length; i++ )
-        a_list->push_front( m_name.c_str()[i] );
+    a_out->put( m_name.c_str(), length );
 }
 
 void
-sequence::fill_proprietary_list(list < char >*a_list)
+sequence::fill_proprietary_list(midi_writer *a_out)
 {
     /* bus */
-    addListVar( a_list, 0 );
-    a_list->push_front( 0xFF );
-    a_list->push_front( 0x7F );
-    a_list->push_front( 0x05 );
-    addLongList( a_list, c_midibus );
-    a_list->push_front( get_midi_bus()  );
+    a_out->put_var( 0 );
+    a_out->put_byte( 0xFF );
+    a_out->put_byte( 0x7F );
+    a_out->put_byte( 0x05 );
+    a_out->put_long( c_midibus );
+    a_out->put_byte( get_midi_bus() );
 
     /* timesig */
-    addListVar( a_list, 0 );
-    a_list->push_front( 0xFF );
-    a_list->push_front( 0x7F );
-    a_list->push_front( 0x06 );
-    addLongList( a_list, c_timesig );
-    a_list->push_front( m_time_beats_per_measure  );
-    a_list->push_front( m_time_beat_width  );
+    a_out->put_var( 0 );
+    a_out->put_byte( 0xFF );
+    a_out->put_byte( 0x7F );
+    a_out->put_byte( 0x06 );
+    a_out->put_long( c_timesig );
+    a_out->put_byte( m_time_beats_per_measure );
+    a_out->put_byte( m_time_beat_width );
 
     /* channel */
-    addListVar( a_list, 0 );
-    a_list->push_front( 0xFF );
-    a_list->push_front( 0x7F );
-    a_list->push_front( 0x05 );
-    addLongList( a_list, c_midich );
-    a_list->push_front( get_midi_channel() );
+    a_out->put_var( 0 );
+    a_out->put_byte( 0xFF );
+    a_out->put_byte( 0x7F );
+    a_out->put_byte( 0x05 );
+    a_out->put_long( c_midich );
+    a_out->put_byte( get_midi_channel() );
 
     /* transposable */
-    addListVar( a_list, 0 );
-    a_list->push_front( 0xFF );
-    a_list->push_front( 0x7F );
-    a_list->push_front( 0x05 );
-    addLongList( a_list, c_transpose );
-    a_list->push_front( (char) get_track()->get_transposable() );
+    a_out->put_var( 0 );
+    a_out->put_byte( 0xFF );
+    a_out->put_byte( 0x7F );
+    a_out->put_byte( 0x05 );
+    a_out->put_long( c_transpose );
+    a_out->put_byte( (char) get_track()->get_transposable() );
 }
 
 void
-sequence::meta_track_end( list<char> *a_list, long delta_time)
+sequence::meta_track_end( midi_writer *a_out, long delta_time)
 {
     //printf("meta end delta %ld\n", delta_time);
-    addListVar( a_list, delta_time );
-    a_list->push_front( 0xFF );
-    a_list->push_front( 0x2F );
-    a_list->push_front( 0x00 );
+    a_out->put_var( delta_time );
+    a_out->put_byte( 0xFF );
+    a_out->put_byte( 0x2F );
+    a_out->put_byte( 0x00 );
 }
 
 void
-sequence::fill_list( list<char> *a_list, int a_pos, bool write_triggers )
+sequence::fill_list( midi_writer *a_out, int a_pos, bool write_triggers )
 {
-    seq_number_fill_list( a_list, a_pos ); // locks
+    seq_number_fill_list( a_out, a_pos ); // locks
 
-    seq_name_fill_list( a_list );          // locks
+    seq_name_fill_list( a_out );          // locks
 
     lock();
 
+    const vector<event> &events = read_events();
+
+    /* a short delta and three bytes for most events */
+    a_out->reserve( events.size() * 4 );
+
     long timestamp = 0, delta_time = 0, prev_timestamp = 0;
-    list<event>::iterator i;
+    vector<event>::const_iterator i;
 
-    for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+    for ( i = events.begin(); i != events.end(); i++ )
     {
         event e = (*i);
         timestamp = e.get_timestamp();
@@ -3389,12 +4218,12 @@ sequence::fill_list( list<char> *a_list, int a_pos, bool write_triggers )
         prev_timestamp = timestamp;
 
         /* encode delta_time */
-        addListVar( a_list, delta_time );
+        a_out->put_var( delta_time );
 
         /* now that the timestamp is encoded, do the status and
            data */
 
-        a_list->push_front( e.m_status | get_midi_channel() );
+        a_out->put_byte( e.m_status | get_midi_channel() );
 
         switch( e.m_status & 0xF0 )
         {
@@ -3403,14 +4232,14 @@ sequence::fill_list( list<char> *a_list, int a_pos, bool write_triggers )
         case 0xA0:
         case 0xB0:
         case 0xE0:
-            a_list->push_front(  e.m_data[0] );
-            a_list->push_front(  e.m_data[1] );
+            a_out->put_byte( e.m_data[0] );
+            a_out->put_byte( e.m_data[1] );
 
             //printf ( "- d[%2X %2X]\n" , e.m_data[0], e.m_data[1] );
             break;
         case 0xC0:
         case 0xD0:
-            a_list->push_front(  e.m_data[0] );
+            a_out->put_byte( e.m_data[0] );
 
             //printf ( "- d[%2X]\n" , e.m_data[0] );
             break;
@@ -3446,11 +4275,11 @@ sequence::fill_list( list<char> *a_list, int a_pos, bool write_triggers )
         int num_triggers = seq_list_trigger.size();
         list<trigger>::iterator t = seq_list_trigger.begin();
 
-        addListVar( a_list, 0 );
-        a_list->push_front( 0xFF );
-        a_list->push_front( 0x7F );
-        addListVar( a_list, (num_triggers * 3 * 4) + 4);
-        addLongList( a_list, c_triggers_new );
+        a_out->put_var( 0 );
+        a_out->put_byte( 0xFF );
+        a_out->put_byte( 0x7F );
+        a_out->put_var( (num_triggers * 3 * 4) + 4 );
+        a_out->put_long( c_triggers_new );
 
         //printf( "num_triggers[%d]\n", num_triggers );
 
@@ -3459,27 +4288,29 @@ sequence::fill_list( list<char> *a_list, int a_pos, bool write_triggers )
             //printf( "> start[%d] end[%d] offset[%d]\n",
             //        (*t).m_tick_start, (*t).m_tick_end, (*t).m_offset );
 
-            addLongList( a_list, (*t).m_tick_start );
-            addLongList( a_list, (*t).m_tick_end );
-            addLongList( a_list, (*t).m_offset );
+            a_out->put_long( (*t).m_tick_start );
+            a_out->put_long( (*t).m_tick_end );
+            a_out->put_long( (*t).m_offset );
 
             t++;
         }
     }
     
-    fill_proprietary_list( a_list );
+    fill_proprietary_list( a_out );
 
     delta_time = m_length - prev_timestamp;
 
-    meta_track_end( a_list, delta_time );
+    meta_track_end( a_out, delta_time );
 
     unlock();
 }
 
 long
-sequence::song_fill_list_seq_event( list<char> *a_list, trigger *a_trig, long prev_timestamp, file_type_e type )
+sequence::song_fill_list_seq_event( midi_writer *a_out, trigger *a_trig, long prev_timestamp, file_type_e type )
 {
     lock();
+
+    const vector<event> &events = read_events();
     
     /* these trigger values may be adjusted if solo trigger*/
     long tick_end = a_trig->m_tick_end;
@@ -3507,6 +4338,8 @@ sequence::song_fill_list_seq_event( list<char> *a_list, trigger *a_trig, long pr
         note_is_used[i] = 0;
 
     times_played += (tick_end - tick_start)/ m_length;
+
+    a_out->reserve( events.size() * (times_played + 1) * 4 );
     
     if((trigger_offset - start_offset) > 0) // in this case the total offset is m_length too far
     {
@@ -3530,9 +4363,9 @@ sequence::song_fill_list_seq_event( list<char> *a_list, trigger *a_trig, long pr
         /* events */
         long timestamp = 0, delta_time = 0;
 
-        list<event>::iterator i;
+        vector<event>::const_iterator i;
 
-        for ( i = m_list_event.begin(); i != m_list_event.end(); i++ )
+        for ( i = events.begin(); i != events.end(); i++ )
         {
             event e = (*i);
 
@@ -3590,12 +4423,12 @@ sequence::song_fill_list_seq_event( list<char> *a_list, trigger *a_trig, long pr
             //printf ( "trig offset[%ld]: trig start[%ld]: sequence[%d]\n" , a_trig->m_offset, a_trig->m_tick_start,a_trig->m_sequence );
 
             /* encode delta_time */
-            addListVar( a_list, delta_time );
+            a_out->put_var( delta_time );
 
             /* now that the timestamp is encoded, do the status and
                data */
 
-            a_list->push_front( e.m_status | get_midi_channel() );
+            a_out->put_byte( e.m_status | get_midi_channel() );
 
             switch( e.m_status & 0xF0 )
             {
@@ -3604,14 +4437,14 @@ sequence::song_fill_list_seq_event( list<char> *a_list, trigger *a_trig, long pr
             case 0xA0:
             case 0xB0:
             case 0xE0:
-                a_list->push_front(  e.m_data[0] );
-                a_list->push_front(  e.m_data[1] );
+                a_out->put_byte( e.m_data[0] );
+                a_out->put_byte( e.m_data[1] );
 
                 //printf ( "- d[%2X %2X]\n" , e.m_data[0], e.m_data[1] );
                 break;
             case 0xC0:
             case 0xD0:
-                a_list->push_front(  e.m_data[0] );
+                a_out->put_byte( e.m_data[0] );
 
                 //printf ( "- d[%2X]\n" , e.m_data[0] );
                 break;
@@ -3627,57 +4460,282 @@ sequence::song_fill_list_seq_event( list<char> *a_list, trigger *a_trig, long pr
 }
 
 void
-sequence::song_fill_list_seq_trigger( list<char> *a_list, trigger *a_trig, long a_length, long prev_timestamp )
+sequence::song_fill_list_seq_trigger( midi_writer *a_out, trigger *a_trig, long a_length, long prev_timestamp )
 {
     lock();
     /* trigger for whole sequence */
 
     int num_triggers = 1; // only one
 
-    addListVar( a_list, 0 );
-    a_list->push_front( 0xFF );
-    a_list->push_front( 0x7F );
-    addListVar( a_list, (num_triggers * 3 * 4) + 4);
-    addLongList( a_list, c_triggers_new );
+    a_out->put_var( 0 );
+    a_out->put_byte( 0xFF );
+    a_out->put_byte( 0x7F );
+    a_out->put_var( (num_triggers * 3 * 4) + 4 );
+    a_out->put_long( c_triggers_new );
 
-    addLongList( a_list, 0 ); // start tick
-    addLongList( a_list, (a_trig)->m_tick_end );
-    addLongList( a_list, 0 ); // offset - done in event
+    a_out->put_long( 0 ); // start tick
+    a_out->put_long( (a_trig)->m_tick_end );
+    a_out->put_long( 0 ); // offset - done in event
 
-    fill_proprietary_list( a_list );
+    fill_proprietary_list( a_out );
 
     long delta_time = a_length - prev_timestamp;
 
     //printf("delta_time [%ld]: a_length [%ld]: prev_timestamp[%ld]\n",delta_time,a_length,prev_timestamp);
 
-    meta_track_end( a_list, delta_time );
+    meta_track_end( a_out, delta_time );
 
     unlock();
 }
 
-bool
-sequence::save(ofstream *file)
+/* version 9, the events go in as one block, packed unless that is
+   turned off or they will not pack */
+void
+sequence::save( chunk_writer *a_chunk )
 {
+    /* the save thread writes snapshots the gui keeps reading in and
+       comparing, so hold the lock for the whole sequence */
+    lock();
+
     char name[c_max_seq_name];
-    strncpy(name, m_name.c_str(), c_max_seq_name);
-    file->write(name, sizeof(char)*c_max_seq_name);
+    memset(name, 0, sizeof(name));
+    m_name.copy(name, c_max_seq_name);
+    a_chunk->put(name, sizeof(char)*c_max_seq_name);
+
+    a_chunk->put_int(m_length);
+    a_chunk->put_int(m_time_beats_per_measure);
+    a_chunk->put_int(m_time_beat_width);
+    a_chunk->put_int(m_swing_mode);
+
+    /* not read in yet, or damaged: the block goes back as it came */
+    if ( m_file_events )
+    {
+        const file_events &pending = *m_file_events;
+
+        a_chunk->put_int(pending.m_encoding);
+        a_chunk->put_int(pending.m_count);
+
+        size_t start = 0;
+        if ( pending.m_encoding == c_events_packed )
+            start = a_chunk->begin_chunk();
+
+        a_chunk->put(pending.m_bytes.data(), pending.m_bytes.size());
+
+        if ( pending.m_encoding == c_events_packed )
+            a_chunk->end_chunk(start);
+
+        unlock();
+        return;
+    }
+
+    const vector<event> &events = *m_list_event;
+
+    bool packed = global_compact_events && can_pack_events(events);
+
+    a_chunk->put_int(packed ? c_events_packed : c_events_records);
+    a_chunk->put_int(events.size());
+
+    if ( packed )
+    {
+        size_t start = a_chunk->begin_chunk();
+        size_t room = events.size() * c_max_packed_event;
+
+        size_t used = pack_events(events, a_chunk->grow(room));
+        a_chunk->shrink(room - used);
+
+        a_chunk->end_chunk(start);
+
+        unlock();
+        return;
+    }
+
+    event_record *records =
+        (event_record *) a_chunk->grow(events.size() * sizeof(event_record));
+
+    for ( unsigned long i = 0; i < events.size(); i++ )
+        events[i].get_record( &records[i] );
+
+    unlock();
+}
+
+bool
+sequence::load( chunk_reader *a_chunk, int a_version, bool a_lazy )
+{
+    char name[c_max_seq_name+1];
+    int32_t length, bp_measure, bw, swing_mode;
+    int32_t encoding = c_events_records;
+    uint32_t num_events;
+
+    a_chunk->get(name, sizeof(char)*c_max_seq_name);
+    name[c_max_seq_name] = '\0';
+
+    a_chunk->get_int(&length);
+    a_chunk->get_int(&bp_measure);
+    a_chunk->get_int(&bw);
+    a_chunk->get_int(&swing_mode);
+
+    if ( a_version > 8 )
+        a_chunk->get_int(&encoding);
+
+    a_chunk->get((char *) &num_events, sizeof(num_events));
+
+    const char *block = NULL;
+    uint32_t packed_size = 0;
+
+    if ( encoding == c_events_packed )
+    {
+        a_chunk->get(&packed_size, sizeof(packed_size));
+        block = a_chunk->get_block(packed_size);
+
+        /* every packed event takes 2 bytes or more, c_max_packed_event at most */
+        if ( packed_size < (size_t) num_events * 2 ||
+                packed_size > (size_t) num_events * c_max_packed_event )
+            block = NULL;
+    }
+    else if ( encoding == c_events_records )
+        block = a_chunk->get_block((size_t) num_events * sizeof(event_record));
+
+    if ( block == NULL || !a_chunk->at_end() || length <= 0 )
+        return false;
+
+    size_t size = (encoding == c_events_packed) ?
+        packed_size : num_events * sizeof(event_record);
+
+    lock();
+
+    if ( a_lazy )
+    {
+        /* a damaged packed block only shows up when it is read in */
+        shared_ptr<file_events> pending = make_shared<file_events>();
+        pending->m_encoding = encoding;
+        pending->m_count = num_events;
+        pending->m_bytes.assign( block, block + size );
+
+        m_file_events = pending;
+    }
+    else if ( !add_file_events( encoding, block, size, num_events ) )
+    {
+        unlock();
+        return false;
+    }
+
+    m_length = length;
+    m_time_beats_per_measure = bp_measure;
+    m_time_beat_width = bw;
+    m_swing_mode = swing_mode;
+
+    unlock();
+
+    set_name(name);
+
+    if ( !a_lazy )
+        sort_events();
 
-    file->write((const char *) &m_length, global_file_long_int_size);
-    file->write((const char *) &m_time_beats_per_measure, global_file_long_int_size);
-    file->write((const char *) &m_time_beat_width, global_file_long_int_size);
-    file->write((const char *) &m_swing_mode, global_file_int_size);
+    return true;
+}
+
+/* helper, does not lock/unlock. Adds the events as they are in a
+   sequence chunk, unsorted, or nothing if they do not add up */
+bool
+sequence::add_file_events( int32_t a_encoding, const char *a_bytes,
+                           size_t a_size, uint32_t a_count )
+{
+    vector<event> &events = edit_events();
+    unsigned long first = events.size();
+    events.resize( first + a_count );
 
-    unsigned int num_events = m_list_event.size();
-    file->write((const char *) &num_events, global_file_int_size);
-    for( list<event>::iterator iter = m_list_event.begin();
-            iter != m_list_event.end(); iter++ )
+    if ( a_encoding == c_events_packed )
+    {
+        if ( !unpack_events( a_bytes, a_size, events.data() + first, a_count ) )
+        {
+            events.resize( first );
+            return false;
+        }
+    }
+    else
     {
-        iter->save(file);
+        /* the block may not be aligned for the records */
+        for ( uint32_t i = 0; i < a_count; i++ )
+        {
+            event_record record;
+            memcpy( &record, a_bytes + i * sizeof(event_record), sizeof(record) );
+            events[first + i].set_record( record );
+        }
     }
 
     return true;
 }
 
+/* reads in the events of a lazy load, the first time something needs
+   them or ahead of the song getting to them. The work is done on the
+   side so the output thread is only held up by the swap, unless it
+   is the one that needs them */
+void
+sequence::materialize()
+{
+    lock();
+
+    shared_ptr<const file_events> pending = m_file_events;
+    long length = m_length;
+
+    unlock();
+
+    if ( !pending )
+        return;
+
+    sequence loaded;
+    loaded.m_track = m_track;
+    loaded.m_length = length;
+
+    bool good = loaded.add_file_events( pending->m_encoding, pending->m_bytes.data(),
+                                        pending->m_bytes.size(), pending->m_count );
+    loaded.sort_events();
+    loaded.verify_and_link();
+
+    lock();
+
+    /* unless another thread got there first */
+    if ( m_file_events == pending && !m_file_damaged )
+    {
+        m_list_event = loaded.m_list_event;
+
+        if ( good )
+        {
+            m_file_events.reset();
+        }
+        else
+        {
+            /* keep the block so saving does not lose it */
+            m_file_damaged = true;
+            s_damaged_count++;
+            fprintf(stderr, "Damaged sequence [%s]\n", m_name.c_str());
+        }
+
+        reset_draw_marker();
+        set_dirty();
+    }
+
+    unlock();
+}
+
+bool
+sequence::is_materialized()
+{
+    lock();
+
+    bool ret = !m_file_events || m_file_damaged;
+
+    unlock();
+
+    return ret;
+}
+
+int
+sequence::take_damaged_count()
+{
+    return s_damaged_count.exchange( 0 );
+}
+
 bool
 sequence::load(ifstream *file, int version)
 {
@@ -3702,13 +4760,20 @@ sequence::load(ifstream *file, int version)
     unsigned int num_events;
     file->read((char *) &num_events, global_file_int_size);
 
+    lock();
+
+    /* read in place, for speed don't sort here on each event */
+    vector<event> &events = edit_events();
+    events.reserve( events.size() + num_events );
+
     for (unsigned int i=0; i< num_events; i++ )
     {
-        event e;
-        e.load(file);
-        add_event_no_sort(&e);  // for speed don't sort here on each event
+        events.push_back( event() );
+        events.back().load(file);
     }
 
+    unlock();
+
     sort_events();              // sort here after all events received, big speed improvements
     
     return true;
@@ -3731,8 +4796,10 @@ sequence::apply_song_transpose()
     push_undo();
 
     lock();
-    for( list<event>::iterator iter = m_list_event.begin();
-            iter != m_list_event.end(); iter++ )
+
+    vector<event> &events = edit_events();
+    for( vector<event>::iterator iter = events.begin();
+            iter != events.end(); iter++ )
     {
         if ((*iter).is_note_on() || (*iter).is_note_off() || ((*iter).get_status() == EVENT_AFTERTOUCH) )
         {
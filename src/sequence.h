@@ -25,8 +25,12 @@ class sequence;
 
 #include <string>
 #include <list>
+#include <vector>
+#include <deque>
 #include <stack>
+#include <memory>
 
+#include "chunk.h"
 #include "event.h"
 #include "midibus.h"
 #include "globals.h"
@@ -42,27 +46,116 @@ enum draw_type
     DRAW_NOTE_OFF
 };
 
+enum wave_type_t
+{
+    WAVE_NONE               = 0,    /**< No waveform, never used.           */
+    WAVE_SINE               = 1,    /**< Sine wave modulation.              */
+    WAVE_SAWTOOTH           = 2,    /**< Saw-tooth (ramp) modulation.       */
+    WAVE_REVERSE_SAWTOOTH   = 3,    /**< Reverse saw-tooth (decay).         */
+    WAVE_TRIANGLE           = 4     /**< No waveform, never used.           */
+};
+
 using std::list;
 
-class sequence
+/* a_removed were at m_index, a_inserted took their place. m_index is
+   from before the change */
+struct event_hunk
+{
+    long m_index;
+    vector < event > m_removed;
+    vector < event > m_inserted;
+};
+
+/* what changed in a sequence's events between two undo points */
+class event_delta
 {
 
 private:
 
-    track *m_track;
+    /* never changed once made, so copies of a delta share them */
+    shared_ptr < const vector < event_hunk > > m_hunks;
+    long m_bytes;
+
+    void replay( const vector<event> &a_events, vector<event> *a_result,
+                 bool a_revert );
+
+public:
 
-    /* holds the events */
-    list < event > m_list_event;
-    static list < event > m_list_clipboard;
+    event_delta();
 
-    list < event > m_list_undo_hold;
+    /* fills in what turns a_old into a_new, one pass over both */
+    void diff( const vector<event> &a_old, const vector<event> &a_new );
 
-    stack < list < event > >m_list_undo;
-    stack < list < event > >m_list_redo;
+    /* old to new, and back, into a_result in one pass */
+    void apply( const vector<event> &a_events, vector<event> *a_result );
+    void revert( const vector<event> &a_events, vector<event> *a_result );
 
-    /* markers */
-    list < event >::iterator m_iterator_play;
-    list < event >::iterator m_iterator_draw;
+    bool empty();
+    long get_bytes();
+};
+
+/* a sequence's events as they are in the file, kept when it is loaded
+   lazily until something needs them */
+struct file_events
+{
+    int32_t m_encoding;
+    uint32_t m_count;
+    vector < char > m_bytes;
+};
+
+class sequence
+{
+
+private:
+
+    track *m_track;
+
+    /* holds the events, always sorted by time. Note ons and offs
+       are linked by index, so anything that moves events around
+       must go through the helpers below to keep the links right.
+       Copies of a sequence share the events until one of them
+       changes them, so only read through read_events() and use
+       edit_events() for any change, selection included */
+    shared_ptr < vector < event > > m_list_event;
+    static vector < event > m_list_clipboard;
+
+    /* set while the events of a lazy load are still to be read in */
+    shared_ptr < const file_events > m_file_events;
+    /* the block would not read in. It is kept so a save writes it
+       back as it was, until the sequence is edited */
+    bool m_file_damaged;
+
+    /* both read in the events first if that is still to be done */
+    const vector < event > & read_events ();
+    /* takes a copy of the events first if they are shared */
+    vector < event > & edit_events ();
+    /* the same, pushing the held undo point first */
+    vector < event > & edit_held_events ();
+
+    bool add_file_events( int32_t a_encoding, const char *a_bytes,
+                          size_t a_size, uint32_t a_count );
+
+    /* undo and redo only keep what changed. The newest undo and
+       redo deltas both meet at m_undo_anchor, the events as they were
+       after the last push or pop. It is the same body as m_list_event
+       until the next edit makes edit_events() copy, so it costs
+       nothing while unchanged and tells sync_undo() there is nothing
+       to fold in. Empty when there is nothing to undo or redo */
+    deque < event_delta > m_list_undo;
+    deque < event_delta > m_list_redo;
+    shared_ptr < const vector < event > > m_undo_anchor;
+
+    /* seqdata & lfownd drags, the undo point is pushed at the first change */
+    bool m_hold_undo;
+
+    /* folds edits made since the anchor into the deltas next to it */
+    void sync_undo ();
+    /* keeps the deltas and the anchor under c_max_undo_seq_bytes */
+    void trim_undo ();
+
+    /* markers, the draw marker is an index so the editors can walk
+       the events while recording adds to them */
+    unsigned long m_draw_index;
 
     /* polyphonic step edit note counter */
     int m_notes_on;
@@ -70,6 +163,8 @@ private:
     /* map for noteon, used when muting, to shut off current
        messages */
     int m_playing_notes[c_midi_notes];
+    /* sum of the above, lets off_playing_notes() skip idle sequences */
+    int m_num_playing_notes;
 
     /* states */
     bool m_playing;
@@ -112,17 +207,22 @@ private:
     long m_time_beats_per_measure;
     long m_time_beat_width;
 
-    /* locking */
-    seq42_mutex m_mutex;
+    /* locking, mutable so a sequence being copied can be locked */
+    mutable seq42_mutex m_mutex;
     void lock ();
     void unlock ();
 
+    /* this and a_other, the lower address first so two threads
+       copying between the same pair can't deadlock */
+    void lock_pair (const sequence & a_other);
+    void unlock_pair (const sequence & a_other);
+
     /* used to idenfity which events are ours in the out queue */
     //unsigned char m_tag;
 
     /* takes an event this sequence is holding and
        places it on our midibus */
-    void put_event_on_bus (event * a_e);
+    void put_event_on_bus (const event * a_e);
     
     /* remove all events from sequence */
     void remove_all ();
@@ -131,8 +231,13 @@ private:
     void set_trigger_offset (long a_trigger_offset);
     long get_trigger_offset ();
 
-    void remove( list<event>::iterator i );
-    void remove( event* e );
+    /* a_map[old index] is the new index, or -1 if it is gone */
+    void remap_links( const vector<long> &a_map );
+    /* stable sort that keeps the links */
+    void sort_list();
+    /* sorts a_events and merges them in behind any equal ones */
+    void merge_events( vector<event> *a_events );
+    void remove( long a_index );
 
 public:
 
@@ -256,6 +361,7 @@ public:
     /* for speed on file loading & midi import these are used to great benefit */
     void add_event_no_sort( const event *a_e );     // all events are added first
     void sort_events();                             // called after all events added, once
+    void reserve_events( long a_count );            // before adding that many unsorted
     
     bool intersectNotes( long position, long position_note, long& start, long& end, long& note );
     bool intersectEvents( long posstart, long posend, long status, long& start );
@@ -338,6 +444,7 @@ public:
     void change_event_data_lfo(double a_value, double a_range,
                                double a_speed, double a_phase, int a_wave,
                                unsigned char a_status, unsigned char a_cc);
+    static double wave_func(double a_angle, int wave_type);
 
     /* moves note off event */
     void increment_selected (unsigned char a_status, unsigned char a_control);
@@ -404,15 +511,22 @@ public:
     bool get_next_event (unsigned char *a_status, unsigned char *a_cc);
 
     sequence & operator= (const sequence & a_rhs);
+    bool matches (sequence & a_rhs);
+    /* true when a_rhs is a copy of us nothing was done to since, told by
+       the shared events alone. For comparing undo and journal snapshots */
+    bool same_snapshot (sequence & a_rhs);
+
+    /* bytes held by the events and by undo and redo */
+    void get_memory_bytes (long *a_num_events, long *a_event_bytes, long *a_undo_bytes);
 
-    void seq_number_fill_list( list<char> *a_list, int a_pos );
-    void seq_name_fill_list( list<char> *a_list );
-    void fill_proprietary_list(list < char >*a_list);
-    void meta_track_end( list<char> *a_list, long delta_time);
-    void fill_list(list < char >*a_list, int a_pos, bool write_triggers = true);
+    void seq_number_fill_list( midi_writer *a_out, int a_pos );
+    void seq_name_fill_list( midi_writer *a_out );
+    void fill_proprietary_list(midi_writer *a_out);
+    void meta_track_end( midi_writer *a_out, long delta_time);
+    void fill_list(midi_writer *a_out, int a_pos, bool write_triggers = true);
 
-    long song_fill_list_seq_event( list<char> *a_list, trigger *a_trig, long prev_timestamp, file_type_e type );
-    void song_fill_list_seq_trigger( list<char> *a_list, trigger *a_trig, long a_length, long prev_timestamp );
+    long song_fill_list_seq_event( midi_writer *a_out, trigger *a_trig, long prev_timestamp, file_type_e type );
+    void song_fill_list_seq_trigger( midi_writer *a_out, trigger *a_trig, long a_length, long prev_timestamp );
 
     void select_events (unsigned char a_status, unsigned char a_cc,
                         bool a_inverse = false);
@@ -425,7 +539,17 @@ public:
     void reverse_pattern();
     void calulate_reverse(event &a_e);
 
-    bool save( ofstream *file );
+    void save( chunk_writer *a_chunk );
+    /* false if a_chunk does not add up, nothing is changed then. With
+       a_lazy the events are only read in when first needed */
+    bool load( chunk_reader *a_chunk, int a_version, bool a_lazy = false );
+    void materialize();
+    /* true once there is nothing left to read in */
+    bool is_materialized();
+    /* lazily loaded sequences found damaged since the last call, for
+       the gui to report like a load error */
+    static int take_damaged_count();
+    /* before version 8 */
     bool load( ifstream *file, int version );
 
     void apply_song_transpose ();
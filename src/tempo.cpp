@@ -41,6 +41,8 @@ tempo::tempo( perform *a_perf, mainwnd *a_main, Adjustment *a_hadjust ) :
     m_snap(c_ppqn),
     m_measure_length(c_ppqn * 4)
 {
+    m_mutex.set_name( "tempo" );
+
     add_events( Gdk::BUTTON_PRESS_MASK |
                 Gdk::BUTTON_RELEASE_MASK |
                 Gdk::POINTER_MOTION_MASK );
@@ -0,0 +1,168 @@
+//----------------------------------------------------------------------------
+//
+//  This file is part of seq42.
+//
+//  seq42 is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  seq42 is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with seq42; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+//-----------------------------------------------------------------------------
+
+#include "trace.h"
+
+#ifdef TRACE_SUPPORT
+
+#include <stdio.h>
+#include <time.h>
+#include <vector>
+
+#include "mutex.h"
+
+std::string global_trace_file = "seq42_trace.json";
+
+/* all rings ever made, they live until exit so a dump never
+   sees a dangling one */
+static std::vector<trace_ring *> s_rings;
+static seq42_mutex s_rings_mutex;
+
+static thread_local trace_ring *t_ring = NULL;
+
+long
+trace_now_us()
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (now.tv_sec * 1000000) + (now.tv_nsec / 1000);
+}
+
+trace_ring::trace_ring( int a_tid ) :
+    m_thread_name(NULL),
+    m_tid(a_tid),
+    m_head(0)
+{
+}
+
+/* single writer, no locking. The slot is filled before head moves
+   on, a dump reading head with acquire sees complete entries */
+void
+trace_ring::push( const char *a_name, long a_start_us, long a_dur_us )
+{
+    unsigned long head = m_head.load( std::memory_order_relaxed );
+    trace_event *e = &m_events[head & (c_trace_ring_size - 1)];
+
+    e->m_name = a_name;
+    e->m_start_us = a_start_us;
+    e->m_dur_us = a_dur_us;
+
+    m_head.store( head + 1, std::memory_order_release );
+}
+
+/* first trace point on a thread allocates its ring */
+static trace_ring *
+get_ring()
+{
+    if ( t_ring == NULL )
+    {
+        s_rings_mutex.lock();
+        t_ring = new trace_ring( s_rings.size() + 1 );
+        s_rings.push_back( t_ring );
+        s_rings_mutex.unlock();
+    }
+
+    return t_ring;
+}
+
+trace_scope::trace_scope( const char *a_name ) :
+    m_name(a_name),
+    m_start_us(trace_now_us())
+{
+}
+
+trace_scope::~trace_scope()
+{
+    get_ring()->push( m_name, m_start_us, trace_now_us() - m_start_us );
+}
+
+void
+trace_thread_name( const char *a_name )
+{
+    get_ring()->m_thread_name = a_name;
+}
+
+bool
+trace_dump( const std::string& a_filename )
+{
+    FILE *file = fopen( a_filename.c_str(), "w" );
+    if ( file == NULL )
+    {
+        printf( "Error writing [%s]\n", a_filename.c_str() );
+        return false;
+    }
+
+    fprintf( file, "{\"traceEvents\":[\n" );
+
+    bool first = true;
+
+    s_rings_mutex.lock();
+
+    for ( unsigned i = 0; i < s_rings.size(); i++ )
+    {
+        trace_ring *ring = s_rings[i];
+
+        if ( ring->m_thread_name != NULL )
+        {
+            fprintf( file,
+                     "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                     "\"args\":{\"name\":\"%s\"}}",
+                     first ? "" : ",\n", ring->m_tid, ring->m_thread_name );
+            first = false;
+        }
+
+        unsigned long head = ring->m_head.load( std::memory_order_acquire );
+        unsigned long tail = (head > c_trace_ring_size) ? head - c_trace_ring_size : 0;
+
+        /* the owner keeps writing while we copy */
+        std::vector<trace_event> events;
+        events.reserve( head - tail );
+        for ( unsigned long n = tail; n < head; n++ )
+            events.push_back( ring->m_events[n & (c_trace_ring_size - 1)] );
+
+        /* anything it lapped meanwhile may be torn, drop it */
+        unsigned long now_head = ring->m_head.load( std::memory_order_acquire );
+        unsigned long skip = 0;
+        if ( now_head > c_trace_ring_size && now_head - c_trace_ring_size > tail )
+            skip = now_head - c_trace_ring_size - tail;
+
+        for ( unsigned long n = skip; n < events.size(); n++ )
+        {
+            fprintf( file,
+                     "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                     "\"ts\":%ld,\"dur\":%ld}",
+                     first ? "" : ",\n", events[n].m_name, ring->m_tid,
+                     events[n].m_start_us, events[n].m_dur_us );
+            first = false;
+        }
+    }
+
+    s_rings_mutex.unlock();
+
+    fprintf( file, "\n]}\n" );
+    fclose( file );
+
+    printf( "Wrote trace [%s]\n", a_filename.c_str() );
+
+    return true;
+}
+
+#endif // TRACE_SUPPORT
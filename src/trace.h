@@ -0,0 +1,107 @@
+//----------------------------------------------------------------------------
+//
+//  This file is part of seq42.
+//
+//  seq42 is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  seq42 is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with seq42; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+//-----------------------------------------------------------------------------
+
+/*
+ *  Trace points for looking at glitches on a timeline.
+ *
+ *  Built only with ./configure --enable-trace, otherwise TRACE_SCOPE and
+ *  TRACE_THREAD expand to nothing. Each thread writes into its own ring,
+ *  the oldest entries get overwritten. trace_dump() writes the rings as
+ *  Chrome trace JSON (chrome://tracing or ui.perfetto.dev).
+ *
+ *  Names must be string literals, only the pointer is stored.
+ */
+
+#pragma once
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#else
+#include "configdefault.h"
+#endif
+
+#ifdef TRACE_SUPPORT
+
+#include <atomic>
+#include <string>
+
+/* per thread, must be a power of two */
+const unsigned long c_trace_ring_size = 1 << 16;
+
+struct trace_event
+{
+    const char *m_name;
+    long m_start_us;
+    long m_dur_us;
+};
+
+class trace_ring
+{
+
+public:
+
+    const char *m_thread_name;
+    int m_tid;
+
+    trace_event m_events[c_trace_ring_size];
+
+    /* number of events ever written, only the owning thread stores */
+    std::atomic<unsigned long> m_head;
+
+    trace_ring( int a_tid );
+
+    void push( const char *a_name, long a_start_us, long a_dur_us );
+};
+
+class trace_scope
+{
+
+private:
+
+    const char *m_name;
+    long m_start_us;
+
+public:
+
+    trace_scope( const char *a_name );
+    ~trace_scope();
+};
+
+long trace_now_us();
+
+/* names the calling thread in the dump */
+void trace_thread_name( const char *a_name );
+
+bool trace_dump( const std::string& a_filename );
+
+extern std::string global_trace_file;
+
+#define TRACE_CONCAT_( a, b ) a##b
+#define TRACE_CONCAT( a, b ) TRACE_CONCAT_( a, b )
+
+#define TRACE_SCOPE( a_name ) trace_scope TRACE_CONCAT( trace_scope_, __LINE__ )( a_name )
+#define TRACE_THREAD( a_name ) trace_thread_name( a_name )
+
+#else
+
+#define TRACE_SCOPE( a_name )
+#define TRACE_THREAD( a_name )
+
+#endif // TRACE_SUPPORT
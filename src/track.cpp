@@ -18,15 +18,16 @@
 ////
 ////-----------------------------------------------------------------------------
 #include "track.h"
+#include "trace.h"
 #include <stdlib.h>
 #include <fstream>
-#include <gtkmm.h>
 
 track::track()
 {
     m_editing = false;
     m_raise = false;
     m_name = c_dummy;
+    m_mutex.set_name( "track ", m_name.c_str() );
     m_bus = 0;
     m_midi_channel = 0;
     m_song_mute = false;
@@ -62,12 +63,13 @@ track&
 track::operator=(const track& other)
 {
     //printf("in track::operator=()\n");
-    lock();
+    lock_pair(other);
     if(this != &other)
     {
         free();
 
         m_name = other.m_name;
+        m_mutex.set_name( "track ", m_name.c_str() );
         m_bus = other.m_bus;
         m_midi_channel = other.m_midi_channel;
         m_song_mute = other.m_song_mute;  // for undo/redo and load from file - set to false for user copy/paste
@@ -101,10 +103,68 @@ track::operator=(const track& other)
             m_vector_sequence.push_back(a_seq);
         }
     }
-    unlock();
+    unlock_pair(other);
     return *this;
 }
 
+/* true when copying other would leave this track as it is, so an undo
+   snapshot can be shared instead of copied */
+bool
+track::matches(const track& other)
+{
+    lock_pair(other);
+    bool same = m_name == other.m_name &&
+                m_bus == other.m_bus &&
+                m_midi_channel == other.m_midi_channel &&
+                m_song_mute == other.m_song_mute &&
+                m_transposable == other.m_transposable &&
+                m_masterbus == other.m_masterbus &&
+                m_list_trigger == other.m_list_trigger &&
+                m_list_trigger_undo == other.m_list_trigger_undo &&
+                m_list_trigger_redo == other.m_list_trigger_redo &&
+                m_vector_sequence.size() == other.m_vector_sequence.size();
+
+    for(unsigned i=0; same && i<m_vector_sequence.size(); i++)
+        same = m_vector_sequence[i]->matches(*(other.m_vector_sequence[i]));
+
+    unlock_pair(other);
+    return same;
+}
+
+bool
+track::same_settings(const track& other)
+{
+    lock_pair(other);
+    bool same = m_name == other.m_name &&
+                m_bus == other.m_bus &&
+                m_midi_channel == other.m_midi_channel &&
+                m_song_mute == other.m_song_mute &&
+                m_transposable == other.m_transposable;
+    unlock_pair(other);
+    return same;
+}
+
+bool
+track::same_triggers(const track& other)
+{
+    lock_pair(other);
+    bool same = m_list_trigger == other.m_list_trigger;
+    unlock_pair(other);
+    return same;
+}
+
+long
+track::get_memory_bytes()
+{
+    lock();
+    /* a list node is the trigger and two links */
+    long bytes = sizeof(track) + m_vector_sequence.capacity() * sizeof(sequence *) +
+        m_list_trigger.size() * (sizeof(trigger) + 2 * sizeof(void *));
+    unlock();
+
+    return bytes;
+}
+
 void
 track::set_dirty()
 {
@@ -123,6 +183,28 @@ track::unlock( )
     m_mutex.unlock();
 }
 
+void
+track::lock_pair( const track& other )
+{
+    if ( this < &other )
+    {
+        m_mutex.lock();
+        other.m_mutex.lock();
+    }
+    else
+    {
+        other.m_mutex.lock();
+        m_mutex.lock();
+    }
+}
+
+void
+track::unlock_pair( const track& other )
+{
+    other.m_mutex.unlock();
+    m_mutex.unlock();
+}
+
 const char*
 track::get_name()
 {
@@ -133,6 +215,7 @@ void
 track::set_name( char *a_name )
 {
     m_name = a_name;
+    m_mutex.set_name( "track ", m_name.c_str() );
     set_dirty();
 }
 
@@ -140,6 +223,7 @@ void
 track::set_name( string a_name )
 {
     m_name = a_name;
+    m_mutex.set_name( "track ", m_name.c_str() );
     set_dirty();
 }
 
@@ -413,6 +497,8 @@ void track::delete_sequence( int a_num )
 void
 track::play( long a_tick, bool a_playback_mode )
 {
+    TRACE_SCOPE( "track::play" );
+
     //printf( "track::play(a_tick=%ld, a_playback=%d)\n", a_tick, a_playback_mode );
     lock();
 
@@ -1379,46 +1465,231 @@ track::off_playing_notes()
     }
 }
 
+/* version 8 on, the track is one chunk with a chunk per sequence in it */
 bool
 track::save(ofstream *file)
 {
-    char name[c_max_track_name];
-    strncpy(name, m_name.c_str(), c_max_track_name);
-    file->write(name, sizeof(char)*c_max_track_name);
+    chunk_writer chunk;
+    save(&chunk);
 
-    file->write((const char *) &m_bus, sizeof(char));
+    return chunk.write(file);
+}
 
-    file->write((const char *) &m_midi_channel, sizeof(char));
+void
+track::save(chunk_writer *a_chunk)
+{
+    chunk_writer &chunk = *a_chunk;
 
-    file->write((const char *) &m_transposable, sizeof(bool));
+    /* snapshots are saved off the gui thread */
+    lock();
 
-    file->write((const char *) &m_song_mute, sizeof(bool));
+    save_settings(&chunk);
 
-    unsigned int num_seqs = get_number_of_sequences();
-    file->write((const char *) &num_seqs, global_file_int_size);
+    chunk.put_int(get_number_of_sequences());
 
     for(unsigned int i=0; i<m_vector_sequence.size(); i++)
     {
-        if(!  m_vector_sequence[i]->save(file))
-        {
-            return false;
-        }
+        size_t start = chunk.begin_chunk();
+        m_vector_sequence[i]->save(&chunk);
+        chunk.end_chunk(start);
     }
 
-    unsigned int num_triggers = m_list_trigger.size();
-    file->write((const char *) &num_triggers, global_file_int_size);
+    save_triggers(&chunk);
+
+    unlock();
+}
+
+void
+track::save_settings(chunk_writer *a_chunk)
+{
+    lock();
+
+    char name[c_max_track_name];
+    memset(name, 0, sizeof(name));
+    m_name.copy(name, c_max_track_name);
+    a_chunk->put(name, sizeof(char)*c_max_track_name);
+
+    char flags[4] = { m_bus, m_midi_channel, m_transposable, m_song_mute };
+    a_chunk->put(flags, sizeof(flags));
+
+    unlock();
+}
+
+void
+track::read_settings(chunk_reader *a_chunk)
+{
+    char name[c_max_track_name+1];
+    a_chunk->get(name, sizeof(char)*c_max_track_name);
+    name[c_max_track_name] = '\0';
+    set_name(name);
+
+    char flags[4] = { 0, 0, 0, 0 };
+    a_chunk->get(flags, sizeof(flags));
+    m_bus = flags[0];
+    m_midi_channel = flags[1];
+    m_transposable = flags[2] != 0;
+    m_song_mute = flags[3] != 0;
+}
+
+bool
+track::load_settings(chunk_reader *a_chunk)
+{
+    lock();
+    read_settings(a_chunk);
+    unlock();
+
+    return a_chunk->good() && a_chunk->at_end();
+}
+
+void
+track::save_triggers(chunk_writer *a_chunk)
+{
+    lock();
+
+    a_chunk->put_int(m_list_trigger.size());
 
     for( list<trigger>::iterator iter = m_list_trigger.begin();
             iter != m_list_trigger.end(); iter++ )
     {
-        file->write((const char *) &(iter->m_tick_start), global_file_long_int_size);
-        file->write((const char *) &(iter->m_tick_end), global_file_long_int_size);
-        file->write((const char *) &(iter->m_offset), global_file_long_int_size);
-        file->write((const char *) &(iter->m_sequence), global_file_int_size);
+        a_chunk->put_int(iter->m_tick_start);
+        a_chunk->put_int(iter->m_tick_end);
+        a_chunk->put_int(iter->m_offset);
+        a_chunk->put_int(iter->m_sequence);
     }
+
+    unlock();
+}
+
+bool
+track::read_triggers(chunk_reader *a_chunk, list<trigger> *a_list)
+{
+    bool ret = true;
+
+    int32_t num_triggers = 0;
+    a_chunk->get_int(&num_triggers);
+
+    for (int i=0; i< num_triggers && a_chunk->good(); i++ )
+    {
+        int32_t data[4];
+        if (! a_chunk->get(data, sizeof(data)))
+            break;
+
+        trigger e;
+        e.m_tick_start = data[0];
+        e.m_tick_end = data[1];
+        e.m_offset = data[2];
+        e.m_sequence = data[3];
+
+        if ( e.m_sequence < 0 || e.m_sequence >= (int) get_number_of_sequences() )
+        {
+            ret = false;
+            continue;
+        }
+
+        a_list->push_back(e);
+    }
+
+    return ret;
+}
+
+bool
+track::load_triggers(chunk_reader *a_chunk)
+{
+    list<trigger> triggers;
+
+    if (! read_triggers(a_chunk, &triggers) || ! a_chunk->good() || ! a_chunk->at_end())
+        return false;
+
+    lock();
+    m_list_trigger.swap(triggers);
+    unlock();
+
+    set_dirty();
     return true;
 }
 
+bool
+track::load(chunk_reader *a_chunk, int a_version, bool a_lazy)
+{
+    bool ret = true;
+
+    read_settings(a_chunk);
+    const char *name = m_name.c_str();
+
+    int32_t num_seqs = 0;
+    a_chunk->get_int(&num_seqs);
+
+    for (int i=0; i< num_seqs && a_chunk->good(); i++ )
+    {
+        chunk_reader seq_chunk;
+        if (! a_chunk->get_chunk(&seq_chunk))
+            break;
+
+        /* a damaged sequence stays, empty, so the triggers still match */
+        new_sequence();
+        if(! get_sequence(i)->load(&seq_chunk, a_version, a_lazy))
+        {
+            fprintf(stderr, "Damaged sequence %d in track [%s]\n", i + 1, name);
+            ret = false;
+        }
+    }
+
+    if (! read_triggers(a_chunk, &m_list_trigger))
+        ret = false;
+
+    if (! a_chunk->good() || ! a_chunk->at_end())
+    {
+        fprintf(stderr, "Damaged track [%s]\n", name);
+        ret = false;
+    }
+
+    /* lazy ones are linked when they are read in */
+    for (unsigned int i=0; i< get_number_of_sequences() && !a_lazy; i++ )
+    {
+        get_sequence(i)->verify_and_link();
+    }
+
+    return ret;
+}
+
+/* reads in the lazily loaded sequences the triggers between the ticks
+   play. Collected first, so playing is not held up on our lock */
+void
+track::materialize( long a_start_tick, long a_end_tick )
+{
+    vector<sequence *> needed;
+
+    lock();
+
+    list<trigger>::iterator i;
+    for ( i = m_list_trigger.begin(); i != m_list_trigger.end(); i++ )
+    {
+        if ( i->m_tick_start > a_end_tick )
+            break;
+
+        if ( i->m_tick_end > a_start_tick && i->m_sequence > -1 &&
+                ! get_sequence( i->m_sequence )->is_materialized() )
+        {
+            needed.push_back( get_sequence( i->m_sequence ) );
+        }
+    }
+
+    /* live play has no triggers, sequence::play() skips these until then */
+    for ( unsigned s = 0; s < m_vector_sequence.size(); s++ )
+    {
+        if ( m_vector_sequence[s]->get_playing() &&
+                ! m_vector_sequence[s]->is_materialized() )
+        {
+            needed.push_back( m_vector_sequence[s] );
+        }
+    }
+
+    unlock();
+
+    for ( unsigned n = 0; n < needed.size(); n++ )
+        needed[n]->materialize();
+}
+
 bool
 track::load(ifstream *file, int version)
 {
@@ -1505,35 +1776,6 @@ track::get_trigger_export()
     return m_trigger_export;
 }
 
-void
-track::delete_unused_sequences()
-{
-    for(unsigned int i=0; i<m_vector_sequence.size(); i++)
-    {
-        if(get_trigger_count_for_seqidx(i) == 0)
-        {
-            Glib::ustring message = "From track: ";
-            message += get_name();
-            message += "\nSequence:  ";
-            message += get_sequence(i)->get_name();
-            message += "\n\nWill be deleted!\nAre you sure?";
-
-            Gtk::MessageDialog warning(message,
-                                   false,
-                                   Gtk::MESSAGE_WARNING, Gtk::BUTTONS_YES_NO, true);
-
-            auto result = warning.run();
-
-            if (result == Gtk::RESPONSE_NO || result == Gtk::RESPONSE_DELETE_EVENT)
-            {
-                continue; // next sequence
-            }
-
-            delete_sequence(i);
-        }
-    }
-}
-
 void
 track::create_triggers(long left_tick, long right_tick)
 {
@@ -83,18 +83,36 @@ private:
     bool m_dirty_perf;
     bool m_dirty_names;
 
-    seq42_mutex m_mutex;
+    /* mutable so a track being copied can be locked */
+    mutable seq42_mutex m_mutex;
 
     void lock ();
     void unlock ();
 
+    /* this and other, lower address first, see sequence::lock_pair() */
+    void lock_pair (const track& other);
+    void unlock_pair (const track& other);
+
     void split_trigger( trigger &trig, long a_split_tick);
 
+    void read_settings( chunk_reader *a_chunk );
+
+    /* a trigger count and the triggers, false if one does not point at
+       a sequence we have, it is left out */
+    bool read_triggers( chunk_reader *a_chunk, list<trigger> *a_list );
+
 public:
 
     track ();
     ~track ();
     track& operator=(const track& other);
+    bool matches (const track& other);
+    /* for the journal, with other an older snapshot of this track: the
+       same name and settings, and the same triggers */
+    bool same_settings (const track& other);
+    bool same_triggers (const track& other);
+    /* bytes held by the track and its triggers, not its sequences */
+    long get_memory_bytes ();
     void free ();
 
     bool m_is_NULL;
@@ -225,10 +243,21 @@ public:
     void play( long a_tick, bool a_playback_mode );
     void set_orig_tick (long a_tick);
 
+    void save( chunk_writer *a_chunk );
     bool save( ofstream *file );
+    /* false if some of a_chunk was damaged, the rest is still loaded */
+    bool load( chunk_reader *a_chunk, int a_version, bool a_lazy = false );
+    /* the name and settings, and the trigger part, of a track chunk on
+       their own */
+    void save_settings( chunk_writer *a_chunk );
+    bool load_settings( chunk_reader *a_chunk );
+    void save_triggers( chunk_writer *a_chunk );
+    /* replaces the triggers, nothing is changed if a_chunk does not add up */
+    bool load_triggers( chunk_reader *a_chunk );
+    void materialize( long a_start_tick, long a_end_tick );
+    /* before version 8 */
     bool load( ifstream *file, int version );
 
-    void delete_unused_sequences();
     void create_triggers(long left_tick, long right_tick);
     void apply_song_transpose ();
 };
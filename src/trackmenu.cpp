@@ -57,7 +57,7 @@ trackmenu::popup_menu()
 
         bool can_we_delete = true;
 
-        for(int i = 0; i < c_max_track; i++)
+        for(int i = 0; i < m_mainperf->get_track_slots(); i++)
         {
             if( (m_mainperf->get_track(i) != NULL) &&
                     m_mainperf->is_track_in_edit(i) )
@@ -98,7 +98,7 @@ trackmenu::popup_menu()
         {
             bool can_we_insert_delete = true;
 
-            for(int i = 0; i < c_max_track; i++)
+            for(int i = 0; i < m_mainperf->get_track_slots(); i++)
             {
                 if( (m_mainperf->get_track(i) != NULL) &&
                         m_mainperf->is_track_in_edit(i) )
@@ -122,7 +122,7 @@ trackmenu::popup_menu()
 
         Menu *merge_seq_menu = NULL;
         char name[40];
-        for ( int t=0; t<c_max_track; ++t )
+        for ( int t=0; t<m_mainperf->get_track_slots(); ++t )
         {
             if (! m_mainperf->is_active_track( t ) || t == m_current_trk)
             {
@@ -240,43 +240,21 @@ trackmenu::trk_insert(int a_track_location)
 {
 
     m_mainperf->push_perf_undo();
-    // first copy all tracks to m_insert_clipboard[];
-    for(int i = 0; i < c_max_track; i++)
+    // first take all tracks, these are shared with the undo just pushed
+    vector< shared_ptr<track> > tracks;
+    for(int i = 0; i < m_mainperf->get_track_slots(); i++)
     {
-        if ( m_mainperf->is_active_track(i) == true )
-        {
-            m_mainperf->m_tracks_clipboard[i] = *m_mainperf->get_track(i);
-        }
-        else
-        {
-            m_mainperf->m_tracks_clipboard[i].m_is_NULL = true;
-        }
+        tracks.push_back( m_mainperf->snapshot_track(i) );
     }
 
     m_mainperf->delete_track(a_track_location); // the new insert blank track
 
-    for(int i = a_track_location + 1; i < c_max_track; i++)//now delete and replace the rest offset
+    // the slots grow by one, the last track only gets lost at c_max_track
+    int slots = m_mainperf->get_track_slots();
+    for(int i = a_track_location + 1; i <= slots && i < c_max_track; i++)//now delete and replace the rest offset
     {
-        if ( m_mainperf->is_active_track(i) == true )
-        {
-            m_mainperf->delete_track(i);
-            if(!m_mainperf->m_tracks_clipboard[i-1].m_is_NULL)
-            {
-                m_mainperf->new_track(i);
-                *m_mainperf->get_track(i) = m_mainperf->m_tracks_clipboard[i-1];
-                m_mainperf->get_track(i)->set_dirty();
-            }
-        }
-        else
-        {
-            if(!m_mainperf->m_tracks_clipboard[i-1].m_is_NULL)
-            {
-                m_mainperf->new_track(i);
-                *m_mainperf->get_track(i) = m_mainperf->m_tracks_clipboard[i-1];
-                m_mainperf->get_track(i)->set_dirty();
-            }
-        }
-    }   // the last track will get lost if > c_max_track ????!!!!!
+        m_mainperf->restore_track(i, tracks[i-1]);
+    }
 }
 
 // delete row at location
@@ -284,40 +262,17 @@ void
 trackmenu::trk_delete(int a_track_location)
 {
     m_mainperf->push_perf_undo();
-    // first copy all tracks to m_insert_clipboard[];
-    for(int i = 0; i < c_max_track; i++)
+    // first take all tracks, these are shared with the undo just pushed
+    vector< shared_ptr<track> > tracks;
+    for(int i = 0; i < m_mainperf->get_track_slots(); i++)
     {
-        if ( m_mainperf->is_active_track(i) == true )
-        {
-            m_mainperf->m_tracks_clipboard[i] = *m_mainperf->get_track(i);
-        }
-        else
-        {
-            m_mainperf->m_tracks_clipboard[i].m_is_NULL = true;
-        }
+        tracks.push_back( m_mainperf->snapshot_track(i) );
     }
+    tracks.push_back( shared_ptr<track>() ); // the last slot is emptied
 
-    for(int i = a_track_location; i < c_max_track - 1; i++)//now delete and replace the rest offset
+    for(int i = a_track_location; i < m_mainperf->get_track_slots(); i++)//now delete and replace the rest offset
     {
-        if ( m_mainperf->is_active_track(i) == true )
-        {
-            m_mainperf->delete_track(i);
-            if(!m_mainperf->m_tracks_clipboard[i+1].m_is_NULL)
-            {
-                m_mainperf->new_track(i);
-                *m_mainperf->get_track(i) = m_mainperf->m_tracks_clipboard[i+1];
-                m_mainperf->get_track(i)->set_dirty();
-            }
-        }
-        else
-        {
-            if(!m_mainperf->m_tracks_clipboard[i+1].m_is_NULL)
-            {
-                m_mainperf->new_track(i);
-                *m_mainperf->get_track(i) = m_mainperf->m_tracks_clipboard[i+1];
-                m_mainperf->get_track(i)->set_dirty();
-            }
-        }
+        m_mainperf->restore_track(i, tracks[i+1]);
     }
 }
 
@@ -326,43 +281,20 @@ trackmenu::pack_tracks()
 {
     m_mainperf->push_perf_undo();
 
-    // first copy all active tracks to m_insert_clipboard[];
-    int active_tracks = 0;
-    for(int i = 0; i < c_max_track; i++)
+    // first take all active tracks, NULL the remainder
+    vector< shared_ptr<track> > tracks;
+    for(int i = 0; i < m_mainperf->get_track_slots(); i++)
     {
         if ( m_mainperf->is_active_track(i) == true )
         {
-            m_mainperf->m_tracks_clipboard[active_tracks] = *m_mainperf->get_track(i);
-            active_tracks++;
+            tracks.push_back( m_mainperf->snapshot_track(i) );
         }
     }
+    tracks.resize( m_mainperf->get_track_slots() );
 
-    for(int i = active_tracks; i < c_max_track; i++) // NULL the remainder
+    for(int i = 0; i < m_mainperf->get_track_slots(); i++)//now delete and replace in order
     {
-        m_mainperf->m_tracks_clipboard[i].m_is_NULL = true;
-    }
-
-    for(int i = 0; i < c_max_track; i++)//now delete and replace in order
-    {
-        if ( m_mainperf->is_active_track(i) == true )
-        {
-            m_mainperf->delete_track(i);
-            if(!m_mainperf->m_tracks_clipboard[i].m_is_NULL)
-            {
-                m_mainperf->new_track(i);
-                *m_mainperf->get_track(i) = m_mainperf->m_tracks_clipboard[i];
-                m_mainperf->get_track(i)->set_dirty();
-            }
-        }
-        else
-        {
-            if(!m_mainperf->m_tracks_clipboard[i].m_is_NULL)
-            {
-                m_mainperf->new_track(i);
-                *m_mainperf->get_track(i) = m_mainperf->m_tracks_clipboard[i];
-                m_mainperf->get_track(i)->set_dirty();
-            }
-        }
+        m_mainperf->restore_track(i, tracks[i]);
     }
 }
 
@@ -51,5 +51,14 @@ public:
 
         return false;
     };
+
+    bool operator== (const trigger& rhs) const
+    {
+        return m_tick_start == rhs.m_tick_start &&
+               m_tick_end == rhs.m_tick_end &&
+               m_selected == rhs.m_selected &&
+               m_offset == rhs.m_offset &&
+               m_sequence == rhs.m_sequence;
+    };
 };
 